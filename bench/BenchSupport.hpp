@@ -0,0 +1,78 @@
+#ifndef BENCHSUPPORT_H
+#define BENCHSUPPORT_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include "LatencyHistogram.hpp"
+
+// Helpers shared by the programs in bench/. Every program takes its knobs as
+// --name=value arguments and prints one line per measurement.
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+class Options {
+    public:
+        Options(int argc, char** argv) : argc_(argc), argv_(argv) {}
+
+        std::string get(std::string_view name, std::string fallback) const {
+            for(int i = 1; i < argc_; ++i){
+                std::string_view arg(argv_[i]);
+                if(arg.size() > name.size() + 3 && arg.substr(0, 2) == "--"
+                   && arg.substr(2, name.size()) == name && arg[name.size() + 2] == '='){
+                    return std::string(arg.substr(name.size() + 3));
+                }
+            }
+            return fallback;
+        }
+
+        size_t get(std::string_view name, size_t fallback) const {
+            auto value = get(name, std::string());
+            return value.empty() ? fallback : std::strtoull(value.c_str(), nullptr, 10);
+        }
+
+    private:
+        int argc_;
+        char** argv_;
+};
+
+// Drops what the server code logs to std::cout while it is alive, which
+// would otherwise be one line per joined session or stored batch.
+class QuietStdout {
+    public:
+        QuietStdout() : previous_(std::cout.rdbuf(&null_)) {}
+        ~QuietStdout() { std::cout.rdbuf(previous_); }
+        QuietStdout(const QuietStdout&) = delete;
+        QuietStdout& operator=(const QuietStdout&) = delete;
+
+    private:
+        struct NullBuffer : std::streambuf {
+            int overflow(int c) override { return c; }
+        };
+        NullBuffer null_;
+        std::streambuf* previous_;
+};
+
+inline double per_second(uint64_t count, Clock::duration elapsed){
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? static_cast<double>(count) / seconds : 0.0;
+}
+
+inline void print_latency(const char* label, const LatencyHistogram::Snapshot& snap){
+    std::printf("  %-22s n=%-8llu mean=%-7llu p50=%-7llu p99=%-7llu p999=%-7llu max=%llu (us)\n", label,
+                static_cast<unsigned long long>(snap.count), static_cast<unsigned long long>(snap.mean()),
+                static_cast<unsigned long long>(snap.percentile(50.0)),
+                static_cast<unsigned long long>(snap.percentile(99.0)),
+                static_cast<unsigned long long>(snap.percentile(99.9)),
+                static_cast<unsigned long long>(snap.max_us));
+}
+
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef CHATSEED_H
+#define CHATSEED_H
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include "SQLiteCpp/SQLiteCpp.h"
+#include "SQLiteCpp/Transaction.h"
+#include "BarrackRepo.hpp"
+#include "types.hpp"
+
+// Generated barracks and memberships, written into SQLite the way a long
+// running server leaves them, for the programs that start from a populated
+// database.
+namespace bench {
+
+inline std::string barrack_id(size_t index){
+    return "barrack_bench-" + std::to_string(index);
+}
+
+// Shaped like the version 7 UUIDs the server hands out, 36 characters
+inline std::string user_id(size_t index){
+    char id[48];
+    std::snprintf(id, sizeof(id), "0192c3a4-5b6c-7d8e-9f00-%012zx", index);
+    return id;
+}
+
+// Public barracks barrack_id(0) .. barrack_id(count - 1)
+inline void seed_barracks(BarrackRepository& repo, size_t count){
+    for(size_t i = 0; i < count; ++i){
+        repo.create(Barrack(barrack_id(i), "bench barrack " + std::to_string(i), user_id(0), false, "", "",
+                            std::chrono::system_clock::now()));
+    }
+}
+
+// count rows of barrack_members in one transaction; membership(i) names the
+// barrack and user index of row i. Repeated pairs are skipped.
+inline void seed_members(SQLite::Database& db, size_t count,
+                         const std::function<std::pair<size_t, size_t>(size_t)>& membership){
+    SQLite::Transaction transaction(db);
+    SQLite::Statement insert(db, "INSERT OR IGNORE INTO barrack_members (barrack_id, user_id) VALUES (?, ?)");
+    for(size_t i = 0; i < count; ++i){
+        auto [barrack, user] = membership(i);
+        insert.bind(1, barrack_id(barrack));
+        insert.bind(2, user_id(user));
+        insert.exec();
+        insert.reset();
+    }
+    transaction.commit();
+}
+
+}
+
+#endif
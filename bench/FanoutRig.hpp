@@ -0,0 +1,377 @@
+#ifndef FANOUTRIG_H
+#define FANOUTRIG_H
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "boost/asio/executor_work_guard.hpp"
+#include "boost/asio/io_context.hpp"
+#include "boost/asio/steady_timer.hpp"
+#include "BenchSupport.hpp"
+#include "ClientSession.hpp"
+#include "Room.hpp"
+
+// A room of real websocket sessions for the fanout benchmarks.
+//
+// The server side lives in this process: ClientSessions without a connection
+// manager or dispatcher, joined to one Room. The members' other ends are
+// opened by a forked child, which reads every broadcast frame, checks that
+// each connection gets them in the order they were made and notes when the
+// first and the last member received each one. steady_clock is the same
+// clock in both processes, so the child's receive times compare with the
+// send times carried in the frames.
+namespace bench {
+
+struct RigConfig {
+    size_t members = 10000;
+    // io_contexts of the server and threads running each of them
+    size_t contexts = 1;
+    size_t threads_per_context = 4;
+    // bytes of every broadcast frame
+    size_t frame_bytes = 256;
+};
+
+// What the child saw of one round of broadcasts
+struct SwarmReport {
+    uint64_t expected = 0;
+    uint64_t received = 0;
+    uint64_t out_of_order = 0;      // frames that did not follow the previous one of their connection
+    LatencyHistogram::Snapshot spread;      // first -> last member receiving a broadcast
+    LatencyHistogram::Snapshot delivered;   // broadcast() called -> last member received it
+    Clock::duration elapsed{};              // first broadcast -> last frame received
+};
+
+class FanoutRig {
+    public:
+        explicit FanoutRig(RigConfig config) : config_(config), room_(std::make_shared<Room>("bench")) {
+            raise_fd_limit();
+            int listener = listen_any(port_);
+            int to_child[2];
+            int to_parent[2];
+            if(::pipe(to_child) != 0 || ::pipe(to_parent) != 0){
+                throw std::runtime_error("pipe failed");
+            }
+            // fork before any thread exists
+            child_ = ::fork();
+            if(child_ < 0){
+                throw std::runtime_error("fork failed");
+            }
+            if(child_ == 0){
+                ::close(listener);
+                ::close(to_child[1]);
+                ::close(to_parent[0]);
+                run_swarm(to_child[0], to_parent[1]);
+                ::_exit(0);
+            }
+            ::close(to_child[0]);
+            ::close(to_parent[1]);
+            ctl_ = to_child[1];
+            report_ = to_parent[0];
+
+            for(size_t i = 0; i < std::max<size_t>(config_.contexts, 1); ++i){
+                contexts_.push_back(std::make_unique<net::io_context>());
+                work_.emplace_back(contexts_.back()->get_executor());
+            }
+            acceptor_ = std::make_unique<tcp::acceptor>(*contexts_.front());
+            acceptor_->assign(tcp::v4(), listener);
+            for(auto& context : contexts_){
+                for(size_t t = 0; t < std::max<size_t>(config_.threads_per_context, 1); ++t){
+                    threads_.emplace_back([&context]{ context->run(); });
+                }
+            }
+            accept_next();
+
+            char ready = 0;
+            if(::read(report_, &ready, 1) != 1){
+                throw std::runtime_error("swarm failed to connect");
+            }
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                accepted_cv_.wait(lock, [&]{ return sessions_.size() == config_.members; });
+            }
+            // the child is done once it read the handshake answer, the session
+            // a moment later when the write completes
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            for(const auto& session : sessions_){
+                room_->join(session);
+            }
+        }
+
+        ~FanoutRig(){
+            work_.clear();
+            for(auto& context : contexts_){
+                context->stop();
+            }
+            for(auto& thread : threads_){
+                thread.join();
+            }
+            // the room's strands must go before their io_contexts
+            sessions_.clear();
+            room_.reset();
+            uint64_t stop[2] = {0, 0};
+            write_all(ctl_, stop, sizeof(stop));
+            ::waitpid(child_, nullptr, 0);
+            ::close(ctl_);
+            ::close(report_);
+        }
+
+        FanoutRig(const FanoutRig&) = delete;
+        FanoutRig& operator=(const FanoutRig&) = delete;
+
+        Room& room() { return *room_; }
+        const std::vector<std::shared_ptr<ClientSession>>& sessions() const { return sessions_; }
+
+        // Broadcasts count numbered frames from this thread, gap apart, and
+        // waits for the child to have read them all (or to give up). before
+        // is called with the index of every broadcast ahead of it.
+        SwarmReport broadcast(size_t count, std::chrono::microseconds gap,
+                              const std::function<void(size_t)>& before = {}){
+            uint64_t header[2] = {next_frame_, count};
+            write_all(ctl_, header, sizeof(header));
+            std::string padding(config_.frame_bytes, 'x');
+            for(size_t i = 0; i < count; ++i){
+                if(before){
+                    before(i);
+                }
+                std::string frame = std::to_string(next_frame_++) + " "
+                                  + std::to_string(Clock::now().time_since_epoch().count()) + " ";
+                if(frame.size() < padding.size()){
+                    frame.append(padding, frame.size());
+                }
+                room_->broadcast(frame);
+                if(gap.count() > 0){
+                    std::this_thread::sleep_for(gap);
+                }
+            }
+
+            uint64_t totals[4];
+            read_all(report_, totals, sizeof(totals));
+            std::vector<int64_t> times(count * 3);
+            read_all(report_, times.data(), times.size() * sizeof(int64_t));
+            SwarmReport report;
+            report.expected = totals[0];
+            report.received = totals[1];
+            report.out_of_order = totals[2];
+            report.elapsed = Clock::duration(static_cast<Clock::rep>(totals[3]));
+            LatencyHistogram spread;
+            LatencyHistogram delivered;
+            for(size_t i = 0; i < count; ++i){
+                int64_t sent = times[i * 3];
+                int64_t first = times[i * 3 + 1];
+                int64_t last = times[i * 3 + 2];
+                if(first <= last){
+                    spread.record(Clock::duration(last - first));
+                    delivered.record(Clock::duration(last - sent));
+                }
+            }
+            report.spread = spread.snapshot();
+            report.delivered = delivered.snapshot();
+            return report;
+        }
+
+    private:
+        static void raise_fd_limit(){
+            rlimit limit{};
+            if(::getrlimit(RLIMIT_NOFILE, &limit) == 0){
+                limit.rlim_cur = limit.rlim_max;
+                ::setrlimit(RLIMIT_NOFILE, &limit);
+            }
+        }
+
+        static int listen_any(unsigned short& port){
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            if(fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 || ::listen(fd, SOMAXCONN) != 0
+               || ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0){
+                throw std::runtime_error("cannot listen on the loopback interface");
+            }
+            port = ntohs(addr.sin_port);
+            return fd;
+        }
+
+        static void write_all(int fd, const void* data, size_t size){
+            auto bytes = static_cast<const char*>(data);
+            while(size > 0){
+                auto n = ::write(fd, bytes, size);
+                if(n <= 0){
+                    return;
+                }
+                bytes += n;
+                size -= static_cast<size_t>(n);
+            }
+        }
+
+        static bool read_all(int fd, void* data, size_t size){
+            auto bytes = static_cast<char*>(data);
+            while(size > 0){
+                auto n = ::read(fd, bytes, size);
+                if(n <= 0){
+                    return false;
+                }
+                bytes += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        void accept_next(){
+            auto& context = *contexts_[next_session_ % contexts_.size()];
+            acceptor_->async_accept(net::make_strand(context), [this](error_code ec, tcp::socket socket){
+                if(ec){
+                    return;
+                }
+                auto session = std::make_shared<ClientSession>(std::move(socket), next_session_++, nullptr, nullptr);
+                session->run();
+                size_t accepted;
+                {
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    sessions_.push_back(session);
+                    accepted = sessions_.size();
+                }
+                if(accepted == config_.members){
+                    accepted_cv_.notify_one();
+                } else {
+                    accept_next();
+                }
+            });
+        }
+
+        // The child: one blocking connect and handshake per member, then a
+        // single thread reading all of them for every round the parent asks for.
+        void run_swarm(int ctl, int report){
+            struct Member {
+                explicit Member(net::io_context& ioc) : ws(ioc) {}
+                websocket::stream<tcp::socket> ws;
+                beast::flat_buffer buffer;
+                uint64_t next = 0;
+                uint64_t left = 0;
+            };
+            net::io_context ioc;
+            std::vector<std::unique_ptr<Member>> members;
+            tcp::endpoint server(net::ip::make_address("127.0.0.1"), port_);
+            for(size_t i = 0; i < config_.members; ++i){
+                auto member = std::make_unique<Member>(ioc);
+                error_code ec;
+                member->ws.next_layer().connect(server, ec);
+                if(!ec){
+                    member->ws.handshake("127.0.0.1", "/", ec);
+                }
+                if(ec){
+                    std::cerr << "swarm: member " << i << ": " << ec.message() << std::endl;
+                    return;
+                }
+                members.push_back(std::move(member));
+            }
+            char ready = 'R';
+            write_all(report, &ready, 1);
+
+            uint64_t header[2];
+            while(read_all(ctl, header, sizeof(header)) && header[1] > 0){
+                uint64_t base = header[0];
+                uint64_t count = header[1];
+                std::vector<int64_t> times(count * 3);
+                for(size_t i = 0; i < count; ++i){
+                    times[i * 3] = 0;
+                    times[i * 3 + 1] = std::numeric_limits<int64_t>::max();
+                    times[i * 3 + 2] = std::numeric_limits<int64_t>::min();
+                }
+                uint64_t received = 0;
+                uint64_t out_of_order = 0;
+                int64_t started = std::numeric_limits<int64_t>::max();
+                int64_t finished = 0;
+
+                std::function<void(Member&)> read_one = [&](Member& member){
+                    member.ws.async_read(member.buffer, [&](error_code ec, size_t){
+                        if(ec){
+                            return;
+                        }
+                        int64_t now = Clock::now().time_since_epoch().count();
+                        auto data = beast::buffers_to_string(member.buffer.data());
+                        member.buffer.consume(member.buffer.size());
+                        unsigned long long n = 0;
+                        long long sent = 0;
+                        std::sscanf(data.c_str(), "%llu %lld", &n, &sent);
+                        if(n != member.next){
+                            ++out_of_order;
+                        }
+                        member.next = n + 1;
+                        ++received;
+                        if(n >= base && n < base + count){
+                            size_t i = n - base;
+                            times[i * 3] = sent;
+                            times[i * 3 + 1] = std::min<int64_t>(times[i * 3 + 1], now);
+                            times[i * 3 + 2] = std::max<int64_t>(times[i * 3 + 2], now);
+                            started = std::min<int64_t>(started, sent);
+                        }
+                        finished = std::max(finished, now);
+                        if(--member.left > 0){
+                            read_one(member);
+                        }
+                    });
+                };
+                for(auto& member : members){
+                    member->next = base;
+                    member->left = count;
+                    read_one(*member);
+                }
+                // a member that lost frames would wait forever
+                net::steady_timer deadline(ioc, std::chrono::seconds(60));
+                deadline.async_wait([&](error_code ec){
+                    if(!ec){
+                        for(auto& member : members){
+                            beast::get_lowest_layer(member->ws).cancel();
+                        }
+                    }
+                });
+                size_t expected = members.size() * count;
+                while(received < expected && ioc.run_one() > 0){}
+                deadline.cancel();
+                ioc.run();
+                ioc.restart();
+
+                uint64_t totals[4] = {expected, received, out_of_order,
+                                      static_cast<uint64_t>(finished > started ? finished - started : 0)};
+                write_all(report, totals, sizeof(totals));
+                write_all(report, times.data(), times.size() * sizeof(int64_t));
+            }
+        }
+
+        RigConfig config_;
+        std::shared_ptr<Room> room_;
+        unsigned short port_ = 0;
+        pid_t child_ = -1;
+        int ctl_ = -1;
+        int report_ = -1;
+
+        std::vector<std::unique_ptr<net::io_context>> contexts_;
+        std::vector<net::executor_work_guard<net::io_context::executor_type>> work_;
+        std::vector<std::thread> threads_;
+        std::unique_ptr<tcp::acceptor> acceptor_;
+
+        std::mutex mtx_;
+        std::condition_variable accepted_cv_;
+        std::vector<std::shared_ptr<ClientSession>> sessions_;
+        ClientSession::SessionID next_session_ = 1;
+        uint64_t next_frame_ = 0;
+};
+
+}
+
+#endif
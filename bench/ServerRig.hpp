@@ -0,0 +1,544 @@
+#ifndef SERVERRIG_H
+#define SERVERRIG_H
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "boost/asio/executor_work_guard.hpp"
+#include "boost/asio/io_context.hpp"
+#include "BarrackManager.hpp"
+#include "BenchSupport.hpp"
+#include "ChatSeed.hpp"
+#include "ConnectionManager.hpp"
+#include "DatabaseConn.hpp"
+#include "IoThreadPool.hpp"
+#include "Listener.hpp"
+#include "MessageDispatcher.hpp"
+#include "RoomRegistry.hpp"
+#include "StandInRepo.hpp"
+
+// The whole server in this process, driven by websocket clients in a forked
+// child.
+//
+// The server is wired like main: an in-memory SQLite database, the Cassandra
+// stand-in, BarrackManager, the dispatcher, ConnectionManager and a Listener
+// on a loopback port, optionally in room placement mode. Connection i belongs
+// to barrack i % barracks; the memberships are seeded into SQLite and loaded
+// by warm_start, and each session joins its barrack's room directly, so no
+// password hashing runs during setup.
+//
+// The child opens every connection before the parent starts a thread (it is
+// forked first), then runs one round at a time: each sending connection keeps
+// up to window requests outstanding and every frame that comes back is
+// classified. request_id carries the send time, broadcast messages start with
+// theirs, so both latencies are measured on steady_clock, which the two
+// processes share.
+namespace bench {
+
+struct ServerConfig {
+    size_t connections = 1000;
+    size_t barracks = 4;
+    // threads running the server's io; in placement mode one io_context each
+    size_t io_threads = 4;
+    size_t workers = 4;             // dispatcher threads
+    bool room_placement = false;
+    // in placement mode, whether clients name their barrack in the upgrade
+    // target; without it connections are spread over the io threads in turn
+    bool barrack_hint = true;
+    size_t max_in_flight = ClientSession::DEFAULT_MAX_IN_FLIGHT;
+    std::chrono::microseconds write_latency{2000};
+    std::chrono::microseconds read_latency{2000};
+};
+
+enum class Workload : uint32_t {
+    STOP = 0,
+    SEND,           // MESSAGEBARRACK to the connection's barrack
+    HISTORY,        // GETBARRACKMESSAGES of it
+    BATCH,          // BATCH frames of MESSAGEBARRACK, see RoundConfig::batch_items
+};
+
+struct RoundConfig {
+    Workload workload = Workload::SEND;
+    uint32_t requests = 100;        // per sending connection
+    uint32_t window = 8;            // requests a connection keeps outstanding
+    uint32_t senders = 0;           // the first senders connections send, 0 = all
+    uint32_t message_bytes = 64;
+    // BATCH: commands per frame, alternating between the connection's
+    // barrack and one that does not exist, so keyed commands interleave.
+    // Item k carries request_id "k" and must be answered in position k.
+    uint32_t batch_items = 4;
+};
+
+struct RoundReport {
+    uint64_t sent = 0;
+    uint64_t ok = 0;
+    uint64_t failed = 0;            // FAILURE or ERROR replies
+    uint64_t timed_out = 0;         // TIMEOUT: expired in the dispatcher queue
+    uint64_t retry_later = 0;       // RETRY_LATER: shed while overloaded
+    uint64_t broadcasts = 0;
+    uint64_t expected_broadcasts = 0;
+    uint64_t out_of_order = 0;      // BATCH replies not in command order
+    Clock::duration elapsed{};      // round start -> last frame received
+    LatencyHistogram::Snapshot answered;    // request -> success reply
+    LatencyHistogram::Snapshot rejected;    // request -> TIMEOUT or RETRY_LATER
+    LatencyHistogram::Snapshot fanout;      // request -> a member receiving the broadcast
+};
+
+class ServerRig {
+    public:
+        explicit ServerRig(ServerConfig config) : config_(config) {
+            raise_fd_limit();
+            int to_child[2];
+            int to_parent[2];
+            if(::pipe(to_child) != 0 || ::pipe(to_parent) != 0){
+                throw std::runtime_error("pipe failed");
+            }
+            // fork before any thread exists
+            child_ = ::fork();
+            if(child_ < 0){
+                throw std::runtime_error("fork failed");
+            }
+            if(child_ == 0){
+                ::close(to_child[1]);
+                ::close(to_parent[0]);
+                run_clients(to_child[0], to_parent[1]);
+                ::_exit(0);
+            }
+            ::close(to_child[0]);
+            ::close(to_parent[1]);
+            ctl_ = to_child[1];
+            report_ = to_parent[0];
+            start_server();
+            connect_clients();
+        }
+
+        ~ServerRig(){
+            RoundConfig stop;
+            stop.workload = Workload::STOP;
+            write_all(ctl_, &stop, sizeof(stop));
+            ::waitpid(child_, nullptr, 0);
+            ::close(ctl_);
+            ::close(report_);
+
+            dispatcher_->stop();
+            work_.reset();
+            ioc_.stop();
+            if(io_pool_){
+                io_pool_->stop();
+                io_pool_->join();
+            }
+            for(auto& thread : threads_){
+                thread.join();
+            }
+            // rooms and sessions hold strands and sockets of the io_contexts
+            conn_manager_.reset();
+            dispatcher_.reset();
+            registry_.reset();
+            manager_.reset();
+        }
+
+        ServerRig(const ServerRig&) = delete;
+        ServerRig& operator=(const ServerRig&) = delete;
+
+        RoundReport run(const RoundConfig& round){
+            write_all(ctl_, &round, sizeof(round));
+            RoundReport report;
+            if(!read_all(report_, &report, sizeof(report))){
+                throw std::runtime_error("clients failed");
+            }
+            return report;
+        }
+
+        MessageDispatcher& dispatcher() { return *dispatcher_; }
+        BarrackManager& barracks() { return *manager_; }
+        StandInRepo& repo() { return *repo_; }
+
+    private:
+        static_assert(std::is_trivially_copyable_v<RoundConfig> && std::is_trivially_copyable_v<RoundReport>);
+
+        static void raise_fd_limit(){
+            rlimit limit{};
+            if(::getrlimit(RLIMIT_NOFILE, &limit) == 0){
+                limit.rlim_cur = limit.rlim_max;
+                ::setrlimit(RLIMIT_NOFILE, &limit);
+            }
+        }
+
+        static unsigned short free_port(){
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            if(fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0
+               || ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0){
+                throw std::runtime_error("no free loopback port");
+            }
+            ::close(fd);
+            return ntohs(addr.sin_port);
+        }
+
+        static void write_all(int fd, const void* data, size_t size){
+            auto bytes = static_cast<const char*>(data);
+            while(size > 0){
+                auto n = ::write(fd, bytes, size);
+                if(n <= 0){
+                    return;
+                }
+                bytes += n;
+                size -= static_cast<size_t>(n);
+            }
+        }
+
+        static bool read_all(int fd, void* data, size_t size){
+            auto bytes = static_cast<char*>(data);
+            while(size > 0){
+                auto n = ::read(fd, bytes, size);
+                if(n <= 0){
+                    return false;
+                }
+                bytes += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        static void write_string(int fd, const std::string& text){
+            uint32_t size = static_cast<uint32_t>(text.size());
+            write_all(fd, &size, sizeof(size));
+            write_all(fd, text.data(), text.size());
+        }
+
+        static std::string read_string(int fd){
+            uint32_t size = 0;
+            read_all(fd, &size, sizeof(size));
+            std::string text(size, '\0');
+            read_all(fd, text.data(), size);
+            return text;
+        }
+
+        void start_server(){
+            auto database = std::make_shared<DatabaseConnection>(":memory:");
+            database->initialize_database();
+            auto barrack_repo = std::make_shared<BarrackRepository>(database->get_connection());
+            seed_barracks(*barrack_repo, config_.barracks);
+            seed_members(*database->get_connection(), config_.connections, [&](size_t i){
+                return std::make_pair(i % config_.barracks, i);
+            });
+            repo_ = std::make_shared<StandInRepo>(config_.write_latency, config_.read_latency);
+            manager_ = std::make_shared<BarrackManager>(barrack_repo, repo_);
+            if(auto loaded = manager_->warm_start(); std::holds_alternative<Error>(loaded)){
+                throw std::runtime_error(std::get<Error>(loaded).message);
+            }
+
+            registry_ = std::make_shared<RoomRegistry>();
+            CommandContext context{
+                .auth_manager = nullptr,
+                .barrack_manager = manager_,
+                .room_registry = registry_
+            };
+            dispatcher_ = std::make_shared<MessageDispatcher>(config_.workers, context);
+            conn_manager_ = std::make_shared<ConnectionManager>(dispatcher_, registry_, config_.max_in_flight);
+
+            port_ = free_port();
+            size_t acceptor_threads = config_.io_threads;
+            if(config_.room_placement){
+                io_pool_ = std::make_shared<IoThreadPool>(config_.io_threads);
+                io_pool_->run();
+                acceptor_threads = 1;
+            }
+            std::make_shared<Listener>(ioc_, tcp::endpoint{net::ip::make_address("127.0.0.1"), port_},
+                                       conn_manager_, io_pool_)->run();
+            for(size_t i = 0; i < std::max<size_t>(acceptor_threads, 1); ++i){
+                threads_.emplace_back([this]{ ioc_.run(); });
+            }
+        }
+
+        void connect_clients(){
+            write_all(ctl_, &port_, sizeof(port_));
+            uint64_t connections = config_.connections;
+            write_all(ctl_, &connections, sizeof(connections));
+            for(size_t i = 0; i < config_.connections; ++i){
+                auto barrack = barrack_id(i % config_.barracks);
+                write_string(ctl_, config_.room_placement && config_.barrack_hint ? "/?barrack=" + barrack : "/");
+                write_string(ctl_, barrack);
+                write_string(ctl_, user_id(i));
+            }
+            char ready = 0;
+            if(::read(report_, &ready, 1) != 1){
+                throw std::runtime_error("clients failed to connect");
+            }
+            // the child connected one at a time, so session i + 1 is connection i
+            for(size_t i = 0; i < config_.connections; ++i){
+                auto session = conn_manager_->get_sessions(i + 1);
+                if(!session){
+                    throw std::runtime_error("session " + std::to_string(i + 1) + " is missing");
+                }
+                registry_->join(barrack_id(i % config_.barracks), session);
+            }
+        }
+
+        // The child: blocking connects and handshakes, then one thread
+        // driving every connection for each round the parent asks for.
+        static void run_clients(int ctl, int report){
+            struct Connection {
+                explicit Connection(net::io_context& ioc) : ws(ioc) {}
+                websocket::stream<tcp::socket> ws;
+                beast::flat_buffer buffer;
+                std::deque<std::string> outbox;
+                bool writing = false;
+                std::string barrack_id;
+                std::string user_id;
+                size_t barrack = 0;
+                uint32_t to_send = 0;
+                uint32_t outstanding = 0;
+            };
+            struct Round {
+                RoundConfig config;
+                RoundReport report;
+                uint64_t answered = 0;
+                uint64_t expected_answers = 0;
+                int64_t started = 0;
+                int64_t last_frame = 0;
+                LatencyHistogram answered_latency;
+                LatencyHistogram rejected_latency;
+                LatencyHistogram fanout_latency;
+            };
+
+            unsigned short port = 0;
+            uint64_t count = 0;
+            if(!read_all(ctl, &port, sizeof(port)) || !read_all(ctl, &count, sizeof(count))){
+                return;
+            }
+            net::io_context ioc;
+            std::vector<std::unique_ptr<Connection>> connections;
+            std::vector<size_t> members;
+            std::vector<std::string> barracks;
+            tcp::endpoint server(net::ip::make_address("127.0.0.1"), port);
+            for(size_t i = 0; i < count; ++i){
+                auto target = read_string(ctl);
+                auto connection = std::make_unique<Connection>(ioc);
+                connection->barrack_id = read_string(ctl);
+                connection->user_id = read_string(ctl);
+                auto known = std::find(barracks.begin(), barracks.end(), connection->barrack_id);
+                connection->barrack = static_cast<size_t>(known - barracks.begin());
+                if(known == barracks.end()){
+                    barracks.push_back(connection->barrack_id);
+                    members.push_back(0);
+                }
+                ++members[connection->barrack];
+                error_code ec;
+                connection->ws.next_layer().connect(server, ec);
+                if(!ec){
+                    connection->ws.handshake("127.0.0.1", target, ec);
+                }
+                if(ec){
+                    std::cerr << "clients: connection " << i << ": " << ec.message() << std::endl;
+                    return;
+                }
+                connections.push_back(std::move(connection));
+            }
+            char ready = 'R';
+            write_all(report, &ready, 1);
+
+            std::unique_ptr<Round> round;
+            auto now = []{ return Clock::now().time_since_epoch().count(); };
+            auto since = [&](int64_t then){ return Clock::duration(std::max<int64_t>(now() - then, 0)); };
+
+            std::function<void(Connection&)> flush = [&](Connection& connection){
+                if(connection.writing || connection.outbox.empty()){
+                    return;
+                }
+                connection.writing = true;
+                connection.ws.async_write(net::buffer(connection.outbox.front()), [&](error_code ec, size_t){
+                    connection.writing = false;
+                    connection.outbox.pop_front();
+                    if(!ec){
+                        flush(connection);
+                    }
+                });
+            };
+            auto pump = [&](Connection& connection){
+                const auto& config = round->config;
+                while(connection.to_send > 0 && connection.outstanding < config.window){
+                    auto sent_at = std::to_string(now());
+                    std::string frame;
+                    std::string text = sent_at + " ";
+                    text.resize(std::max<size_t>(text.size(), config.message_bytes), 'x');
+                    if(config.workload == Workload::SEND){
+                        frame = "{\"type\":\"MESSAGEBARRACK\",\"request_id\":" + sent_at
+                              + ",\"payload\":{\"barrack_id\":\"" + connection.barrack_id
+                              + "\",\"user_id\":\"" + connection.user_id + "\",\"message\":\"" + text + "\"}}";
+                    } else if(config.workload == Workload::BATCH){
+                        frame = "{\"type\":\"BATCH\",\"request_id\":" + sent_at + ",\"payload\":[";
+                        for(uint32_t k = 0; k < config.batch_items; ++k){
+                            frame += std::string(k ? "," : "") + "{\"type\":\"MESSAGEBARRACK\",\"request_id\":\""
+                                   + std::to_string(k) + "\",\"payload\":{\"barrack_id\":\""
+                                   + (k % 2 ? std::string("barrack_missing") : connection.barrack_id)
+                                   + "\",\"user_id\":\"" + connection.user_id + "\",\"message\":\"" + text + "\"}}";
+                        }
+                        frame += "]}";
+                    } else {
+                        frame = "{\"type\":\"GETBARRACKMESSAGES\",\"request_id\":" + sent_at
+                              + ",\"payload\":{\"barrack_id\":\"" + connection.barrack_id + "\"}}";
+                    }
+                    connection.outbox.push_back(std::move(frame));
+                    --connection.to_send;
+                    ++connection.outstanding;
+                    ++round->report.sent;
+                }
+                flush(connection);
+            };
+            auto number_after = [](std::string_view frame, std::string_view key) -> int64_t {
+                auto at = frame.find(key);
+                int64_t value = 0;
+                if(at != std::string_view::npos){
+                    auto begin = frame.data() + at + key.size();
+                    std::from_chars(begin, frame.data() + frame.size(), value);
+                }
+                return value;
+            };
+            auto handle = [&](Connection& connection, std::string_view frame){
+                if(!round){
+                    return;
+                }
+                round->last_frame = now();
+                // keys are written in sorted order, so the envelope's type comes last
+                auto at = frame.rfind("\"type\":\"");
+                std::string_view type = at == std::string_view::npos ? std::string_view{} : frame.substr(at + 8);
+                type = type.substr(0, type.find('"'));
+                if(type == "RECEIVE_MESSAGE_BROADCAST"){
+                    ++round->report.broadcasts;
+                    round->fanout_latency.record(since(number_after(frame, "\"message\":\"")));
+                    return;
+                }
+                // in a BATCH reply the frame's own request_id follows its items'
+                auto sent_at = type == "BATCH"
+                                   ? number_after(frame.substr(frame.rfind("\"request_id\":")), "\"request_id\":")
+                                   : number_after(frame, "\"request_id\":");
+                if(sent_at == 0){
+                    ++round->report.failed;
+                    return;
+                }
+                ++round->answered;
+                --connection.outstanding;
+                // failures carry an error code; not every success type has a
+                // wire name (MESSAGE_BARRACK_SUCCESS goes out as UNKNOWN)
+                if(type == "TIMEOUT" || type == "RETRY_LATER"){
+                    ++(type == "TIMEOUT" ? round->report.timed_out : round->report.retry_later);
+                    round->rejected_latency.record(since(sent_at));
+                } else if(type == "BATCH"){
+                    ++round->report.ok;
+                    round->answered_latency.record(since(sent_at));
+                    // the even items went to the connection's barrack
+                    uint32_t items = round->config.batch_items;
+                    round->report.expected_broadcasts += members[connection.barrack] * ((items + 1) / 2);
+                    uint32_t next = 0;
+                    bool ordered = true;
+                    std::string_view item_key = "\"request_id\":\"";
+                    for(auto at = frame.find(item_key); at != std::string_view::npos; at = frame.find(item_key, at + 1)){
+                        ordered = ordered && frame.substr(at + item_key.size()).starts_with(std::to_string(next) + "\"");
+                        ++next;
+                    }
+                    if(!ordered || next != items){
+                        ++round->report.out_of_order;
+                    }
+                } else if(frame.find("\"error_code\":") != std::string_view::npos){
+                    ++round->report.failed;
+                } else {
+                    ++round->report.ok;
+                    round->answered_latency.record(since(sent_at));
+                    if(round->config.workload == Workload::SEND){
+                        round->report.expected_broadcasts += members[connection.barrack];
+                    }
+                }
+                pump(connection);
+            };
+            std::function<void(Connection&)> read_next = [&](Connection& connection){
+                connection.ws.async_read(connection.buffer, [&](error_code ec, size_t){
+                    if(ec){
+                        return;
+                    }
+                    auto data = connection.buffer.data();
+                    handle(connection, std::string_view(static_cast<const char*>(data.data()), data.size()));
+                    connection.buffer.consume(connection.buffer.size());
+                    read_next(connection);
+                });
+            };
+            for(auto& connection : connections){
+                read_next(*connection);
+            }
+
+            RoundConfig config;
+            while(read_all(ctl, &config, sizeof(config)) && config.workload != Workload::STOP){
+                round = std::make_unique<Round>();
+                round->config = config;
+                round->started = now();
+                round->last_frame = round->started;
+                size_t senders = config.senders == 0 ? connections.size() : std::min<size_t>(config.senders, connections.size());
+                round->expected_answers = static_cast<uint64_t>(senders) * config.requests;
+                for(size_t i = 0; i < senders; ++i){
+                    connections[i]->to_send = config.requests;
+                    pump(*connections[i]);
+                }
+                // done once everything was answered and broadcast, or after
+                // ten quiet seconds
+                while(round->answered < round->expected_answers
+                      || round->report.broadcasts < round->report.expected_broadcasts){
+                    ioc.run_one_for(std::chrono::milliseconds(100));
+                    if(since(round->last_frame) > std::chrono::seconds(10)){
+                        break;
+                    }
+                }
+                round->report.elapsed = Clock::duration(round->last_frame - round->started);
+                round->report.answered = round->answered_latency.snapshot();
+                round->report.rejected = round->rejected_latency.snapshot();
+                round->report.fanout = round->fanout_latency.snapshot();
+                write_all(report, &round->report, sizeof(round->report));
+            }
+            for(auto& connection : connections){
+                error_code ec;
+                connection->ws.next_layer().close(ec);
+            }
+        }
+
+        ServerConfig config_;
+        pid_t child_ = -1;
+        int ctl_ = -1;
+        int report_ = -1;
+        unsigned short port_ = 0;
+
+        // declared first, destroyed last. The Listener's pending accept keeps
+        // the whole server alive until ioc_ is destroyed, rooms with strands
+        // on the pool's io_contexts included, so the pool outlives ioc_.
+        std::shared_ptr<IoThreadPool> io_pool_;
+        net::io_context ioc_;
+        std::optional<net::executor_work_guard<net::io_context::executor_type>> work_{ioc_.get_executor()};
+        std::vector<std::thread> threads_;
+
+        std::shared_ptr<StandInRepo> repo_;
+        std::shared_ptr<BarrackManager> manager_;
+        std::shared_ptr<RoomRegistry> registry_;
+        std::shared_ptr<MessageDispatcher> dispatcher_;
+        std::shared_ptr<ConnectionManager> conn_manager_;
+};
+
+}
+
+#endif
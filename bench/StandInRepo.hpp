@@ -0,0 +1,138 @@
+#ifndef STANDINREPO_H
+#define STANDINREPO_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+#include "MessageRepo.hpp"
+
+// Cassandra stand-in for the benchmarks.
+//
+// Writes are acknowledged after write_latency (plus up to a quarter of it in
+// jitter) by a timer thread, the way the driver completes futures; the
+// blocking add_batch sleeps for the same time. Reads sleep for read_latency
+// on the calling thread and return nothing. Nothing is stored.
+namespace bench {
+
+class StandInRepo : public MessageRepository {
+    public:
+        StandInRepo(std::chrono::microseconds write_latency, std::chrono::microseconds read_latency)
+            : write_latency_(write_latency), read_latency_(read_latency) {
+            timer_ = std::thread(&StandInRepo::run, this);
+        }
+
+        ~StandInRepo() override {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stopping_ = true;
+            }
+            cv_.notify_all();
+            timer_.join();
+        }
+
+        StandInRepo(const StandInRepo&) = delete;
+        StandInRepo& operator=(const StandInRepo&) = delete;
+
+        Result<std::monostate> add(const ChatMessage& message) override {
+            return add_batch({message});
+        }
+
+        Result<std::monostate> add_batch(const std::vector<ChatMessage>& messages) override {
+            std::this_thread::sleep_for(write_delay());
+            stored_.fetch_add(messages.size(), std::memory_order_relaxed);
+            batches_.fetch_add(1, std::memory_order_relaxed);
+            return Success{};
+        }
+
+        void add_batch_async(const std::vector<ChatMessage>& messages, WriteCallback done) override {
+            auto due = std::chrono::steady_clock::now() + write_delay();
+            size_t count = messages.size();
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                pending_.push({due, [this, count, done = std::move(done)]{
+                    stored_.fetch_add(count, std::memory_order_relaxed);
+                    batches_.fetch_add(1, std::memory_order_relaxed);
+                    done(Success{});
+                }});
+            }
+            cv_.notify_one();
+        }
+
+        Result<std::vector<ChatMessage>> get_for_barrack(const std::string&, int) override { return read(); }
+        Result<std::vector<ChatMessage>> get_since(const std::string&, uint64_t, int) override { return read(); }
+        Result<std::vector<ChatMessage>> get_latest(const std::string&, int) override { return read(); }
+        Result<uint64_t> get_latest_seq(const std::string&) override { return uint64_t{0}; }
+        Result<std::monostate> delete_barrack_messages(const std::string&) override { return Success{}; }
+
+        uint64_t stored() const { return stored_.load(std::memory_order_relaxed); }
+        uint64_t batches() const { return batches_.load(std::memory_order_relaxed); }
+        uint64_t reads() const { return reads_.load(std::memory_order_relaxed); }
+
+    private:
+        using Time = std::chrono::steady_clock::time_point;
+
+        struct Completion {
+            Time due;
+            std::function<void()> run;
+            bool operator>(const Completion& other) const { return due > other.due; }
+        };
+
+        std::chrono::microseconds write_delay(){
+            if(write_latency_.count() < 4){
+                return write_latency_;
+            }
+            std::lock_guard<std::mutex> lock(rng_mtx_);
+            return write_latency_ + std::chrono::microseconds(rng_() % (write_latency_.count() / 4));
+        }
+
+        std::vector<ChatMessage> read(){
+            reads_.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::sleep_for(read_latency_);
+            return {};
+        }
+
+        void run(){
+            std::unique_lock<std::mutex> lock(mtx_);
+            while(!stopping_ || !pending_.empty()){
+                if(pending_.empty()){
+                    cv_.wait(lock);
+                    continue;
+                }
+                auto due = pending_.top().due;
+                if(std::chrono::steady_clock::now() < due){
+                    cv_.wait_until(lock, due);
+                    continue;
+                }
+                auto completion = std::move(const_cast<Completion&>(pending_.top()).run);
+                pending_.pop();
+                lock.unlock();
+                completion();
+                lock.lock();
+            }
+        }
+
+        const std::chrono::microseconds write_latency_;
+        const std::chrono::microseconds read_latency_;
+        std::mutex rng_mtx_;
+        std::mt19937 rng_{1};
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::priority_queue<Completion, std::vector<Completion>, std::greater<Completion>> pending_;
+        bool stopping_ = false;
+        std::thread timer_;
+
+        std::atomic<uint64_t> stored_{0};
+        std::atomic<uint64_t> batches_{0};
+        std::atomic<uint64_t> reads_{0};
+};
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+// BATCH frames (user-035).
+//
+// Every connection keeps window BATCH frames outstanding, each holding
+// batch_items MESSAGEBARRACK commands that alternate between the
+// connection's barrack and one that does not exist, so commands with
+// different batch keys interleave inside every frame. The same commands are
+// then sent one per frame for comparison. Reports frames/s, commands/s,
+// reply and broadcast latency, and checks that every BATCH reply lists its
+// responses in command order; exits with 1 when one does not.
+//
+//   batch_frames --connections=128 --barracks=8 --requests=100 --window=4
+//                --batch_items=8 --workers=4
+#include <cstdio>
+#include "ServerRig.hpp"
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    bench::ServerConfig config;
+    config.connections = options.get("connections", size_t{128});
+    config.barracks = options.get("barracks", size_t{8});
+    config.workers = options.get("workers", size_t{4});
+    bench::RoundConfig round;
+    round.workload = bench::Workload::BATCH;
+    round.requests = static_cast<uint32_t>(options.get("requests", size_t{100}));
+    round.window = static_cast<uint32_t>(options.get("window", size_t{4}));
+    round.batch_items = static_cast<uint32_t>(options.get("batch_items", size_t{8}));
+
+    std::printf("%zu connections in %zu barracks; %u BATCH frames of %u commands each, %u outstanding\n",
+                config.connections, config.barracks, round.requests, round.batch_items, round.window);
+    bench::RoundReport batched;
+    bench::RoundReport single;
+    {
+        bench::QuietStdout quiet;
+        bench::ServerRig rig(config);
+        batched = rig.run(round);
+        // the same commands that reach a barrack, one per frame
+        bench::RoundConfig plain = round;
+        plain.workload = bench::Workload::SEND;
+        plain.requests = round.requests * ((round.batch_items + 1) / 2);
+        plain.window = round.window * round.batch_items;
+        single = rig.run(plain);
+    }
+    auto count = [](uint64_t value){ return static_cast<unsigned long long>(value); };
+    std::printf("BATCH frames:\n");
+    std::printf("  %llu/%llu answered ok, %.0f frames/s, %.0f commands/s, %llu/%llu broadcast frames\n",
+                count(batched.ok), count(batched.sent), bench::per_second(batched.ok, batched.elapsed),
+                bench::per_second(batched.ok * round.batch_items, batched.elapsed),
+                count(batched.broadcasts), count(batched.expected_broadcasts));
+    std::printf("  %llu replies out of command order\n", count(batched.out_of_order));
+    bench::print_latency("request->reply", batched.answered);
+    bench::print_latency("request->broadcast", batched.fanout);
+    std::printf("one MESSAGEBARRACK per frame:\n");
+    std::printf("  %llu/%llu sent ok, %.0f messages/s, %llu/%llu broadcast frames\n",
+                count(single.ok), count(single.sent), bench::per_second(single.ok, single.elapsed),
+                count(single.broadcasts), count(single.expected_broadcasts));
+    bench::print_latency("request->reply", single.answered);
+    bench::print_latency("request->broadcast", single.fanout);
+    return batched.out_of_order == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// Routing cost per frame (user-028).
+//
+// Routes a chat-like mix of command types (mostly MESSAGEBARRACK, 1% unknown)
+// through the compile-time perfect hash and, for comparison, through what it
+// replaced: an unordered_map of std::function factories returning a heap
+// allocated command. Reported with and without constructing the command,
+// plus string_to_message_type against a chain of string compares.
+//
+//   command_routing --frames=20000000
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "BenchSupport.hpp"
+#include "Messages.hpp"
+#include "../src/commands/CommandFactory.hpp"
+
+namespace {
+
+// The replaced factory: commands behind a virtual base, one per heap block
+struct RoutedCommand {
+    virtual ~RoutedCommand() = default;
+};
+
+template<typename Command>
+struct Boxed : RoutedCommand {
+    explicit Boxed(const PayloadFields& payload) : command(payload) {}
+    Command command;
+};
+
+using Factory = std::function<std::unique_ptr<RoutedCommand>(const PayloadFields&)>;
+
+template<size_t... I>
+std::unordered_map<std::string, Factory> old_factories(std::index_sequence<I...>){
+    std::unordered_map<std::string, Factory> factories;
+    ((factories[std::string(COMMAND_NAMES[I])] = [](const PayloadFields& payload) -> std::unique_ptr<RoutedCommand> {
+        return std::make_unique<Boxed<std::tuple_element_t<I, COMMAND_TYPES>>>(payload);
+    }), ...);
+    return factories;
+}
+
+// The replaced string_to_message_type, one compare per known name
+MessageType old_message_type(std::string_view name){
+    for(size_t i = 0; i < MESSAGE_TYPE_NAMES.size(); ++i){
+        if(name == MESSAGE_TYPE_NAMES[i]){
+            return MESSAGE_TYPE_VALUES[i];
+        }
+    }
+    return MessageType::UNKNOWN;
+}
+
+std::vector<std::string> command_mix(size_t count){
+    std::mt19937 rng(42);
+    std::vector<std::string> types;
+    types.reserve(count);
+    for(size_t i = 0; i < count; ++i){
+        auto roll = rng() % 100;
+        if(roll < 60){
+            types.emplace_back("MESSAGEBARRACK");
+        } else if(roll < 70){
+            types.emplace_back("GETBARRACKMESSAGES");
+        } else if(roll < 80){
+            types.emplace_back("SYNC");
+        } else if(roll < 85){
+            types.emplace_back("JOINBARRACK");
+        } else if(roll < 90){
+            types.emplace_back("PONG");
+        } else if(roll < 99){
+            types.emplace_back(COMMAND_NAMES[rng() % COMMAND_NAMES.size()]);
+        } else {
+            types.emplace_back("MESSAGEBARRAKC");
+        }
+    }
+    return types;
+}
+
+template<typename Route>
+void measure(const char* label, size_t frames, const std::vector<std::string>& types, Route&& route){
+    uint64_t sink = 0;
+    auto started = bench::Clock::now();
+    for(size_t i = 0; i < frames; ++i){
+        sink += route(types[i & (types.size() - 1)]);
+    }
+    auto elapsed = bench::Clock::now() - started;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(frames);
+    std::printf("  %-36s %7.1f ns/frame  %12.0f frames/s  (%llu)\n", label, ns, bench::per_second(frames, elapsed),
+                static_cast<unsigned long long>(sink % 10));
+}
+
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    size_t frames = options.get("frames", size_t{20000000});
+    auto types = command_mix(4096);
+    PayloadFields payload;
+    payload.add("barrack_id", "barrack_0192c3a4-5b6c-7d8e-9f00-00000000002a");
+    payload.add("user_id", "0192c3a4-5b6c-7d8e-9f00-000000000007");
+    payload.add("message", "hello there");
+
+    auto factories = old_factories(std::make_index_sequence<COMMAND_NAMES.size()>{});
+    CommandFactory factory;
+    AnyCommand command;
+
+    std::printf("command routing, %zu frames:\n", frames);
+    measure("route only, unordered_map", frames, types, [&](const std::string& type) -> uint64_t {
+        return factories.find(type) != factories.end();
+    });
+    measure("route only, perfect hash", frames, types, [&](const std::string& type) -> uint64_t {
+        uint64_t index = 0;
+        CommandFactory::route(type, [&]<typename Command>(){ index = sizeof(Command); });
+        return index;
+    });
+    measure("construct, std::function+make_unique", frames, types, [&](const std::string& type) -> uint64_t {
+        auto found = factories.find(type);
+        if(found == factories.end()){
+            return 0;
+        }
+        auto routed = found->second(payload);
+        return routed != nullptr;
+    });
+    measure("construct, in place", frames, types, [&](const std::string& type) -> uint64_t {
+        return factory.create_command(type, payload, command) ? command.index() : 0;
+    });
+
+    std::vector<std::string> names;
+    std::mt19937 rng(7);
+    for(size_t i = 0; i < 4096; ++i){
+        names.emplace_back(MESSAGE_TYPE_NAMES[rng() % MESSAGE_TYPE_NAMES.size()]);
+    }
+    std::printf("string_to_message_type, %zu names:\n", frames);
+    measure("compare chain", frames, names, [](const std::string& name) -> uint64_t {
+        return static_cast<uint64_t>(old_message_type(name));
+    });
+    measure("perfect hash", frames, names, [](const std::string& name) -> uint64_t {
+        return static_cast<uint64_t>(string_to_message_type(name));
+    });
+    return 0;
+}
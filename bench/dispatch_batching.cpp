@@ -0,0 +1,129 @@
+// Batched dequeue and per-barrack coalescing in the dispatcher (user-026).
+//
+// First the queue alone: producers push into the dispatcher's LaneQueue and
+// workers drain it one item per lock (max_batch=1, the old worker loop) or up
+// to MAX_BATCH_SIZE per lock. Reports items/s and lock acquisitions per item
+// on both sides.
+//
+// Then the whole server under load (see ServerRig): every connection keeps
+// window MESSAGEBARRACK requests outstanding to its barrack. Reports
+// messages/s, reply and broadcast latency, queue pops per command and how
+// many commands each coalesced write and fanout covered.
+//
+//   dispatch_batching --items=2000000 --producers=4 --consumers=4
+//                     --connections=128 --barracks=8 --requests=200 --window=16 --workers=4
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "LaneQueue.hpp"
+#include "Room.hpp"
+#include "ServerRig.hpp"
+
+struct QueueRun {
+    double items_per_second;
+    double pops_per_item;
+};
+
+static QueueRun drain_queue(size_t items, size_t producers, size_t consumers, size_t max_batch){
+    LaneQueue<uint64_t, 3> queue({8, 4, 1}, std::chrono::milliseconds(500));
+    std::atomic<uint64_t> pops{0};
+    std::atomic<uint64_t> drained{0};
+    auto started = bench::Clock::now();
+    std::vector<std::thread> threads;
+    for(size_t c = 0; c < consumers; ++c){
+        threads.emplace_back([&]{
+            std::vector<uint64_t> batch;
+            batch.reserve(max_batch);
+            uint64_t sum = 0;
+            while(queue.wait_and_pop_batch(batch, max_batch) > 0){
+                pops.fetch_add(1, std::memory_order_relaxed);
+                for(uint64_t item : batch){
+                    sum += item;
+                }
+                drained.fetch_add(batch.size(), std::memory_order_relaxed);
+                batch.clear();
+            }
+            if(sum == 1){
+                std::printf(" ");
+            }
+        });
+    }
+    std::vector<std::thread> pushers;
+    for(size_t p = 0; p < producers; ++p){
+        pushers.emplace_back([&, p]{
+            for(size_t i = p; i < items; i += producers){
+                queue.push(1, static_cast<uint64_t>(i));
+            }
+        });
+    }
+    for(auto& thread : pushers){
+        thread.join();
+    }
+    while(drained.load() < items){
+        std::this_thread::yield();
+    }
+    auto elapsed = bench::Clock::now() - started;
+    queue.shutdown();
+    for(auto& thread : threads){
+        thread.join();
+    }
+    return {bench::per_second(items, elapsed), static_cast<double>(pops.load()) / static_cast<double>(items)};
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    size_t items = options.get("items", size_t{2000000});
+    size_t producers = options.get("producers", size_t{4});
+    size_t consumers = options.get("consumers", size_t{4});
+
+    std::printf("queue: %zu items, %zu producers, %zu consumers (producers lock once per push)\n",
+                items, producers, consumers);
+    for(size_t max_batch : {size_t{1}, size_t{64}}){
+        auto run = drain_queue(items, producers, consumers, max_batch);
+        std::printf("  max_batch=%-3zu %10.0f items/s  %.3f consumer locks per item\n",
+                    max_batch, run.items_per_second, run.pops_per_item);
+    }
+
+    bench::ServerConfig config;
+    config.connections = options.get("connections", size_t{128});
+    config.barracks = options.get("barracks", size_t{8});
+    config.workers = options.get("workers", size_t{4});
+    config.io_threads = options.get("io_threads", size_t{4});
+    bench::RoundConfig round;
+    round.requests = static_cast<uint32_t>(options.get("requests", size_t{200}));
+    round.window = static_cast<uint32_t>(options.get("window", size_t{16}));
+
+    std::printf("server: %zu connections in %zu barracks, %u MESSAGEBARRACK each, %u outstanding per connection\n",
+                config.connections, config.barracks, round.requests, round.window);
+    bench::QuietStdout quiet;
+    bench::ServerRig rig(config);
+    // warm up the sessions and the writer before measuring
+    bench::RoundConfig warmup = round;
+    warmup.requests = 10;
+    rig.run(warmup);
+
+    auto before = rig.dispatcher().get_stats();
+    auto writes_before = rig.barracks().writer_stats().batches;
+    auto fanouts_before = Room::fanout_stats().broadcasts.load();
+    auto report = rig.run(round);
+    auto after = rig.dispatcher().get_stats();
+    auto writes = rig.barracks().writer_stats().batches - writes_before;
+    auto fanouts = Room::fanout_stats().broadcasts.load() - fanouts_before;
+
+    uint64_t commands = after.commands_executed - before.commands_executed;
+    uint64_t pops = after.queue_pops - before.queue_pops;
+    std::printf("  %llu/%llu sent ok, %llu failed, %.0f messages/s, %llu/%llu broadcast frames\n",
+                static_cast<unsigned long long>(report.ok), static_cast<unsigned long long>(report.sent),
+                static_cast<unsigned long long>(report.failed), bench::per_second(report.ok, report.elapsed),
+                static_cast<unsigned long long>(report.broadcasts),
+                static_cast<unsigned long long>(report.expected_broadcasts));
+    auto per = [](uint64_t total, uint64_t parts){ return parts ? static_cast<double>(total) / static_cast<double>(parts) : 0.0; };
+    std::printf("  %llu commands in %llu queue pops: %.3f locks per command\n",
+                static_cast<unsigned long long>(commands), static_cast<unsigned long long>(pops), per(pops, commands));
+    std::printf("  %llu fanout passes (%.2f messages each), %llu Cassandra batches (%.1f messages each)\n",
+                static_cast<unsigned long long>(fanouts), per(report.ok, fanouts),
+                static_cast<unsigned long long>(writes), per(report.ok, writes));
+    bench::print_latency("request->reply", report.answered);
+    bench::print_latency("request->broadcast", report.fanout);
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Inbound frame parsing on one core (user-032).
+//
+// Each frame is taken from text to envelope type plus flattened payload
+// fields twice: by JsonScanner (scan_envelope + scan_fields) and by the
+// nlohmann path it sits in front of (parse the DOM, then flatten the payload
+// the way the dispatcher's fallback does). Reports frames/s and MB/s per
+// frame shape.
+//
+//   frame_parsing --frames=1000000
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <json.hpp>
+#include "BenchSupport.hpp"
+#include "JsonScanner.hpp"
+
+namespace {
+
+struct Frame {
+    const char* label;
+    std::string text;
+};
+
+std::vector<Frame> frames(){
+    std::string head = R"({"type":"MESSAGEBARRACK","request_id":12345,"payload":{"barrack_id":"barrack_0192c3a4-5b6c-7d8e-9f00-00000000002a","user_id":"0192c3a4-5b6c-7d8e-9f00-000000000007","message":")";
+    return {
+        {"PONG", R"({"type":"PONG","payload":{}})"},
+        {"MESSAGEBARRACK, 80 B", head + std::string(80, 'x') + "\"}}"},
+        {"MESSAGEBARRACK, 1 KB", head + std::string(1024, 'x') + "\"}}"},
+        {"MESSAGEBARRACK, escaped", head + R"(she said \"hi\"\n\tand left é)" + "\"}}"},
+        {"GETBARRACKMESSAGES", R"({"type":"GETBARRACKMESSAGES","request_id":"r-7","payload":{"barrack_id":"barrack_0192c3a4-5b6c-7d8e-9f00-00000000002a","limit":50,"include_deleted":false}})"},
+    };
+}
+
+// The dispatcher's nlohmann fallback
+bool parse_dom(const std::string& frame, CommandArena& arena, PayloadFields& fields, std::string_view& type){
+    auto message = nlohmann::json::parse(frame.begin(), frame.end());
+    type = arena.copy(message["type"].get_ref<const std::string&>());
+    for(const auto& item : message["payload"].items()){
+        const auto& value = item.value();
+        std::string_view field;
+        if(value.is_string()){
+            field = arena.copy(value.get_ref<const std::string&>());
+        } else if(value.is_boolean()){
+            field = value.get<bool>() ? "true" : "false";
+        } else if(value.is_null()){
+            continue;
+        } else {
+            field = arena.copy(value.dump());
+        }
+        if(!fields.add(arena.copy(item.key()), field)){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool scan(const std::string& frame, CommandArena& arena, PayloadFields& fields, std::string_view& type){
+    JsonScanner::Envelope envelope;
+    if(!JsonScanner::scan_envelope(frame, arena, envelope)){
+        return false;
+    }
+    type = envelope.type;
+    return JsonScanner::scan_fields(envelope.payload, arena, fields);
+}
+
+template<typename Parse>
+double measure(const std::string& frame, size_t count, Parse&& parse){
+    CommandArena arena;
+    size_t sink = 0;
+    auto started = bench::Clock::now();
+    for(size_t i = 0; i < count; ++i){
+        PayloadFields fields;
+        std::string_view type;
+        if(parse(frame, arena, fields, type)){
+            sink += fields.size() + type.size();
+        }
+        arena.reset();
+    }
+    auto elapsed = bench::Clock::now() - started;
+    if(sink == 0){
+        std::printf("  (nothing parsed)\n");
+    }
+    return bench::per_second(count, elapsed);
+}
+
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    size_t count = options.get("frames", size_t{1000000});
+
+    std::printf("%zu frames of each shape, one thread\n", count);
+    for(const auto& frame : frames()){
+        double scanned = measure(frame.text, count, scan);
+        double parsed = measure(frame.text, count / 10, parse_dom);
+        auto mb = [&](double rate){ return rate * static_cast<double>(frame.text.size()) / 1e6; };
+        std::printf("  %-24s %5zu B  scanner %10.0f frames/s %7.1f MB/s   nlohmann %9.0f frames/s %6.1f MB/s   %.1fx\n",
+                    frame.label, frame.text.size(), scanned, mb(scanned), parsed, mb(parsed), scanned / parsed);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Grouped fanout of one 10k member room (user-039).
+//
+// Every member is a real websocket session; a forked swarm reads the frames.
+// The room is kept below the shard threshold and every round runs twice:
+// grouped, task_sessions members per task posted through the room's strand
+// on each io_context, and inline, with group_min_members above the room size
+// so the broadcasting thread writes to every session itself. Reports how
+// long the first to the last member waited for a broadcast and whether any
+// member saw two of them swapped, for both side by side.
+//
+//   grouped_fanout --members=10000 --threads=4 --task_sessions=256 --group_min_members=64
+//                  --broadcasts=200 --paced=50 --gap_us=100000
+#include <cstdio>
+#include <vector>
+#include "FanoutRig.hpp"
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    bench::RigConfig rig_config;
+    rig_config.members = options.get("members", size_t{10000});
+    rig_config.contexts = options.get("contexts", size_t{1});
+    rig_config.threads_per_context = options.get("threads", size_t{4});
+    rig_config.frame_bytes = options.get("frame_bytes", size_t{256});
+    size_t broadcasts = options.get("broadcasts", size_t{200});
+    // the paced round leaves every broadcast time to drain before the next
+    size_t paced = options.get("paced", size_t{50});
+    std::chrono::microseconds gap(options.get("gap_us", size_t{100000}));
+
+    FanoutConfig grouped;
+    grouped.task_sessions = options.get("task_sessions", grouped.task_sessions);
+    grouped.group_min_members = options.get("group_min_members", grouped.group_min_members);
+    grouped.shard_members = rig_config.members + 1;
+    FanoutConfig inline_config = grouped;
+    inline_config.group_min_members = rig_config.members + 1;
+
+    std::printf("%zu members, %zu io_context(s) x %zu threads; grouped: %zu tasks of %zu per broadcast%s\n",
+                rig_config.members, rig_config.contexts, rig_config.threads_per_context,
+                (rig_config.members + grouped.task_sessions - 1) / grouped.task_sessions, grouped.task_sessions,
+                rig_config.members < grouped.group_min_members ? " (below group_min_members, runs inline too)" : "");
+
+    struct Round {
+        const char* label;
+        bench::SwarmReport report;
+    };
+    std::vector<Round> rounds;
+    uint64_t grouped_broadcasts = 0;
+    uint64_t group_tasks = 0;
+    {
+        bench::QuietStdout quiet;
+        bench::FanoutRig rig(rig_config);
+        auto& stats = Room::fanout_stats();
+        for(bool grouping : {true, false}){
+            Room::configure_fanout(grouping ? grouped : inline_config);
+            // warm up the sessions' write paths before measuring
+            rig.broadcast(10, std::chrono::microseconds(0));
+            auto grouped_before = stats.grouped_broadcasts.load();
+            auto tasks_before = stats.group_tasks.load();
+            rounds.push_back({grouping ? "grouped, back to back" : "inline, back to back",
+                              rig.broadcast(broadcasts, std::chrono::microseconds(0))});
+            rounds.push_back({grouping ? "grouped, paced" : "inline, paced", rig.broadcast(paced, gap)});
+            if(grouping){
+                grouped_broadcasts = stats.grouped_broadcasts.load() - grouped_before;
+                group_tasks = stats.group_tasks.load() - tasks_before;
+            }
+        }
+    }
+
+    auto count = [](uint64_t value){ return static_cast<unsigned long long>(value); };
+    for(const auto& [label, report] : rounds){
+        std::printf("%s: %llu/%llu frames received, %llu out of order, %.0f frames/s\n", label,
+                    count(report.received), count(report.expected), count(report.out_of_order),
+                    bench::per_second(report.received, report.elapsed));
+        bench::print_latency("first->last member", report.spread);
+        bench::print_latency("broadcast->last member", report.delivered);
+    }
+    std::printf("server, grouped rounds: %llu grouped broadcasts, %llu tasks\n",
+                count(grouped_broadcasts), count(group_tasks));
+    return 0;
+}
@@ -0,0 +1,80 @@
+// ID generation (user-047).
+//
+// One thread, then threads threads, each generate ids IDs with IdGenerator::time_uuid (version
+// 1, message ids) and IdGenerator::sortable_uuid (version 7, user and
+// barrack ids), then the way generate_message_id did before: a fresh
+// boost::uuids::random_generator per ID, formatted through a stringstream.
+// Reports IDs/s per thread and in total, and checks that each thread's
+// version 7 IDs come out sorted; exits with 1 when they do not.
+//
+//   id_generator --threads=4 --ids=1000000
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include "BenchSupport.hpp"
+#include "IdGenerator.hpp"
+
+namespace {
+
+std::string random_uuid(){
+    boost::uuids::random_generator generator;
+    boost::uuids::uuid uuid = generator();
+    std::stringstream ss;
+    ss << uuid;
+    return ss.str();
+}
+
+// true when every thread's IDs came out in increasing order
+bool measure(const char* label, const std::function<std::string()>& generate, size_t threads, size_t ids){
+    std::atomic<size_t> unordered{0};
+    std::vector<std::thread> workers;
+    auto started = bench::Clock::now();
+    for(size_t t = 0; t < threads; ++t){
+        workers.emplace_back([&]{
+            std::string previous;
+            size_t backwards = 0;
+            for(size_t i = 0; i < ids; ++i){
+                std::string id = generate();
+                backwards += id <= previous;
+                previous = std::move(id);
+            }
+            unordered.fetch_add(backwards, std::memory_order_relaxed);
+        });
+    }
+    for(auto& worker : workers){
+        worker.join();
+    }
+    double total = bench::per_second(threads * ids, bench::Clock::now() - started);
+    std::printf("  %-28s %11.0f IDs/s per thread, %11.0f IDs/s in total, %zu out of order\n",
+                label, total / static_cast<double>(threads), total, unordered.load());
+    return unordered.load() == 0;
+}
+
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    size_t ids = options.get("ids", size_t{1000000});
+    size_t most = std::max<size_t>(options.get("threads", size_t{4}), 1);
+
+    bool sorted = true;
+    for(size_t threads : {size_t{1}, most}){
+        std::printf("%zu threads, %zu IDs each:\n", threads, ids);
+        // version 1 text does not sort by time, its timestamp starts with the low bits
+        measure("time_uuid (v1)", []{ return IdGenerator::time_uuid(); }, threads, ids);
+        sorted = measure("sortable_uuid (v7)", []{ return IdGenerator::sortable_uuid(); }, threads, ids) && sorted;
+        measure("random_generator+stringstream", random_uuid, threads, std::max<size_t>(ids / 10, 1));
+        if(most == 1){
+            break;
+        }
+    }
+    return sorted ? 0 : 1;
+}
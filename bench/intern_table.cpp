@@ -0,0 +1,107 @@
+// Interned member sets (user-048).
+//
+// users users are spread over barracks barracks, once in member sets keyed
+// by InternTable handle (what BarrackState keeps) and once keyed by the
+// std::string id, the way members were held before. Reports the heap each
+// layout takes per membership (glibc mallinfo2, the intern table counted
+// with the handle sets), and membership checks per second: the send path's
+// find() on the table plus a handle probe, a probe with the handle already
+// known, and a lookup by string. Non-members are checked as often as members.
+//
+//   intern_table --users=1000000 --barracks=1000 --checks=2000000
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <malloc.h>
+#include "BenchSupport.hpp"
+#include "ChatSeed.hpp"
+#include "InternTable.hpp"
+
+namespace {
+
+using Time = std::chrono::system_clock::time_point;
+using HandleSet = std::unordered_map<InternTable::Handle, Time>;
+using StringSet = std::unordered_map<std::string, Time>;
+
+size_t heap_in_use(){
+    return mallinfo2().uordblks;
+}
+
+template<typename Check>
+void measure(const char* label, size_t checks, Check&& check){
+    size_t found = 0;
+    auto started = bench::Clock::now();
+    for(size_t i = 0; i < checks; ++i){
+        found += check(i);
+    }
+    auto elapsed = bench::Clock::now() - started;
+    std::printf("  %-30s %11.0f checks/s, %6.1f ns each (%zu found)\n", label, bench::per_second(checks, elapsed),
+                std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(checks), found);
+}
+
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    size_t users = std::max<size_t>(options.get("users", size_t{1000000}), 1);
+    size_t barracks = std::max<size_t>(options.get("barracks", size_t{1000}), 1);
+    size_t checks = options.get("checks", size_t{2000000});
+
+    // user i is a member of barrack i % barracks; the ids are built up front
+    // so neither layout pays for formatting
+    std::vector<std::string> ids;
+    ids.reserve(users * 2);
+    for(size_t i = 0; i < users * 2; ++i){
+        ids.push_back(bench::user_id(i));
+    }
+    auto now = std::chrono::system_clock::now();
+
+    size_t before = heap_in_use();
+    auto table = std::make_unique<InternTable>();
+    auto by_handle = std::make_unique<std::vector<HandleSet>>(barracks);
+    for(size_t i = 0; i < users; ++i){
+        (*by_handle)[i % barracks].emplace(table->intern(ids[i]), now);
+    }
+    size_t handle_bytes = heap_in_use() - before;
+
+    before = heap_in_use();
+    auto by_string = std::make_unique<std::vector<StringSet>>(barracks);
+    for(size_t i = 0; i < users; ++i){
+        (*by_string)[i % barracks].emplace(ids[i], now);
+    }
+    size_t string_bytes = heap_in_use() - before;
+
+    std::vector<InternTable::Handle> handles(users);
+    for(size_t i = 0; i < users; ++i){
+        handles[i] = table->find(ids[i]);
+    }
+
+    std::printf("%zu users in %zu barracks, %zu checks\n", users, barracks, checks);
+    std::printf("  handle sets    %7.1f bytes per member (intern table %zu bytes of it)\n",
+                static_cast<double>(handle_bytes) / static_cast<double>(users), table->bytes());
+    std::printf("  string sets    %7.1f bytes per member\n",
+                static_cast<double>(string_bytes) / static_cast<double>(users));
+
+    // a fixed stride over members and non-members; odd checks ask about the
+    // member's barrack for a user that was never interned
+    auto user_of = [&](size_t i){ return (i * 7919) % users; };
+    measure("find + handle probe", checks, [&](size_t i){
+        size_t user = user_of(i);
+        auto& members = (*by_handle)[user % barracks];
+        auto handle = table->find(ids[i % 2 ? users + user : user]);
+        return handle != InternTable::NONE && members.contains(handle);
+    });
+    measure("handle probe, handle known", checks, [&](size_t i){
+        size_t user = user_of(i);
+        return (*by_handle)[user % barracks].contains(i % 2 ? InternTable::NONE : handles[user]);
+    });
+    measure("string lookup", checks, [&](size_t i){
+        size_t user = user_of(i);
+        return (*by_string)[user % barracks].contains(ids[i % 2 ? users + user : user]);
+    });
+    return 0;
+}
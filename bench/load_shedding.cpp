@@ -0,0 +1,67 @@
+// Deadlines and load shedding under overload (user-030).
+//
+// Every connection keeps window GETBARRACKMESSAGES requests outstanding while
+// each history read takes read_latency_ms in the Cassandra stand-in, so the
+// dispatcher can serve workers / read_latency reads a second. A light round
+// (a few senders) is measured first, then all connections at once. For each
+// round: how many requests were served, expired in the queue (TIMEOUT) or shed
+// at the door (RETRY_LATER), the repository reads that actually ran, and the
+// latency of served and of rejected requests. Without deadlines every request
+// would have run; the time that takes is printed for comparison.
+//
+//   load_shedding --connections=500 --barracks=8 --requests=20 --window=8
+//                 --workers=4 --read_latency_ms=5 --light_senders=8
+#include <cstdio>
+#include "ServerRig.hpp"
+
+static void print_round(const char* label, const bench::RoundReport& report, uint64_t reads,
+                        const MessageDispatcher::Stats& before, const MessageDispatcher::Stats& after,
+                        std::chrono::microseconds read_latency, size_t workers){
+    auto count = [](uint64_t value){ return static_cast<unsigned long long>(value); };
+    std::printf("%s: %llu requests in %.2f s\n", label, count(report.sent),
+                std::chrono::duration<double>(report.elapsed).count());
+    std::printf("  %llu served, %llu TIMEOUT, %llu RETRY_LATER, %llu failed\n", count(report.ok),
+                count(report.timed_out), count(report.retry_later), count(report.failed));
+    std::printf("  %llu repository reads ran, %llu commands expired, %llu frames shed\n", count(reads),
+                count(after.commands_expired - before.commands_expired),
+                count(after.frames_shed - before.frames_shed));
+    double unshed = std::chrono::duration<double>(read_latency).count() * static_cast<double>(report.sent)
+                  / static_cast<double>(workers);
+    std::printf("  running every request would take at least %.2f s\n", unshed);
+    bench::print_latency("request->served", report.answered);
+    bench::print_latency("request->rejected", report.rejected);
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    bench::ServerConfig config;
+    config.connections = options.get("connections", size_t{500});
+    config.barracks = options.get("barracks", size_t{8});
+    config.workers = options.get("workers", size_t{4});
+    config.io_threads = options.get("io_threads", size_t{4});
+    config.read_latency = std::chrono::milliseconds(options.get("read_latency_ms", size_t{5}));
+    bench::RoundConfig round;
+    round.workload = bench::Workload::HISTORY;
+    round.requests = static_cast<uint32_t>(options.get("requests", size_t{20}));
+    round.window = static_cast<uint32_t>(options.get("window", size_t{8}));
+    auto light_senders = static_cast<uint32_t>(options.get("light_senders", size_t{8}));
+
+    std::printf("%zu connections, %u GETBARRACKMESSAGES each, %u outstanding, %zu workers, %lld ms per read\n",
+                config.connections, round.requests, round.window, config.workers,
+                static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(config.read_latency).count()));
+    bench::QuietStdout quiet;
+    bench::ServerRig rig(config);
+
+    auto measure = [&](const char* label, const bench::RoundConfig& measured){
+        auto before = rig.dispatcher().get_stats();
+        auto reads_before = rig.repo().reads();
+        auto report = rig.run(measured);
+        auto after = rig.dispatcher().get_stats();
+        print_round(label, report, rig.repo().reads() - reads_before, before, after, config.read_latency, config.workers);
+    };
+    bench::RoundConfig light = round;
+    light.senders = light_senders;
+    measure("light load", light);
+    measure("overload", round);
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Barrack membership index (user-043).
+//
+// One barrack with members members, for 10, 1k and 100k members, seeded into
+// SQLite and loaded by warm_start. Measures get_barrack_member for members
+// and for users in no barrack, and message_barrack, whose membership check is
+// the hash probe this change introduced, against a Cassandra stand-in that
+// acknowledges at once. The std::find_if over a vector of BarrackMember the
+// manager used before runs on the same ids for comparison.
+//
+//   membership_index --lookups=1000000 --sends=100000
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+#include "BarrackManager.hpp"
+#include "BenchSupport.hpp"
+#include "ChatSeed.hpp"
+#include "DatabaseConn.hpp"
+#include "StandInRepo.hpp"
+
+namespace {
+
+void measure(size_t members, size_t lookups, size_t sends){
+    std::vector<std::string> users;
+    for(size_t i = 0; i < members; ++i){
+        users.push_back(bench::user_id(i));
+    }
+    std::vector<std::string> strangers;
+    for(size_t i = 0; i < 1024; ++i){
+        strangers.push_back(bench::user_id(members + i));
+    }
+    // a fixed stride through the members, so consecutive lookups do not share cache lines
+    auto pick = [&](size_t i){ return (i * 7919) % members; };
+
+    auto database = std::make_shared<DatabaseConnection>(":memory:");
+    database->initialize_database();
+    auto barrack_repo = std::make_shared<BarrackRepository>(database->get_connection());
+    bench::seed_barracks(*barrack_repo, 1);
+    bench::seed_members(*database->get_connection(), members, [](size_t i){ return std::make_pair(size_t{0}, i); });
+    auto repo = std::make_shared<bench::StandInRepo>(std::chrono::microseconds{0}, std::chrono::microseconds{0});
+    BarrackManager manager(barrack_repo, repo);
+    if(auto loaded = manager.warm_start(); std::holds_alternative<Error>(loaded)){
+        throw std::runtime_error(std::get<Error>(loaded).message);
+    }
+    std::string barrack = bench::barrack_id(0);
+
+    size_t found = 0;
+    auto started = bench::Clock::now();
+    for(size_t i = 0; i < lookups; ++i){
+        found += manager.get_barrack_member(barrack, users[pick(i)]).has_value();
+    }
+    double member_rate = bench::per_second(lookups, bench::Clock::now() - started);
+
+    started = bench::Clock::now();
+    for(size_t i = 0; i < lookups; ++i){
+        found += manager.get_barrack_member(barrack, strangers[i % strangers.size()]).has_value();
+    }
+    double stranger_rate = bench::per_second(lookups, bench::Clock::now() - started);
+
+    size_t sent = 0;
+    started = bench::Clock::now();
+    for(size_t i = 0; i < sends; ++i){
+        sent += std::holds_alternative<ChatMessage>(manager.message_barrack(barrack, users[pick(i)], "hello"));
+    }
+    double send_rate = bench::per_second(sends, bench::Clock::now() - started);
+
+    // the old layout, scanned the way leave/get_barrack_member/message_barrack did
+    std::vector<BarrackMember> list;
+    for(const auto& user : users){
+        list.emplace_back(barrack, user, std::chrono::system_clock::now());
+    }
+    size_t scans = std::max<size_t>(lookups / std::max<size_t>(members / 16, 1), 64);
+    size_t scanned = 0;
+    started = bench::Clock::now();
+    for(size_t i = 0; i < scans; ++i){
+        const auto& user = users[pick(i)];
+        scanned += std::find_if(list.begin(), list.end(),
+                                [&](const BarrackMember& member){ return member.user_id == user; }) != list.end();
+    }
+    double scan_rate = bench::per_second(scans, bench::Clock::now() - started);
+
+    std::printf("%zu members:\n", members);
+    std::printf("  get_barrack_member   %11.0f/s members, %11.0f/s non-members (%zu found)\n",
+                member_rate, stranger_rate, found);
+    std::printf("  vector scan          %11.0f/s members, %.0fx slower (%zu found)\n",
+                scan_rate, scan_rate > 0 ? member_rate / scan_rate : 0.0, scanned);
+    std::printf("  message_barrack      %11.0f/s (%zu/%zu accepted)\n", send_rate, sent, sends);
+}
+
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    size_t lookups = options.get("lookups", size_t{1000000});
+    size_t sends = options.get("sends", size_t{100000});
+
+    for(size_t members : {size_t{10}, size_t{1000}, size_t{100000}}){
+        bench::QuietStdout quiet;
+        measure(members, lookups, sends);
+    }
+    return 0;
+}
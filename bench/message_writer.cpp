@@ -0,0 +1,121 @@
+// Message writer (user-049).
+//
+// senders threads push messages round-robin over barracks into a
+// MessageWriter whose repository is the Cassandra stand-in, acknowledging
+// add_batch_async after write_latency_us. Every sender owns
+// barracks / senders barracks, so each barrack is pushed in seq order. The
+// same load runs with max_in_flight 1 (the old one blocking round trip at a
+// time), 8 and in_flight. A
+// sender that finds the backlog full (has_room) waits and counts it. Reports
+// messages/s until everything is stored, messages per batch, the peak
+// backlog, how often senders were turned away and the commit (accepted ->
+// stored) and round trip latency.
+//
+//   message_writer --senders=8 --messages=50000 --barracks=64
+//                  --write_latency_us=2000 --in_flight=128
+//                  --max_backlog=262144
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchSupport.hpp"
+#include "MessageWriter.hpp"
+#include "StandInRepo.hpp"
+
+namespace {
+
+struct Load {
+    size_t senders;
+    size_t messages;        // per sender
+    size_t barracks;        // per sender
+    std::chrono::microseconds write_latency;
+    size_t max_backlog;
+};
+
+void measure(size_t max_in_flight, const Load& load){
+    auto repo = std::make_shared<bench::StandInRepo>(load.write_latency, std::chrono::microseconds{0});
+    WriterConfig config;
+    config.max_in_flight = max_in_flight;
+    config.max_backlog = load.max_backlog;
+    std::atomic<uint64_t> settled{0};
+    MessageWriter writer(repo, config, nullptr, [&](const std::vector<ChatMessage>& batch){
+        settled.fetch_add(batch.size(), std::memory_order_relaxed);
+    });
+
+    std::atomic<uint64_t> turned_away{0};
+    std::atomic<bool> sending{true};
+    uint64_t peak_backlog = 0;
+    uint64_t total = load.senders * load.messages;
+
+    std::vector<std::thread> senders;
+    auto started = bench::Clock::now();
+    std::thread monitor([&]{
+        while(sending.load(std::memory_order_relaxed) || settled.load(std::memory_order_relaxed) < total){
+            peak_backlog = std::max(peak_backlog, writer.stats().backlog);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    for(size_t s = 0; s < load.senders; ++s){
+        senders.emplace_back([&, s]{
+            std::string content(64, 'x');
+            std::vector<std::string> barracks;
+            for(size_t b = 0; b < load.barracks; ++b){
+                barracks.push_back("barrack-" + std::to_string(s) + "-" + std::to_string(b));
+            }
+            std::vector<uint64_t> seqs(load.barracks, 0);
+            for(size_t i = 0; i < load.messages; ++i){
+                size_t b = i % load.barracks;
+                while(!writer.has_room()){
+                    turned_away.fetch_add(1, std::memory_order_relaxed);
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                writer.push(ChatMessage("message-" + std::to_string(s) + "-" + std::to_string(i), barracks[b],
+                                        "user-" + std::to_string(s), content, std::chrono::system_clock::now(),
+                                        ++seqs[b]));
+            }
+        });
+    }
+    for(auto& sender : senders){
+        sender.join();
+    }
+    sending.store(false, std::memory_order_relaxed);
+    monitor.join();
+    auto elapsed = bench::Clock::now() - started;
+
+    auto stats = writer.stats();
+    auto count = [](uint64_t value){ return static_cast<unsigned long long>(value); };
+    std::printf("max_in_flight=%zu:\n", max_in_flight);
+    std::printf("  %llu/%llu stored, %.0f messages/s, %llu batches, %.1f messages per batch\n",
+                count(stats.written), count(total), bench::per_second(stats.written, elapsed), count(stats.batches),
+                stats.batches ? static_cast<double>(stats.written) / static_cast<double>(stats.batches) : 0.0);
+    std::printf("  peak backlog %llu messages, senders turned away %llu times\n",
+                count(peak_backlog), count(turned_away.load()));
+    bench::print_latency("accepted->stored", stats.commit);
+    bench::print_latency("batch round trip", stats.round_trip);
+}
+
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    Load load;
+    load.senders = options.get("senders", size_t{8});
+    load.messages = options.get("messages", size_t{50000});
+    load.barracks = std::max<size_t>(options.get("barracks", size_t{64}) / std::max<size_t>(load.senders, 1), 1);
+    load.write_latency = std::chrono::microseconds(options.get("write_latency_us", size_t{2000}));
+    load.max_backlog = options.get("max_backlog", size_t{256 * 1024});
+
+    size_t in_flight = std::max<size_t>(options.get("in_flight", size_t{128}), 1);
+
+    std::printf("%zu senders, %zu messages each over %zu barracks, writes acknowledged after %lld us\n",
+                load.senders, load.messages, load.senders * load.barracks,
+                static_cast<long long>(load.write_latency.count()));
+    for(size_t window : {size_t{1}, size_t{8}, in_flight}){
+        bench::QuietStdout quiet;
+        measure(window, load);
+    }
+    return 0;
+}
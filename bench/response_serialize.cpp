@@ -0,0 +1,137 @@
+// Response serialization (user-033).
+//
+// Renders the common reply shapes with the Responses.hpp serializers and,
+// for comparison, by building the same nlohmann::json DOM and dumping it, the
+// way the commands did before. Reports responses/s and heap allocations per
+// response (global operator new is counted), and checks that both produce the
+// same bytes.
+//
+//   response_serialize --responses=1000000 --history=50
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include <json.hpp>
+#include "BenchSupport.hpp"
+#include "Responses.hpp"
+
+static std::atomic<uint64_t> allocations{0};
+
+// libstdc++'s operator delete releases with free(), so only new is replaced
+void* operator new(std::size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* memory = std::malloc(size ? size : 1)){
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+namespace {
+
+nlohmann::json chat_message_json(const ChatMessage& message){
+    nlohmann::json json;
+    json["barrack_id"] = message.barrack_id;
+    json["created_at"] = std::chrono::system_clock::to_time_t(message.sent_at);
+    json["message"] = message.content;
+    json["seq"] = message.seq;
+    json["user_id"] = message.sender_user_id;
+    return json;
+}
+
+void set_meta(nlohmann::json& json, const ResponseMeta& meta){
+    if(!meta.request_id.empty()){
+        json["request_id"] = nlohmann::json::parse(meta.request_id);
+    }
+    json["sequence_id"] = meta.sequence_id;
+}
+
+struct Shape {
+    const char* label;
+    size_t items;       // messages rendered per response
+    std::function<std::string()> writer;
+    std::function<std::string()> dom;
+};
+
+void measure(const Shape& shape, size_t count){
+    auto run = [&](const std::function<std::string()>& serialize, size_t n, double& rate, double& allocs){
+        size_t bytes = 0;
+        auto before = allocations.load();
+        auto started = bench::Clock::now();
+        for(size_t i = 0; i < n; ++i){
+            bytes += serialize().size();
+        }
+        auto elapsed = bench::Clock::now() - started;
+        allocs = static_cast<double>(allocations.load() - before) / static_cast<double>(n);
+        rate = bench::per_second(n, elapsed);
+        return bytes / n;
+    };
+    double writer_rate = 0, writer_allocs = 0, dom_rate = 0, dom_allocs = 0;
+    size_t size = run(shape.writer, count, writer_rate, writer_allocs);
+    run(shape.dom, std::max<size_t>(count / 10, 1), dom_rate, dom_allocs);
+    std::printf("  %-26s %6zu B  writer %9.0f/s %5.1f allocs   DOM %8.0f/s %6.1f allocs   %5.1fx  %s\n",
+                shape.label, size, writer_rate, writer_allocs, dom_rate, dom_allocs, writer_rate / dom_rate,
+                shape.writer() == shape.dom() ? "same bytes" : "BYTES DIFFER");
+}
+
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    size_t count = options.get("responses", size_t{1000000});
+    size_t history = options.get("history", size_t{50});
+
+    ResponseMeta meta{41, "12345"};
+    ChatMessage message("0192c3a4-5b6c-7d8e-9f00-0000000000ff", "barrack_0192c3a4-5b6c-7d8e-9f00-00000000002a",
+                        "0192c3a4-5b6c-7d8e-9f00-000000000007",
+                        "hey everyone, are we still meeting at the usual place tonight? \"bring snacks\"",
+                        std::chrono::system_clock::from_time_t(1760000000), 1234);
+    std::vector<ChatMessage> messages(history, message);
+    for(size_t i = 0; i < messages.size(); ++i){
+        messages[i].seq = 1000 + i;
+    }
+
+    std::vector<Shape> shapes;
+    shapes.push_back({"failure", 1,
+        [&]{ return failure_response(MessageType::MESSAGE_BARRACK_FAILURE, meta, "You are not a member of this barrack"); },
+        [&]{
+            auto name = message_type_to_string(MessageType::MESSAGE_BARRACK_FAILURE);
+            nlohmann::json json;
+            json["type"] = name;
+            set_meta(json, meta);
+            json["payload"]["error_code"] = name;
+            json["payload"]["message"] = "You are not a member of this barrack";
+            return json.dump();
+        }});
+    shapes.push_back({"message broadcast", 1,
+        [&]{ return message_broadcast(message); },
+        [&]{
+            nlohmann::json json;
+            json["type"] = message_type_to_string(MessageType::RECEIVE_MESSAGE_BROADCAST);
+            json["payload"] = chat_message_json(message);
+            return json.dump();
+        }});
+    shapes.push_back({"barrack messages", history,
+        [&]{ return barrack_messages_response(meta, messages); },
+        [&]{
+            nlohmann::json json;
+            json["type"] = message_type_to_string(MessageType::GET_BARRACK_MESSAGES_SUCCESS);
+            set_meta(json, meta);
+            json["payload"]["message"] = "Barrack messages fetched successfully";
+            json["payload"]["messages"] = nlohmann::json::array();
+            for(const auto& item : messages){
+                json["payload"]["messages"].push_back(chat_message_json(item));
+            }
+            return json.dump();
+        }});
+
+    std::printf("%zu responses of each shape (pages: divided by their size, DOM: a tenth), %zu messages per history page\n", count, history);
+    for(const auto& shape : shapes){
+        measure(shape, std::max<size_t>(count / std::max<size_t>(shape.items, 1), 1));
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+// Room placement on io threads (user-040).
+//
+// The same server and load three times: every connection accepted onto a
+// shared io_context run by io_threads threads; an io_context per thread with
+// connections handed out in turn; and room placement, where each connection
+// is steered to the thread that owns its barrack. A few large barracks are
+// hot: senders connections keep window MESSAGEBARRACK requests outstanding.
+// Reports messages/s, how many io_contexts each broadcast touched,
+// cross-thread handoffs per broadcast and the broadcast latency. Connection i
+// is in barrack i % barracks, so when barracks is a multiple of io_threads
+// handing connections out in turn already lines rooms up with threads.
+//
+//   room_placement --connections=600 --barracks=3 --io_threads=4 --senders=30
+//                  --requests=100 --window=8 --workers=4
+#include <cstdio>
+#include "Room.hpp"
+#include "ServerRig.hpp"
+
+static void run(const char* label, const bench::ServerConfig& config, const bench::RoundConfig& round){
+    bench::RoundReport report;
+    uint64_t broadcasts = 0, groups = 0, handoffs = 0, steered = 0;
+    {
+        bench::QuietStdout quiet;
+        bench::ServerRig rig(config);
+        bench::RoundConfig warmup = round;
+        warmup.requests = 5;
+        rig.run(warmup);
+
+        auto& stats = Room::fanout_stats();
+        auto broadcasts_before = stats.broadcasts.load();
+        auto groups_before = stats.executor_groups.load();
+        auto handoffs_before = stats.handoffs.load();
+        report = rig.run(round);
+        broadcasts = stats.broadcasts.load() - broadcasts_before;
+        groups = stats.executor_groups.load() - groups_before;
+        handoffs = stats.handoffs.load() - handoffs_before;
+        steered = stats.steered_sessions.load();
+    }
+    auto per = [&](uint64_t total){ return broadcasts ? static_cast<double>(total) / static_cast<double>(broadcasts) : 0.0; };
+    std::printf("%s:\n", label);
+    std::printf("  %llu/%llu sent ok, %.0f messages/s, %llu/%llu broadcast frames, %llu sessions steered\n",
+                static_cast<unsigned long long>(report.ok), static_cast<unsigned long long>(report.sent),
+                bench::per_second(report.ok, report.elapsed), static_cast<unsigned long long>(report.broadcasts),
+                static_cast<unsigned long long>(report.expected_broadcasts), static_cast<unsigned long long>(steered));
+    std::printf("  %llu fanout passes: %.2f io_contexts and %.1f handoffs each\n",
+                static_cast<unsigned long long>(broadcasts), per(groups), per(handoffs));
+    bench::print_latency("request->reply", report.answered);
+    bench::print_latency("request->broadcast", report.fanout);
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    bench::ServerConfig config;
+    config.connections = options.get("connections", size_t{600});
+    config.barracks = options.get("barracks", size_t{3});
+    config.io_threads = options.get("io_threads", size_t{4});
+    config.workers = options.get("workers", size_t{4});
+    bench::RoundConfig round;
+    round.requests = static_cast<uint32_t>(options.get("requests", size_t{100}));
+    round.window = static_cast<uint32_t>(options.get("window", size_t{8}));
+    round.senders = static_cast<uint32_t>(options.get("senders", size_t{30}));
+
+    std::printf("%zu connections in %zu barracks, %zu io threads; %u senders, %u MESSAGEBARRACK each, %u outstanding\n",
+                config.connections, config.barracks, config.io_threads, round.senders, round.requests, round.window);
+    config.room_placement = false;
+    run("shared io_context", config, round);
+    config.room_placement = true;
+    config.barrack_hint = false;
+    run("io_context per thread, connections spread in turn", config, round);
+    config.barrack_hint = true;
+    run("io_context per thread, connections placed by barrack", config, round);
+    return 0;
+}
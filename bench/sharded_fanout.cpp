@@ -0,0 +1,65 @@
+// Sharded fanout of one 10k member room (user-042).
+//
+// Every member is a real websocket session; a forked swarm reads the frames.
+// The room is cut into shards of shard_members, each walked on its own strand
+// pace_sessions members at a time. The churn round moves one member to the
+// end of the room every churn_every broadcasts (leave and join again between
+// two broadcasts), which moves members across shard boundaries. Reports how
+// long the first to the last member waited for a broadcast and whether any
+// member saw two of them swapped.
+//
+//   sharded_fanout --members=10000 --threads=4 --shard_members=2500 --pace_sessions=1024 --broadcasts=200 --churn_every=10
+#include <cstdio>
+#include "FanoutRig.hpp"
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    bench::RigConfig rig_config;
+    rig_config.members = options.get("members", size_t{10000});
+    rig_config.contexts = options.get("contexts", size_t{1});
+    rig_config.threads_per_context = options.get("threads", size_t{4});
+    rig_config.frame_bytes = options.get("frame_bytes", size_t{256});
+    size_t broadcasts = options.get("broadcasts", size_t{200});
+    size_t churn_every = std::max<size_t>(options.get("churn_every", size_t{10}), 1);
+
+    FanoutConfig fanout;
+    fanout.shard_members = options.get("shard_members", size_t{2500});
+    fanout.pace_sessions = options.get("pace_sessions", fanout.pace_sessions);
+    Room::configure_fanout(fanout);
+
+    std::printf("sharded fanout: %zu members, %zu io_context(s) x %zu threads, %zu shards of %zu paced every %zu\n",
+                rig_config.members, rig_config.contexts, rig_config.threads_per_context,
+                (rig_config.members + fanout.shard_members - 1) / fanout.shard_members, fanout.shard_members,
+                fanout.pace_sessions);
+
+    bench::QuietStdout quiet;
+    bench::FanoutRig rig(rig_config);
+    // warm up the sessions' write paths before measuring
+    rig.broadcast(10, std::chrono::microseconds(0));
+    size_t moved = 0;
+    auto churn = [&](size_t index){
+        if(index > 0 && index % churn_every == 0){
+            const auto& session = rig.sessions()[moved++ % rig.sessions().size()];
+            rig.room().leave(session);
+            rig.room().join(session);
+        }
+    };
+    for(bool churning : {false, true}){
+        auto report = churning ? rig.broadcast(broadcasts, std::chrono::microseconds(0), churn)
+                               : rig.broadcast(broadcasts, std::chrono::microseconds(0));
+        std::printf("%s: %llu/%llu frames received, %llu out of order, %.0f frames/s\n",
+                    churning ? "with churn" : "steady",
+                    static_cast<unsigned long long>(report.received), static_cast<unsigned long long>(report.expected),
+                    static_cast<unsigned long long>(report.out_of_order),
+                    bench::per_second(report.received, report.elapsed));
+        bench::print_latency("first->last member", report.spread);
+        bench::print_latency("broadcast->last member", report.delivered);
+    }
+    auto& stats = Room::fanout_stats();
+    std::printf("server: %llu sharded broadcasts, %llu shard tasks, %llu paced yields\n",
+                static_cast<unsigned long long>(stats.sharded_broadcasts.load()),
+                static_cast<unsigned long long>(stats.shard_tasks.load()),
+                static_cast<unsigned long long>(stats.paced_yields.load()));
+    bench::print_latency("queued spread", stats.spread.snapshot());
+    return 0;
+}
@@ -0,0 +1,115 @@
+// WAL append (user-050).
+//
+// threads appenders each append a message to a WriteAheadLog in a scratch
+// directory and wait for its sync, the way message_barrack does, for every
+// WalSync policy in turn. Synced records are released in batches as the
+// writer would, so segments are recycled. Reports appends/s, the
+// append->synced latency, msyncs and appends per msync.
+//
+//   wal_append --threads=8 --appends=20000 --bytes=128 --segment_mb=16
+//              --dir=/tmp
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+#include <unistd.h>
+#include "BenchSupport.hpp"
+#include "WriteAheadLog.hpp"
+
+namespace {
+
+struct Sweep {
+    size_t threads;
+    size_t appends;         // per thread
+    size_t bytes;
+    size_t segment_bytes;
+    std::filesystem::path root;
+};
+
+void measure(const char* label, WalSync policy, const Sweep& sweep){
+    auto directory = sweep.root / ("wal-append-" + std::to_string(::getpid()) + "-" + label);
+    std::filesystem::remove_all(directory);
+    uint64_t failed = 0;
+    LatencyHistogram latency;
+    bench::Clock::duration elapsed{};
+    WalStats stats{};
+    {
+        WriteAheadLog wal(WalConfig{directory.string(), sweep.segment_bytes, policy});
+        auto opened = wal.open([](ChatMessage&&, WriteAheadLog::Lsn){});
+        if(std::holds_alternative<Error>(opened)){
+            std::printf("  %-7s could not open %s: %s\n", label, directory.c_str(),
+                        std::get<Error>(opened).message.c_str());
+            return;
+        }
+
+        std::vector<uint64_t> failures(sweep.threads, 0);
+        std::vector<std::thread> appenders;
+        auto started = bench::Clock::now();
+        for(size_t t = 0; t < sweep.threads; ++t){
+            appenders.emplace_back([&, t]{
+                std::string barrack = "barrack-" + std::to_string(t);
+                std::string content(sweep.bytes, 'x');
+                std::vector<WriteAheadLog::Lsn> synced;
+                for(size_t i = 0; i < sweep.appends; ++i){
+                    ChatMessage message("message-" + std::to_string(i), barrack, "user",
+                                        content, std::chrono::system_clock::now(), i + 1);
+                    auto sent = bench::Clock::now();
+                    auto logged = wal.append(message);
+                    if(std::holds_alternative<Error>(logged)){
+                        ++failures[t];
+                        continue;
+                    }
+                    auto lsn = std::get<WriteAheadLog::Lsn>(logged);
+                    if(std::holds_alternative<Error>(wal.sync(lsn))){
+                        ++failures[t];
+                    }
+                    latency.record(bench::Clock::now() - sent);
+                    synced.push_back(lsn);
+                    if(synced.size() == 256){
+                        wal.release(synced);
+                        synced.clear();
+                    }
+                }
+                wal.release(synced);
+            });
+        }
+        for(auto& appender : appenders){
+            appender.join();
+        }
+        elapsed = bench::Clock::now() - started;
+        stats = wal.stats();
+        for(uint64_t f : failures){
+            failed += f;
+        }
+    }
+    std::filesystem::remove_all(directory);
+
+    auto count = [](uint64_t value){ return static_cast<unsigned long long>(value); };
+    std::printf("  %-7s %9.0f appends/s, %llu msyncs, %.1f appends per msync, %llu failed\n", label,
+                bench::per_second(stats.appends, elapsed), count(stats.syncs),
+                stats.syncs ? static_cast<double>(stats.appends) / static_cast<double>(stats.syncs) : 0.0,
+                count(failed));
+    bench::print_latency("append->synced", latency.snapshot());
+    bench::print_latency("msync", stats.sync_latency);
+}
+
+}
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    Sweep sweep;
+    sweep.threads = options.get("threads", size_t{8});
+    sweep.appends = options.get("appends", size_t{20000});
+    sweep.bytes = options.get("bytes", size_t{128});
+    sweep.segment_bytes = options.get("segment_mb", size_t{16}) * 1024 * 1024;
+    sweep.root = options.get("dir", std::filesystem::temp_directory_path().string());
+
+    std::printf("%zu appenders, %zu appends of %zu bytes each, %zu MiB segments in %s\n",
+                sweep.threads, sweep.appends, sweep.bytes, sweep.segment_bytes / (1024 * 1024), sweep.root.c_str());
+    measure("NONE", WalSync::NONE, sweep);
+    measure("GROUP", WalSync::GROUP, sweep);
+    measure("ALWAYS", WalSync::ALWAYS, sweep);
+    return 0;
+}
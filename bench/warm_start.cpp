@@ -0,0 +1,69 @@
+// Warm start (user-046).
+//
+// Seeds barracks barracks and memberships rows of barrack_members into
+// SQLite, users joins barracks each, then starts rounds fresh
+// BarrackManagers on that database and reports what each warm_start()
+// loaded and its WarmStartStats::elapsed against the one second budget for
+// a million memberships. The Cassandra side is the stand-in, warm_start
+// does not read it.
+//
+//   warm_start --memberships=1000000 --barracks=10000 --joins=10 --rounds=3
+//              --db=:memory:
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <variant>
+#include "BarrackManager.hpp"
+#include "BenchSupport.hpp"
+#include "ChatSeed.hpp"
+#include "DatabaseConn.hpp"
+#include "StandInRepo.hpp"
+
+int main(int argc, char** argv){
+    bench::Options options(argc, argv);
+    size_t memberships = options.get("memberships", size_t{1000000});
+    size_t barracks = std::max<size_t>(options.get("barracks", size_t{10000}), 1);
+    size_t joins = std::clamp<size_t>(options.get("joins", size_t{10}), 1, barracks);
+    size_t rounds = std::max<size_t>(options.get("rounds", size_t{3}), 1);
+    std::string path = options.get("db", std::string(":memory:"));
+
+    auto database = std::make_shared<DatabaseConnection>(path);
+    database->initialize_database();
+    auto barrack_repo = std::make_shared<BarrackRepository>(database->get_connection());
+    auto seeding = bench::Clock::now();
+    bench::seed_barracks(*barrack_repo, barracks);
+    // row i: user i / joins in its (i % joins)th barrack, spread evenly
+    size_t stride = barracks / joins;
+    bench::seed_members(*database->get_connection(), memberships, [&](size_t i){
+        size_t user = i / joins;
+        return std::make_pair((user + (i % joins) * stride) % barracks, user);
+    });
+    std::printf("%zu barracks, %zu memberships of %zu users seeded in %.2f s (%s)\n", barracks, memberships,
+                (memberships + joins - 1) / joins,
+                std::chrono::duration<double>(bench::Clock::now() - seeding).count(), path.c_str());
+
+    auto repo = std::make_shared<bench::StandInRepo>(std::chrono::microseconds{0}, std::chrono::microseconds{0});
+    // the budget scales with the table: one second per million rows
+    auto budget = std::chrono::milliseconds(std::max<size_t>(memberships / 1000, 1));
+    bool within = true;
+    for(size_t round = 0; round < rounds; ++round){
+        Result<WarmStartStats> loaded = Error{ErrorCode::DATABASE_ERROR, "not run"};
+        {
+            bench::QuietStdout quiet;
+            BarrackManager manager(barrack_repo, repo);
+            loaded = manager.warm_start();
+        }
+        if(std::holds_alternative<Error>(loaded)){
+            std::printf("  round %zu: warm_start failed: %s\n", round + 1, std::get<Error>(loaded).message.c_str());
+            return 1;
+        }
+        const auto& stats = std::get<WarmStartStats>(loaded);
+        within = within && stats.elapsed <= budget;
+        std::printf("  round %zu: %zu barracks, %zu memberships in %lld ms, %.0f memberships/s (budget %lld ms)\n",
+                    round + 1, stats.barracks, stats.memberships, static_cast<long long>(stats.elapsed.count()),
+                    bench::per_second(stats.memberships, stats.elapsed), static_cast<long long>(budget.count()));
+    }
+    std::printf("  %s\n", within ? "every round within budget" : "over budget");
+    return 0;
+}
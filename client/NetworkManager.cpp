@@ -18,9 +18,11 @@ void fail(beast::error_code ec, char const *what)
 NetworkManager::NetworkManager(
     const std::string& host, uint16_t port, net::io_context& ioc,
     ConcurrentQueue<std::string>& inbound_queue,
-    ConcurrentQueue<std::string>& outbound_queue
+    ConcurrentQueue<std::string>& outbound_queue,
+    const std::string& target
 ) : host_(host),
     port_(port),
+    target_(target),
     resolver_(net::make_strand(ioc)),
     ws_(net::make_strand(ioc)),
     inbound_queue_(inbound_queue),
@@ -45,8 +47,96 @@ void NetworkManager::send(std::string& message){
     );
 }
 
+std::future<std::string> NetworkManager::request(const std::string& type, nlohmann::json payload,
+                                                 std::chrono::milliseconds timeout){
+    uint64_t request_id = next_request_id_++;
+    auto timer = std::make_shared<net::steady_timer>(ws_.get_executor(), timeout);
+    std::future<std::string> reply;
+    {
+        std::lock_guard<std::mutex> lock(pending_mtx_);
+        auto& pending = pending_[request_id];
+        pending.timer = timer;
+        reply = pending.promise.get_future();
+    }
+    net::post(ws_.get_executor(), [self = shared_from_this(), request_id, timer]() {
+        {
+            // answered (or failed) before the timer got armed
+            std::lock_guard<std::mutex> lock(self->pending_mtx_);
+            if(self->pending_.find(request_id) == self->pending_.end()){
+                return;
+            }
+        }
+        timer->async_wait([self, request_id](beast::error_code ec) {
+            if(!ec){
+                self->expire_request(request_id);
+            }
+        });
+    });
+    std::string frame = nlohmann::json{
+        {"type", type},
+        {"request_id", request_id},
+        {"payload", std::move(payload)}
+    }.dump();
+    send(frame);
+    return reply;
+}
+
+// Hands the frame to the future waiting for its request_id, if there is one.
+bool NetworkManager::complete_request(const std::string& message){
+    auto json = nlohmann::json::parse(message, nullptr, false);
+    if(json.is_discarded() || !json.is_object()){
+        return false;
+    }
+    auto id = json.find("request_id");
+    if(id == json.end() || !id->is_number_unsigned()){
+        return false;
+    }
+    PendingRequest request;
+    {
+        std::lock_guard<std::mutex> lock(pending_mtx_);
+        auto it = pending_.find(id->get<uint64_t>());
+        if(it == pending_.end()){
+            return false;
+        }
+        request = std::move(it->second);
+        pending_.erase(it);
+    }
+    request.timer->cancel();
+    request.promise.set_value(message);
+    return true;
+}
+
+void NetworkManager::expire_request(uint64_t request_id){
+    PendingRequest request;
+    {
+        std::lock_guard<std::mutex> lock(pending_mtx_);
+        auto it = pending_.find(request_id);
+        if(it == pending_.end()){
+            return;
+        }
+        request = std::move(it->second);
+        pending_.erase(it);
+    }
+    request.promise.set_exception(std::make_exception_ptr(std::runtime_error("request timed out")));
+}
+
+// Runs on the strand, which owns the timers
+void NetworkManager::fail_pending_requests(const std::string& reason){
+    std::unordered_map<uint64_t, PendingRequest> pending;
+    {
+        std::lock_guard<std::mutex> lock(pending_mtx_);
+        pending.swap(pending_);
+    }
+    for(auto& [id, request] : pending){
+        request.timer->cancel();
+        request.promise.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+    }
+}
+
 void NetworkManager::close() {
     net::post(ws_.get_executor(), [self = shared_from_this()]() {
+        // nobody is going to answer them anymore
+        self->fail_pending_requests("connection closed");
         if (self->ws_.is_open()) {
             self->ws_.async_close(websocket::close_code::normal,
                 beast::bind_front_handler(&NetworkManager::on_close, self));
@@ -89,7 +179,7 @@ void NetworkManager::on_connect(beast::error_code ec, tcp::resolver::results_typ
     host_ += ':' + std::to_string(ep.port());
     ws_.async_handshake(
         host_,
-        "/",
+        target_,
         beast::bind_front_handler(
             &NetworkManager::on_handshake,
             shared_from_this()
@@ -138,6 +228,7 @@ void NetworkManager::on_write(beast::error_code ec, std::size_t bytes_transferre
     if (ec) {
         inbound_queue_.push(R"({"type":"DISCONNECTED"})");
         is_writing_ = false;
+        fail_pending_requests("connection lost");
         return fail(ec, "write");
     }
 
@@ -165,10 +256,14 @@ void NetworkManager::on_read(beast::error_code ec, std::size_t bytes_transferred
 
     if (ec) {
         inbound_queue_.push(R"({"type":"DISCONNECTED"})");
+        fail_pending_requests("connection lost");
         return fail(ec, "read");
     }
 
-    inbound_queue_.push(beast::buffers_to_string(buffer_.data()));
+    std::string message = beast::buffers_to_string(buffer_.data());
+    if(!complete_request(message)){
+        inbound_queue_.push(std::move(message));
+    }
     
     buffer_.consume(buffer_.size());
     do_read();
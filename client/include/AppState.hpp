@@ -1,11 +1,17 @@
 #ifndef APPSTATE_H
 #define APPSTATE_H
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <deque>
+#include <set>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
 #include <unordered_map>
+#include <json.hpp>
 #include "types.hpp"
 
 struct Users{
@@ -41,6 +47,13 @@ struct AppState{
     std::unordered_map<std::string, Barracks> total_barracks_;
     std::deque<ChatMessage> chat_history_;
     static const size_t MAX_HISTORY = 200;
+    // barrack id -> seq up to which no message is missing, sent with SYNC on
+    // reconnect. Broadcasts of concurrent senders may arrive out of seq
+    // order, so the seqs past a gap are held until it fills.
+    std::unordered_map<std::string, uint64_t> barrack_cursors_;
+    std::unordered_map<std::string, std::set<uint64_t>> held_seqs_;
+    static constexpr size_t MAX_HELD = 64;
+    static constexpr const char* CURSOR_FILE = ".cli-chat-cursors.json";
 
     void set_connected(){
         conn_status_ = ConnectionStatus::DISCONNECTED;
@@ -58,15 +71,144 @@ struct AppState{
         current_barrack_id_.clear();
         current_barrack_name_.clear();
         barrack_members_.clear();
+        barrack_cursors_.clear();
+        held_seqs_.clear();
         clear_history();
     }
     void add_chat_message(ChatMessage message){
         if(chat_history_.size() >= MAX_HISTORY){
             chat_history_.pop_front();
         }
+        advance_cursor(message.barrack_id, message.seq);
         chat_history_.push_back(std::move(message));
     }
 
+    // A broadcast moves the cursor only when no seq is missing before it.
+    // Returns true each time a gap has held back another MAX_HELD messages:
+    // a seq can be skipped for good (its send failed) and only a SYNC tells.
+    bool advance_cursor(const std::string& barrack_id, uint64_t seq){
+        auto& cursor = barrack_cursors_[barrack_id];
+        if(seq <= cursor){
+            return false;
+        }
+        if(seq != cursor + 1){
+            auto& held = held_seqs_[barrack_id];
+            return held.insert(seq).second && held.size() % MAX_HELD == 0;
+        }
+        cursor = seq;
+        release_held(barrack_id, cursor);
+        return false;
+    }
+
+    // A SYNC reply lists every message stored past the cursor in seq order,
+    // so the seqs it skips do not exist and the cursor moves past them.
+    void settle_cursor(const std::string& barrack_id, uint64_t seq){
+        auto& cursor = barrack_cursors_[barrack_id];
+        cursor = std::max(cursor, seq);
+        release_held(barrack_id, cursor);
+    }
+
+    // Drops the held seqs the cursor passed and takes the ones that follow it
+    void release_held(const std::string& barrack_id, uint64_t& cursor){
+        auto itr = held_seqs_.find(barrack_id);
+        if(itr == held_seqs_.end()){
+            return;
+        }
+        auto& held = itr->second;
+        held.erase(held.begin(), held.upper_bound(cursor));
+        while(!held.empty() && *held.begin() == cursor + 1){
+            cursor = *held.begin();
+            held.erase(held.begin());
+        }
+        if(held.empty()){
+            held_seqs_.erase(itr);
+        }
+    }
+
+    // Moves the cursors past the messages of a RECEIVE_MESSAGE_BROADCAST or
+    // a SYNC reply. Returns true when a SYNC should follow: the reply has
+    // more to fetch, or a gap is holding back broadcasts (see advance_cursor).
+    bool track_cursors(const nlohmann::json& frame){
+        auto type = frame.find("type");
+        auto payload = frame.find("payload");
+        if(type == frame.end() || !type->is_string() || payload == frame.end() || !payload->is_object()){
+            return false;
+        }
+        auto advance = [this](const nlohmann::json& message, bool synced){
+            auto barrack_id = message.find("barrack_id");
+            auto seq = message.find("seq");
+            if(barrack_id == message.end() || !barrack_id->is_string() || seq == message.end() || !seq->is_number_unsigned()){
+                return false;
+            }
+            if(synced){
+                settle_cursor(barrack_id->get<std::string>(), seq->get<uint64_t>());
+                return false;
+            }
+            return advance_cursor(barrack_id->get<std::string>(), seq->get<uint64_t>());
+        };
+        if(*type == "RECEIVE_MESSAGE_BROADCAST"){
+            return advance(*payload, false);
+        }
+        if(*type != "SYNC" || !payload->contains("messages") || !(*payload)["messages"].is_array()){
+            return false;
+        }
+        for(const auto& message : (*payload)["messages"]){
+            advance(message, true);
+        }
+        return payload->value("more", false);
+    }
+
+    // Payload of the SYNC command: {"cursors": {"<barrack_id>": seq, ...}}
+    nlohmann::json sync_payload() const {
+        return {{"cursors", barrack_cursors_}};
+    }
+
+    // Cursors are kept per user so a different login starts from scratch.
+    // The file is replaced atomically so a crash never leaves it half written.
+    bool save_cursors(const std::filesystem::path& path = CURSOR_FILE) const {
+        nlohmann::json stored = nlohmann::json::object();
+        if(auto existing = read_cursor_file(path)){
+            stored = std::move(*existing);
+        }
+        stored[user_id_] = barrack_cursors_;
+        auto tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            if(!(out << stored.dump())){
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        return !ec;
+    }
+
+    bool load_cursors(const std::filesystem::path& path = CURSOR_FILE){
+        auto stored = read_cursor_file(path);
+        if(!stored || !stored->contains(user_id_)){
+            return false;
+        }
+        for(const auto& [barrack_id, seq] : (*stored)[user_id_].items()){
+            if(seq.is_number_unsigned()){
+                settle_cursor(barrack_id, seq.get<uint64_t>());
+            }
+        }
+        return true;
+    }
+
+    static std::optional<nlohmann::json> read_cursor_file(const std::filesystem::path& path){
+        std::ifstream in(path);
+        if(!in){
+            return std::nullopt;
+        }
+        auto stored = nlohmann::json::parse(in, nullptr, false);
+        if(stored.is_discarded() || !stored.is_object()){
+            return std::nullopt;
+        }
+        return stored;
+    }
+
     std::string get_userid(){
         return user_id_;
     }
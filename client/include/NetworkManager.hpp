@@ -7,13 +7,18 @@
 #include "boost/beast/core/error.hpp"
 #include "boost/beast/websocket.hpp"
 #include "boost/asio/dispatch.hpp"
+#include "boost/asio/steady_timer.hpp"
 #include "boost/asio/strand.hpp"
 
 #include <cstdint>
 #include <thread>
 #include <condition_variable>
 #include <chrono>
+#include <future>
+#include <mutex>
+#include <unordered_map>
 #include <ConcurrentQueue.hpp>
+#include <json.hpp>
 
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
@@ -29,20 +34,32 @@ class NetworkManager : public std::enable_shared_from_this<NetworkManager> {
         uint16_t port,
         net::io_context& ioc,
         ConcurrentQueue<std::string>& inbound_queue,
-        ConcurrentQueue<std::string>& outbound_queue
+        ConcurrentQueue<std::string>& outbound_queue,
+        const std::string& target = "/"
     ){
-        return std::shared_ptr<NetworkManager>(new NetworkManager(host, port, ioc, inbound_queue, outbound_queue));
+        return std::shared_ptr<NetworkManager>(new NetworkManager(host, port, ioc, inbound_queue, outbound_queue, target));
     }
     
     void run();
     void send(std::string& message);
+    // Pipelined request: tags the frame with a fresh request_id and returns
+    // a future for the reply carrying the same id. Any number of requests may
+    // be outstanding and their replies can arrive in any order; frames
+    // without a matching id (broadcasts, pushes) still go to inbound_queue.
+    // Without a reply within timeout the future fails, as does every
+    // outstanding one when the connection is lost or closed.
+    std::future<std::string> request(const std::string& type, nlohmann::json payload,
+                                     std::chrono::milliseconds timeout = DEFAULT_REQUEST_TIMEOUT);
     void close();
+
+    static constexpr std::chrono::milliseconds DEFAULT_REQUEST_TIMEOUT{10000};
         
     private:
     NetworkManager(
         const std::string& host, uint16_t port, net::io_context& ioc,
         ConcurrentQueue<std::string>& inbound_queue,
-        ConcurrentQueue<std::string>& outbound_queue
+        ConcurrentQueue<std::string>& outbound_queue,
+        const std::string& target
     );
 
 
@@ -56,8 +73,15 @@ class NetworkManager : public std::enable_shared_from_this<NetworkManager> {
         void on_write(beast::error_code ec, std::size_t bytes_transferred);
 
         void on_close(beast::error_code ec);
+        bool complete_request(const std::string& message);
+        // Called on the strand when a request's timer fired
+        void expire_request(uint64_t request_id);
+        void fail_pending_requests(const std::string& reason);
         std::string host_;
         uint16_t port_;
+        // Upgrade target; "/?barrack=<id>" asks a server running in room
+        // placement mode to put this connection next to that barrack's room
+        std::string target_;
 
         tcp::resolver resolver_;
         websocket::stream<beast::tcp_stream> ws_;
@@ -69,6 +93,16 @@ class NetworkManager : public std::enable_shared_from_this<NetworkManager> {
         // State for the write loop
         std::deque<std::string> write_queue_;
         std::atomic<bool> is_writing_{false};
+
+        // Outstanding pipelined requests keyed by request_id; the timer runs
+        // on the strand and is cancelled once the request is answered
+        struct PendingRequest {
+            std::promise<std::string> promise;
+            std::shared_ptr<net::steady_timer> timer;
+        };
+        std::atomic<uint64_t> next_request_id_{1};
+        std::mutex pending_mtx_;
+        std::unordered_map<uint64_t, PendingRequest> pending_;
 };
 
 #endif
\ No newline at end of file
@@ -3,29 +3,78 @@
 #include <ftxui/dom/elements.hpp>
 #include <ftxui/screen/screen.hpp>
 
+#include <AppState.hpp>
 #include <NetworkManager.hpp>
+#include <atomic>
+#include <csignal>
 #include <iostream>
 
+static std::atomic<bool> running{true};
+
+static void on_signal(int){
+  running = false;
+}
+
+// Asks for everything missed since the stored cursors
+static void send_sync(NetworkManager& net_manager, const AppState& app){
+  if(app.barrack_cursors_.empty()){
+    return;
+  }
+  std::string sync_json = nlohmann::json{{"type", "SYNC"}, {"payload", app.sync_payload()}}.dump();
+  net_manager.send(sync_json);
+}
+
 int main() {
-  std::stringstream ss;
   net::io_context ioc;
 
   ConcurrentQueue<std::string> inbound_queue;
   ConcurrentQueue<std::string> outbound_queue;
+  AppState app;
 
   auto net_manager = NetworkManager::Create("localhost", 8080, ioc, inbound_queue, outbound_queue);
   net_manager->run();
 
   std::thread network_thread([&ioc]{ioc.run();});
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+
+  while(running){
+    auto msg = inbound_queue.try_pop();
+    if(!msg.has_value()){
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    std::cout << msg.value() << std::endl;
 
-  while(true){
-    std::string login_json = R"({"type":"LOGIN", "payload":{"username":"user", "password":"pass"}})";
-    net_manager->send(login_json);
-    if(auto msg = inbound_queue.try_pop()){
-      if(msg.has_value()){
-        std::cout << msg.value();
-      }
+    auto frame = nlohmann::json::parse(msg.value(), nullptr, false);
+    if(frame.is_discarded() || !frame.is_object()){
+      continue;
     }
+    std::string type = frame.value("type", "");
+    if(type == "CONNECTED"){
+      std::string login_json = R"({"type":"LOGIN", "payload":{"username":"user", "password":"pass"}})";
+      net_manager->send(login_json);
+    }
+    else if(type == "AUTH_SUCCESS"){
+      app.set_login_success(frame["payload"].value("user_id", ""), "user");
+      app.load_cursors();
+      send_sync(*net_manager, app);
+    }
+    else if(type == "DISCONNECTED"){
+      break;
+    }
+    else if(app.track_cursors(frame)){
+      // a SYNC reply was cut short or a gap holds broadcasts back,
+      // continue from the cursors
+      send_sync(*net_manager, app);
+    }
+  }
+
+  if(!app.user_id_.empty() && !app.save_cursors()){
+    std::cerr << "Could not save the message cursors to " << AppState::CURSOR_FILE << std::endl;
   }
+  net_manager->close();
+  ioc.stop();
+  network_thread.join();
   return 0;
-}
\ No newline at end of file
+}
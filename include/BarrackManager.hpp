@@ -1,42 +1,106 @@
 #ifndef BARRACK_MANAGER_H
 #define BARRACK_MANAGER_H
 
-#include <thread>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
+#include <string_view>
 #include <unordered_map>
 #include <mutex>
 #include <sodium.h>
 
-#include "ConcurrentQueue.hpp"
 #include "Error.hpp"
+#include "InternTable.hpp"
 #include <variant>
 #include "BarrackRepo.hpp"
 #include "MessageRepo.hpp"
+#include "MessageWriter.hpp"
 #include "types.hpp"
 
+// Bounds on the recent message history kept in memory, see main.
+struct HistoryConfig {
+    // newest messages each barrack keeps in its ring
+    size_t ring_capacity = 1024;
+    // all rings together; past it the least recently used histories are dropped
+    size_t budget_bytes = 64 * 1024 * 1024;
+};
+
+// Reported under "history" in the dispatcher stats.
+struct HistoryStats {
+    size_t bytes;               // estimated size of every cached history
+    size_t budget_bytes;
+    size_t cached_barracks;
+    uint64_t hits;              // reads served from memory alone
+    uint64_t misses;            // reads that went to Cassandra
+    uint64_t evictions;         // histories dropped to get under the budget
+};
+
+// What warm_start() loaded.
+struct WarmStartStats {
+    size_t barracks;
+    size_t memberships;
+    std::chrono::milliseconds elapsed;
+};
+
 class BarrackManager{
     public:
         using BarrackResult = Result<std::string>;
         using StatusResult = std::variant<Success, Error>;
+        using MessageResult = Result<ChatMessage>;
+
+        // messages get_barrack_messages returns, as many as the Cassandra query
+        static constexpr size_t RECENT_MESSAGES = 50;
 
         BarrackManager(std::shared_ptr<BarrackRepository> barrack_repo,
-                        std::shared_ptr<MessageRepository> msg_repo) 
-            : barrack_repo_(barrack_repo), msg_repo_(msg_repo)  {
-                message_dispatcher_ = std::thread(&BarrackManager::dispatch_cass_message, this);
+                        std::shared_ptr<MessageRepository> msg_repo,
+                        HistoryConfig history_config = {},
+                        WriterConfig writer_config = {},
+                        std::shared_ptr<WriteAheadLog> wal = nullptr) 
+            : history_config_(history_config), barrack_repo_(barrack_repo), msg_repo_(msg_repo), wal_(wal)  {
+                writer_ = std::make_unique<MessageWriter>(msg_repo_, writer_config, wal_,
+                                                          [this](const std::vector<ChatMessage>& batch){ settle_history(batch); });
             }
         ~BarrackManager();
+        // Loads every barrack and membership from SQLite in two bulk scans, so
+        // membership checks work right after a restart. Run once at startup
+        // before the server accepts connections; state created meanwhile wins
+        // over the loaded rows.
+        Result<WarmStartStats> warm_start();
+        // Opens the WAL and queues the messages it still holds for Cassandra
+        // again, restoring each barrack's seq and recent history. Run after
+        // warm_start(), records of barracks that are gone are dropped.
+        Result<size_t> replay_wal();
         BarrackResult create_barrack(const std::string& barrack_name, const std::string& owner_uid, bool is_private, std::optional<std::string> password);
         StatusResult destroy_barrack(const std::string& barrack_id, const std::string& owener_uid);
 
         StatusResult join_barrack(const std::string& barrack_id, const std::string& user_id, std::optional<std::string> password);
         StatusResult leave_barrack(const std::string& barrack_id, const std::string& user_id);
-        StatusResult message_barrack(const std::string& barrack_id, const std::string& user_id, const std::string& message);
+        // Accepted messages come back with their per-barrack seq assigned.
+        // With a WAL, a message reaches the history and the writer only once
+        // it is on disk; a failed sync fails the send and the message is
+        // dropped, leaving a gap in the barrack's seq.
+        MessageResult message_barrack(const std::string& barrack_id, const std::string& user_id, const std::string& message);
+        // messages are (user_id, content) pairs, results are returned in the same order
+        std::vector<MessageResult> message_barrack_batch(const std::string& barrack_id,
+                                                         const std::vector<std::pair<std::string, std::string>>& messages);
 
         std::optional<Barrack> get_barrack(const std::string& barrack_id);
+        // Every barrack, oldest first, from the published catalog
         std::optional<std::vector<Barrack>> get_all_barracks();
         std::optional<BarrackMember> get_barrack_member(const std::string& barrack_id, const std::string& user_id);
         std::optional<std::vector<BarrackMember>> get_barrack_members(const std::string& barrack_id);
+        // The RECENT_MESSAGES newest messages, from the history ring when it
+        // holds them, otherwise from messages_by_seq merged with the ring by seq.
         std::optional<std::vector<ChatMessage>> get_barrack_messages(const std::string& barrack_id);
+        // Up to limit messages with seq > after_seq, oldest first. Served from
+        // the in-memory history when it reaches back far enough, otherwise
+        // the older part is read from Cassandra.
+        Result<std::vector<ChatMessage>> get_messages_since(const std::string& barrack_id, uint64_t after_seq, size_t limit);
+
+        HistoryStats history_stats() const;
+        WriterStats writer_stats() const { return writer_->stats(); }
+        std::optional<WalStats> wal_stats() const;
 
     private:
         
@@ -45,16 +109,93 @@ class BarrackManager{
         std::string hash_password(const std::string& passowrd, const std::string& salt);
         bool verify_password(const std::string& hashed_password, const std::string& stored_hash);
         std::string generate_salt();
-        std::unordered_map<std::string, Barrack> barracks_;                                 // barrack id -> barrack
-        std::unordered_map<std::string, std::vector<BarrackMember>> barracks_members_;      // barrack id -> members
-        std::unordered_map<std::string, std::vector<ChatMessage>> barracks_messages_;       // barrack id -> messages
-        void dispatch_cass_message();
-            
-        ConcurrentQueue<ChatMessage> message_queue_;
-        std::mutex mtx_;
-        std::thread message_dispatcher_;
+
+        struct IdHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view id) const { return std::hash<std::string_view>{}(id); }
+        };
+        // interned user id -> joined at; membership checks on the send path
+        // are an integer probe and each user's id is stored once in user_ids_
+        using MemberSet = std::unordered_map<InternTable::Handle, std::chrono::system_clock::time_point>;
+
+        // Everything the manager keeps about one barrack. Operations on a
+        // barrack are serialized by its own mutex, so they stay ordered while
+        // unrelated barracks never share a lock.
+        //
+        // history_ is a ring of the newest messages in seq order. Messages
+        // only leave it once the Cassandra writer is done with them
+        // (seq <= settled_seq_), so anything missing from memory can be read
+        // back from the database.
+        //
+        // unsynced_ holds messages in the WAL that are not on disk yet, in
+        // seq order. Whoever's sync returns first publishes them, so the
+        // history and the writer never see a later seq before an earlier one.
+        struct BarrackState {
+            std::mutex mtx_;
+            MemberSet members_;
+            std::deque<ChatMessage> history_;
+            std::deque<std::pair<ChatMessage, WriteAheadLog::Lsn>> unsynced_;
+            size_t history_bytes_ = 0;
+            uint64_t seq_ = 0;                      // last assigned message seq
+            uint64_t settled_seq_ = 0;              // messages up to here went through the writer
+            bool seq_loaded_ = false;
+            std::atomic<uint64_t> last_used_{0};    // history clock tick of the last read or write
+        };
+        using StateMap = std::unordered_map<std::string, std::shared_ptr<BarrackState>, IdHash, std::equal_to<>>;
+        using Catalog = std::unordered_map<std::string, Barrack>;
+
+        // Lookups in the published state map, without states_mtx_; nullptr
+        // if the barrack has no state in this process yet.
+        std::shared_ptr<BarrackState> find_state(std::string_view barrack_id) const;
+        std::shared_ptr<BarrackState> state_for(const std::string& barrack_id);
+        void drop_state(const std::string& barrack_id);
+        // Copy-on-write update of the barrack catalog. Caller holds catalog_mtx_.
+        template<typename Edit>
+        void update_catalog(Edit&& edit);
+
+        // History upkeep. The first two are called with state.mtx_ held.
+        void append_history(BarrackState& state, const ChatMessage& message);
+        // Drops settled messages from the front until at most keep remain
+        void trim_history(BarrackState& state, size_t keep);
+        void touch_history(BarrackState& state);
+        // Drops the least recently used histories until the rings are back
+        // under three quarters of the budget. Only run by the writer thread.
+        void evict_cold_histories();
+        // Called with state.mtx_ held once the WAL answered for upto: moves
+        // the unsynced messages up to it into the history and the writer,
+        // and releases the ones whose sync failed so replay skips them.
+        void publish_synced(BarrackState& state, WriteAheadLog::Lsn upto);
+        // Called by the writer once a batch went to Cassandra (or failed)
+        void settle_history(const std::vector<ChatMessage>& batch);
+        // Seeds the barrack's seq from Cassandra the first time it is used.
+        // On failure nothing is cached and the next send tries again; a
+        // guessed seq would reuse numbers and overwrite stored messages.
+        StatusResult load_seq(BarrackState& state, const std::string& barrack_id);
+        // Sends turned away because the writer's backlog is full; nothing was logged
+        static Error backlog_full_error();
+
+        // Both maps are immutable snapshots: readers load the current one and
+        // never wait for a writer, which (barrack creation, first use,
+        // destruction) copies, modifies and publishes under its mutex. The
+        // atomic shared_ptr is not lock free in libstdc++, load and store
+        // take a short internal lock around the reference count.
+        std::atomic<std::shared_ptr<const StateMap>> states_{std::make_shared<const StateMap>()};
+        std::mutex states_mtx_;
+        std::atomic<std::shared_ptr<const Catalog>> barracks_{std::make_shared<const Catalog>()};   // barrack id -> barrack
+        std::mutex catalog_mtx_;
+
+        InternTable user_ids_;
+        HistoryConfig history_config_;
+        std::atomic<size_t> history_bytes_{0};
+        std::atomic<uint64_t> history_clock_{0};
+        std::atomic<uint64_t> history_hits_{0};
+        std::atomic<uint64_t> history_misses_{0};
+        std::atomic<uint64_t> history_evictions_{0};
+
         std::shared_ptr<BarrackRepository> barrack_repo_;
         std::shared_ptr<MessageRepository> msg_repo_;
+        std::shared_ptr<WriteAheadLog> wal_;
+        std::unique_ptr<MessageWriter> writer_;     // settles into the histories above
 };
 
 #endif
\ No newline at end of file
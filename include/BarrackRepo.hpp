@@ -2,8 +2,11 @@
 #define BARRACKREPOSITORY_H
 
 #include <SQLiteCpp/SQLiteCpp.h>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 #include "types.hpp"
@@ -23,6 +26,16 @@ public:
     Result<std::vector<BarrackMember>> get_members(const std::string& barrack_id);
     Result<std::vector<Barrack>> get_all_barracks();
 
+    // Bulk scans for the startup warm start. Rows are handed to visit as they
+    // are stepped, the table is never held in memory; both return the row count.
+    // Barracks come without their password hash and salt.
+    Result<size_t> for_each_barrack(const std::function<void(Barrack&&)>& visit);
+    // In table order, not grouped by barrack: a barrack's members may come
+    // interleaved with others'. The views are only valid during the call.
+    using MemberVisitor = std::function<void(std::string_view barrack_id, std::string_view user_id,
+                                             std::chrono::system_clock::time_point joined_at)>;
+    Result<size_t> for_each_member(const MemberVisitor& visit);
+
 private:
     std::shared_ptr<SQLite::Database> db_;
 };
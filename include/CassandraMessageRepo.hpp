@@ -19,11 +19,41 @@ static constexpr const char* CREATE_MESSAGES_TABLE_QUERY =
         "    PRIMARY KEY (barrack_id, message_id)"
         ") WITH CLUSTERING ORDER BY (message_id DESC);";
 
+// Same messages keyed by their per-barrack sequence, so a reconnecting
+// client can read exactly the range it missed.
+static constexpr const char* CREATE_MESSAGES_BY_SEQ_TABLE_QUERY =
+        "CREATE TABLE IF NOT EXISTS chat_app.messages_by_seq ("
+        "    barrack_id text,"
+        "    seq bigint,"
+        "    message_id text,"
+        "    sender_id text,"
+        "    content text,"
+        "    timestamp timestamp,"
+        "    PRIMARY KEY (barrack_id, seq)"
+        ") WITH CLUSTERING ORDER BY (seq ASC);";
+
 static constexpr const char* ADD_MESSAGE_TO_DATABASE = 
         "INSERT INTO chat_app.messages "
         "(barrack_id, message_id, sender_id, content, timestamp)"
         "VALUES (?, ?, ?, ?, ?)";
 
+static constexpr const char* ADD_MESSAGE_BY_SEQ =
+        "INSERT INTO chat_app.messages_by_seq "
+        "(barrack_id, seq, message_id, sender_id, content, timestamp)"
+        "VALUES (?, ?, ?, ?, ?, ?)";
+
+static constexpr const char* GET_MESSAGES_SINCE =
+        "SELECT barrack_id, seq, message_id, sender_id, content, timestamp "
+        "FROM chat_app.messages_by_seq WHERE barrack_id = ? AND seq > ? LIMIT ?";
+
+static constexpr const char* GET_LATEST_MESSAGES =
+        "SELECT barrack_id, seq, message_id, sender_id, content, timestamp "
+        "FROM chat_app.messages_by_seq WHERE barrack_id = ? ORDER BY seq DESC LIMIT ?";
+
+static constexpr const char* GET_LATEST_SEQ =
+        "SELECT seq FROM chat_app.messages_by_seq "
+        "WHERE barrack_id = ? ORDER BY seq DESC LIMIT 1";
+
 static constexpr const char* GET_MESSAGES = 
         "SELECT barrack_id, message_id, sender_id, content, timestamp "
         "FROM chat_app.messages WHERE barrack_id = ? LIMIT ?";
@@ -32,6 +62,10 @@ static constexpr const char* DELETE_BARRACK_MESSAGES =
         "DELETE FROM chat_app.messages "
         "WHERE barrack_id = ?";
 
+static constexpr const char* DELETE_BARRACK_MESSAGES_BY_SEQ =
+        "DELETE FROM chat_app.messages_by_seq "
+        "WHERE barrack_id = ?";
+
 struct CassandraConnection {
     CassCluster *cluster = nullptr;
     CassSession *session = nullptr;
@@ -53,15 +87,32 @@ class CassandraMessageRepo : public MessageRepository {
         ~CassandraMessageRepo();
         Result<std::monostate> init_database();
         Result<std::monostate> add(const ChatMessage& message) override;
+        Result<std::monostate> add_batch(const std::vector<ChatMessage>& messages) override;
+        void add_batch_async(const std::vector<ChatMessage>& messages, WriteCallback done) override;
         Result<std::vector<ChatMessage>> get_for_barrack(const std::string& barrack_id, int limit) override;
+        Result<std::vector<ChatMessage>> get_since(const std::string& barrack_id, uint64_t after_seq, int limit) override;
+        Result<std::vector<ChatMessage>> get_latest(const std::string& barrack_id, int limit) override;
+        Result<uint64_t> get_latest_seq(const std::string& barrack_id) override;
         Result<std::monostate> delete_barrack_messages(const std::string& barrack_id) override;
     private:
         std::shared_ptr<CassandraConnection> conn_;
         Result<std::monostate> execute_simple_query(const char* query);
+        Result<std::monostate> bind_message(CassStatement* statement, const ChatMessage& message);
+        Result<std::monostate> bind_message_by_seq(CassStatement* statement, const ChatMessage& message);
+        // Adds the inserts into both message tables to the batch
+        Result<std::monostate> add_to_batch(CassBatch* batch, const ChatMessage& message);
+        Result<std::monostate> execute_for_barrack(const CassPrepared* prepared, const std::string& barrack_id);
+        // Runs a bound query on messages_by_seq and reads its rows
+        Result<std::vector<ChatMessage>> execute_by_seq(CassStatement* statement, const char* query_name);
         bool prepare_statements();
         const CassPrepared* add_message_prepared_ = nullptr;
         const CassPrepared* get_message_prepared_ = nullptr;
         const CassPrepared* delete_barrack_messages_prepared_ = nullptr;
+        const CassPrepared* add_message_by_seq_prepared_ = nullptr;
+        const CassPrepared* get_messages_since_prepared_ = nullptr;
+        const CassPrepared* get_latest_messages_prepared_ = nullptr;
+        const CassPrepared* get_latest_seq_prepared_ = nullptr;
+        const CassPrepared* delete_barrack_messages_by_seq_prepared_ = nullptr;
 };
 
 #endif
\ No newline at end of file
@@ -1,15 +1,43 @@
 #ifndef CLIENTSESSION_H
 #define CLIENTSESSION_H
 
+#include <array>
 #include <memory>
 #include <chrono>
 #include <deque>
+#include <optional>
+#include <vector>
 #include "net.hpp"
 #include "MessageDispatcher.hpp"
 
 
 using c_time = std::chrono::steady_clock;
 class ConnectionManager;
+class ClientSession;
+
+// While alive, replies sent to `session` from this thread are appended to
+// `replies` instead of being written, so the dispatcher can answer a BATCH
+// frame with a single frame. Other sessions and broadcasts are unaffected.
+class ReplyCapture {
+    public:
+        ReplyCapture(const ClientSession* session, std::vector<std::string>& replies) :
+            session_(session), replies_(replies), previous_(current_) {
+            current_ = this;
+        }
+        ~ReplyCapture() { current_ = previous_; }
+        ReplyCapture(const ReplyCapture&) = delete;
+        ReplyCapture& operator=(const ReplyCapture&) = delete;
+
+        // The capture buffer for session on this thread, or nullptr
+        static std::vector<std::string>* replies_for(const ClientSession* session){
+            return current_ && current_->session_ == session ? &current_->replies_ : nullptr;
+        }
+    private:
+        const ClientSession* session_;
+        std::vector<std::string>& replies_;
+        ReplyCapture* previous_;
+        static thread_local ReplyCapture* current_;
+};
 
 enum ConnStatus{
     HANDSHAKING = 0,
@@ -23,6 +51,7 @@ enum ConnStatus{
 class ClientSession : public std::enable_shared_from_this<ClientSession> {
     public:
         using SessionID = uint64_t;
+        using UpgradeRequest = http::request<http::string_body>;
 
     private:
         websocket::stream<beast::tcp_stream> ws_;
@@ -30,7 +59,19 @@ class ClientSession : public std::enable_shared_from_this<ClientSession> {
         std::weak_ptr<ConnectionManager> conn_manager_;
         std::weak_ptr<MessageDispatcher> message_dispatcher_;
         SessionID session_id_;
-        std::deque<std::string> write_msg_;
+        // A queued frame remembers which command produced it (if any) so the
+        // flush latency can be attributed once the write completes.
+        // Broadcast frames are shared between all recipients instead of
+        // being copied into every queue.
+        struct PendingWrite {
+            std::string data;
+            std::shared_ptr<const std::string> shared;
+            int command;
+            c_time::time_point queued_at;
+
+            const std::string& bytes() const { return shared ? *shared : data; }
+        };
+        std::deque<PendingWrite> write_msg_;
         bool is_writing_ = false;
         
         std::string client_ip_;
@@ -38,15 +79,38 @@ class ClientSession : public std::enable_shared_from_this<ClientSession> {
         c_time::time_point conn_time_;
         c_time::time_point last_activity_;
         ConnStatus status_;
+        // set once close_session() ran, before the session is unregistered
+        std::atomic<bool> closed_{false};
         std::string authenticated_user_id_;
         std::atomic<uint64_t> next_sequence_id_{0};
+        // Pipelining window: a client may have up to max_in_flight_ commands
+        // queued or executing. Once the window is full the session stops
+        // reading until a command completes, so back-pressure reaches the
+        // client through TCP instead of growing the dispatcher queue.
+        // Commands complete in whatever order the workers finish them.
+        size_t max_in_flight_;
+        std::atomic<size_t> in_flight_{0};
+        std::atomic<bool> read_paused_{false};
+        // Commands of this session waiting in each dispatcher lane. A new
+        // command is queued no higher than the least urgent lane still
+        // holding one of them, so a session's commands are dequeued in the
+        // order they arrived. That is all: different workers may take
+        // consecutive commands and run them at the same time, so a
+        // LEAVEBARRACK dequeued right after its SEND can still finish first.
+        std::array<std::atomic<uint32_t>, MessageDispatcher::LANE_COUNT> queued_in_lane_{};
+        // Upgrade request read before the session was created, if any
+        std::optional<UpgradeRequest> upgrade_;
 
         void close_session(websocket::close_reason = {});
         void update_last_activity();
         void do_actual_write();
+        bool pause_if_window_full();
     public:
-        explicit ClientSession(tcp::socket&&, ClientSession::SessionID, std::shared_ptr<ConnectionManager>, std::shared_ptr<MessageDispatcher>);
-        void run();
+        static const size_t DEFAULT_MAX_IN_FLIGHT = 32;
+
+        explicit ClientSession(tcp::socket&&, ClientSession::SessionID, std::shared_ptr<ConnectionManager>, std::shared_ptr<MessageDispatcher>,
+                               size_t max_in_flight = DEFAULT_MAX_IN_FLIGHT);
+        void run(std::optional<UpgradeRequest> upgrade = std::nullopt);
         void on_run();
         void on_accept(error_code);
         void do_read();
@@ -57,13 +121,17 @@ class ClientSession : public std::enable_shared_from_this<ClientSession> {
         SessionID get_id() const { return session_id_;}
         std::string get_client_ip_addr() const { return client_ip_; }
         unsigned short get_client_port() const { return client_port_; }
+        // The io_context whose threads run this session's strand
+        net::execution_context& get_execution_context() { return net::query(ws_.get_executor(), net::execution::context); }
 
         ConnStatus get_status() const { return status_; }
+        bool is_closed() const { return closed_.load(std::memory_order_acquire); }
         std::string get_authentiated_user_id() const { return authenticated_user_id_; }
         
         c_time::time_point get_connection_time() const { return conn_time_; }
         c_time::time_point get_last_activity_time() const { return last_activity_; }
         uint64_t get_next_sequence_id() { return next_sequence_id_++;}
+        size_t get_in_flight() const { return in_flight_.load(); }
         /* getters */
 
         /* setters */
@@ -71,7 +139,23 @@ class ClientSession : public std::enable_shared_from_this<ClientSession> {
         void set_authenticated_user(const std::string&);
         /* setters */
 
-        void send_message(const std::string&);
+        void send_message(std::string);
+        void send_messages(const std::vector<std::string>&);
+        // Queues a frame owned jointly with other sessions. command and
+        // queued_at are passed in because broadcasts may be handed over from
+        // a thread that is no longer running the command.
+        void send_shared(std::shared_ptr<const std::string> frame, int command, c_time::time_point queued_at);
+        // Response to a command sent by this session. Same as send_message()
+        // unless a ReplyCapture for this session is active on the thread.
+        void reply(std::string);
+
+        // Called by the dispatcher when a command is queued for lane and once
+        // it has been executed (or expired); end_request() resumes a paused
+        // reader. begin_request() returns the lane the command has to wait
+        // in, see queued_in_lane_; left_lane() is called once it was dequeued.
+        size_t begin_request(size_t lane);
+        void left_lane(size_t lane);
+        void end_request();
 };
 
 #endif
\ No newline at end of file
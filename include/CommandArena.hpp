@@ -0,0 +1,71 @@
+#ifndef COMMANDARENA_H
+#define COMMANDARENA_H
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+
+// Per-task bump allocator. The inbound frame and every string a command keeps
+// live here; reset() hands the whole block back at once when the task slot is
+// recycled. Frames larger than the inline buffer spill to the heap.
+class CommandArena {
+    public:
+        CommandArena() : resource_(buffer_.data(), buffer_.size(), std::pmr::new_delete_resource()) {}
+        CommandArena(const CommandArena&) = delete;
+        CommandArena& operator=(const CommandArena&) = delete;
+
+        std::string_view copy(std::string_view str){
+            if(str.empty()){
+                return {};
+            }
+            char* dst = static_cast<char*>(resource_.allocate(str.size(), 1));
+            std::memcpy(dst, str.data(), str.size());
+            return {dst, str.size()};
+        }
+
+        void reset(){
+            resource_.release();
+        }
+
+        static const size_t INLINE_BYTES = 4096;
+
+    private:
+        alignas(std::max_align_t) std::array<std::byte, INLINE_BYTES> buffer_;
+        std::pmr::monotonic_buffer_resource resource_;
+};
+
+// Flat key/value view of a command payload. Keys and values point into a
+// CommandArena (or into the frame itself), never into a json DOM.
+class PayloadFields {
+    public:
+        bool add(std::string_view key, std::string_view value){
+            if(count_ == MAX_FIELDS){
+                return false;
+            }
+            fields_[count_++] = {key, value};
+            return true;
+        }
+
+        std::string_view get(std::string_view key, std::string_view default_value = {}) const {
+            for(size_t i = 0; i < count_; ++i){
+                if(fields_[i].first == key){
+                    return fields_[i].second;
+                }
+            }
+            return default_value;
+        }
+
+        size_t size() const { return count_; }
+        void clear(){ count_ = 0; }
+
+        static const size_t MAX_FIELDS = 16;
+
+    private:
+        std::array<std::pair<std::string_view, std::string_view>, MAX_FIELDS> fields_;
+        size_t count_ = 0;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef COMMANDMETRICS_H
+#define COMMANDMETRICS_H
+
+#include <array>
+#include <chrono>
+#include <json.hpp>
+#include "LatencyHistogram.hpp"
+#include "../src/commands/CommandFactory.hpp"
+
+enum class LatencyStage {
+    QUEUE_WAIT = 0,     // dispatch() enqueue -> worker starts the command
+    EXECUTION,          // execute() / execute_batch() wall time
+    FLUSH,              // send_message() -> websocket write completed
+    COUNT
+};
+
+// Process wide latency histograms, one per command type and stage.
+class CommandMetrics {
+    public:
+        static constexpr size_t COMMAND_COUNT = COMMAND_NAMES.size();
+        static constexpr size_t STAGE_COUNT = static_cast<size_t>(LatencyStage::COUNT);
+        static constexpr int NO_COMMAND = -1;
+
+        static CommandMetrics& instance();
+
+        void record(size_t command, LatencyStage stage, std::chrono::steady_clock::duration elapsed){
+            histograms_[command][static_cast<size_t>(stage)].record(elapsed);
+        }
+
+        // Command the calling worker is executing, NO_COMMAND outside of
+        // execution. Lets sessions attribute queued responses to their command.
+        static int current_command() { return current_command_; }
+
+        class Scope {
+            public:
+                explicit Scope(size_t command) : previous_(current_command_) {
+                    current_command_ = static_cast<int>(command);
+                }
+                ~Scope() { current_command_ = previous_; }
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+            private:
+                int previous_;
+        };
+
+        // {"<COMMAND>": {"<stage>": {"count","mean_us","p50_us","p90_us","p99_us","p999_us","max_us"}}}
+        // Commands that were never recorded are left out.
+        nlohmann::json to_json() const;
+
+        // {"count","mean_us","p50_us","p90_us","p99_us","p999_us","max_us"}
+        static nlohmann::json snapshot_to_json(const LatencyHistogram::Snapshot& snap);
+
+    private:
+        CommandMetrics() = default;
+
+        std::array<std::array<LatencyHistogram, STAGE_COUNT>, COMMAND_COUNT> histograms_;
+        static thread_local int current_command_;
+};
+
+#endif
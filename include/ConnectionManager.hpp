@@ -3,21 +3,32 @@
 
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 #include "ClientSession.hpp"
+#include "RoomRegistry.hpp"
 
 class ConnectionManager : public std::enable_shared_from_this<ConnectionManager> {
     private:
         std::mutex mtx_;
         std::unordered_map<ClientSession::SessionID, std::shared_ptr<ClientSession>> sessions_;
         std::shared_ptr<MessageDispatcher> message_dispatcher_;
+        // closing sessions leave their rooms through the registry's index
+        std::shared_ptr<RoomRegistry> room_registry_;
         ClientSession::SessionID next_session_id_ = 1;
+        size_t max_in_flight_;
     public:
-        ConnectionManager(std::shared_ptr<MessageDispatcher> message_dispatcher) :
-            message_dispatcher_(message_dispatcher) {}
+        ConnectionManager(std::shared_ptr<MessageDispatcher> message_dispatcher,
+                          std::shared_ptr<RoomRegistry> room_registry,
+                          size_t max_in_flight = ClientSession::DEFAULT_MAX_IN_FLIGHT) :
+            message_dispatcher_(message_dispatcher),
+            room_registry_(room_registry),
+            max_in_flight_(max_in_flight) {}
 
-        void start_new_session(tcp::socket&&);
+        // upgrade is the websocket upgrade request when it was already read
+        // off the socket (room placement mode)
+        void start_new_session(tcp::socket&&, std::optional<ClientSession::UpgradeRequest> upgrade = std::nullopt);
         void unregister_session(ClientSession::SessionID);
         size_t get_active_session_count();
 
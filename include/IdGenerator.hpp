@@ -0,0 +1,32 @@
+#ifndef IDGENERATOR_H
+#define IDGENERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Time ordered 128-bit identifiers in canonical UUID text form.
+//
+// Every thread keeps its own generator state, seeded from the OS once, so
+// producing an ID takes no lock and no system call beyond reading the clock.
+// IDs from one thread are strictly increasing; threads are kept apart by
+// their random node and counter bits.
+class IdGenerator {
+public:
+    static constexpr size_t UUID_TEXT_LEN = 36;
+
+    // RFC 4122 version 1, what Cassandra expects in a timeuuid column and
+    // orders by its embedded timestamp.
+    static std::string time_uuid();
+    // RFC 9562 version 7: the unix millisecond timestamp leads, so the text
+    // form sorts by creation time and new keys land at the end of an index.
+    static std::string sortable_uuid(std::string_view prefix = {});
+
+    // Writes the UUID_TEXT_LEN characters of the uuid whose big endian
+    // halves are hi and lo to out.
+    static void format(uint64_t hi, uint64_t lo, char* out);
+
+private:
+    IdGenerator() = delete;
+};
+#endif
@@ -0,0 +1,77 @@
+#ifndef INTERNTABLE_H
+#define INTERNTABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// Maps external string IDs to dense 32-bit handles, so in-memory structures
+// can key and compare by integer and hold each string once. The text is only
+// looked up again at the protocol and storage boundaries.
+//
+// Handles are never reused and their text lives as long as the table, packed
+// into shared arena blocks. Resolving a handle is a lock-free array index.
+// Finding an ID hashes it once and probes a flat open addressing table under
+// a shared shard lock; the text is only compared when the stored hash tag
+// matches, so a lookup usually touches one slot line and one text line.
+class InternTable {
+    public:
+        using Handle = uint32_t;
+        static constexpr Handle NONE = 0;   // never handed out
+        static constexpr size_t SHARD_COUNT = 16;
+
+        InternTable();
+        InternTable(const InternTable&) = delete;
+        InternTable& operator=(const InternTable&) = delete;
+
+        // The id's handle, assigning the next one if it is new.
+        Handle intern(std::string_view id);
+        // NONE if the id was never interned.
+        Handle find(std::string_view id) const;
+        // Valid for the table's lifetime; handle must come from this table.
+        std::string_view str(Handle handle) const;
+        size_t size() const { return next_.load(std::memory_order_relaxed) - 1; }
+        // Arena, slot and directory memory in use
+        size_t bytes() const;
+
+    private:
+        static constexpr size_t CHUNK_BITS = 16;
+        static constexpr size_t CHUNK_SIZE = size_t{1} << CHUNK_BITS;
+        static constexpr size_t MAX_CHUNKS = size_t{1} << (32 - CHUNK_BITS);
+        static constexpr size_t ARENA_BLOCK = 64 * 1024;
+        static constexpr size_t INITIAL_SLOTS = 256;
+
+        struct Slot {
+            uint32_t tag;       // high half of the id's hash
+            Handle handle;      // NONE marks an empty slot
+        };
+        struct Shard {
+            mutable std::shared_mutex mtx_;
+            std::vector<Slot> slots_ = std::vector<Slot>(INITIAL_SLOTS);     // power of two, at most half full
+            size_t count_ = 0;
+        };
+
+        static size_t hash(std::string_view id) { return std::hash<std::string_view>{}(id); }
+        // Slot holding id, or the empty slot where it would go.
+        size_t probe(const std::vector<Slot>& slots, size_t hash, std::string_view id) const;
+        // Doubles the shard's slots. Caller holds the shard lock exclusively.
+        void grow(Shard& shard);
+        // Copies id into the arena and gives it the next handle.
+        Handle append(std::string_view id);
+
+        std::array<Shard, SHARD_COUNT> shards_;
+        std::unique_ptr<std::atomic<std::string_view*>[]> chunks_;    // handle -> text, by chunk
+        std::mutex append_mtx_;             // arena, chunk allocation and handle assignment
+        std::vector<std::unique_ptr<std::string_view[]>> chunk_storage_;
+        std::vector<std::unique_ptr<char[]>> arena_;
+        size_t arena_used_ = ARENA_BLOCK;
+        std::atomic<size_t> arena_bytes_{0};
+        std::atomic<Handle> next_{1};
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef IOTHREADPOOL_H
+#define IOTHREADPOOL_H
+
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "net.hpp"
+#include "boost/asio/executor_work_guard.hpp"
+#include "boost/asio/io_context.hpp"
+
+// One single threaded io_context per io thread, used by the room placement
+// mode. Each barrack is owned by one of the threads; a session that names a
+// barrack when it connects is created on that thread, so the members of a
+// hot room share a thread and its broadcasts stay thread local. Sessions are
+// placed when they connect and never migrated afterwards.
+class IoThreadPool {
+    public:
+        explicit IoThreadPool(size_t threads);
+        ~IoThreadPool();
+        IoThreadPool(const IoThreadPool&) = delete;
+        IoThreadPool& operator=(const IoThreadPool&) = delete;
+
+        size_t size() const { return contexts_.size(); }
+        net::io_context& context(size_t index) { return *contexts_[index]; }
+        // Thread owning the barrack's room
+        size_t owner_of(std::string_view barrack_id) const;
+        // Round robin for sessions without a placement hint
+        size_t next_index();
+
+        void run();
+        void stop();
+        void join();
+
+    private:
+        using WorkGuard = net::executor_work_guard<net::io_context::executor_type>;
+
+        std::vector<std::unique_ptr<net::io_context>> contexts_;
+        std::vector<WorkGuard> work_;
+        std::vector<std::thread> threads_;
+        std::atomic<size_t> next_{0};
+};
+
+#endif
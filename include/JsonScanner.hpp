@@ -0,0 +1,49 @@
+#ifndef JSONSCANNER_H
+#define JSONSCANNER_H
+
+#include <string_view>
+#include <vector>
+#include "CommandArena.hpp"
+
+// On-demand scanner for the inbound {"type": ..., "payload": {...}} envelope.
+// Strings without escapes are returned as views into the frame itself; only
+// escaped strings are decoded into the arena. The scanner validates what it
+// reads against the JSON grammar, but it gives up (returns false) instead of
+// reporting errors: the caller then falls back to nlohmann::json, which
+// produces the usual error responses. String scanning uses SSE2 when
+// available.
+class JsonScanner {
+    public:
+        struct Envelope {
+            std::string_view type;
+            std::string_view payload;   // raw text of the payload object
+            std::string_view request_id;    // raw JSON token, empty if absent
+        };
+
+        // Succeeds for a single JSON object holding exactly one string "type"
+        // and one object or array "payload", plus an optional string or
+        // integer "request_id". Other members are validated and skipped.
+        static bool scan_envelope(std::string_view frame, CommandArena& arena, Envelope& out);
+
+        // Reads only the top level "type" and "request_id" of a frame, as views
+        // into it, without an arena: nested values are skipped, not decoded,
+        // and payload fields are never looked at. For load shedding, which has
+        // to answer a frame before it is worth parsing. Fails when the frame
+        // is not an object or the type is missing or escaped; request_id
+        // follows the scan_envelope rules but is left empty instead of failing.
+        static bool peek_envelope(std::string_view frame, std::string_view& type, std::string_view& request_id);
+
+        // Splits an array validated by scan_envelope (a BATCH payload) into
+        // the raw text of its elements.
+        static void scan_items(std::string_view array, std::vector<std::string_view>& items);
+
+        // Flattens a payload object into fields the same way the nlohmann path
+        // does: strings as is, booleans as "true"/"false", integers in their
+        // decimal spelling, nulls dropped. Fails for nested values, non-integer
+        // numbers, duplicate keys or more than PayloadFields::MAX_FIELDS members.
+        static bool scan_fields(std::string_view payload, CommandArena& arena, PayloadFields& fields);
+
+        static const int MAX_DEPTH = 64;
+};
+
+#endif
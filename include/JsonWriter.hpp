@@ -0,0 +1,126 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Object key usable as a template argument: object<"payload", "type">(...)
+template<size_t N>
+struct JsonKey {
+    char name[N]{};
+
+    consteval JsonKey(const char (&str)[N]){
+        std::copy_n(str, N, name);
+    }
+
+    constexpr std::string_view view() const { return {name, N - 1}; }
+};
+
+// Pre-serialized JSON value, copied verbatim. A member whose value is an
+// empty RawJson is left out of the object.
+struct RawJson {
+    std::string_view text;
+};
+
+// Appends compact JSON to a caller owned string without building a DOM.
+// The output is byte for byte what nlohmann::json::dump() produces for the
+// same document: object members are emitted in the order nlohmann stores them
+// (sorted by key, enforced at compile time) and strings use its escaping.
+//
+// Values may be strings, integers, booleans, RawJson, or callables that write
+// a nested value through the same writer.
+class JsonWriter {
+    public:
+        explicit JsonWriter(std::string& out) : out_(out) {}
+
+        template<JsonKey... Keys, typename... Values>
+        void object(const Values&... values){
+            static_assert(sizeof...(Keys) == sizeof...(Values), "one value per key");
+            static_assert(keys_sorted<Keys...>(), "keys must be listed in nlohmann (sorted) order");
+            out_ += '{';
+            bool first = true;
+            (member<Keys>(first, values), ...);
+            out_ += '}';
+        }
+
+        template<typename Range, typename WriteItem>
+        void array(const Range& items, WriteItem&& write_item){
+            out_ += '[';
+            bool first = true;
+            for(const auto& item : items){
+                if(!first){
+                    out_ += ',';
+                }
+                first = false;
+                write_item(item);
+            }
+            out_ += ']';
+        }
+
+        template<typename T>
+        void value(const T& v){
+            if constexpr (std::is_same_v<T, bool>){
+                out_ += v ? "true" : "false";
+            } else if constexpr (std::is_same_v<T, RawJson>){
+                out_ += v.text;
+            } else if constexpr (std::is_integral_v<T>){
+                char digits[24];
+                auto result = std::to_chars(digits, digits + sizeof(digits), v);
+                out_.append(digits, result.ptr);
+            } else if constexpr (std::is_convertible_v<const T&, std::string_view>){
+                write_string(v);
+            } else {
+                static_assert(std::is_invocable_v<const T&>, "unsupported JSON value type");
+                v();
+            }
+        }
+
+        void write_string(std::string_view str);
+
+    private:
+        template<JsonKey Key>
+        static constexpr auto key_token(){
+            constexpr std::string_view name = Key.view();
+            std::array<char, name.size() + 3> token{};
+            token[0] = '"';
+            std::copy(name.begin(), name.end(), token.begin() + 1);
+            token[name.size() + 1] = '"';
+            token[name.size() + 2] = ':';
+            return token;
+        }
+
+        template<JsonKey Key, typename T>
+        void member(bool& first, const T& v){
+            static constexpr auto token = key_token<Key>();
+            if constexpr (std::is_same_v<T, RawJson>){
+                if(v.text.empty()){
+                    return;
+                }
+            }
+            if(!first){
+                out_ += ',';
+            }
+            first = false;
+            out_.append(token.data(), token.size());
+            value(v);
+        }
+
+        template<JsonKey... Keys>
+        static constexpr bool keys_sorted(){
+            std::array<std::string_view, sizeof...(Keys)> keys = {Keys.view()...};
+            for(size_t i = 1; i < keys.size(); ++i){
+                if(!(keys[i - 1] < keys[i])){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::string& out_;
+};
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef LANEQUEUE_H
+#define LANEQUEUE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Multi-lane blocking queue. Lane 0 has the highest priority. Consumers pick
+// lanes by smooth weighted round robin over the non-empty lanes, except that
+// the most urgent lane whose head has waited longer than the starvation limit
+// is served first.
+// Lanes are growable ring buffers, so a warmed up queue never allocates.
+// T must be default constructible.
+template<typename T, size_t Lanes>
+class LaneQueue {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct LaneStats {
+            uint64_t dequeued;
+            uint64_t total_wait_us;
+            uint64_t max_wait_us;
+            size_t depth;
+        };
+
+        LaneQueue(std::array<int, Lanes> weights, std::chrono::milliseconds starvation_limit)
+            : weights_(weights), starvation_limit_(starvation_limit) {}
+        LaneQueue(const LaneQueue&) = delete;
+        LaneQueue& operator=(const LaneQueue&) = delete;
+
+        void push(size_t lane, T&& value){
+            std::unique_lock<std::mutex> lock(mtx_);
+            lanes_[lane].push_back({std::move(value), Clock::now()});
+            size_.fetch_add(1, std::memory_order_relaxed);
+            cv_.notify_one();
+        }
+
+        // Blocks until at least one item is available, then drains up to
+        // max_items into out. Returns 0 once the queue has been shut down.
+        size_t wait_and_pop_batch(std::vector<T>& out, size_t max_items){
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this]{ return size_locked() > 0 || done_; });
+            if(done_){
+                return 0;
+            }
+            auto now = Clock::now();
+            size_t count = 0;
+            while(count < max_items){
+                int lane = pick_lane(now);
+                if(lane < 0){
+                    break;
+                }
+                auto& entry = lanes_[lane].front();
+                record_wait(lane, now - entry.enqueued);
+                out.push_back(std::move(entry.value));
+                lanes_[lane].pop_front();
+                ++count;
+            }
+            size_.fetch_sub(count, std::memory_order_relaxed);
+            return count;
+        }
+
+        void shutdown(){
+            std::unique_lock<std::mutex> lock(mtx_);
+            done_ = true;
+            cv_.notify_all();
+        }
+
+        bool empty(){
+            std::unique_lock<std::mutex> lock(mtx_);
+            return size_locked() == 0;
+        }
+
+        // Lock free, may be momentarily stale.
+        size_t size_approx() const {
+            return size_.load(std::memory_order_relaxed);
+        }
+
+        std::array<LaneStats, Lanes> get_stats(){
+            std::array<LaneStats, Lanes> stats{};
+            std::unique_lock<std::mutex> lock(mtx_);
+            for(size_t i = 0; i < Lanes; ++i){
+                stats[i] = {stats_[i].dequeued.load(std::memory_order_relaxed),
+                            stats_[i].total_wait_us.load(std::memory_order_relaxed),
+                            stats_[i].max_wait_us.load(std::memory_order_relaxed),
+                            lanes_[i].size()};
+            }
+            return stats;
+        }
+
+    private:
+        struct Entry {
+            T value{};
+            Clock::time_point enqueued;
+        };
+
+        class Ring {
+            public:
+                bool empty() const { return size_ == 0; }
+                size_t size() const { return size_; }
+                Entry& front() { return items_[head_]; }
+
+                void push_back(Entry&& entry){
+                    if(size_ == items_.size()){
+                        grow();
+                    }
+                    items_[(head_ + size_) & (items_.size() - 1)] = std::move(entry);
+                    ++size_;
+                }
+
+                void pop_front(){
+                    items_[head_] = Entry{};
+                    head_ = (head_ + 1) & (items_.size() - 1);
+                    --size_;
+                }
+
+            private:
+                void grow(){
+                    std::vector<Entry> bigger(items_.empty() ? INITIAL_CAPACITY : items_.size() * 2);
+                    for(size_t i = 0; i < size_; ++i){
+                        bigger[i] = std::move(items_[(head_ + i) & (items_.size() - 1)]);
+                    }
+                    items_ = std::move(bigger);
+                    head_ = 0;
+                }
+
+                static const size_t INITIAL_CAPACITY = 256;
+                std::vector<Entry> items_;
+                size_t head_ = 0;
+                size_t size_ = 0;
+        };
+
+        struct AtomicLaneStats {
+            std::atomic<uint64_t> dequeued{0};
+            std::atomic<uint64_t> total_wait_us{0};
+            std::atomic<uint64_t> max_wait_us{0};
+        };
+
+        size_t size_locked() const {
+            size_t size = 0;
+            for(const auto& lane : lanes_){
+                size += lane.size();
+            }
+            return size;
+        }
+
+        int pick_lane(Clock::time_point now){
+            // starvation protection: the most urgent lane past the limit wins,
+            // the others follow once it caught up
+            for(size_t i = 0; i < Lanes; ++i){
+                if(!lanes_[i].empty() && now - lanes_[i].front().enqueued > starvation_limit_){
+                    return static_cast<int>(i);
+                }
+            }
+
+            int best = -1;
+            int total = 0;
+            for(size_t i = 0; i < Lanes; ++i){
+                if(lanes_[i].empty()){
+                    continue;
+                }
+                current_[i] += weights_[i];
+                total += weights_[i];
+                if(best < 0 || current_[i] > current_[best]){
+                    best = static_cast<int>(i);
+                }
+            }
+            if(best >= 0){
+                current_[best] -= total;
+            }
+            return best;
+        }
+
+        void record_wait(size_t lane, Clock::duration wait){
+            auto wait_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+            auto& stats = stats_[lane];
+            stats.dequeued.fetch_add(1, std::memory_order_relaxed);
+            stats.total_wait_us.fetch_add(wait_us, std::memory_order_relaxed);
+            auto max = stats.max_wait_us.load(std::memory_order_relaxed);
+            while(wait_us > max && !stats.max_wait_us.compare_exchange_weak(max, wait_us, std::memory_order_relaxed)){}
+        }
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::array<Ring, Lanes> lanes_;
+        std::array<int, Lanes> weights_;
+        std::array<int, Lanes> current_{};
+        std::array<AtomicLaneStats, Lanes> stats_;
+        std::chrono::milliseconds starvation_limit_;
+        std::atomic<size_t> size_{0};
+        bool done_ = false;
+};
+
+#endif
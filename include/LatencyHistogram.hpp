@@ -0,0 +1,132 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+// HDR style log-linear histogram of microsecond latencies. Every power of two
+// is split into 16 linear sub-buckets (~6% relative error), values above
+// MAX_VALUE_US are clamped.
+//
+// Writers never lock. The counters are split into SHARD_COUNT shards shared
+// by all threads; a thread is assigned one on first use, so with more than
+// SHARD_COUNT threads several of them update the same shard's relaxed
+// atomics. This spreads the contention, it does not remove it. Readers merge
+// the shards into a Snapshot.
+class LatencyHistogram {
+    public:
+        static constexpr unsigned PRECISION_BITS = 4;
+        static constexpr unsigned MAX_VALUE_BITS = 32;    // ~71 minutes
+        static constexpr uint64_t MAX_VALUE_US = (uint64_t{1} << MAX_VALUE_BITS) - 1;
+        static constexpr size_t SUB_BUCKETS = size_t{1} << PRECISION_BITS;
+        static constexpr size_t LINEAR_BUCKETS = SUB_BUCKETS * 2;
+        static constexpr size_t BUCKET_COUNT = LINEAR_BUCKETS + (MAX_VALUE_BITS - PRECISION_BITS - 1) * SUB_BUCKETS;
+        static constexpr size_t SHARD_COUNT = 8;
+
+        struct Snapshot {
+            std::array<uint64_t, BUCKET_COUNT> counts{};
+            uint64_t count = 0;
+            uint64_t sum_us = 0;
+            uint64_t max_us = 0;
+
+            // Upper bound of the bucket holding the given percentile (0-100).
+            uint64_t percentile(double p) const {
+                if(count == 0){
+                    return 0;
+                }
+                auto rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count) + 0.5);
+                if(rank == 0){
+                    rank = 1;
+                }
+                uint64_t seen = 0;
+                for(size_t i = 0; i < BUCKET_COUNT; ++i){
+                    seen += counts[i];
+                    if(seen >= rank){
+                        return std::min(bucket_upper(i), max_us);
+                    }
+                }
+                return max_us;
+            }
+
+            uint64_t mean() const { return count ? sum_us / count : 0; }
+        };
+
+        LatencyHistogram() = default;
+        LatencyHistogram(const LatencyHistogram&) = delete;
+        LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+        void record(std::chrono::steady_clock::duration elapsed){
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+            record_us(us < 0 ? 0 : static_cast<uint64_t>(us));
+        }
+
+        void record_us(uint64_t us){
+            if(us > MAX_VALUE_US){
+                us = MAX_VALUE_US;
+            }
+            Shard& shard = shards_[shard_index()];
+            shard.counts[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+            shard.sum_us.fetch_add(us, std::memory_order_relaxed);
+            uint64_t max = shard.max_us.load(std::memory_order_relaxed);
+            while(us > max && !shard.max_us.compare_exchange_weak(max, us, std::memory_order_relaxed)){
+            }
+        }
+
+        // Counts recorded concurrently may or may not be included.
+        Snapshot snapshot() const {
+            Snapshot snap;
+            for(const Shard& shard : shards_){
+                for(size_t i = 0; i < BUCKET_COUNT; ++i){
+                    uint64_t n = shard.counts[i].load(std::memory_order_relaxed);
+                    snap.counts[i] += n;
+                    snap.count += n;
+                }
+                snap.sum_us += shard.sum_us.load(std::memory_order_relaxed);
+                snap.max_us = std::max(snap.max_us, shard.max_us.load(std::memory_order_relaxed));
+            }
+            return snap;
+        }
+
+        static constexpr size_t bucket_index(uint64_t us){
+            if(us < LINEAR_BUCKETS){
+                return static_cast<size_t>(us);
+            }
+            unsigned shift = static_cast<unsigned>(std::bit_width(us)) - 1 - PRECISION_BITS;
+            size_t sub = static_cast<size_t>(us >> shift) & (SUB_BUCKETS - 1);
+            return LINEAR_BUCKETS + (shift - 1) * SUB_BUCKETS + sub;
+        }
+
+        static constexpr uint64_t bucket_upper(size_t index){
+            if(index < LINEAR_BUCKETS){
+                return index;
+            }
+            unsigned shift = static_cast<unsigned>((index - LINEAR_BUCKETS) / SUB_BUCKETS) + 1;
+            uint64_t sub = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+            return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+        }
+
+    private:
+        struct alignas(64) Shard {
+            std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts{};
+            std::atomic<uint64_t> sum_us{0};
+            std::atomic<uint64_t> max_us{0};
+        };
+
+        // Threads are spread over the shards round robin on first use.
+        static size_t shard_index(){
+            static std::atomic<size_t> next_shard{0};
+            thread_local const size_t index = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+            return index;
+        }
+
+        std::array<Shard, SHARD_COUNT> shards_;
+};
+
+static_assert(LatencyHistogram::bucket_index(LatencyHistogram::MAX_VALUE_US) == LatencyHistogram::BUCKET_COUNT - 1,
+              "LatencyHistogram bucket layout does not cover MAX_VALUE_US");
+
+#endif
@@ -2,18 +2,24 @@
 #define LISTENER_H
 
 #include "ConnectionManager.hpp"
+#include "IoThreadPool.hpp"
 
 class Listener : public std::enable_shared_from_this<Listener>{
     private:
         net::io_context& ioc_;
         tcp::acceptor acceptor_;
         std::shared_ptr<ConnectionManager> conn_manager_;
+        // Set in room placement mode: sessions are created on the pool's io
+        // threads instead of on ioc_, see place_session()
+        std::shared_ptr<IoThreadPool> io_pool_;
 
         void do_accept();
         void on_accept(error_code, tcp::socket);
+        void place_session(tcp::socket);
     
     public:
-        Listener(net::io_context&, tcp::endpoint, std::shared_ptr<ConnectionManager>);
+        Listener(net::io_context&, tcp::endpoint, std::shared_ptr<ConnectionManager>,
+                 std::shared_ptr<IoThreadPool> io_pool = nullptr);
         void run();
 };
 
@@ -0,0 +1,77 @@
+#ifndef MEMBERSHIPINDEX_H
+#define MEMBERSHIPINDEX_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class ClientSession;
+
+// Reverse lookups the rooms themselves cannot answer: the rooms a session
+// has joined, and the sessions (one per device) a user is logged in on.
+// Kept up to date by RoomRegistry and the auth commands, so closing a
+// session costs time proportional to its own rooms and reaching a user is a
+// hash lookup instead of a scan over every room or connection.
+//
+// Sessions and users live in separate sharded tables; a call never holds
+// more than one shard lock at a time. A session that has been closed is not
+// taken in again: its status is checked under the shard lock forget() takes,
+// so a command that runs after the disconnect cannot leave an entry behind.
+class MembershipIndex {
+    public:
+        using SessionID = uint64_t;
+        static constexpr size_t SHARD_COUNT = 16;
+
+        // What the index knew about a session it was told to forget
+        struct SessionEntry {
+            std::string user_id;
+            std::vector<std::string> rooms;
+        };
+
+        // false, and nothing recorded, once the session is closed
+        bool add_room(const std::shared_ptr<ClientSession>& session, std::string_view barrack_id);
+        // true when the session had joined the room
+        bool remove_room(SessionID session, std::string_view barrack_id);
+
+        // Rebinding a session to another user drops it from the old one.
+        // A closed session is left alone.
+        void bind_user(std::string_view user_id, const std::shared_ptr<ClientSession>& session);
+        std::vector<std::shared_ptr<ClientSession>> sessions_of(std::string_view user_id) const;
+
+        // Drops the session from the index, including its user's session list.
+        SessionEntry forget(SessionID session);
+
+    private:
+        struct IdHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view id) const { return std::hash<std::string_view>{}(id); }
+        };
+        struct UserSession {
+            SessionID id;
+            std::weak_ptr<ClientSession> session;
+        };
+        struct SessionShard {
+            mutable std::mutex mtx_;
+            std::unordered_map<SessionID, SessionEntry> sessions_;
+        };
+        struct UserShard {
+            mutable std::mutex mtx_;
+            std::unordered_map<std::string, std::vector<UserSession>, IdHash, std::equal_to<>> users_;
+        };
+
+        SessionShard& session_shard(SessionID session) { return session_shards_[session % SHARD_COUNT]; }
+        const SessionShard& session_shard(SessionID session) const { return session_shards_[session % SHARD_COUNT]; }
+        UserShard& user_shard(std::string_view user_id) { return user_shards_[IdHash{}(user_id) % SHARD_COUNT]; }
+        const UserShard& user_shard(std::string_view user_id) const { return user_shards_[IdHash{}(user_id) % SHARD_COUNT]; }
+        void unbind_user(std::string_view user_id, SessionID session);
+
+        std::array<SessionShard, SHARD_COUNT> session_shards_;
+        std::array<UserShard, SHARD_COUNT> user_shards_;
+};
+
+#endif
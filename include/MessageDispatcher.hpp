@@ -1,32 +1,136 @@
 #ifndef MESSAGEDISPATCHER_H
 #define MESSAGEDISPATCHER_H
 
-#include "ConcurrentQueue.hpp"
+#include <atomic>
+#include <string_view>
+#include "JsonScanner.hpp"
+#include "LaneQueue.hpp"
+#include "ObjectPool.hpp"
 #include "../src/commands/ICommand.hpp"
 #include "../src/commands/CommandFactory.hpp"
 
 
 class MessageDispatcher{
+        // One command of a BATCH frame. Items that could not be turned into a
+        // command carry their pre-rendered error reply instead.
+        struct BatchItem {
+            AnyCommand command;
+            std::string_view error;
+        };
+
+        // A task owns its inbound frame (in the arena) and the command parsed
+        // from it, or for a BATCH frame the list of its commands. Slots come
+        // from a preallocated pool and are recycled after the command executes.
+        struct TaskSlot {
+            CommandArena arena;
+            AnyCommand command;
+            std::vector<BatchItem> batch;
+            std::string_view batch_request_id;
+            std::shared_ptr<ClientSession> session;
+            size_t lane = 0;
+            std::chrono::steady_clock::time_point enqueued_at;
+            std::chrono::steady_clock::time_point deadline;
+
+            void reset(){
+                command.emplace<std::monostate>();
+                batch.clear();
+                batch_request_id = {};
+                session.reset();
+                arena.reset();
+            }
+        };
     public:
+        static constexpr size_t LANE_COUNT = static_cast<size_t>(CommandPriority::COUNT);
+        using CommandQueue = LaneQueue<TaskSlot*, LANE_COUNT>;
+
         MessageDispatcher(size_t num_threads, CommandContext context);
 
         ~MessageDispatcher();
 
-        void dispatch(std::shared_ptr<ClientSession> session, const std::string& raw_payload);
+        void dispatch(std::shared_ptr<ClientSession> session, std::string_view raw_payload);
 
         void stop();
+
+        // True once the queue wait EWMA went past OVERLOAD_ENTER_WAIT, until
+        // it fell below OVERLOAD_EXIT_WAIT again, and commands are queued.
+        // dispatch() then answers every frame that is not a CONTROL command
+        // with RETRY_LATER, before parsing it.
+        bool is_overloaded() const;
+
+        struct Stats {
+            uint64_t commands_executed;
+            uint64_t queue_pops;        // consumer side lock acquisitions
+            uint64_t commands_expired;  // answered with TIMEOUT, not executed
+            uint64_t frames_shed;
+            uint64_t frames_scanned;    // routed by JsonScanner
+            uint64_t frames_parsed;     // fell back to nlohmann::json
+            uint64_t batch_frames;
+            uint64_t batch_commands;
+            uint64_t queue_wait_ewma_us;
+            bool overloaded;
+            size_t task_slots;
+            std::array<CommandQueue::LaneStats, LANE_COUNT> lanes;
+        };
+        Stats get_stats() const;
+        // get_stats() plus the per command latency histograms, as served by
+        // the STATS command and dumped on SIGUSR1.
+        nlohmann::json stats_json() const;
     private:
+        struct CommandGroup {
+            size_t type;
+            std::string_view key;
+            AnyCommand* first_command;
+            std::vector<BatchEntry> entries;
+        };
 
-        void worker_loop();
-        struct CommandTask {
-            std::unique_ptr<ICommand> command;
-            std::shared_ptr<ClientSession> session;
+        // per worker buffers, reused across batches
+        struct WorkerScratch {
+            std::vector<TaskSlot*> batch;
+            std::vector<CommandGroup> groups;
+            size_t groups_used = 0;
+            std::vector<std::string> replies;   // captured BATCH replies
         };
+
+        bool dispatch_scanned(const std::shared_ptr<ClientSession>& session, TaskSlot* slot, std::string_view frame);
+        bool dispatch_parsed(const std::shared_ptr<ClientSession>& session, TaskSlot* slot, std::string_view frame);
+        bool dispatch_batch_scanned(const std::shared_ptr<ClientSession>& session, TaskSlot* slot, const JsonScanner::Envelope& envelope);
+        bool dispatch_batch_parsed(const std::shared_ptr<ClientSession>& session, TaskSlot* slot, const nlohmann::json& commands, std::string_view request_id);
+        // Called while overloaded; true when the frame was answered with
+        // RETRY_LATER and must not be dispatched.
+        bool shed(const std::shared_ptr<ClientSession>& session, std::string_view frame);
+        void enqueue(const std::shared_ptr<ClientSession>& session, TaskSlot* slot);
+        // Folds the longest wait of a dequeued batch into the EWMA and
+        // updates the overload state from it.
+        void record_queue_wait(uint64_t wait_us);
+        void worker_loop();
+        void execute_batch(WorkerScratch& scratch, std::chrono::steady_clock::time_point now);
         CommandFactory commandFactory;
         CommandContext commandContext;
-        std::unique_ptr<ConcurrentQueue<CommandTask>> command_queue;
+        std::unique_ptr<ObjectPool<TaskSlot>> slot_pool_;
+        std::unique_ptr<CommandQueue> command_queue;
         std::vector<std::thread> workers_;
         bool done_ = false;
+        std::atomic<uint64_t> commands_executed_{0};
+        std::atomic<uint64_t> queue_pops_{0};
+        std::atomic<uint64_t> commands_expired_{0};
+        std::atomic<uint64_t> frames_shed_{0};
+        std::atomic<uint64_t> frames_scanned_{0};
+        std::atomic<uint64_t> frames_parsed_{0};
+        std::atomic<uint64_t> batch_frames_{0};
+        std::atomic<uint64_t> batch_commands_{0};
+        std::atomic<uint64_t> queue_wait_ewma_us_{0};
+        std::atomic<bool> overloaded_{false};
+
+        static const size_t MAX_BATCH_SIZE = 64;
+        // commands accepted in one BATCH frame
+        static const size_t MAX_BATCH_COMMANDS = 256;
+        static const size_t INITIAL_TASK_SLOTS = 1024;
+        // CONTROL : INTERACTIVE : BULK
+        static constexpr std::array<int, LANE_COUNT> LANE_WEIGHTS = {8, 4, 1};
+        static constexpr std::chrono::milliseconds LANE_STARVATION_LIMIT{500};
+        // shedding starts above the first queue wait and stops below the second
+        static constexpr std::chrono::milliseconds OVERLOAD_ENTER_WAIT{1000};
+        static constexpr std::chrono::milliseconds OVERLOAD_EXIT_WAIT{250};
 };
 
-#endif // MESSAGEDISPATCHER_H
\ No newline at end of file
+#endif // MESSAGEDISPATCHER_H
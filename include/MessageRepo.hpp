@@ -1,6 +1,7 @@
 #ifndef MESSAGEREPOSITORY_H
 #define MESSAGEREPOSITORY_H
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <variant>
@@ -8,11 +9,46 @@
 #include "types.hpp"
 #include "Error.hpp"
 
+// Cassandra rejects a batch larger than batch_size_fail_threshold_in_kb
+// (50 KB by default); batches are cut well below it.
+static constexpr size_t MAX_WRITE_BATCH_BYTES = 32 * 1024;
+
+// What a message adds to a write batch, roughly: its columns are inserted
+// into both message tables.
+inline size_t write_batch_bytes(const ChatMessage& message){
+    return 2 * (message.barrack_id.size() + message.message_id.size()
+                + message.sender_user_id.size() + message.content.size() + 32);
+}
+
 class MessageRepository {
     public:
         virtual ~MessageRepository() = default;
         virtual Result<std::monostate> add(const ChatMessage& message) = 0;
+        virtual Result<std::monostate> add_batch(const std::vector<ChatMessage>& messages){
+            for(const auto& message : messages){
+                auto res = add(message);
+                if(std::holds_alternative<Error>(res)){
+                    return res;
+                }
+            }
+            return Success{};
+        }
+        using WriteCallback = std::function<void(Result<std::monostate>)>;
+        // Writes messages of a single barrack without waiting for the result;
+        // done runs once they are stored or failed, possibly on a driver
+        // thread. More than MAX_WRITE_BATCH_BYTES worth is sent as several
+        // batches and done reports the first failure among them. The messages are only read during the call. By default the
+        // write is made inline through add_batch.
+        virtual void add_batch_async(const std::vector<ChatMessage>& messages, WriteCallback done){
+            done(add_batch(messages));
+        }
         virtual Result<std::vector<ChatMessage>> get_for_barrack(const std::string& barrack_id, int limit = 50) = 0;
+        // Messages with seq > after_seq in ascending seq order
+        virtual Result<std::vector<ChatMessage>> get_since(const std::string& barrack_id, uint64_t after_seq, int limit) = 0;
+        // The limit newest messages, with their seq, in descending seq order
+        virtual Result<std::vector<ChatMessage>> get_latest(const std::string& barrack_id, int limit) = 0;
+        // Highest seq stored for the barrack, 0 if it has no messages
+        virtual Result<uint64_t> get_latest_seq(const std::string& barrack_id) = 0;
         virtual Result<std::monostate> delete_barrack_messages(const std::string& barrack_id) = 0;  
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,163 @@
+#ifndef MESSAGEWRITER_H
+#define MESSAGEWRITER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "LatencyHistogram.hpp"
+#include "MessageRepo.hpp"
+#include "WriteAheadLog.hpp"
+#include "types.hpp"
+
+// Batching and pipelining of the Cassandra writes, see main.
+struct WriterConfig {
+    // messages per UNLOGGED batch; a barrack with more pending is split
+    size_t max_batch_messages = 64;
+    // and their encoded size, so Cassandra does not reject the batch
+    size_t max_batch_bytes = MAX_WRITE_BATCH_BYTES;
+    // how long a partial batch waits for more messages of its barrack
+    std::chrono::microseconds linger{1000};
+    // batches awaiting Cassandra at once; past it the writer stops issuing
+    size_t max_in_flight = 128;
+    // how long a failed batch waits before it is written again, doubled
+    // after every failed retry up to max_retry_delay
+    std::chrono::milliseconds retry_delay{100};
+    std::chrono::milliseconds max_retry_delay{10000};
+    // messages accepted but not stored yet; past it senders are turned away
+    // (see has_room) instead of the writer growing without bound while
+    // Cassandra is down
+    size_t max_backlog = 256 * 1024;
+};
+
+// Reported under "writer" in the dispatcher stats.
+struct WriterStats {
+    uint64_t queued;            // accepted messages not issued yet
+    uint64_t backlog;           // accepted messages not stored yet
+    uint64_t in_flight;         // batches awaiting Cassandra
+    uint64_t batches;           // writes issued, retries included
+    uint64_t written;
+    uint64_t failed;            // failed writes, each retry counted again
+    LatencyHistogram::Snapshot commit;      // message accepted -> acknowledged
+    LatencyHistogram::Snapshot round_trip;  // batch issued -> acknowledged
+};
+
+// Writes accepted messages to the MessageRepository in the background.
+//
+// Messages are grouped per barrack, so every batch is a single partition. A
+// barrack's batch goes out once it is full or its oldest message lingered
+// long enough, and up to max_in_flight batches are outstanding at once
+// through add_batch_async instead of one blocking round trip at a time.
+//
+// Completions are handed back to the writer thread, which calls settled for
+// each batch in issue order per barrack. A barrack's batches may be stored
+// out of order, but settled never sees a later one before an earlier one.
+// Only stored batches are settled: a failed one keeps its place at the head
+// of its barrack, holding back the batches behind it, and is written again
+// with exponential backoff until it succeeds. Meanwhile the barrack issues
+// nothing new, so an outage costs one write per barrack per retry. Stored messages are released from the
+// WAL; what is still failing when the writer stops stays in it and is written
+// again after the next start.
+class MessageWriter {
+    public:
+        using SettleCallback = std::function<void(const std::vector<ChatMessage>&)>;
+
+        // wal may be null; otherwise stored messages are released from it
+        MessageWriter(std::shared_ptr<MessageRepository> repo, WriterConfig config,
+                      std::shared_ptr<WriteAheadLog> wal, SettleCallback settled);
+        // Writes out everything queued and waits for the answers
+        ~MessageWriter();
+
+        MessageWriter(const MessageWriter&) = delete;
+        MessageWriter& operator=(const MessageWriter&) = delete;
+
+        // Messages of a barrack must be pushed in seq order. lsn is where the
+        // message sits in the WAL, 0 when it was not logged.
+        void push(ChatMessage&& message, WriteAheadLog::Lsn lsn = 0);
+        void push_batch(std::vector<ChatMessage>&& messages, const std::vector<WriteAheadLog::Lsn>& lsns = {});
+        // false once max_backlog messages wait to be stored. Checked before a
+        // message is logged, so concurrent senders may pass it by a few.
+        bool has_room() const { return backlog_.load(std::memory_order_relaxed) < config_.max_backlog; }
+
+        WriterStats stats() const;
+
+    private:
+        using Time = std::chrono::steady_clock::time_point;
+
+        // What the writer keeps next to each message
+        struct Ticket {
+            Time queued_at;
+            WriteAheadLog::Lsn lsn;
+        };
+
+        struct Batch {
+            std::vector<ChatMessage> messages;
+            std::vector<Ticket> tickets;
+            Time issued_at;
+            bool done = false;
+            std::optional<Error> error;     // filled in by the completion
+            Time retry_at;                  // when a failed batch is written again
+            unsigned failures = 0;
+        };
+
+        struct Partition {
+            std::deque<ChatMessage> pending;
+            std::deque<Ticket> tickets;
+            size_t pending_bytes = 0;                       // write_batch_bytes of pending
+            std::deque<std::shared_ptr<Batch>> in_flight;   // issue order
+            bool abandoned = false;     // a failed batch was left to the WAL, settle nothing after it
+        };
+
+        void run();
+        // Sorts newly queued messages into their barracks' partitions
+        void partition_incoming(std::vector<ChatMessage>& messages, std::vector<Ticket>& tickets);
+        // Settles the stored batches at the head of the barrack's queue; a
+        // failed one stops it. While draining failed batches are dropped.
+        void complete(const std::string& barrack_id);
+        // Gives the batch's stored messages back to the WAL
+        void release(const Batch& batch);
+        // Issues what is due while the window has room, one batch per
+        // barrack per round. Returns when the next partial batch falls due.
+        std::optional<Time> flush(Time now, bool draining);
+        void issue(Partition& partition, Time now);
+        // Sends the batch to the repository, again for a failed one
+        void write(const std::shared_ptr<Batch>& batch, Time now);
+
+        std::shared_ptr<MessageRepository> repo_;
+        std::shared_ptr<WriteAheadLog> wal_;
+        const WriterConfig config_;
+        SettleCallback settled_;
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::vector<ChatMessage> incoming_;
+        std::vector<Ticket> incoming_tickets_;
+        std::vector<std::shared_ptr<Batch>> completed_;
+        bool stopping_ = false;
+
+        // writer thread only
+        std::unordered_map<std::string, Partition> partitions_;
+        bool draining_ = false;
+
+        std::atomic<uint64_t> queued_{0};
+        std::atomic<uint64_t> backlog_{0};
+        std::atomic<uint64_t> in_flight_{0};
+        std::atomic<uint64_t> batches_{0};
+        std::atomic<uint64_t> written_{0};
+        std::atomic<uint64_t> failed_{0};
+        LatencyHistogram commit_latency_;
+        LatencyHistogram round_trip_;
+
+        std::thread thread_;
+};
+
+#endif
@@ -5,6 +5,9 @@
 #include <iostream>
 #include <chrono>
 #include <vector>
+#include <array>
+#include <string_view>
+#include "PerfectHash.hpp"
 
 enum MessageType{
     UNKNOWN = -1,
@@ -43,63 +46,120 @@ enum MessageType{
     GET_USER_NAME,
     USER_LEFT_BARRACK_NOTIFY,
     ERROR_MESSAGE,
-    PING // S->C KEEP ALIVE REQUEST
+    PING, // S->C KEEP ALIVE REQUEST
+    TIMEOUT,        // request expired in the server queue
+    RETRY_LATER,    // server overloaded, request was not accepted
+    STATS,          // dispatcher and latency statistics
+    BATCH,          // several commands in one frame, answered with one frame
+    SYNC            // barrack messages after a client's sequence cursor
 };
 
-inline std::string message_type_to_string(MessageType type){
+// Wire name of a message type. Types without a case go out as "UNKNOWN".
+inline constexpr std::string_view message_type_name(MessageType type){
     switch(type){
-        case MessageType::AUTH_REQUEST: return std::string("AUTH_REQUEST"); 
-        case MessageType::SEND_MESSAGE_REQUEST: return std::string("SEND_MESSAGE_REQUEST"); 
-        case MessageType::CREATE_BARRACK_REQUEST: return std::string("CREATE_BARRACK_REQUEST");
-        case MessageType::JOIN_BARRACK_REQUEST: return std::string("JOIN_BARRACK_REQUEST");
-        case MessageType::LEAVE_BARRACK_REQUEST: return std::string("LEAVE_BARRACK_REQUEST");
-        case MessageType::LIST_BARRACK_REQUEST: return std::string("LIST_BARRACK_REQUEST");
-        case MessageType::PONG: return std::string("PONG");  
-        case MessageType::AUTH_SUCCESS: return std::string("AUTH_SUCCESS"); 
-        case MessageType::AUTH_FAILURE: return std::string("AUTH_FAILURE");
-        case MessageType::RECEIVE_MESSAGE_BROADCAST: return std::string("RECEIVE_MESSAGE_BROADCAST");
-        case MessageType::CREATE_BARRACK_SUCCESS: return std::string("CREATE_BARRACK_SUCCESS");
-        case MessageType::CREATE_BARRACK_FAILURE: return std::string("CREATE_BARRACK_FAILURE"); 
-        case MessageType::DESTROY_BARRACK_SUCCESS: return std::string("DESTROY_BARRACK_SUCCESS");
-        case MessageType::DESTROY_BARRACK_FAILURE: return std::string("DESTROY_BARRACK_FAILURE");
-        case MessageType::JOIN_BARRACK_SUCCESS: return std::string("JOIN_BARRACK_SUCCESS");
-        case MessageType::JOIN_BARRACK_FAILURE: return std::string("JOIN_BARRACK_FAILURE");
-        case MessageType::LEAVE_BARRACK_SUCCESS: return std::string("LEAVE_BARRACK_SUCCESS"); 
-        case MessageType::LEAVE_BARRACK_FAILURE: return std::string("LEAVE_BARRACK_FAILURE");
-        case MessageType::LIST_BARRACK_RESPONSE: return std::string("LIST_BARRACK_RESPONSE");
-        case MessageType::USER_JOINED_BARRACK_NOTIFY: return std::string("USER_JOINED_BARRACK_NOTIFY");
-        case MessageType::USER_LEFT_BARRACK_NOTIFY: return std::string("USER_LEFT_BARRACK_NOTIFY");
-        case MessageType::ERROR_MESSAGE: return std::string("ERROR_MESSAGE"); 
-        case MessageType::PING : return std::string("PING");  
-        default: return std::string("UNKNOWN");
+        case MessageType::AUTH_REQUEST: return "AUTH_REQUEST"; 
+        case MessageType::SEND_MESSAGE_REQUEST: return "SEND_MESSAGE_REQUEST"; 
+        case MessageType::CREATE_BARRACK_REQUEST: return "CREATE_BARRACK_REQUEST";
+        case MessageType::JOIN_BARRACK_REQUEST: return "JOIN_BARRACK_REQUEST";
+        case MessageType::LEAVE_BARRACK_REQUEST: return "LEAVE_BARRACK_REQUEST";
+        case MessageType::LIST_BARRACK_REQUEST: return "LIST_BARRACK_REQUEST";
+        case MessageType::PONG: return "PONG";  
+        case MessageType::AUTH_SUCCESS: return "AUTH_SUCCESS"; 
+        case MessageType::AUTH_FAILURE: return "AUTH_FAILURE";
+        case MessageType::RECEIVE_MESSAGE_BROADCAST: return "RECEIVE_MESSAGE_BROADCAST";
+        case MessageType::CREATE_BARRACK_SUCCESS: return "CREATE_BARRACK_SUCCESS";
+        case MessageType::CREATE_BARRACK_FAILURE: return "CREATE_BARRACK_FAILURE"; 
+        case MessageType::DESTROY_BARRACK_SUCCESS: return "DESTROY_BARRACK_SUCCESS";
+        case MessageType::DESTROY_BARRACK_FAILURE: return "DESTROY_BARRACK_FAILURE";
+        case MessageType::JOIN_BARRACK_SUCCESS: return "JOIN_BARRACK_SUCCESS";
+        case MessageType::JOIN_BARRACK_FAILURE: return "JOIN_BARRACK_FAILURE";
+        case MessageType::LEAVE_BARRACK_SUCCESS: return "LEAVE_BARRACK_SUCCESS"; 
+        case MessageType::LEAVE_BARRACK_FAILURE: return "LEAVE_BARRACK_FAILURE";
+        case MessageType::LIST_BARRACK_RESPONSE: return "LIST_BARRACK_RESPONSE";
+        case MessageType::USER_JOINED_BARRACK_NOTIFY: return "USER_JOINED_BARRACK_NOTIFY";
+        case MessageType::USER_LEFT_BARRACK_NOTIFY: return "USER_LEFT_BARRACK_NOTIFY";
+        case MessageType::ERROR_MESSAGE: return "ERROR_MESSAGE"; 
+        case MessageType::PING : return "PING";  
+        case MessageType::TIMEOUT: return "TIMEOUT";
+        case MessageType::RETRY_LATER: return "RETRY_LATER";
+        case MessageType::STATS: return "STATS";
+        case MessageType::BATCH: return "BATCH";
+        case MessageType::SYNC: return "SYNC";
+        default: return "UNKNOWN";
     }
 }
 
-inline MessageType string_to_message_type(const std::string& type_str) {
-    if (type_str == "AUTH_REQUEST") return MessageType::AUTH_REQUEST;
-    else if (type_str == "SEND_MESSAGE_REQUEST") return MessageType::SEND_MESSAGE_REQUEST;
-    else if (type_str == "CREATE_BARRACK_REQUEST") return MessageType::CREATE_BARRACK_REQUEST;
-    else if (type_str == "JOIN_BARRACK_REQUEST") return MessageType::JOIN_BARRACK_REQUEST;
-    else if (type_str == "LEAVE_BARRACK_REQUEST") return MessageType::LEAVE_BARRACK_REQUEST;
-    else if (type_str == "LIST_BARRACK_REQUEST") return MessageType::LIST_BARRACK_REQUEST;
-    else if (type_str == "PONG") return MessageType::PONG;
-    else if (type_str == "AUTH_SUCCESS") return MessageType::AUTH_SUCCESS;
-    else if (type_str == "AUTH_FAILURE") return MessageType::AUTH_FAILURE;
-    else if (type_str == "RECEIVE_MESSAGE_BROADCAST") return MessageType::RECEIVE_MESSAGE_BROADCAST;
-    else if (type_str == "CREATE_BARRACK_SUCCESS") return MessageType::CREATE_BARRACK_SUCCESS;
-    else if (type_str == "CREATE_BARRACK_FAILURE") return MessageType::CREATE_BARRACK_FAILURE;
-    else if (type_str == "DESTROY_BARRACK_SUCCESS") return MessageType::DESTROY_BARRACK_SUCCESS;
-    else if (type_str == "DESTROY_BARRACK_FAILURE") return MessageType::DESTROY_BARRACK_FAILURE;
-    else if (type_str == "JOIN_BARRACK_SUCCESS") return MessageType::JOIN_BARRACK_SUCCESS;
-    else if (type_str == "JOIN_BARRACK_FAILURE") return MessageType::JOIN_BARRACK_FAILURE;
-    else if (type_str == "LEAVE_BARRACK_SUCCESS") return MessageType::LEAVE_BARRACK_SUCCESS;
-    else if (type_str == "LEAVE_BARRACK_FAILURE") return MessageType::LEAVE_BARRACK_FAILURE;
-    else if (type_str == "LIST_BARRACK_RESPONSE") return MessageType::LIST_BARRACK_RESPONSE;
-    else if (type_str == "USER_JOINED_BARRACK_NOTIFY") return MessageType::USER_JOINED_BARRACK_NOTIFY;
-    else if (type_str == "USER_LEFT_BARRACK_NOTIFY") return MessageType::USER_LEFT_BARRACK_NOTIFY;
-    else if (type_str == "ERROR_MESSAGE") return MessageType::ERROR_MESSAGE;
-    else if (type_str == "PING") return MessageType::PING;
-    else return MessageType::UNKNOWN;
+inline std::string message_type_to_string(MessageType type){
+    return std::string(message_type_name(type));
+}
+
+inline constexpr std::array<std::string_view, 28> MESSAGE_TYPE_NAMES = {
+    "AUTH_REQUEST",
+    "SEND_MESSAGE_REQUEST",
+    "CREATE_BARRACK_REQUEST",
+    "JOIN_BARRACK_REQUEST",
+    "LEAVE_BARRACK_REQUEST",
+    "LIST_BARRACK_REQUEST",
+    "PONG",
+    "AUTH_SUCCESS",
+    "AUTH_FAILURE",
+    "RECEIVE_MESSAGE_BROADCAST",
+    "CREATE_BARRACK_SUCCESS",
+    "CREATE_BARRACK_FAILURE",
+    "DESTROY_BARRACK_SUCCESS",
+    "DESTROY_BARRACK_FAILURE",
+    "JOIN_BARRACK_SUCCESS",
+    "JOIN_BARRACK_FAILURE",
+    "LEAVE_BARRACK_SUCCESS",
+    "LEAVE_BARRACK_FAILURE",
+    "LIST_BARRACK_RESPONSE",
+    "USER_JOINED_BARRACK_NOTIFY",
+    "USER_LEFT_BARRACK_NOTIFY",
+    "ERROR_MESSAGE",
+    "PING",
+    "TIMEOUT",
+    "RETRY_LATER",
+    "STATS",
+    "BATCH",
+    "SYNC"
+};
+
+inline constexpr std::array<MessageType, MESSAGE_TYPE_NAMES.size()> MESSAGE_TYPE_VALUES = {
+    MessageType::AUTH_REQUEST,
+    MessageType::SEND_MESSAGE_REQUEST,
+    MessageType::CREATE_BARRACK_REQUEST,
+    MessageType::JOIN_BARRACK_REQUEST,
+    MessageType::LEAVE_BARRACK_REQUEST,
+    MessageType::LIST_BARRACK_REQUEST,
+    MessageType::PONG,
+    MessageType::AUTH_SUCCESS,
+    MessageType::AUTH_FAILURE,
+    MessageType::RECEIVE_MESSAGE_BROADCAST,
+    MessageType::CREATE_BARRACK_SUCCESS,
+    MessageType::CREATE_BARRACK_FAILURE,
+    MessageType::DESTROY_BARRACK_SUCCESS,
+    MessageType::DESTROY_BARRACK_FAILURE,
+    MessageType::JOIN_BARRACK_SUCCESS,
+    MessageType::JOIN_BARRACK_FAILURE,
+    MessageType::LEAVE_BARRACK_SUCCESS,
+    MessageType::LEAVE_BARRACK_FAILURE,
+    MessageType::LIST_BARRACK_RESPONSE,
+    MessageType::USER_JOINED_BARRACK_NOTIFY,
+    MessageType::USER_LEFT_BARRACK_NOTIFY,
+    MessageType::ERROR_MESSAGE,
+    MessageType::PING,
+    MessageType::TIMEOUT,
+    MessageType::RETRY_LATER,
+    MessageType::STATS,
+    MessageType::BATCH,
+    MessageType::SYNC
+};
+
+inline constexpr PerfectHashMap<MESSAGE_TYPE_NAMES.size()> MESSAGE_TYPE_INDEX{MESSAGE_TYPE_NAMES};
+
+inline MessageType string_to_message_type(std::string_view type_str) {
+    int index = MESSAGE_TYPE_INDEX.find(type_str);
+    return index < 0 ? MessageType::UNKNOWN : MESSAGE_TYPE_VALUES[index];
 }
 
 class BaseMessage {
@@ -0,0 +1,57 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Fixed set of preallocated objects handed out by pointer. When the pool runs
+// dry it grows; objects are never freed before the pool itself.
+template<typename T>
+class ObjectPool {
+    public:
+        explicit ObjectPool(size_t initial_size){
+            storage_.reserve(initial_size);
+            free_.reserve(initial_size);
+            for(size_t i = 0; i < initial_size; ++i){
+                storage_.push_back(std::make_unique<T>());
+                free_.push_back(storage_.back().get());
+            }
+        }
+        ObjectPool(const ObjectPool&) = delete;
+        ObjectPool& operator=(const ObjectPool&) = delete;
+
+        T* acquire(){
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(free_.empty()){
+                storage_.push_back(std::make_unique<T>());
+                free_.reserve(storage_.capacity());
+                return storage_.back().get();
+            }
+            T* obj = free_.back();
+            free_.pop_back();
+            return obj;
+        }
+
+        void release(T* obj){
+            std::lock_guard<std::mutex> lock(mtx_);
+            free_.push_back(obj);
+        }
+
+        void release(const std::vector<T*>& objs){
+            std::lock_guard<std::mutex> lock(mtx_);
+            free_.insert(free_.end(), objs.begin(), objs.end());
+        }
+
+        size_t capacity(){
+            std::lock_guard<std::mutex> lock(mtx_);
+            return storage_.size();
+        }
+
+    private:
+        std::mutex mtx_;
+        std::vector<std::unique_ptr<T>> storage_;
+        std::vector<T*> free_;
+};
+
+#endif
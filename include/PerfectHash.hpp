@@ -0,0 +1,77 @@
+#ifndef PERFECTHASH_H
+#define PERFECTHASH_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Compile-time perfect hash over a fixed set of string keys. The constructor
+// searches for a seed under which every key lands in its own slot, so a
+// lookup costs one hash, one table read and one string compare.
+template<size_t N>
+class PerfectHashMap {
+    public:
+        static constexpr size_t TABLE_SIZE = [](){
+            size_t size = 1;
+            while(size < N * 2){
+                size <<= 1;
+            }
+            return size;
+        }();
+
+        consteval explicit PerfectHashMap(const std::array<std::string_view, N>& keys) : keys_(keys) {
+            for(uint32_t seed = 1; seed < MAX_SEED; ++seed){
+                if(try_seed(seed)){
+                    seed_ = seed;
+                    return;
+                }
+            }
+            throw "PerfectHashMap: no collision free seed found";
+        }
+
+        // Index of key in the original array, or -1 when it is not a member.
+        constexpr int find(std::string_view key) const {
+            int index = slots_[slot_of(key, seed_)];
+            if(index >= 0 && keys_[index] == key){
+                return index;
+            }
+            return -1;
+        }
+
+        static constexpr size_t size() { return N; }
+
+    private:
+        static constexpr uint32_t MAX_SEED = 1u << 16;
+
+        static constexpr size_t slot_of(std::string_view key, uint32_t seed){
+            // FNV-1a mixed with the seed and the length
+            uint32_t hash = 2166136261u ^ seed;
+            for(char c : key){
+                hash ^= static_cast<uint8_t>(c);
+                hash *= 16777619u;
+            }
+            hash ^= static_cast<uint32_t>(key.size()) * 0x9E3779B1u;
+            hash ^= hash >> 15;
+            return hash & (TABLE_SIZE - 1);
+        }
+
+        constexpr bool try_seed(uint32_t seed){
+            for(auto& slot : slots_){
+                slot = -1;
+            }
+            for(size_t i = 0; i < N; ++i){
+                auto slot = slot_of(keys_[i], seed);
+                if(slots_[slot] != -1){
+                    return false;
+                }
+                slots_[slot] = static_cast<int16_t>(i);
+            }
+            return true;
+        }
+
+        std::array<std::string_view, N> keys_;
+        std::array<int16_t, TABLE_SIZE> slots_{};
+        uint32_t seed_ = 0;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef RESPONSES_H
+#define RESPONSES_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Messages.hpp"
+#include "types.hpp"
+
+// Serializers for every server -> client frame the commands and the
+// dispatcher send. Each one renders into a per thread scratch buffer with
+// JsonWriter and returns an exactly sized copy, so a response costs a single
+// allocation. The bytes match what the old nlohmann::json DOMs dumped.
+
+// Correlation data every command reply carries. request_id is the raw JSON
+// token the client sent in its envelope and is echoed back verbatim; it is
+// empty (and omitted) when the client did not send one.
+struct ResponseMeta {
+    uint64_t sequence_id;
+    std::string_view request_id;
+};
+
+// {"payload":{"error_code":<type>,"message":...},"request_id":R,"sequence_id":N,"type":<type>}
+std::string failure_response(MessageType type, const ResponseMeta& meta, std::string_view message);
+std::string failure_response(std::string_view type, const ResponseMeta& meta, std::string_view error_code, std::string_view message);
+
+// Dispatcher level errors, not tied to a sequence id:
+// {"payload":{"error_code":...,"message":...},"request_id":R,"type":"ERROR"}
+std::string error_response(std::string_view error_code, std::string_view message, std::string_view request_id = {});
+
+// {"payload":{"message":...},"request_id":R,"sequence_id":N,"type":<type>}
+std::string status_response(MessageType type, const ResponseMeta& meta, std::string_view message);
+
+// {"message":...,"request_id":R,"sequence_id":N,"type":<type>}
+std::string message_response(MessageType type, const ResponseMeta& meta, std::string_view message);
+
+std::string auth_success_response(const ResponseMeta& meta, std::string_view token, std::string_view user_id, bool user_created);
+std::string username_response(const ResponseMeta& meta, std::string_view username);
+
+std::string create_barrack_success_response(const ResponseMeta& meta, std::string_view barrack_id, std::string_view owner_id);
+std::string barrack_response(const ResponseMeta& meta, const Barrack& barrack);
+std::string barracks_response(const ResponseMeta& meta, const std::vector<Barrack>& barracks);
+std::string barrack_members_response(const ResponseMeta& meta, const std::vector<BarrackMember>& members);
+std::string barrack_messages_response(const ResponseMeta& meta, const std::vector<ChatMessage>& messages);
+
+// Fanout of a new barrack message to the room:
+// {"payload":{"barrack_id":...,"created_at":...,"message":...,"seq":N,"user_id":...},"type":"RECEIVE_MESSAGE_BROADCAST"}
+std::string message_broadcast(const ChatMessage& message);
+
+// One page of a SYNC reply. last_seq is the cursor the client should keep
+// (the seq of the last message, or its old cursor for an empty page) and
+// more says whether another page follows.
+// {"payload":{"barrack_id":...,"last_seq":N,"messages":[...],"more":bool},"request_id":R,"sequence_id":N,"type":"SYNC"}
+std::string sync_response(const ResponseMeta& meta, std::string_view barrack_id, uint64_t last_seq,
+                          std::span<const ChatMessage> messages, bool more);
+
+// Replies of a BATCH frame's commands, in command order:
+// {"payload":{"responses":[...]},"request_id":R,"sequence_id":N,"type":"BATCH"}
+std::string batch_response(const ResponseMeta& meta, const std::vector<std::string>& replies);
+
+#endif
@@ -1,24 +1,141 @@
 #ifndef ROOM_H
 #define ROOM_H
 
-#include <set>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <json.hpp>
+#include "LatencyHistogram.hpp"
 
 // Forward declaration to avoid recursive include
 class ClientSession;
 
+// Fanout thresholds, set once at startup (see main) before any broadcast.
+struct FanoutConfig {
+    // rooms smaller than this are delivered inline by the caller
+    size_t group_min_members = 64;
+    // sessions served by one posted fanout task
+    size_t task_sessions = 256;
+    // rooms with at least this many members are split into member shards of
+    // this size, each fanned out by its own task on an io thread
+    size_t shard_members = 8192;
+    // recipients a shard task serves before it re-posts itself, so one huge
+    // room cannot hold an io thread away from other rooms' traffic
+    size_t pace_sessions = 1024;
+};
+
+// Process wide broadcast counters, reported under "fanout" in the dispatcher stats.
+struct FanoutStats {
+    std::atomic<uint64_t> broadcasts{0};
+    std::atomic<uint64_t> grouped_broadcasts{0};    // fanned out through per executor tasks
+    std::atomic<uint64_t> group_tasks{0};
+    std::atomic<uint64_t> sharded_broadcasts{0};    // split into member shards
+    std::atomic<uint64_t> shard_tasks{0};
+    std::atomic<uint64_t> paced_yields{0};          // shard tasks re-posted to let other work run
+    std::atomic<uint64_t> deliveries{0};            // frames queued on sessions
+    // posts made from a thread that does not run the recipient's io_context
+    std::atomic<uint64_t> handoffs{0};
+    // io_contexts touched, summed over broadcasts; divided by broadcasts it
+    // tells how well placement keeps rooms on one thread
+    std::atomic<uint64_t> executor_groups{0};
+    // sessions created on the io thread of the barrack they asked for
+    std::atomic<uint64_t> steered_sessions{0};
+    // broadcast() called -> every frame queued on the sessions of one task
+    // (or of the whole room when it was delivered inline)
+    LatencyHistogram handoff;
+    // first -> last recipient of one broadcast getting its frames queued
+    LatencyHistogram spread;
+
+    nlohmann::json to_json() const;
+};
+
+// One published member list of a Room. Entries are never removed from a
+// list once it is published: leave() only sets the entry's flag, and the
+// room's next rewrite drops flagged entries together with expired ones.
+struct RoomMembers {
+    explicit RoomMembers(std::vector<std::weak_ptr<ClientSession>> members);
+
+    size_t size() const { return sessions.size(); }
+    // nullptr once the member closed or left the room
+    std::shared_ptr<ClientSession> lock(size_t index) const;
+
+    std::vector<std::weak_ptr<ClientSession>> sessions;
+    std::unique_ptr<std::atomic<bool>[]> left;
+};
+
+// Sessions subscribed to one barrack.
+//
+// Membership is an array published through an atomic pointer. join() builds
+// a new array under mtx_ and swaps it in, so broadcasts walk a snapshot
+// without taking the room lock and never block membership changes. leave()
+// finds the session's entry through an index by session id and flags it in
+// place, which costs O(1) however large the room. Flagged entries, and those
+// of closed sessions, stay in the array until the next rewrite compacts them
+// away; a quarter of the room's worth of them triggers that rewrite.
+//
+// Frames are shared by every recipient. Larger rooms are not fanned out from
+// the calling dispatcher thread: recipients are grouped by the io_context
+// running their strand and each group is handed over in a few tasks, so the
+// per session posts happen on io threads instead of as N cross thread wakeups.
+// The tasks for one io_context go through the room's strand on it, so every
+// member gets the room's broadcasts in the order they were made.
+// Very large rooms skip even the grouping pass on the dispatcher thread: the
+// snapshot is cut into member shards that io threads walk in parallel, a
+// paced slice at a time, each shard on a strand the room keeps for it.
+// Broadcasts that cannot share those strands safely (an inline one, or a
+// sharded one after a membership change) wait until the ones in flight have
+// been delivered.
 class Room {
     public:
-        explicit Room(const std::string& barrack_id) : barrack_id_(barrack_id){}
-        void join(std::shared_ptr<ClientSession> session);
+
+        explicit Room(const std::string& barrack_id);
+        // false once the room has been retired; look the room up again
+        bool join(std::shared_ptr<ClientSession> session);
         void leave(std::shared_ptr<ClientSession> session);
         void broadcast(const std::string& message);
+        void broadcast_batch(const std::vector<std::string>& messages);
+        bool empty() const;
+        size_t size() const;
+        std::vector<std::shared_ptr<ClientSession>> live_members() const;
+        // Marks an empty room dead so no one can join it after the registry
+        // dropped it. Returns false, and leaves the room alone, if it has members.
+        bool try_retire();
+
+        static FanoutStats& fanout_stats();
+        static void configure_fanout(const FanoutConfig& config);
+        static const FanoutConfig& fanout_config();
+        // Orders a room's broadcasts, shared with its fanout tasks
+        class FanoutOrder;
     private:
+        using Members = RoomMembers;
+        using SessionList = std::vector<std::weak_ptr<ClientSession>>;
+
+        std::shared_ptr<const Members> members() const;
+        // Copy of the current members without the expired or departed ones.
+        // Caller holds mtx_.
+        SessionList compacted() const;
+        // Publishes members and indexes their positions. Caller holds mtx_.
+        void publish(SessionList members);
+        // Called by broadcasts that found expired members in their snapshot.
+        void note_dead(size_t dead, size_t total);
+        void fanout(std::shared_ptr<const std::vector<std::string>> frames);
+        void fanout_sharded(std::shared_ptr<const Members> snapshot, std::shared_ptr<const std::vector<std::string>> frames,
+                            int command, std::chrono::steady_clock::time_point started);
+
         std::string barrack_id_;
-        std::mutex mtx_;
-        std::set<std::weak_ptr<ClientSession>, std::owner_less<std::weak_ptr<ClientSession>>> members_;
+        std::mutex mtx_;    // serializes writers; broadcasts never take it
+        bool retired_ = false;
+        std::atomic<std::shared_ptr<const Members>> members_{std::make_shared<const Members>(SessionList{})};
+        // session id -> entry in the published members, guarded by mtx_
+        std::unordered_map<uint64_t, size_t> positions_;
+        std::atomic<size_t> joined_{0};     // positions_.size()
+        std::atomic<size_t> dead_{0};
+        std::shared_ptr<FanoutOrder> order_;
 };
 
-#endif
\ No newline at end of file
+#endif
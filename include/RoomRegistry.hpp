@@ -0,0 +1,86 @@
+#ifndef ROOMREGISTRY_H
+#define ROOMREGISTRY_H
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "MembershipIndex.hpp"
+#include "Room.hpp"
+
+class ClientSession;
+
+// Live rooms by barrack id, shared by every dispatcher worker.
+//
+// The registry is split into shards by barrack id. Each shard publishes an
+// immutable map snapshot; writers (room creation, removal, sweeping) copy the
+// map under the shard mutex and swap the snapshot in. Readers load the current
+// snapshot and probe it, so they never wait for a writer's copy. The atomic
+// shared_ptr itself is not lock free in libstdc++: load and store take a short
+// internal lock around the reference count. Readers hold a snapshot only for
+// the duration of a lookup, so a replaced map and the rooms only it still
+// references go away as soon as the last lookup in flight finishes.
+//
+// Rooms are not dropped when their last member leaves. Empty rooms are retired
+// lazily when their shard is next rewritten, or once enough of them pile up.
+//
+// Joins and leaves are mirrored into a MembershipIndex, so a closing session
+// leaves exactly the rooms it joined (see disconnect()), and a user leaving a
+// barrack takes all of their sessions out of its room (see leave_user()).
+// Each leave is O(1) in the size of the room, see Room::leave().
+class RoomRegistry {
+    public:
+        static constexpr size_t SHARD_COUNT = 16;
+        // empty rooms a shard tolerates before a leave triggers a sweep
+        static constexpr size_t SWEEP_THRESHOLD = 32;
+
+        RoomRegistry();
+        RoomRegistry(const RoomRegistry&) = delete;
+        RoomRegistry& operator=(const RoomRegistry&) = delete;
+
+        // Does not take the shard mutex; nullptr when the barrack has no live room.
+        std::shared_ptr<Room> find(std::string_view barrack_id) const;
+        std::shared_ptr<Room> get_or_create(std::string_view barrack_id);
+
+        void join(std::string_view barrack_id, std::shared_ptr<ClientSession> session);
+        void leave(std::string_view barrack_id, std::shared_ptr<ClientSession> session);
+        // The user left the barrack: session and every other session the
+        // user is logged in on leave its room.
+        void leave_user(std::string_view barrack_id, std::string_view user_id, std::shared_ptr<ClientSession> session);
+        bool remove(std::string_view barrack_id);
+        // Leaves every room the session joined and drops it from the index.
+        void disconnect(const std::shared_ptr<ClientSession>& session);
+
+        size_t size() const;
+        MembershipIndex& membership() { return membership_; }
+
+    private:
+        struct IdHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view id) const { return std::hash<std::string_view>{}(id); }
+        };
+        using RoomMap = std::unordered_map<std::string, std::shared_ptr<Room>, IdHash, std::equal_to<>>;
+
+        struct Shard {
+            std::mutex mtx_;    // serializes writers only
+            std::atomic<std::shared_ptr<const RoomMap>> snapshot_{std::make_shared<const RoomMap>()};
+            std::atomic<size_t> idle_rooms_{0};
+        };
+
+        static size_t shard_index(std::string_view barrack_id);
+        // Locked path of get_or_create; never returns a retired room.
+        std::shared_ptr<Room> create(std::string_view barrack_id);
+        void leave_room(std::string_view barrack_id, const std::shared_ptr<ClientSession>& session);
+        // Copies the shard map, dropping the empty rooms it manages to retire,
+        // lets edit change the copy and publishes it. Caller holds the shard mutex.
+        template<typename Edit>
+        void rewrite(Shard& shard, Edit&& edit);
+
+        std::array<Shard, SHARD_COUNT> shards_;
+        MembershipIndex membership_;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "Error.hpp"
+#include "LatencyHistogram.hpp"
+#include "types.hpp"
+
+// When appended messages are forced to disk, see main.
+enum class WalSync {
+    NONE,       // left to the kernel: survives a crash of the server, not of the machine
+    GROUP,      // appenders wait for one msync shared by everyone queued behind it
+    ALWAYS,     // every append is synced on its own, under the log lock
+};
+
+struct WalConfig {
+    std::string directory = "chat-wal";
+    // preallocated size of every segment file; a record never spans two
+    size_t segment_bytes = 16 * 1024 * 1024;
+    WalSync sync = WalSync::GROUP;
+};
+
+// Reported under "wal" in the dispatcher stats.
+struct WalStats {
+    size_t segments;            // files on disk, the one being appended to included
+    uint64_t appends;
+    uint64_t syncs;
+    uint64_t sync_failures;     // msyncs that failed, their records were refused
+    uint64_t released;          // records Cassandra acknowledged
+    LatencyHistogram::Snapshot sync_latency;
+};
+
+// Local log of the chat messages Cassandra has not acknowledged yet.
+//
+// The log is a directory of fixed size segment files, each mapped into
+// memory and appended to with memcpy. A record is its length, a CRC32 of the
+// payload, a released flag and the encoded message; a zero length ends a
+// segment. Records are addressed by an Lsn, the segment index in the high 32
+// bits and the offset in the low ones, so Lsns grow with every append.
+//
+// Released records are flagged in place and skipped by replay; once every
+// record of a segment was released the file is deleted. Records that are
+// never released (their write failed) keep their segment around and are
+// replayed by the next open().
+class WriteAheadLog {
+    public:
+        using Lsn = uint64_t;
+        using RecordVisitor = std::function<void(ChatMessage&& message, Lsn lsn)>;
+
+        explicit WriteAheadLog(WalConfig config);
+        ~WriteAheadLog();
+
+        WriteAheadLog(const WriteAheadLog&) = delete;
+        WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+        // Replays every record left by the previous run, oldest first, then
+        // starts a new segment. Must be called once before append().
+        // Replayed records stay in the log until they are released.
+        Result<size_t> open(const RecordVisitor& visit);
+
+        // Copies the message into the log. It is durable once sync(lsn)
+        // succeeded (at once with WalSync::ALWAYS, where a failed msync
+        // takes the record back and fails the append).
+        Result<Lsn> append(const ChatMessage& message);
+        // Waits until every record up to lsn is on disk, as the policy says.
+        // Fails when the msync that covered lsn failed; the record stays in
+        // the log until released, which is how a caller drops it. Once it
+        // answered for a record, sync gives that record the same answer.
+        StatusResult sync(Lsn lsn);
+        // Records Cassandra has stored; drops segments nobody needs anymore
+        void release(const std::vector<Lsn>& lsns);
+
+        WalStats stats() const;
+
+    private:
+        struct Segment {
+            uint32_t index;
+            int fd = -1;
+            char* base = nullptr;
+            size_t size = 0;
+            size_t end = 0;         // where the next record goes
+            size_t synced = 0;      // everything before it is on disk
+            size_t live = 0;        // records not released yet
+            std::string path;
+
+            ~Segment();
+        };
+
+        Result<std::shared_ptr<Segment>> create_segment(uint32_t index);
+        // Appends follow in a new segment; the current one keeps its records
+        Result<std::monostate> roll();
+        void drop_segment(uint32_t index);
+        // msync of [from, to) rounded out to whole pages
+        static StatusResult sync_range(const Segment& segment, size_t from, size_t to);
+
+        const WalConfig config_;
+        int dir_fd_ = -1;
+
+        mutable std::mutex mtx_;
+        std::condition_variable synced_cv_;
+        std::map<uint32_t, std::shared_ptr<Segment>> segments_;
+        std::shared_ptr<Segment> current_;
+        Lsn durable_ = 0;           // every record below it is on disk
+        bool syncing_ = false;      // a group commit is running
+        // [from, to) ranges covered by a failed group commit, never reported
+        // durable. Kept apart so records synced between two failures stay
+        // durable: sync() answers the same for a record every time it is asked.
+        std::vector<std::pair<Lsn, Lsn>> failed_;
+
+        std::atomic<uint64_t> appends_{0};
+        std::atomic<uint64_t> syncs_{0};
+        std::atomic<uint64_t> sync_failures_{0};
+        std::atomic<uint64_t> released_{0};
+        LatencyHistogram sync_latency_;
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <chrono>
+#include <cstdint>
 #include <optional>
 
 #define MIN_BARRAK_NAME_LEN 5
@@ -64,11 +65,13 @@ struct ChatMessage {
     std::string sender_user_id; // Foreign Key to UserAccounts.user_id
     std::string content;        // The message text
     std::chrono::system_clock::time_point sent_at;
+    uint64_t seq = 0;           // Position in the barrack, assigned by the server starting at 1
 
     ChatMessage(std::string mid, std::string bid, std::string sid, std::string msg_content,
-                std::chrono::system_clock::time_point sent)
+                std::chrono::system_clock::time_point sent, uint64_t sequence = 0)
         : message_id(std::move(mid)), barrack_id(std::move(bid)),
-          sender_user_id(std::move(sid)), content(std::move(msg_content)), sent_at(sent) {}
+          sender_user_id(std::move(sid)), content(std::move(msg_content)), sent_at(sent),
+          seq(sequence) {}
 
     ChatMessage() = default;
     virtual ~ChatMessage() = default;
@@ -3,11 +3,9 @@
 #include <mutex>
 #include <string>
 
-#include <boost/uuid/uuid.hpp>            // uuid class
-#include <boost/uuid/uuid_generators.hpp> // generators (random, name-based, etc.)
-#include <boost/uuid/uuid_io.hpp> 
 
 #include "AuthManager.hpp"
+#include "IdGenerator.hpp"
 #include "UserRepo.hpp"
 #include "Messages.hpp"
 #include "types.hpp"
@@ -176,12 +174,7 @@ std::string AuthManager::generate_salt(){
 
 
 std::string AuthManager::generate_user_id(){
-    boost::uuids::random_generator generator;
-    boost::uuids::uuid uuid = generator();
-
-    std::stringstream ss;
-    ss << uuid;
-    return ss.str();
+    return IdGenerator::sortable_uuid();
 }
 
 bool AuthManager::verify_password(const std::string& password, const std::string& stored_hash){
@@ -1,34 +1,287 @@
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <mutex>
 #include <optional>
 #include <string>
 
-#include <boost/uuid/uuid.hpp>            // uuid class
-#include <boost/uuid/uuid_generators.hpp> // generators (random, name-based, etc.)
-#include <boost/uuid/uuid_io.hpp>
 #include <variant>
 
 #include "BarrackManager.hpp"
 #include "Crypto.hpp"
 #include "Error.hpp"
+#include "IdGenerator.hpp"
 #include "types.hpp"
 
 using Clock = std::chrono::system_clock;
 
-void BarrackManager::dispatch_cass_message(){
-    while (auto msg_optional = message_queue_.wait_and_pop()) {
-        ChatMessage& msg_to_db = *msg_optional;
+// Rough heap footprint of a cached message
+static size_t message_bytes(const ChatMessage& message){
+    return sizeof(ChatMessage) + message.message_id.size() + message.barrack_id.size()
+         + message.sender_user_id.size() + message.content.size();
+}
+
+void BarrackManager::append_history(BarrackState& state, const ChatMessage& message){
+    size_t bytes = message_bytes(message);
+    state.history_.push_back(message);
+    state.history_bytes_ += bytes;
+    history_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    trim_history(state, history_config_.ring_capacity);
+    touch_history(state);
+}
+
+void BarrackManager::trim_history(BarrackState& state, size_t keep){
+    size_t freed = 0;
+    while(state.history_.size() > keep && state.history_.front().seq <= state.settled_seq_){
+        freed += message_bytes(state.history_.front());
+        state.history_.pop_front();
+    }
+    if(state.history_.empty()){
+        std::deque<ChatMessage>().swap(state.history_);     // give the blocks back
+    }
+    state.history_bytes_ -= freed;
+    history_bytes_.fetch_sub(freed, std::memory_order_relaxed);
+}
+
+void BarrackManager::touch_history(BarrackState& state){
+    state.last_used_.store(history_clock_.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void BarrackManager::evict_cold_histories(){
+    size_t low_watermark = history_config_.budget_bytes / 4 * 3;
+    if(history_bytes_.load(std::memory_order_relaxed) <= history_config_.budget_bytes){
+        return;
+    }
+
+    auto states = states_.load(std::memory_order_acquire);
+    std::vector<std::pair<uint64_t, BarrackState*>> cached;
+    for(const auto& [barrack_id, state] : *states){
+        cached.emplace_back(state->last_used_.load(std::memory_order_relaxed), state.get());
+    }
+    std::sort(cached.begin(), cached.end(), [](const auto& a, const auto& b){ return a.first < b.first; });
+    for(auto& [last_used, state] : cached){
+        if(history_bytes_.load(std::memory_order_relaxed) <= low_watermark){
+            break;
+        }
+        std::lock_guard<std::mutex> lock(state->mtx_);
+        size_t before = state->history_bytes_;
+        trim_history(*state, 0);
+        if(state->history_bytes_ != before){
+            history_evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
 
-        auto res = msg_repo_->add(msg_to_db);
-        if (std::holds_alternative<Error>(res)) {
-            std::cerr << "Chat messages insertion to database failed for message ID: "
-                      << msg_to_db.message_id << std::endl;
+void BarrackManager::publish_synced(BarrackState& state, WriteAheadLog::Lsn upto){
+    std::vector<ChatMessage> synced;
+    std::vector<WriteAheadLog::Lsn> lsns;
+    std::vector<WriteAheadLog::Lsn> dropped;
+    while(!state.unsynced_.empty() && state.unsynced_.front().second <= upto){
+        auto& [message, lsn] = state.unsynced_.front();
+        // upto is settled and commits go in lsn order, so this never waits
+        if(std::holds_alternative<Success>(wal_->sync(lsn))){
+            append_history(state, message);
+            synced.push_back(std::move(message));
+            lsns.push_back(lsn);
         } else {
-            std::cout << "Message ID: " << msg_to_db.message_id << " saved to database." << std::endl;
+            dropped.push_back(lsn);
+        }
+        state.unsynced_.pop_front();
+    }
+    if(!synced.empty()){
+        writer_->push_batch(std::move(synced), lsns);
+    }
+    if(!dropped.empty()){
+        wal_->release(dropped);
+    }
+}
+
+void BarrackManager::settle_history(const std::vector<ChatMessage>& batch){
+    // messages of a barrack are queued in seq order, so the last one of each
+    // barrack in the batch settles everything before it
+    std::unordered_map<std::string_view, uint64_t> settled;
+    for(const auto& message : batch){
+        settled[message.barrack_id] = message.seq;
+    }
+    for(const auto& [barrack_id, seq] : settled){
+        auto state = find_state(barrack_id);
+        if(!state){
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(state->mtx_);
+        state->settled_seq_ = std::max(state->settled_seq_, seq);
+        trim_history(*state, history_config_.ring_capacity);
+    }
+    // only settled messages can be dropped, so this is the one place eviction can help
+    evict_cold_histories();
+}
+
+HistoryStats BarrackManager::history_stats() const {
+    size_t cached_barracks = 0;
+    for(const auto& [barrack_id, state] : *states_.load(std::memory_order_acquire)){
+        std::lock_guard<std::mutex> lock(state->mtx_);
+        cached_barracks += !state->history_.empty();
+    }
+    return {history_bytes_.load(std::memory_order_relaxed),
+            history_config_.budget_bytes,
+            cached_barracks,
+            history_hits_.load(std::memory_order_relaxed),
+            history_misses_.load(std::memory_order_relaxed),
+            history_evictions_.load(std::memory_order_relaxed)};
+}
+
+std::optional<WalStats> BarrackManager::wal_stats() const {
+    if(!wal_){
+        return std::nullopt;
+    }
+    return wal_->stats();
+}
+
+std::shared_ptr<BarrackManager::BarrackState> BarrackManager::find_state(std::string_view barrack_id) const {
+    auto states = states_.load(std::memory_order_acquire);
+    auto itr = states->find(barrack_id);
+    return itr == states->end() ? nullptr : itr->second;
+}
+
+std::shared_ptr<BarrackManager::BarrackState> BarrackManager::state_for(const std::string& barrack_id){
+    if(auto state = find_state(barrack_id)){
+        return state;
+    }
+    std::lock_guard<std::mutex> lock(states_mtx_);
+    auto current = states_.load(std::memory_order_acquire);
+    auto itr = current->find(barrack_id);
+    if(itr != current->end()){
+        return itr->second;
+    }
+    auto state = std::make_shared<BarrackState>();
+    auto next = std::make_shared<StateMap>(*current);
+    next->emplace(barrack_id, state);
+    states_.store(std::move(next), std::memory_order_release);
+    return state;
+}
+
+void BarrackManager::drop_state(const std::string& barrack_id){
+    std::lock_guard<std::mutex> lock(states_mtx_);
+    auto current = states_.load(std::memory_order_acquire);
+    auto itr = current->find(barrack_id);
+    if(itr == current->end()){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> state_lock(itr->second->mtx_);
+        history_bytes_.fetch_sub(itr->second->history_bytes_, std::memory_order_relaxed);
+        itr->second->history_bytes_ = 0;
+        itr->second->history_.clear();
+    }
+    auto next = std::make_shared<StateMap>(*current);
+    next->erase(barrack_id);
+    states_.store(std::move(next), std::memory_order_release);
+}
+
+template<typename Edit>
+void BarrackManager::update_catalog(Edit&& edit){
+    auto next = std::make_shared<Catalog>(*barracks_.load(std::memory_order_acquire));
+    edit(*next);
+    barracks_.store(std::move(next), std::memory_order_release);
+}
+
+Result<WarmStartStats> BarrackManager::warm_start(){
+    auto started = std::chrono::steady_clock::now();
+
+    Catalog catalog;
+    auto barracks = barrack_repo_->for_each_barrack([&](Barrack&& barrack){
+        auto barrack_id = barrack.barrack_id;
+        catalog.insert_or_assign(std::move(barrack_id), std::move(barrack));
+    });
+    if(std::holds_alternative<Error>(barracks)){
+        return std::get<Error>(barracks);
+    }
+
+    // Rows come in table order, barracks interleaved. Inserting them straight
+    // into the member sets misses the cache on nearly every row, so they are
+    // collected first and each set is built in one go at its final size.
+    struct LoadedMember {
+        uint32_t barrack;
+        InternTable::Handle user;
+        Clock::time_point joined_at;
+    };
+    std::deque<LoadedMember> loaded;       // grows without moving the rows
+    std::vector<std::pair<std::string_view, size_t>> barrack_sizes;   // id, member count
+    std::unordered_map<std::string, uint32_t, IdHash, std::equal_to<>> barrack_index;
+    auto memberships = barrack_repo_->for_each_member([&](std::string_view barrack_id, std::string_view user_id,
+                                                          Clock::time_point joined_at){
+        auto itr = barrack_index.find(barrack_id);
+        if(itr == barrack_index.end()){
+            itr = barrack_index.emplace(std::string(barrack_id), static_cast<uint32_t>(barrack_sizes.size())).first;
+            barrack_sizes.emplace_back(itr->first, 0);
+        }
+        ++barrack_sizes[itr->second].second;
+        loaded.push_back({itr->second, user_ids_.intern(user_id), joined_at});
+    });
+    if(std::holds_alternative<Error>(memberships)){
+        return std::get<Error>(memberships);
+    }
+
+    StateMap states;
+    states.reserve(barrack_sizes.size());
+    std::vector<BarrackState*> by_index;
+    by_index.reserve(barrack_sizes.size());
+    for(const auto& [barrack_id, members] : barrack_sizes){
+        auto state = std::make_shared<BarrackState>();
+        state->members_.reserve(members);
+        by_index.push_back(state.get());
+        states.emplace(std::string(barrack_id), std::move(state));
+    }
+    for(auto& member : loaded){
+        by_index[member.barrack]->members_.try_emplace(member.user, member.joined_at);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(catalog_mtx_);
+        update_catalog([&](Catalog& live){
+            for(auto& [barrack_id, barrack] : catalog){
+                live.try_emplace(barrack_id, std::move(barrack));
+            }
+        });
+    }
+    {
+        std::lock_guard<std::mutex> lock(states_mtx_);
+        auto next = std::make_shared<StateMap>(std::move(states));
+        for(const auto& [barrack_id, live] : *states_.load(std::memory_order_acquire)){
+            auto [itr, inserted] = next->try_emplace(barrack_id, live);
+            if(!inserted){
+                std::lock_guard<std::mutex> state_lock(live->mtx_);
+                for(auto& [user, joined_at] : itr->second->members_){
+                    live->members_.try_emplace(user, joined_at);
+                }
+                itr->second = live;
+            }
         }
+        states_.store(std::move(next), std::memory_order_release);
+    }
+
+    return WarmStartStats{std::get<size_t>(barracks), std::get<size_t>(memberships),
+                          std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started)};
+}
+
+Result<size_t> BarrackManager::replay_wal(){
+    if(!wal_){
+        return size_t{0};
     }
-    std::cout << "Message dispatcher thread finished." << std::endl;
+    auto barracks = barracks_.load(std::memory_order_acquire);
+    return wal_->open([&](ChatMessage&& message, WriteAheadLog::Lsn lsn){
+        if(barracks->find(message.barrack_id) == barracks->end()){
+            // destroyed before its messages were stored
+            wal_->release({lsn});
+            return;
+        }
+        // records of a barrack come back in seq order
+        auto state = state_for(message.barrack_id);
+        std::lock_guard<std::mutex> lock(state->mtx_);
+        state->seq_ = std::max(state->seq_, message.seq);
+        append_history(*state, message);
+        writer_->push(std::move(message), lsn);
+    });
 }
 
 BarrackManager::BarrackResult BarrackManager::create_barrack(const std::string& barrack_name, 
@@ -53,23 +306,20 @@ BarrackManager::BarrackResult BarrackManager::create_barrack(const std::string&
     
     std::string b_id = generate_barrack_id();
     Barrack new_barrack(b_id, barrack_name, owner_id, is_private, hashed_password, salt, created_at);
-    std::lock_guard<std::mutex> lock(mtx_);
-    barracks_[b_id] = new_barrack;
     auto result = barrack_repo_->create(new_barrack);
-    barracks_[b_id].hashed_password = "";
-    barracks_[b_id].salt = "";
     if(std::holds_alternative<Error>(result)){
-        barracks_.erase(b_id);
         return std::get<Error>(result);
     }
+    new_barrack.hashed_password = "";
+    new_barrack.salt = "";
+    std::lock_guard<std::mutex> lock(catalog_mtx_);
+    update_catalog([&](Catalog& barracks){ barracks[b_id] = std::move(new_barrack); });
     return b_id;
 }
 
 BarrackManager::~BarrackManager(){
-    message_queue_.shutdown();
-    if(message_dispatcher_.joinable()){
-        message_dispatcher_.join();
-    }
+    // the writer settles into the barrack states, so it has to finish first
+    writer_.reset();
 }
 
 BarrackManager::StatusResult BarrackManager::destroy_barrack(const std::string& barrack_id, const std::string& owner_id){
@@ -90,10 +340,11 @@ BarrackManager::StatusResult BarrackManager::destroy_barrack(const std::string&
         return std::get<Error>(result);
     }
 
-    std::lock_guard<std::mutex> lock(mtx_);
-    barracks_.erase(barrack_id);
-    barracks_members_.erase(barrack_id);
-    barracks_messages_.erase(barrack_id);
+    {
+        std::lock_guard<std::mutex> lock(catalog_mtx_);
+        update_catalog([&](Catalog& barracks){ barracks.erase(barrack_id); });
+    }
+    drop_state(barrack_id);
 
     return SUCCESS;
 }
@@ -123,8 +374,9 @@ BarrackManager::StatusResult BarrackManager::join_barrack(const std::string &bar
         return std::get<Error>(join_result);
     }
 
-    std::lock_guard<std::mutex> lock(mtx_);
-    barracks_members_[barrack_id].emplace_back(barrack_id, user_id, Clock::now());
+    auto state = state_for(barrack_id);
+    std::lock_guard<std::mutex> lock(state->mtx_);
+    state->members_.try_emplace(user_ids_.intern(user_id), Clock::now());
     return SUCCESS;
 }
 
@@ -139,61 +391,203 @@ BarrackManager::StatusResult BarrackManager::leave_barrack(const std::string &ba
         return std::get<Error>(result);
     }
 
-    auto barrack = std::get<Barrack>(result);
-    std::unique_lock<std::mutex> lock(mtx_);
-    auto members = barracks_members_[barrack_id];
-    auto member_it = std::find_if(members.begin(), members.end(), 
-                [&user_id](const BarrackMember& member){
-                    return member.user_id == user_id;
-                });
-    lock.unlock();
-    if(member_it != members.end()){
-        auto leave_result = barrack_repo_->remove_member(barrack_id, user_id);
-        if(std::holds_alternative<Error>(leave_result)){
-            return std::get<Error>(leave_result);
+    auto state = find_state(barrack_id);
+    auto user = user_ids_.find(user_id);
+    bool member = false;
+    if(state && user != InternTable::NONE){
+        std::lock_guard<std::mutex> lock(state->mtx_);
+        member = state->members_.contains(user);
+    }
+    if(!member){
+        return Error{ErrorCode::MEMBER_NOT_FOUND, "User is not member of this barrack"};
+    }
+
+    auto leave_result = barrack_repo_->remove_member(barrack_id, user_id);
+    if(std::holds_alternative<Error>(leave_result)){
+        return std::get<Error>(leave_result);
+    }
+
+    std::lock_guard<std::mutex> lock(state->mtx_);
+    state->members_.erase(user);
+    return SUCCESS;
+}
+
+// Seeds a barrack's sequence from Cassandra the first time it is messaged in
+// this process, so numbering continues across restarts.
+BarrackManager::StatusResult BarrackManager::load_seq(BarrackState& state, const std::string& barrack_id){
+    {
+        std::lock_guard<std::mutex> lock(state.mtx_);
+        if(state.seq_loaded_){
+            return SUCCESS;
         }
-        members.erase(member_it);
-        return SUCCESS;
     }
-    return Error{ErrorCode::MEMBER_NOT_FOUND, "User is not member of this barrack"};
+    auto result = msg_repo_->get_latest_seq(barrack_id);
+    if(std::holds_alternative<Error>(result)){
+        std::cerr << "Could not load the message sequence of " << barrack_id << ": "
+                  << std::get<Error>(result).message << std::endl;
+        return Error{ErrorCode::DATABASE_ERROR, "Could not load the message sequence, retry later"};
+    }
+    std::lock_guard<std::mutex> lock(state.mtx_);
+    state.seq_ = std::max(state.seq_, std::get<uint64_t>(result));
+    state.seq_loaded_ = true;
+    return SUCCESS;
+}
+
+Error BarrackManager::backlog_full_error(){
+    return Error{ErrorCode::DATABASE_ERROR, "Too many messages waiting for the database, retry later"};
 }
 
-BarrackManager::StatusResult BarrackManager::message_barrack(const std::string &barrack_id, const std::string &user_id, const std::string &message){
+BarrackManager::MessageResult BarrackManager::message_barrack(const std::string &barrack_id, const std::string &user_id, const std::string &message){
     if(barrack_id.empty() || user_id.empty() || message.empty()){
         return Error{ErrorCode::INVALID_DATA, "Invalid data"};
     }
 
-    std::unique_lock<std::mutex> lock(mtx_);
-    auto member_present = std::find_if(barracks_members_[barrack_id].begin(), barracks_members_[barrack_id].end(),
-                                                [&user_id](const BarrackMember& member){
-                                                        return member.user_id == user_id;
-                                                });
-
-    if(member_present == barracks_members_[barrack_id].end()){
+    // only barracks someone joined have state, and only members may send
+    auto state = find_state(barrack_id);
+    auto user = user_ids_.find(user_id);
+    if(!state || user == InternTable::NONE){
+        return Error{ErrorCode::USER_NOT_FOUND, "User not member of the group"};
+    }
+    auto loaded = load_seq(*state, barrack_id);
+    if(std::holds_alternative<Error>(loaded)){
+        return std::get<Error>(loaded);
+    }
+    if(!writer_->has_room()){
+        return backlog_full_error();
+    }
+    std::unique_lock<std::mutex> lock(state->mtx_);
+    if(!state->members_.contains(user)){
         lock.unlock();
         return Error{ErrorCode::USER_NOT_FOUND, "User not member of the group"};
     }
-    lock.unlock();
+    // seq is assigned under the lock so the history stays in seq order
     ChatMessage msg(generate_message_id(),
                     barrack_id,
                     user_id,
                     message,
-                    Clock::now());
-               
-    barracks_messages_[barrack_id].push_back(msg);
-    message_queue_.push(std::move(msg));
-
-    return SUCCESS;
+                    Clock::now(),
+                    ++state->seq_);
+    if(!wal_){
+        append_history(*state, msg);
+        // queued under the lock too, so the writer sees each barrack in seq order
+        writer_->push(ChatMessage(msg));
+        return msg;
+    }
+    auto logged = wal_->append(msg);
+    if(std::holds_alternative<Error>(logged)){
+        --state->seq_;
+        lock.unlock();
+        return std::get<Error>(logged);
+    }
+    auto lsn = std::get<WriteAheadLog::Lsn>(logged);
+    state->unsynced_.emplace_back(msg, lsn);
+    lock.unlock();
+    // Visible and acknowledged only once the log has it on disk. A failed
+    // sync leaves nothing behind for a retry to duplicate; the seq stays
+    // used, later messages may have taken the next ones already.
+    auto synced = wal_->sync(lsn);
+    lock.lock();
+    publish_synced(*state, lsn);
+    lock.unlock();
+    if(std::holds_alternative<Error>(synced)){
+        return std::get<Error>(synced);
+    }
+    return msg;
 }
 
-std::optional<Barrack> BarrackManager::get_barrack(const std::string &barrack_id){
+std::vector<BarrackManager::MessageResult> BarrackManager::message_barrack_batch(const std::string& barrack_id,
+                                                                                const std::vector<std::pair<std::string, std::string>>& messages){
+    std::vector<MessageResult> results;
+    results.reserve(messages.size());
+    auto state = barrack_id.empty() ? nullptr : find_state(barrack_id);
+    if(!state){
+        auto error = barrack_id.empty() ? Error{ErrorCode::INVALID_DATA, "Invalid data"}
+                                        : Error{ErrorCode::USER_NOT_FOUND, "User not member of the group"};
+        for(const auto& [user_id, content] : messages){
+            results.emplace_back(user_id.empty() || content.empty() ? Error{ErrorCode::INVALID_DATA, "Invalid data"} : error);
+        }
+        return results;
+    }
 
-    std::unique_lock<std::mutex> lock(mtx_);
-    if(barracks_.find(barrack_id) != barracks_.end()){
-        lock.unlock();
-        return barracks_[barrack_id];
+    std::vector<ChatMessage> accepted;
+    std::vector<WriteAheadLog::Lsn> lsns;
+    accepted.reserve(messages.size());
+    auto now = Clock::now();
+
+    auto loaded = load_seq(*state, barrack_id);
+    if(std::holds_alternative<Error>(loaded)){
+        for(const auto& [user_id, content] : messages){
+            results.emplace_back(user_id.empty() || content.empty() ? Error{ErrorCode::INVALID_DATA, "Invalid data"}
+                                                                    : std::get<Error>(loaded));
+        }
+        return results;
+    }
+    std::unique_lock<std::mutex> lock(state->mtx_);
+    for(const auto& [user_id, content] : messages){
+        if(user_id.empty() || content.empty()){
+            results.emplace_back(Error{ErrorCode::INVALID_DATA, "Invalid data"});
+            continue;
+        }
+        if(!state->members_.contains(user_ids_.find(user_id))){
+            results.emplace_back(Error{ErrorCode::USER_NOT_FOUND, "User not member of the group"});
+            continue;
+        }
+        if(!writer_->has_room()){
+            results.emplace_back(backlog_full_error());
+            continue;
+        }
+        ChatMessage message(generate_message_id(), barrack_id, user_id, content, now, ++state->seq_);
+        if(wal_){
+            auto logged = wal_->append(message);
+            if(std::holds_alternative<Error>(logged)){
+                --state->seq_;
+                results.emplace_back(std::get<Error>(logged));
+                continue;
+            }
+            lsns.push_back(std::get<WriteAheadLog::Lsn>(logged));
+        }
+        results.emplace_back(message);
+        accepted.push_back(std::move(message));
+    }
+    if(!wal_){
+        for(const auto& message : accepted){
+            append_history(*state, message);
+        }
+        writer_->push_batch(std::move(accepted));
+        return results;
+    }
+    for(size_t i = 0; i < accepted.size(); ++i){
+        state->unsynced_.emplace_back(std::move(accepted[i]), lsns[i]);
     }
     lock.unlock();
+    if(lsns.empty()){
+        return results;
+    }
+    // one sync covers the whole batch; the messages an earlier failed commit
+    // covered fail on their own, as publish_synced drops them
+    wal_->sync(lsns.back());
+    lock.lock();
+    publish_synced(*state, lsns.back());
+    lock.unlock();
+    auto lsn = lsns.begin();
+    for(auto& result : results){
+        if(!std::holds_alternative<ChatMessage>(result)){
+            continue;
+        }
+        auto synced = wal_->sync(*lsn++);
+        if(std::holds_alternative<Error>(synced)){
+            result = std::get<Error>(synced);
+        }
+    }
+    return results;
+}
+
+std::optional<Barrack> BarrackManager::get_barrack(const std::string &barrack_id){
+    auto barracks = barracks_.load(std::memory_order_acquire);
+    auto itr = barracks->find(barrack_id);
+    if(itr != barracks->end()){
+        return itr->second;
+    }
     auto result = barrack_repo_->find_by_id(barrack_id);
     if(std::holds_alternative<Error>(result)){
         return std::nullopt;
@@ -207,23 +601,15 @@ std::optional<BarrackMember> BarrackManager::get_barrack_member(const std::strin
         return std::nullopt;
     }
 
-    std::unique_lock<std::mutex> lock(mtx_);
-    auto members_it = barracks_members_.find(barrack_id);
-    if(members_it == barracks_members_.end()){
-        lock.unlock();    
+    auto state = find_state(barrack_id);
+    if(!state){
         return std::nullopt;
     }
-    auto& members = members_it->second;
-    auto member_itr = std::find_if(members.begin(), members.end(),
-    [&user_id](const BarrackMember& member){
-        return member.user_id == user_id;
-    });
-    
-    if(member_itr != members.end()){
-        lock.unlock();
-        return *member_itr;
+    std::lock_guard<std::mutex> lock(state->mtx_);
+    auto member_itr = state->members_.find(user_ids_.find(user_id));
+    if(member_itr != state->members_.end()){
+        return BarrackMember(barrack_id, user_id, member_itr->second);
     }
-    lock.unlock();
     return std::nullopt;
 }
 
@@ -231,30 +617,110 @@ std::optional<std::vector<ChatMessage>> BarrackManager::get_barrack_messages(con
     if(barrack_id.empty()){
         return std::nullopt;
     }
-    std::unique_lock<std::mutex> lock(mtx_);
-    if(barracks_messages_.find(barrack_id) != barracks_messages_.end()){
-        lock.unlock();
-        return barracks_messages_[barrack_id];
+    std::vector<ChatMessage> unflushed;
+    auto state = find_state(barrack_id);
+    if(state){
+        std::lock_guard<std::mutex> lock(state->mtx_);
+        const auto& history = state->history_;
+        // the ring answers when it has enough messages or the barrack's very first one
+        if(history.size() >= RECENT_MESSAGES || (!history.empty() && history.front().seq == 1)){
+            history_hits_.fetch_add(1, std::memory_order_relaxed);
+            touch_history(*state);
+            auto count = std::min(RECENT_MESSAGES, history.size());
+            return std::vector<ChatMessage>(history.end() - count, history.end());
+        }
+        unflushed.assign(history.begin(), history.end());
     }
-    lock.unlock();
-    auto result = msg_repo_->get_for_barrack(barrack_id);
+
+    history_misses_.fetch_add(1, std::memory_order_relaxed);
+    // messages_by_seq, since the ring is merged in by seq
+    auto result = msg_repo_->get_latest(barrack_id, static_cast<int>(RECENT_MESSAGES));
     if(std::holds_alternative<Error>(result)){
         return std::nullopt;
     }
-    return std::get<std::vector<ChatMessage>>(result);
+    // Cassandra returns newest first, the ring and SYNC pages are oldest first
+    auto messages = std::move(std::get<std::vector<ChatMessage>>(result));
+    std::reverse(messages.begin(), messages.end());
+    if(!unflushed.empty()){
+        // the cached tail may not be in Cassandra yet; where both have a
+        // message the ring's copy is kept
+        uint64_t first_cached = unflushed.front().seq;
+        std::erase_if(messages, [first_cached](const ChatMessage& message){ return message.seq >= first_cached; });
+        messages.insert(messages.end(), unflushed.begin(), unflushed.end());
+        if(messages.size() > RECENT_MESSAGES){
+            messages.erase(messages.begin(), messages.end() - RECENT_MESSAGES);
+        }
+    }
+    return messages;
+}
+
+Result<std::vector<ChatMessage>> BarrackManager::get_messages_since(const std::string& barrack_id, uint64_t after_seq, size_t limit){
+    if(barrack_id.empty()){
+        return Error{ErrorCode::INVALID_DATA, "Invalid data"};
+    }
+    // history is appended in seq order, so the cached part is a sorted suffix
+    auto first_after = [](const std::deque<ChatMessage>& history, uint64_t seq){
+        return std::upper_bound(history.begin(), history.end(), seq,
+                                [](uint64_t s, const ChatMessage& message){ return s < message.seq; });
+    };
+
+    std::vector<ChatMessage> messages;
+    uint64_t first_cached = 0;
+    auto state = find_state(barrack_id);
+    if(state){
+        std::lock_guard<std::mutex> lock(state->mtx_);
+        const auto& history = state->history_;
+        if(!history.empty()){
+            first_cached = history.front().seq;
+            if(after_seq + 1 >= first_cached){
+                history_hits_.fetch_add(1, std::memory_order_relaxed);
+                touch_history(*state);
+                auto from = first_after(history, after_seq);
+                auto count = std::min<size_t>(limit, static_cast<size_t>(history.end() - from));
+                messages.assign(from, from + count);
+                return messages;
+            }
+        }
+    }
+
+    // the gap starts before the cached history
+    history_misses_.fetch_add(1, std::memory_order_relaxed);
+    auto stored = msg_repo_->get_since(barrack_id, after_seq, static_cast<int>(limit));
+    if(std::holds_alternative<Error>(stored)){
+        return std::get<Error>(stored);
+    }
+    messages = std::move(std::get<std::vector<ChatMessage>>(stored));
+    if(first_cached == 0){
+        return messages;
+    }
+
+    // the tail may not be flushed to Cassandra yet, take it from memory
+    std::erase_if(messages, [first_cached](const ChatMessage& message){ return message.seq >= first_cached; });
+    std::lock_guard<std::mutex> lock(state->mtx_);
+    if(messages.size() < limit){
+        const auto& history = state->history_;
+        auto from = first_after(history, messages.empty() ? after_seq : messages.back().seq);
+        auto count = std::min<size_t>(limit - messages.size(), static_cast<size_t>(history.end() - from));
+        messages.insert(messages.end(), from, from + count);
+    }
+    return messages;
 }
 
 std::optional<std::vector<BarrackMember>> BarrackManager::get_barrack_members(const std::string &barrack_id){
     if(barrack_id.empty()){
         return std::nullopt;
     }
-    std::unique_lock<std::mutex> lock(mtx_);
-
-    if(barracks_members_.find(barrack_id) != barracks_members_.end()){
-        lock.unlock();
-        return barracks_members_[barrack_id];
+    if(auto state = find_state(barrack_id)){
+        std::lock_guard<std::mutex> lock(state->mtx_);
+        if(!state->members_.empty()){
+            std::vector<BarrackMember> members;
+            members.reserve(state->members_.size());
+            for(const auto& [user, joined_at] : state->members_){
+                members.emplace_back(barrack_id, std::string(user_ids_.str(user)), joined_at);
+            }
+            return members;
+        }
     }
-    lock.unlock();
 
     auto result = barrack_repo_->get_members(barrack_id);
     if(std::holds_alternative<Error>(result)){
@@ -264,31 +730,17 @@ std::optional<std::vector<BarrackMember>> BarrackManager::get_barrack_members(co
 }
 
 std::optional<std::vector<Barrack>> BarrackManager::get_all_barracks(){
-    std::unique_lock<std::mutex> lock(mtx_);
+    // warm_start() filled the catalog and every create or destroy since
+    // went through it, so the published snapshot is the whole listing
+    auto catalog = barracks_.load(std::memory_order_acquire);
     std::vector<Barrack> barracks;
-    auto result = barrack_repo_->get_all_barracks();
-    if(std::holds_alternative<Error>(result)){
-        return std::nullopt;
+    barracks.reserve(catalog->size());
+    for(const auto& [barrack_id, barrack] : *catalog){
+        barracks.push_back(barrack);
     }
-    auto db_barracks = std::get<std::vector<Barrack>>(result);
-    if(barracks_.size() > 0 && db_barracks.size() > 0){
-        for(auto itr = db_barracks.begin(); itr != db_barracks.end() ; ++itr){
-            auto b_itr = barracks_.find(itr->barrack_id);
-            if(b_itr == barracks_.end()){
-                barracks_[itr->barrack_id] = Barrack(
-                    itr->barrack_id,
-                    itr->barrack_name,
-                    itr->admin_id,
-                    itr->is_private,
-                    "",
-                    "",
-                    itr->created_at
-                );
-            }
-            barracks.emplace_back(barracks_[itr->barrack_id]);
-        }
-    }
-    lock.unlock();
+    std::sort(barracks.begin(), barracks.end(), [](const Barrack& a, const Barrack& b){
+        return a.created_at != b.created_at ? a.created_at < b.created_at : a.barrack_id < b.barrack_id;
+    });
     return barracks;
 }
 
@@ -305,19 +757,10 @@ bool BarrackManager::verify_password(const std::string& password, const std::str
 }
 
 std::string BarrackManager::generate_barrack_id(){
-    boost::uuids::random_generator generator;
-    boost::uuids::uuid uuid = generator();
-
-    std::stringstream ss;
-    ss << "barrack_" << uuid;
-    return ss.str();
+    return IdGenerator::sortable_uuid("barrack_");
 }
 
+// message_id is a timeuuid column in Cassandra
 std::string BarrackManager::generate_message_id(){
-    boost::uuids::random_generator generator;
-    boost::uuids::uuid uuid = generator();
-
-    std::stringstream ss;
-    ss << "msg_" << uuid;
-    return ss.str();
-}
\ No newline at end of file
+    return IdGenerator::time_uuid();
+}
@@ -41,6 +41,36 @@ static std::chrono::system_clock::time_point parse_timestamp_iso8601(const std::
         return time_point;
 }
 
+// Fast path for the two layouts the table holds: our own
+// "YYYY-MM-DDTHH:MM:SS.mmmZ" and SQLite's CURRENT_TIMESTAMP
+// "YYYY-MM-DD HH:MM:SS". Anything else goes through the stream parser.
+static std::chrono::system_clock::time_point parse_timestamp_fast(std::string_view str){
+    auto digits = [&](size_t pos, size_t count, int& out){
+        out = 0;
+        for(size_t i = pos; i < pos + count; ++i){
+            if(str[i] < '0' || str[i] > '9'){
+                return false;
+            }
+            out = out * 10 + (str[i] - '0');
+        }
+        return true;
+    };
+    int year, month, day, hour, minute, second, millis = 0;
+    bool valid = str.size() >= 19 && str[4] == '-' && str[7] == '-' && (str[10] == 'T' || str[10] == ' ')
+              && str[13] == ':' && str[16] == ':'
+              && digits(0, 4, year) && digits(5, 2, month) && digits(8, 2, day)
+              && digits(11, 2, hour) && digits(14, 2, minute) && digits(17, 2, second);
+    if(valid && str.size() >= 23 && str[19] == '.'){
+        valid = digits(20, 3, millis);
+    }
+    if(!valid){
+        return parse_timestamp_iso8601(std::string(str));
+    }
+    std::chrono::year_month_day date{std::chrono::year(year), std::chrono::month(month), std::chrono::day(day)};
+    return std::chrono::sys_days(date) + std::chrono::hours(hour) + std::chrono::minutes(minute)
+         + std::chrono::seconds(second) + std::chrono::milliseconds(millis);
+}
+
 BarrackRepository::BarrackRepository(std::shared_ptr<SQLite::Database> db){
     db_ = db;
 }
@@ -234,4 +264,48 @@ Result<std::vector<Barrack>> BarrackRepository::get_all_barracks(){
     } catch(const SQLite::Exception& ex){
         return Error{ErrorCode::DATABASE_ERROR, "Database query failed for get_barracks: " + std::string(ex.what())};
     }
-}
\ No newline at end of file
+}
+
+Result<size_t> BarrackRepository::for_each_barrack(const std::function<void(Barrack&&)>& visit){
+    const char* query =
+        "SELECT barrack_id, name, admin_id, is_private, created_at "
+        "FROM barracks";
+
+    try {
+        size_t rows = 0;
+        SQLite::Statement statement(*db_, query);
+        while (statement.executeStep()) {
+            Barrack barrack;
+            barrack.barrack_id   = statement.getColumn(0).getString();
+            barrack.barrack_name = statement.getColumn(1).getString();
+            barrack.admin_id     = statement.getColumn(2).getString();
+            barrack.is_private   = statement.getColumn(3).getInt();
+            barrack.created_at   = parse_timestamp_fast(statement.getColumn(4).getText());
+            visit(std::move(barrack));
+            ++rows;
+        }
+        return rows;
+    } catch (const SQLite::Exception& ex) {
+        return Error{ErrorCode::DATABASE_ERROR, "Database query failed for for_each_barrack: " + std::string(ex.what())};
+    }
+}
+
+Result<size_t> BarrackRepository::for_each_member(const MemberVisitor& visit){
+    const char* query =
+        "SELECT barrack_id, user_id, joined_at "
+        "FROM barrack_members";
+
+    try {
+        size_t rows = 0;
+        SQLite::Statement statement(*db_, query);
+        while (statement.executeStep()) {
+            visit(statement.getColumn(0).getText(),
+                  statement.getColumn(1).getText(),
+                  parse_timestamp_fast(statement.getColumn(2).getText()));
+            ++rows;
+        }
+        return rows;
+    } catch (const SQLite::Exception& ex) {
+        return Error{ErrorCode::DATABASE_ERROR, "Database query failed for for_each_member: " + std::string(ex.what())};
+    }
+}
@@ -1,12 +1,16 @@
 #include "Error.hpp"
 #include "types.hpp"
 #include <CassandraMessageRepo.hpp>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
 // These will automatically call the correct `_free` function when they go out of scope.
 using CassStatementPtr = std::unique_ptr<CassStatement, decltype(&cass_statement_free)>;
 using CassFuturePtr    = std::unique_ptr<CassFuture, decltype(&cass_future_free)>;
 using CassIteratorPtr  = std::unique_ptr<CassIterator, decltype(&cass_iterator_free)>;
 using CassResultPtr    = std::unique_ptr<const CassResult, decltype(&cass_result_free)>;
+using CassBatchPtr     = std::unique_ptr<CassBatch, decltype(&cass_batch_free)>;
 
 CassandraMessageRepo::CassandraMessageRepo(std::shared_ptr<CassandraConnection> cass_conn){
     conn_ = cass_conn;
@@ -33,6 +37,12 @@ CassandraMessageRepo::CassandraMessageRepo(std::shared_ptr<CassandraConnection>
 CassandraMessageRepo::~CassandraMessageRepo() {
     if (add_message_prepared_) cass_prepared_free(add_message_prepared_);
     if (get_message_prepared_) cass_prepared_free(get_message_prepared_);
+    if (delete_barrack_messages_prepared_) cass_prepared_free(delete_barrack_messages_prepared_);
+    if (add_message_by_seq_prepared_) cass_prepared_free(add_message_by_seq_prepared_);
+    if (get_messages_since_prepared_) cass_prepared_free(get_messages_since_prepared_);
+    if (get_latest_messages_prepared_) cass_prepared_free(get_latest_messages_prepared_);
+    if (get_latest_seq_prepared_) cass_prepared_free(get_latest_seq_prepared_);
+    if (delete_barrack_messages_by_seq_prepared_) cass_prepared_free(delete_barrack_messages_by_seq_prepared_);
 }
 
 Result<std::monostate> CassandraMessageRepo::init_database(){
@@ -53,6 +63,14 @@ Result<std::monostate> CassandraMessageRepo::init_database(){
 
     std::cout << "Table 'chat_app.messages' is ready.\n";
 
+    auto seq_table_res = execute_simple_query(CREATE_MESSAGES_BY_SEQ_TABLE_QUERY);
+    if(std::holds_alternative<Error>(seq_table_res)){
+        std::cerr << "Table creation failed.\n";
+        return seq_table_res;
+    }
+
+    std::cout << "Table 'chat_app.messages_by_seq' is ready.\n";
+
     if(!prepare_statements()){
         std::cerr << "[FATAL] Statment preperation failed";
         return Error{ErrorCode::DATABASE_ERROR, "[FATAL] Statment preperation failed"};
@@ -67,59 +85,241 @@ bool CassandraMessageRepo::prepare_statements(){
     CassFuturePtr add_msg_future(cass_session_prepare(conn_->session, ADD_MESSAGE_TO_DATABASE), cass_future_free);
     CassFuturePtr get_message_future(cass_session_prepare(conn_->session, GET_MESSAGES), cass_future_free);
     CassFuturePtr delete_messages(cass_session_prepare(conn_->session, DELETE_BARRACK_MESSAGES), cass_future_free);
-
-    CassError rc_1 = cass_future_error_code(add_msg_future.get());
-    CassError rc_2 = cass_future_error_code(get_message_future.get());
-    CassError rc_3 = cass_future_error_code(delete_messages.get());
-    if(rc_1 != CASS_OK || rc_2 != CASS_OK || rc_3 != CASS_OK){
-        std::cerr << "[ERROR] Prepared statments creation failed: "
-                  << cass_error_desc(rc_1) << std::endl ;
-        return false;
+    CassFuturePtr add_by_seq_future(cass_session_prepare(conn_->session, ADD_MESSAGE_BY_SEQ), cass_future_free);
+    CassFuturePtr since_future(cass_session_prepare(conn_->session, GET_MESSAGES_SINCE), cass_future_free);
+    CassFuturePtr latest_future(cass_session_prepare(conn_->session, GET_LATEST_MESSAGES), cass_future_free);
+    CassFuturePtr latest_seq_future(cass_session_prepare(conn_->session, GET_LATEST_SEQ), cass_future_free);
+    CassFuturePtr delete_by_seq_future(cass_session_prepare(conn_->session, DELETE_BARRACK_MESSAGES_BY_SEQ), cass_future_free);
+
+    for(CassFuture* future : {add_msg_future.get(), get_message_future.get(), delete_messages.get(),
+                              add_by_seq_future.get(), since_future.get(), latest_future.get(), latest_seq_future.get(),
+                              delete_by_seq_future.get()}){
+        CassError rc = cass_future_error_code(future);
+        if(rc != CASS_OK){
+            std::cerr << "[ERROR] Prepared statments creation failed: "
+                      << cass_error_desc(rc) << std::endl ;
+            return false;
+        }
     }
 
     add_message_prepared_ = cass_future_get_prepared(add_msg_future.get());
     get_message_prepared_ = cass_future_get_prepared(get_message_future.get());
     delete_barrack_messages_prepared_ = cass_future_get_prepared(delete_messages.get());
+    add_message_by_seq_prepared_ = cass_future_get_prepared(add_by_seq_future.get());
+    get_messages_since_prepared_ = cass_future_get_prepared(since_future.get());
+    get_latest_messages_prepared_ = cass_future_get_prepared(latest_future.get());
+    get_latest_seq_prepared_ = cass_future_get_prepared(latest_seq_future.get());
+    delete_barrack_messages_by_seq_prepared_ = cass_future_get_prepared(delete_by_seq_future.get());
 
     return true;
 }
 
-Result<std::monostate> CassandraMessageRepo::add(const ChatMessage &message) {
-    if(!add_message_prepared_){
-        return Error{ErrorCode::DATABASE_ERROR, "Add messages statement is not prepared."};
+Result<std::monostate> CassandraMessageRepo::bind_message(CassStatement* statement, const ChatMessage& message){
+    if(cass_statement_bind_string(statement, 0, message.barrack_id.c_str())){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind barrack_id."};
     }
+    // a timeuuid column, it takes the binary uuid rather than its text
+    CassUuid message_id;
+    if(cass_uuid_from_string(message.message_id.c_str(), &message_id) != CASS_OK
+       || cass_statement_bind_uuid(statement, 1, message_id)){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind message_id."};
+    }
+    if(cass_statement_bind_string(statement, 2, message.sender_user_id.c_str())){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind sender_id."};
+    }
+    if(cass_statement_bind_string(statement, 3, message.content.c_str())){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind content."};
+    }
+    
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(message.sent_at.time_since_epoch()).count();
+    if(cass_statement_bind_int64(statement, 4, ms)){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind sent_at."};
+    }
+    return Success{};
+}
 
-    CassStatementPtr statement(cass_prepared_bind(add_message_prepared_), cass_statement_free);
-
-    if(cass_statement_bind_string(statement.get(), 0, message.barrack_id.c_str())){
+Result<std::monostate> CassandraMessageRepo::bind_message_by_seq(CassStatement* statement, const ChatMessage& message){
+    if(cass_statement_bind_string(statement, 0, message.barrack_id.c_str())){
         return Error{ErrorCode::DATABASE_ERROR, "Failed to bind barrack_id."};
     }
-    if(cass_statement_bind_string(statement.get(), 1, message.message_id.c_str())){
+    if(cass_statement_bind_int64(statement, 1, static_cast<cass_int64_t>(message.seq))){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind seq."};
+    }
+    if(cass_statement_bind_string(statement, 2, message.message_id.c_str())){
         return Error{ErrorCode::DATABASE_ERROR, "Failed to bind message_id."};
     }
-    if(cass_statement_bind_string(statement.get(), 2, message.sender_user_id.c_str())){
+    if(cass_statement_bind_string(statement, 3, message.sender_user_id.c_str())){
         return Error{ErrorCode::DATABASE_ERROR, "Failed to bind sender_id."};
     }
-    if(cass_statement_bind_string(statement.get(), 3, message.content.c_str())){
+    if(cass_statement_bind_string(statement, 4, message.content.c_str())){
         return Error{ErrorCode::DATABASE_ERROR, "Failed to bind content."};
     }
-    
+
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(message.sent_at.time_since_epoch()).count();
-    if(cass_statement_bind_int64(statement.get(), 4, ms)){
+    if(cass_statement_bind_int64(statement, 5, ms)){
         return Error{ErrorCode::DATABASE_ERROR, "Failed to bind sent_at."};
     }
-    
-    CassFuturePtr res_future(cass_session_execute(conn_->session, statement.get()), cass_future_free);
+    return Success{};
+}
 
-    if(cass_future_error_code(res_future.get()) != CASS_OK){
-        const char* msg; size_t len;
-        cass_future_error_message(res_future.get(), &msg, &len);
-        return Error{ErrorCode::DATABASE_ERROR, "Failed to execute add_message query: " + std::string(msg, len)};
+Result<std::monostate> CassandraMessageRepo::add(const ChatMessage &message) {
+    // both tables have to be written, which add_batch already does in one round trip
+    return add_batch(std::vector<ChatMessage>{message});
+}
+
+Result<std::monostate> CassandraMessageRepo::add_to_batch(CassBatch* batch, const ChatMessage& message){
+    CassStatementPtr statement(cass_prepared_bind(add_message_prepared_), cass_statement_free);
+    auto bind_res = bind_message(statement.get(), message);
+    if(std::holds_alternative<Error>(bind_res)){
+        return bind_res;
     }
+    cass_batch_add_statement(batch, statement.get());
 
+    CassStatementPtr by_seq(cass_prepared_bind(add_message_by_seq_prepared_), cass_statement_free);
+    bind_res = bind_message_by_seq(by_seq.get(), message);
+    if(std::holds_alternative<Error>(bind_res)){
+        return bind_res;
+    }
+    cass_batch_add_statement(batch, by_seq.get());
     return Success{};
 }
 
+// Cuts the messages of one barrack into runs that stay below
+// MAX_WRITE_BATCH_BYTES; a single oversized message gets a batch of its own.
+static std::vector<std::vector<const ChatMessage*>> split_by_size(const std::vector<const ChatMessage*>& messages){
+    std::vector<std::vector<const ChatMessage*>> runs;
+    size_t run_bytes = 0;
+    for(const ChatMessage* message : messages){
+        size_t bytes = write_batch_bytes(*message);
+        if(runs.empty() || (!runs.back().empty() && run_bytes + bytes > MAX_WRITE_BATCH_BYTES)){
+            runs.emplace_back();
+            run_bytes = 0;
+        }
+        runs.back().push_back(message);
+        run_bytes += bytes;
+    }
+    return runs;
+}
+
+Result<std::monostate> CassandraMessageRepo::add_batch(const std::vector<ChatMessage>& messages){
+    if(!add_message_prepared_ || !add_message_by_seq_prepared_){
+        return Error{ErrorCode::DATABASE_ERROR, "Add messages statement is not prepared."};
+    }
+
+    // UNLOGGED batches per barrack so every batch stays within a single
+    // partition, and within the batch size Cassandra accepts.
+    std::unordered_map<std::string, std::vector<const ChatMessage*>> partitions;
+    for(const auto& message : messages){
+        partitions[message.barrack_id].push_back(&message);
+    }
+
+    std::vector<CassFuturePtr> futures;
+    futures.reserve(partitions.size());
+    for(const auto& [barrack_id, partition] : partitions){
+        for(const auto& run : split_by_size(partition)){
+            CassBatchPtr batch(cass_batch_new(CASS_BATCH_TYPE_UNLOGGED), cass_batch_free);
+            for(const ChatMessage* message : run){
+                auto add_res = add_to_batch(batch.get(), *message);
+                if(std::holds_alternative<Error>(add_res)){
+                    return add_res;
+                }
+            }
+            futures.emplace_back(cass_session_execute_batch(conn_->session, batch.get()), cass_future_free);
+        }
+    }
+
+    Result<std::monostate> result = Success{};
+    for(auto& future : futures){
+        if(cass_future_error_code(future.get()) != CASS_OK){
+            const char* msg; size_t len;
+            cass_future_error_message(future.get(), &msg, &len);
+            result = Error{ErrorCode::DATABASE_ERROR, "Failed to execute add_message batch: " + std::string(msg, len)};
+        }
+    }
+    return result;
+}
+
+// Shared by the driver callbacks of the batches one add_batch_async call
+// was split into; the last one to finish reports.
+struct PendingWrite {
+    MessageRepository::WriteCallback done;
+    std::mutex mtx;
+    size_t remaining = 0;
+    std::optional<Error> error;
+
+    void finish(std::optional<Error> failure){
+        std::unique_lock<std::mutex> lock(mtx);
+        if(failure && !error){
+            error = std::move(failure);
+        }
+        if(--remaining > 0){
+            return;
+        }
+        lock.unlock();
+        if(error){
+            done(std::move(*error));
+        } else {
+            done(Success{});
+        }
+    }
+};
+
+static void on_batch_written(CassFuture* future, void* data){
+    std::unique_ptr<std::shared_ptr<PendingWrite>> pending(static_cast<std::shared_ptr<PendingWrite>*>(data));
+    if(cass_future_error_code(future) != CASS_OK){
+        const char* msg; size_t len;
+        cass_future_error_message(future, &msg, &len);
+        (*pending)->finish(Error{ErrorCode::DATABASE_ERROR, "Failed to execute add_message batch: " + std::string(msg, len)});
+        return;
+    }
+    (*pending)->finish(std::nullopt);
+}
+
+void CassandraMessageRepo::add_batch_async(const std::vector<ChatMessage>& messages, WriteCallback done){
+    if(!add_message_prepared_ || !add_message_by_seq_prepared_){
+        done(Error{ErrorCode::DATABASE_ERROR, "Add messages statement is not prepared."});
+        return;
+    }
+    if(messages.empty()){
+        done(Success{});
+        return;
+    }
+
+    // the caller hands over a single barrack, so every batch is one partition
+    std::vector<const ChatMessage*> partition;
+    partition.reserve(messages.size());
+    for(const auto& message : messages){
+        partition.push_back(&message);
+    }
+    auto runs = split_by_size(partition);
+    std::vector<CassBatchPtr> batches;
+    for(const auto& run : runs){
+        batches.emplace_back(cass_batch_new(CASS_BATCH_TYPE_UNLOGGED), cass_batch_free);
+        for(const ChatMessage* message : run){
+            auto add_res = add_to_batch(batches.back().get(), *message);
+            if(std::holds_alternative<Error>(add_res)){
+                done(std::move(add_res));
+                return;
+            }
+        }
+    }
+
+    auto pending = std::make_shared<PendingWrite>();
+    pending->done = std::move(done);
+    pending->remaining = batches.size();
+    for(const auto& batch : batches){
+        // the driver keeps the future alive until the callback ran, which may
+        // happen right here when the batch already completed
+        CassFuturePtr future(cass_session_execute_batch(conn_->session, batch.get()), cass_future_free);
+        auto data = std::make_unique<std::shared_ptr<PendingWrite>>(pending);
+        if(cass_future_set_callback(future.get(), on_batch_written, data.get()) != CASS_OK){
+            pending->finish(Error{ErrorCode::DATABASE_ERROR, "Failed to watch add_message batch."});
+            continue;
+        }
+        data.release();
+    }
+}
+
 Result<std::vector<ChatMessage>> CassandraMessageRepo::get_for_barrack(const std::string &barrack_id, int limit) {
     if(!get_message_prepared_){
         return Error{ErrorCode::DATABASE_ERROR, "Get messages statement is not prepared."};
@@ -191,12 +391,144 @@ Result<std::vector<ChatMessage>> CassandraMessageRepo::get_for_barrack(const std
     return messages;
 }
 
+Result<std::vector<ChatMessage>> CassandraMessageRepo::get_since(const std::string& barrack_id, uint64_t after_seq, int limit){
+    if(!get_messages_since_prepared_){
+        return Error{ErrorCode::DATABASE_ERROR, "Get messages since statement is not prepared."};
+    }
+
+    CassStatementPtr statement(cass_prepared_bind(get_messages_since_prepared_), cass_statement_free);
+    if(cass_statement_bind_string(statement.get(), 0, barrack_id.c_str())){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind barrack_id."};
+    }
+    if(cass_statement_bind_int64(statement.get(), 1, static_cast<cass_int64_t>(after_seq))){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind seq."};
+    }
+    if(cass_statement_bind_int32(statement.get(), 2, limit)){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind limit."};
+    }
+
+    return execute_by_seq(statement.get(), "get_messages_since");
+}
+
+Result<std::vector<ChatMessage>> CassandraMessageRepo::get_latest(const std::string& barrack_id, int limit){
+    if(!get_latest_messages_prepared_){
+        return Error{ErrorCode::DATABASE_ERROR, "Get latest messages statement is not prepared."};
+    }
+
+    CassStatementPtr statement(cass_prepared_bind(get_latest_messages_prepared_), cass_statement_free);
+    if(cass_statement_bind_string(statement.get(), 0, barrack_id.c_str())){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind barrack_id."};
+    }
+    if(cass_statement_bind_int32(statement.get(), 1, limit)){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind limit."};
+    }
+    return execute_by_seq(statement.get(), "get_latest_messages");
+}
+
+Result<std::vector<ChatMessage>> CassandraMessageRepo::execute_by_seq(CassStatement* statement, const char* query_name){
+    CassFuturePtr future(cass_session_execute(conn_->session, statement), cass_future_free);
+    cass_future_wait(future.get());
+
+    if(cass_future_error_code(future.get()) != CASS_OK){
+        const char* msg; size_t len;
+        cass_future_error_message(future.get(), &msg, &len);
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to execute " + std::string(query_name) + " query: " + std::string(msg, len)};
+    }
+
+    CassResultPtr result(cass_future_get_result(future.get()), cass_result_free);
+    CassIteratorPtr iterator(cass_iterator_from_result(result.get()), cass_iterator_free);
+
+    std::vector<ChatMessage> messages;
+    messages.reserve(cass_result_row_count(result.get()));
+
+    while(cass_iterator_next(iterator.get())){
+        const CassRow* row = cass_iterator_get_row(iterator.get());
+        ChatMessage msg;
+        const char* str_val;
+        size_t str_len;
+
+        if(cass_value_get_string(cass_row_get_column_by_name(row, "barrack_id"), &str_val, &str_len)){
+            return Error{ErrorCode::DATABASE_ERROR, "Failed to get barrack_id from row."};
+        }
+        msg.barrack_id.assign(str_val, str_len);
+
+        cass_int64_t seq;
+        if(cass_value_get_int64(cass_row_get_column_by_name(row, "seq"), &seq)){
+            return Error{ErrorCode::DATABASE_ERROR, "Failed to get seq from row."};
+        }
+        msg.seq = static_cast<uint64_t>(seq);
+
+        if(cass_value_get_string(cass_row_get_column_by_name(row, "message_id"), &str_val, &str_len)){
+            return Error{ErrorCode::DATABASE_ERROR, "Failed to get message_id from row."};
+        }
+        msg.message_id.assign(str_val, str_len);
+
+        if(cass_value_get_string(cass_row_get_column_by_name(row, "sender_id"), &str_val, &str_len)){
+            return Error{ErrorCode::DATABASE_ERROR, "Failed to get sender_id from row."};
+        }
+        msg.sender_user_id.assign(str_val, str_len);
+
+        if(cass_value_get_string(cass_row_get_column_by_name(row, "content"), &str_val, &str_len)){
+            return Error{ErrorCode::DATABASE_ERROR, "Failed to get content from row."};
+        }
+        msg.content.assign(str_val, str_len);
+
+        cass_int64_t timestamp_ms;
+        if(cass_value_get_int64(cass_row_get_column_by_name(row, "timestamp"), &timestamp_ms)){
+            return Error{ErrorCode::DATABASE_ERROR, "Failed to get timestamp from row."};
+        }
+        msg.sent_at = std::chrono::system_clock::time_point(std::chrono::milliseconds(timestamp_ms));
+
+        messages.push_back(std::move(msg));
+    }
+
+    return messages;
+}
+
+Result<uint64_t> CassandraMessageRepo::get_latest_seq(const std::string& barrack_id){
+    if(!get_latest_seq_prepared_){
+        return Error{ErrorCode::DATABASE_ERROR, "Get latest seq statement is not prepared."};
+    }
+
+    CassStatementPtr statement(cass_prepared_bind(get_latest_seq_prepared_), cass_statement_free);
+    if(cass_statement_bind_string(statement.get(), 0, barrack_id.c_str())){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to bind barrack_id."};
+    }
+
+    CassFuturePtr future(cass_session_execute(conn_->session, statement.get()), cass_future_free);
+    cass_future_wait(future.get());
+
+    if(cass_future_error_code(future.get()) != CASS_OK){
+        const char* msg; size_t len;
+        cass_future_error_message(future.get(), &msg, &len);
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to execute get_latest_seq query: " + std::string(msg, len)};
+    }
+
+    CassResultPtr result(cass_future_get_result(future.get()), cass_result_free);
+    CassIteratorPtr iterator(cass_iterator_from_result(result.get()), cass_iterator_free);
+    if(!cass_iterator_next(iterator.get())){
+        return uint64_t{0};
+    }
+    cass_int64_t seq;
+    if(cass_value_get_int64(cass_row_get_column_by_name(cass_iterator_get_row(iterator.get()), "seq"), &seq)){
+        return Error{ErrorCode::DATABASE_ERROR, "Failed to get seq from row."};
+    }
+    return static_cast<uint64_t>(seq);
+}
+
 Result<std::monostate> CassandraMessageRepo::delete_barrack_messages(const std::string& barrack_id){
-    if(!delete_barrack_messages_prepared_){
+    if(!delete_barrack_messages_prepared_ || !delete_barrack_messages_by_seq_prepared_){
         return Error{ErrorCode::DATABASE_ERROR, "Delete messages statement is not prepared."};
     }
+    auto result = execute_for_barrack(delete_barrack_messages_prepared_, barrack_id);
+    if(std::holds_alternative<Error>(result)){
+        return result;
+    }
+    return execute_for_barrack(delete_barrack_messages_by_seq_prepared_, barrack_id);
+}
 
-    CassStatementPtr statement(cass_prepared_bind(delete_barrack_messages_prepared_), cass_statement_free);
+Result<std::monostate> CassandraMessageRepo::execute_for_barrack(const CassPrepared* prepared, const std::string& barrack_id){
+    CassStatementPtr statement(cass_prepared_bind(prepared), cass_statement_free);
     if(cass_statement_bind_string(statement.get(), 0, barrack_id.c_str())){
         return Error{ErrorCode::DATABASE_ERROR, "Failed to bind barrack_id for deletion"};
     }
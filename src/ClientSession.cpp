@@ -1,20 +1,26 @@
 #include "ClientSession.hpp" 
 #include "ConnectionManager.hpp"
+#include "CommandMetrics.hpp"
+#include <algorithm>
 #include <json.hpp>
 
 using json = nlohmann::json;
 
+thread_local ReplyCapture* ReplyCapture::current_ = nullptr;
+
 ClientSession::ClientSession(tcp::socket&& socket,
                             SessionID session_id,
                             std::shared_ptr<ConnectionManager> conn_manager,
-                            std::shared_ptr<MessageDispatcher> message_dispatcher)
+                            std::shared_ptr<MessageDispatcher> message_dispatcher,
+                            size_t max_in_flight)
                 : ws_(std::move(socket)),
                   conn_manager_(conn_manager),
                   message_dispatcher_(message_dispatcher),
                   session_id_(session_id),
                   conn_time_(c_time::now()),
                   last_activity_(conn_time_),
-                  status_(ConnStatus::CONNECTING)
+                  status_(ConnStatus::CONNECTING),
+                  max_in_flight_(std::max<size_t>(max_in_flight, 1))
 {
     try{
 
@@ -38,7 +44,8 @@ ClientSession::ClientSession(tcp::socket&& socket,
     }
 }
 
-void ClientSession::run(){
+void ClientSession::run(std::optional<UpgradeRequest> upgrade){
+    upgrade_ = std::move(upgrade);
     net::dispatch(
         ws_.get_executor(),
         beast::bind_front_handler(
@@ -57,11 +64,16 @@ void ClientSession::on_run(){
                         res.set(http::field::server, "cli-chat-server/1.0");
                     }));
 
-    ws_.async_accept(
-        [self = shared_from_this()](error_code ec){
-            self->on_accept(ec);
-        }
-    );
+    auto on_accepted = [self = shared_from_this()](error_code ec){
+        self->upgrade_.reset();
+        self->on_accept(ec);
+    };
+    if(upgrade_){
+        ws_.async_accept(*upgrade_, std::move(on_accepted));
+    }
+    else {
+        ws_.async_accept(std::move(on_accepted));
+    }
 }
 
 void ClientSession::on_accept(error_code ec){
@@ -94,41 +106,85 @@ void ClientSession::on_read(error_code ec, std::size_t bytes_transfered){
     }
     if(ec){
         fail(ec, "read");
+        // resets and timeouts end the session too, so it leaves its rooms
+        close_session();
         return;
     }
 
-    //1. Convert Buffer to string
-    std::string payload = beast::buffers_to_string(buffer_.data());
+    //1. View the frame in place, the dispatcher copies it into its task arena
+    std::string_view payload(static_cast<const char*>(buffer_.data().data()), buffer_.size());
 
-    //2. Consume the buffer basically this clears the buffer_
-    buffer_.consume(buffer_.size());
+    if(payload == "quit"){
+        buffer_.consume(buffer_.size());
+        close_session();
+        return;
+    }
 
-    // 3. TODO: Parse received_payload_str to JSON
+    //2. Hand the frame to the dispatcher, which sheds it if it is backed up
     try{
        if(auto d = message_dispatcher_.lock()){
             d->dispatch(shared_from_this(), payload);
        }
        else {
             std::cerr << "Session " << session_id_ << ": Dispatcher is gone, closing session.\n";
+            buffer_.consume(buffer_.size());
             close_session();
             return;
        }
     }
     catch(const json::parse_error& ex){
+        buffer_.consume(buffer_.size());
         send_message("{\"type\":\"ERROR\", \"payload\":{\"code\":\"INVALID_JSON\", \"message\":\"" + std::string(ex.what()) + "\"}}");
         do_read(); // Continue reading for next message
         return;
     }
 
-    //4. Pass json payload to the message manager
-    std::cout << "Session id: " << session_id_ << " Received: " << payload << "\n";  
+    //3. Consume the buffer basically this clears the buffer_
+    buffer_.consume(buffer_.size());
+    if(!pause_if_window_full()){
+        do_read();
+    }
+}
+
+// Runs on the session strand after a frame was dispatched. Whoever flips
+// read_paused_ back to false (this re-check or end_request) restarts reading,
+// so a completion racing with the pause cannot leave the session stalled.
+bool ClientSession::pause_if_window_full(){
+    if(in_flight_.load() < max_in_flight_){
+        return false;
+    }
+    read_paused_.store(true);
+    if(in_flight_.load() < max_in_flight_ && read_paused_.exchange(false)){
+        return false;
+    }
+    return true;
+}
 
-    if(payload == "quit"){
-        close_session();
-        return;
+// Only called from the session strand, so no other command of this session
+// is queued concurrently; dequeues only ever lower the counts.
+size_t ClientSession::begin_request(size_t lane){
+    in_flight_.fetch_add(1);
+    for(size_t lower = queued_in_lane_.size() - 1; lower > lane; --lower){
+        if(queued_in_lane_[lower].load() > 0){
+            lane = lower;
+            break;
+        }
+    }
+    queued_in_lane_[lane].fetch_add(1);
+    return lane;
+}
+
+void ClientSession::left_lane(size_t lane){
+    queued_in_lane_[lane].fetch_sub(1);
+}
+
+void ClientSession::end_request(){
+    auto previous = in_flight_.fetch_sub(1);
+    if(previous <= max_in_flight_ && read_paused_.exchange(false)){
+        net::post(ws_.get_executor(), [self = shared_from_this()](){
+            self->do_read();
+        });
     }
-    send_message(payload);
-    do_read();
 }
 
 void ClientSession::on_write(error_code ec, std::size_t bytes_transfered){
@@ -143,6 +199,11 @@ void ClientSession::on_write(error_code ec, std::size_t bytes_transfered){
     }
 
     if(!write_msg_.empty()){
+        const auto& written = write_msg_.front();
+        if(written.command != CommandMetrics::NO_COMMAND){
+            CommandMetrics::instance().record(static_cast<size_t>(written.command), LatencyStage::FLUSH,
+                                              c_time::now() - written.queued_at);
+        }
         write_msg_.pop_front();
     }
     
@@ -153,14 +214,55 @@ void ClientSession::on_write(error_code ec, std::size_t bytes_transfered){
     }
 }
 
-void ClientSession::send_message(const std::string& message){
+void ClientSession::send_message(std::string message){
+    if(!ws_.is_open()){
+        std::cerr << "Session " << session_id_ << ": Attempted to write on a closed socket\n";
+        return;
+    }
+    auto self = shared_from_this();
+    int command = CommandMetrics::current_command();
+    auto queued_at = c_time::now();
+    net::post(ws_.get_executor(), [self, message = std::move(message), command, queued_at]() mutable {
+        self->write_msg_.push_back({std::move(message), nullptr, command, queued_at});
+        if(!self->is_writing_){
+            self->do_actual_write();
+        }
+    });
+}
+
+void ClientSession::reply(std::string message){
+    if(auto* replies = ReplyCapture::replies_for(this)){
+        replies->push_back(std::move(message));
+        return;
+    }
+    send_message(std::move(message));
+}
+
+void ClientSession::send_messages(const std::vector<std::string>& messages){
     if(!ws_.is_open()){
         std::cerr << "Session " << session_id_ << ": Attempted to write on a closed socket\n";
         return;
     }
     auto self = shared_from_this();
-    net::post(ws_.get_executor(), [self, message](){
-        self->write_msg_.push_back(message);
+    int command = CommandMetrics::current_command();
+    auto queued_at = c_time::now();
+    net::post(ws_.get_executor(), [self, messages, command, queued_at](){
+        for(const auto& message : messages){
+            self->write_msg_.push_back({message, nullptr, command, queued_at});
+        }
+        if(!self->is_writing_){
+            self->do_actual_write();
+        }
+    });
+}
+
+void ClientSession::send_shared(std::shared_ptr<const std::string> frame, int command, c_time::time_point queued_at){
+    if(!ws_.is_open()){
+        std::cerr << "Session " << session_id_ << ": Attempted to write on a closed socket\n";
+        return;
+    }
+    net::post(ws_.get_executor(), [self = shared_from_this(), frame = std::move(frame), command, queued_at]() mutable {
+        self->write_msg_.push_back({{}, std::move(frame), command, queued_at});
         if(!self->is_writing_){
             self->do_actual_write();
         }
@@ -176,7 +278,7 @@ void ClientSession::do_actual_write(){
     is_writing_ = true;
 
     ws_.text(true);
-    ws_.async_write(net::buffer(write_msg_.front()),
+    ws_.async_write(net::buffer(write_msg_.front().bytes()),
                     beast::bind_front_handler(
                         &ClientSession::on_write,
                         shared_from_this()
@@ -190,6 +292,7 @@ void ClientSession::leave_session(boost::beast::websocket::close_code code, boos
 
 void ClientSession::close_session(websocket::close_reason reason){
     set_status(ConnStatus::CLOSING);
+    closed_.store(true, std::memory_order_release);
 
     if(ws_.is_open()){
         // Send a websocket close frame
@@ -0,0 +1,44 @@
+#include <string>
+#include "CommandMetrics.hpp"
+
+thread_local int CommandMetrics::current_command_ = CommandMetrics::NO_COMMAND;
+
+static const std::array<const char*, CommandMetrics::STAGE_COUNT> STAGE_NAMES = {
+    "queue_wait",
+    "execution",
+    "flush"
+};
+
+nlohmann::json CommandMetrics::snapshot_to_json(const LatencyHistogram::Snapshot& snap){
+    return {
+        {"count", snap.count},
+        {"mean_us", snap.mean()},
+        {"p50_us", snap.percentile(50.0)},
+        {"p90_us", snap.percentile(90.0)},
+        {"p99_us", snap.percentile(99.0)},
+        {"p999_us", snap.percentile(99.9)},
+        {"max_us", snap.max_us}
+    };
+}
+
+CommandMetrics& CommandMetrics::instance(){
+    static CommandMetrics metrics;
+    return metrics;
+}
+
+nlohmann::json CommandMetrics::to_json() const {
+    nlohmann::json report = nlohmann::json::object();
+    for(size_t command = 0; command < COMMAND_COUNT; ++command){
+        nlohmann::json stages = nlohmann::json::object();
+        for(size_t stage = 0; stage < STAGE_COUNT; ++stage){
+            auto snap = histograms_[command][stage].snapshot();
+            if(snap.count > 0){
+                stages[STAGE_NAMES[stage]] = snapshot_to_json(snap);
+            }
+        }
+        if(!stages.empty()){
+            report[std::string(COMMAND_NAMES[command])] = std::move(stages);
+        }
+    }
+    return report;
+}
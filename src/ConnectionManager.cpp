@@ -1,30 +1,35 @@
 #include "ConnectionManager.hpp"
 
-void ConnectionManager::start_new_session(tcp::socket&& socket){
+void ConnectionManager::start_new_session(tcp::socket&& socket, std::optional<ClientSession::UpgradeRequest> upgrade){
     ClientSession::SessionID current_id;
     std::shared_ptr<ClientSession> new_session;
     {
         std::lock_guard<std::mutex> lock(mtx_);
         current_id = next_session_id_++;
         new_session = std::make_shared<ClientSession>(std::move(socket), current_id,
-                                                        shared_from_this(), message_dispatcher_);
+                                                        shared_from_this(), message_dispatcher_, max_in_flight_);
         sessions_[current_id] = new_session;
     }
 
     std::cout << "ConnectionManager: Registered new session ID " << current_id
               << " from " << new_session->get_client_ip_addr() << ":" << new_session->get_client_port() << "\n";
-    new_session->run();
+    new_session->run(std::move(upgrade));
 }
 
 void ConnectionManager::unregister_session(ClientSession::SessionID id){
-    bool erased = false;
+    std::shared_ptr<ClientSession> session;
     {
         std::lock_guard<std::mutex> lock(mtx_);
-        if(sessions_.erase(id) > 0){
-            erased = true;
+        auto itr = sessions_.find(id);
+        if(itr != sessions_.end()){
+            session = std::move(itr->second);
+            sessions_.erase(itr);
         }
     }
-    if(erased){
+    if(session){
+        if(room_registry_){
+            room_registry_->disconnect(session);
+        }
         std::cout << "ConnectionManager: Unregister session ID " << id << "\n";  
     }
 }
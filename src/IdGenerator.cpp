@@ -0,0 +1,96 @@
+#include <chrono>
+#include <random>
+#include "IdGenerator.hpp"
+
+// 100ns intervals between the Gregorian reform (the version 1 epoch) and 1970
+static constexpr uint64_t GREGORIAN_OFFSET = 0x01B21DD213814000ULL;
+static constexpr uint64_t VARIANT_RFC4122 = 0x8000000000000000ULL;
+
+namespace {
+
+struct GeneratorState {
+    std::mt19937_64 rng;
+    uint64_t node;              // random, with the multicast bit set as RFC 4122 asks
+    uint64_t clock_seq;
+    uint64_t last_ticks = 0;    // version 1 timestamp of the previous ID
+    uint64_t last_ms = 0;       // version 7 timestamp of the previous ID
+    uint64_t counter = 0;       // version 7 sequence within last_ms
+
+    GeneratorState() : rng(std::random_device{}()) {
+        node = (rng() & 0xFFFFFFFFFFFFULL) | 0x010000000000ULL;
+        clock_seq = rng() & 0x3FFF;
+    }
+};
+
+GeneratorState& state(){
+    thread_local GeneratorState generator;
+    return generator;
+}
+
+}
+
+std::string IdGenerator::time_uuid(){
+    auto& gen = state();
+    auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+    uint64_t ticks = std::chrono::duration_cast<std::chrono::duration<uint64_t, std::ratio<1, 10000000>>>(since_epoch).count()
+                   + GREGORIAN_OFFSET;
+    // more than one ID per tick borrows from the next ticks
+    if(ticks <= gen.last_ticks){
+        ticks = gen.last_ticks + 1;
+    }
+    gen.last_ticks = ticks;
+
+    uint64_t hi = (ticks & 0xFFFFFFFFULL) << 32                 // time_low
+                | ((ticks >> 32) & 0xFFFF) << 16                // time_mid
+                | 0x1000 | ((ticks >> 48) & 0x0FFF);            // version, time_hi
+    uint64_t lo = VARIANT_RFC4122 | gen.clock_seq << 48 | gen.node;
+
+    std::string id(UUID_TEXT_LEN, '\0');
+    format(hi, lo, id.data());
+    return id;
+}
+
+std::string IdGenerator::sortable_uuid(std::string_view prefix){
+    auto& gen = state();
+    uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    // the 12 bit counter orders IDs within a millisecond; it starts at a
+    // random point below half its range and borrows the next millisecond
+    // when it runs out
+    if(ms <= gen.last_ms){
+        ms = gen.last_ms;
+        if(++gen.counter > 0x0FFF){
+            ++ms;
+            gen.counter = gen.rng() & 0x07FF;
+        }
+    } else {
+        gen.counter = gen.rng() & 0x07FF;
+    }
+    gen.last_ms = ms;
+
+    uint64_t hi = (ms & 0xFFFFFFFFFFFFULL) << 16 | 0x7000 | gen.counter;
+    uint64_t lo = VARIANT_RFC4122 | (gen.rng() & 0x3FFFFFFFFFFFFFFFULL);
+
+    std::string id(prefix.size() + UUID_TEXT_LEN, '\0');
+    prefix.copy(id.data(), prefix.size());
+    format(hi, lo, id.data() + prefix.size());
+    return id;
+}
+
+void IdGenerator::format(uint64_t hi, uint64_t lo, char* out){
+    static constexpr char digits[] = "0123456789abcdef";
+    auto write = [&out](uint64_t value, int nibbles){
+        for(int shift = (nibbles - 1) * 4; shift >= 0; shift -= 4){
+            *out++ = digits[(value >> shift) & 0xF];
+        }
+    };
+    write(hi >> 32, 8);
+    *out++ = '-';
+    write(hi >> 16, 4);
+    *out++ = '-';
+    write(hi, 4);
+    *out++ = '-';
+    write(lo >> 48, 4);
+    *out++ = '-';
+    write(lo, 12);
+}
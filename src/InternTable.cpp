@@ -0,0 +1,112 @@
+#include <cstring>
+#include <stdexcept>
+#include "InternTable.hpp"
+
+InternTable::InternTable() : chunks_(new std::atomic<std::string_view*>[MAX_CHUNKS]) {
+    for(size_t i = 0; i < MAX_CHUNKS; ++i){
+        chunks_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+size_t InternTable::probe(const std::vector<Slot>& slots, size_t hash, std::string_view id) const {
+    // the low bits picked the shard, the high half is the tag
+    size_t mask = slots.size() - 1;
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+    for(size_t i = (hash / SHARD_COUNT) & mask;; i = (i + 1) & mask){
+        const auto& slot = slots[i];
+        if(slot.handle == NONE || (slot.tag == tag && str(slot.handle) == id)){
+            return i;
+        }
+    }
+}
+
+InternTable::Handle InternTable::intern(std::string_view id){
+    size_t h = hash(id);
+    auto& shard = shards_[h % SHARD_COUNT];
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mtx_);
+        Handle handle = shard.slots_[probe(shard.slots_, h, id)].handle;
+        if(handle != NONE){
+            return handle;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(shard.mtx_);
+    if((shard.count_ + 1) * 2 > shard.slots_.size()){
+        grow(shard);
+    }
+    auto& slot = shard.slots_[probe(shard.slots_, h, id)];
+    if(slot.handle == NONE){
+        slot = {static_cast<uint32_t>(h >> 32), append(id)};
+        ++shard.count_;
+    }
+    return slot.handle;
+}
+
+InternTable::Handle InternTable::find(std::string_view id) const {
+    size_t h = hash(id);
+    const auto& shard = shards_[h % SHARD_COUNT];
+    std::shared_lock<std::shared_mutex> lock(shard.mtx_);
+    return shard.slots_[probe(shard.slots_, h, id)].handle;
+}
+
+std::string_view InternTable::str(Handle handle) const {
+    return chunks_[handle >> CHUNK_BITS].load(std::memory_order_acquire)[handle & (CHUNK_SIZE - 1)];
+}
+
+size_t InternTable::bytes() const {
+    size_t slots = 0;
+    for(const auto& shard : shards_){
+        std::shared_lock<std::shared_mutex> lock(shard.mtx_);
+        slots += shard.slots_.size() * sizeof(Slot);
+    }
+    size_t chunks = (size() >> CHUNK_BITS) + 1;
+    return arena_bytes_.load(std::memory_order_relaxed) + slots
+         + chunks * CHUNK_SIZE * sizeof(std::string_view) + MAX_CHUNKS * sizeof(chunks_[0]);
+}
+
+void InternTable::grow(Shard& shard){
+    std::vector<Slot> slots(shard.slots_.size() * 2);
+    for(const auto& slot : shard.slots_){
+        if(slot.handle != NONE){
+            auto text = str(slot.handle);
+            slots[probe(slots, hash(text), text)] = slot;
+        }
+    }
+    shard.slots_.swap(slots);
+}
+
+InternTable::Handle InternTable::append(std::string_view id){
+    std::lock_guard<std::mutex> lock(append_mtx_);
+    Handle handle = next_.load(std::memory_order_relaxed);
+    if(handle == 0){
+        throw std::length_error("InternTable is out of handles");
+    }
+
+    char* text;
+    if(id.size() > ARENA_BLOCK / 4){
+        // oversized ids get a block of their own
+        arena_.insert(arena_.begin(), std::make_unique<char[]>(id.size()));
+        text = arena_.front().get();
+        arena_bytes_.fetch_add(id.size(), std::memory_order_relaxed);
+    } else {
+        if(arena_used_ + id.size() > ARENA_BLOCK){
+            arena_.push_back(std::make_unique<char[]>(ARENA_BLOCK));
+            arena_used_ = 0;
+            arena_bytes_.fetch_add(ARENA_BLOCK, std::memory_order_relaxed);
+        }
+        text = arena_.back().get() + arena_used_;
+        arena_used_ += id.size();
+    }
+    std::memcpy(text, id.data(), id.size());
+
+    auto& chunk = chunks_[handle >> CHUNK_BITS];
+    std::string_view* views = chunk.load(std::memory_order_relaxed);
+    if(!views){
+        chunk_storage_.push_back(std::make_unique<std::string_view[]>(CHUNK_SIZE));
+        views = chunk_storage_.back().get();
+        chunk.store(views, std::memory_order_release);
+    }
+    views[handle & (CHUNK_SIZE - 1)] = std::string_view(text, id.size());
+    next_.store(handle + 1, std::memory_order_relaxed);
+    return handle;
+}
@@ -0,0 +1,52 @@
+#include <algorithm>
+#include <functional>
+#include "IoThreadPool.hpp"
+
+IoThreadPool::IoThreadPool(size_t threads){
+    threads = std::max<size_t>(threads, 1);
+    contexts_.reserve(threads);
+    work_.reserve(threads);
+    for(size_t i = 0; i < threads; ++i){
+        contexts_.push_back(std::make_unique<net::io_context>(1));
+        work_.push_back(net::make_work_guard(*contexts_.back()));
+    }
+}
+
+IoThreadPool::~IoThreadPool(){
+    stop();
+    join();
+}
+
+size_t IoThreadPool::owner_of(std::string_view barrack_id) const {
+    return std::hash<std::string_view>{}(barrack_id) % contexts_.size();
+}
+
+size_t IoThreadPool::next_index(){
+    return next_.fetch_add(1, std::memory_order_relaxed) % contexts_.size();
+}
+
+void IoThreadPool::run(){
+    for(auto& context : contexts_){
+        threads_.emplace_back([&ioc = *context](){
+            std::cout << "[INFO] IO thread started" << std::endl;
+            ioc.run();
+            std::cout << "[INFO] IO thread stopped" << std::endl;
+        });
+    }
+}
+
+void IoThreadPool::stop(){
+    work_.clear();
+    for(auto& context : contexts_){
+        context->stop();
+    }
+}
+
+void IoThreadPool::join(){
+    for(auto& thread : threads_){
+        if(thread.joinable()){
+            thread.join();
+        }
+    }
+    threads_.clear();
+}
@@ -0,0 +1,547 @@
+#include <array>
+#include <cstdint>
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "JsonScanner.hpp"
+
+static void skip_whitespace(const char*& p, const char* end){
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')){
+        ++p;
+    }
+}
+
+// First byte in [p, end) that needs a closer look inside a string: a quote,
+// a backslash, a control character or a non-ASCII byte.
+static const char* find_string_special(const char* p, const char* end){
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+    while(end - p >= 16){
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // signed compare: catches both control characters and bytes >= 0x80
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                    _mm_cmpeq_epi8(chunk, backslash)),
+                                       _mm_cmplt_epi8(chunk, space));
+        int mask = _mm_movemask_epi8(special);
+        if(mask != 0){
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+        p += 16;
+    }
+#endif
+    while(p < end){
+        auto c = static_cast<unsigned char>(*p);
+        if(c == '"' || c == '\\' || c < 0x20 || c >= 0x80){
+            return p;
+        }
+        ++p;
+    }
+    return end;
+}
+
+// Validates one UTF-8 sequence starting at p (a byte >= 0x80) and advances
+// past it. Rejects overlong forms, surrogates and code points above U+10FFFF.
+static bool skip_utf8_sequence(const char*& p, const char* end){
+    auto byte = [&](ptrdiff_t i){ return static_cast<unsigned char>(p[i]); };
+    unsigned char lead = byte(0);
+    size_t length;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    if(lead >= 0xC2 && lead <= 0xDF){
+        length = 2;
+    } else if(lead >= 0xE0 && lead <= 0xEF){
+        length = 3;
+        if(lead == 0xE0){ low = 0xA0; }
+        if(lead == 0xED){ high = 0x9F; }
+    } else if(lead >= 0xF0 && lead <= 0xF4){
+        length = 4;
+        if(lead == 0xF0){ low = 0x90; }
+        if(lead == 0xF4){ high = 0x8F; }
+    } else {
+        return false;
+    }
+    if(static_cast<size_t>(end - p) < length){
+        return false;
+    }
+    if(byte(1) < low || byte(1) > high){
+        return false;
+    }
+    for(size_t i = 2; i < length; ++i){
+        if(byte(i) < 0x80 || byte(i) > 0xBF){
+            return false;
+        }
+    }
+    p += length;
+    return true;
+}
+
+static bool parse_hex4(const char*& p, const char* end, uint32_t& out){
+    if(end - p < 4){
+        return false;
+    }
+    out = 0;
+    for(int i = 0; i < 4; ++i){
+        char c = *p++;
+        out <<= 4;
+        if(c >= '0' && c <= '9'){
+            out |= static_cast<uint32_t>(c - '0');
+        } else if(c >= 'a' && c <= 'f'){
+            out |= static_cast<uint32_t>(c - 'a' + 10);
+        } else if(c >= 'A' && c <= 'F'){
+            out |= static_cast<uint32_t>(c - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void append_utf8(std::string& out, uint32_t cp){
+    if(cp < 0x80){
+        out += static_cast<char>(cp);
+    } else if(cp < 0x800){
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if(cp < 0x10000){
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Decodes one escape sequence; p points just past the backslash.
+static bool decode_escape(const char*& p, const char* end, std::string& out){
+    if(p == end){
+        return false;
+    }
+    switch(*p++){
+        case '"': out += '"'; return true;
+        case '\\': out += '\\'; return true;
+        case '/': out += '/'; return true;
+        case 'b': out += '\b'; return true;
+        case 'f': out += '\f'; return true;
+        case 'n': out += '\n'; return true;
+        case 'r': out += '\r'; return true;
+        case 't': out += '\t'; return true;
+        case 'u': break;
+        default: return false;
+    }
+    uint32_t cp;
+    if(!parse_hex4(p, end, cp)){
+        return false;
+    }
+    if(cp >= 0xDC00 && cp <= 0xDFFF){
+        return false;
+    }
+    if(cp >= 0xD800 && cp <= 0xDBFF){
+        uint32_t low;
+        if(end - p < 2 || p[0] != '\\' || p[1] != 'u'){
+            return false;
+        }
+        p += 2;
+        if(!parse_hex4(p, end, low) || low < 0xDC00 || low > 0xDFFF){
+            return false;
+        }
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+    }
+    append_utf8(out, cp);
+    return true;
+}
+
+// p points at the opening quote. Unescaped strings become views into the
+// frame, escaped ones are decoded into the arena. With arena == nullptr the
+// string is only validated.
+static bool parse_string(const char*& p, const char* end, CommandArena* arena, std::string_view& out){
+    const char* start = ++p;
+    std::string decoded;
+    bool escaped = false;
+    while(true){
+        const char* q = find_string_special(p, end);
+        if(q == end){
+            return false;
+        }
+        if(escaped){
+            decoded.append(p, q);
+        }
+        auto c = static_cast<unsigned char>(*q);
+        if(c == '"'){
+            p = q + 1;
+            if(!escaped){
+                out = std::string_view(start, static_cast<size_t>(q - start));
+            } else if(arena){
+                out = arena->copy(decoded);
+            }
+            return true;
+        }
+        if(c == '\\'){
+            if(!escaped){
+                escaped = true;
+                decoded.assign(start, q);
+            }
+            p = q + 1;
+            if(!decode_escape(p, end, decoded)){
+                return false;
+            }
+        } else if(c >= 0x80){
+            p = q;
+            if(!skip_utf8_sequence(p, end)){
+                return false;
+            }
+            if(escaped){
+                decoded.append(q, p);
+            }
+        } else {
+            // raw control character
+            return false;
+        }
+    }
+}
+
+static bool skip_digits(const char*& p, const char* end){
+    const char* start = p;
+    while(p < end && *p >= '0' && *p <= '9'){
+        ++p;
+    }
+    return p != start;
+}
+
+// Validates a number. integer is set when it is a plain integer that
+// nlohmann would dump back unchanged.
+static bool parse_number(const char*& p, const char* end, bool& integer){
+    const char* start = p;
+    if(p < end && *p == '-'){
+        ++p;
+    }
+    if(p < end && *p == '0'){
+        ++p;
+    } else if(!skip_digits(p, end)){
+        return false;
+    }
+    integer = true;
+    if(p < end && *p == '.'){
+        ++p;
+        integer = false;
+        if(!skip_digits(p, end)){
+            return false;
+        }
+    }
+    if(p < end && (*p == 'e' || *p == 'E')){
+        ++p;
+        integer = false;
+        if(p < end && (*p == '+' || *p == '-')){
+            ++p;
+        }
+        if(!skip_digits(p, end)){
+            return false;
+        }
+    }
+    // "-0" dumps as "0" and long integers may not fit in 64 bits
+    if(integer && ((p - start == 2 && start[0] == '-' && start[1] == '0') || p - start > 18)){
+        integer = false;
+    }
+    return true;
+}
+
+static bool skip_literal(const char*& p, const char* end, std::string_view literal){
+    if(static_cast<size_t>(end - p) < literal.size() || std::string_view(p, literal.size()) != literal){
+        return false;
+    }
+    p += literal.size();
+    return true;
+}
+
+static bool skip_value(const char*& p, const char* end, int depth);
+
+// Skips an object or array; p points at the opening bracket.
+static bool skip_container(const char*& p, const char* end, int depth){
+    if(depth > JsonScanner::MAX_DEPTH){
+        return false;
+    }
+    bool object = *p == '{';
+    char close = object ? '}' : ']';
+    ++p;
+    skip_whitespace(p, end);
+    if(p < end && *p == close){
+        ++p;
+        return true;
+    }
+    while(true){
+        if(object){
+            std::string_view key;
+            if(p == end || *p != '"' || !parse_string(p, end, nullptr, key)){
+                return false;
+            }
+            skip_whitespace(p, end);
+            if(p == end || *p++ != ':'){
+                return false;
+            }
+            skip_whitespace(p, end);
+        }
+        if(!skip_value(p, end, depth + 1)){
+            return false;
+        }
+        skip_whitespace(p, end);
+        if(p == end){
+            return false;
+        }
+        if(*p == close){
+            ++p;
+            return true;
+        }
+        if(*p++ != ','){
+            return false;
+        }
+        skip_whitespace(p, end);
+    }
+}
+
+static bool skip_value(const char*& p, const char* end, int depth){
+    if(p == end){
+        return false;
+    }
+    switch(*p){
+        case '{':
+        case '[':
+            return skip_container(p, end, depth);
+        case '"': {
+            std::string_view ignored;
+            return parse_string(p, end, nullptr, ignored);
+        }
+        case 't': return skip_literal(p, end, "true");
+        case 'f': return skip_literal(p, end, "false");
+        case 'n': return skip_literal(p, end, "null");
+        default: {
+            bool integer;
+            return parse_number(p, end, integer);
+        }
+    }
+}
+
+bool JsonScanner::scan_envelope(std::string_view frame, CommandArena& arena, Envelope& out){
+    const char* p = frame.data();
+    const char* end = p + frame.size();
+    bool have_type = false;
+    bool have_payload = false;
+
+    skip_whitespace(p, end);
+    if(p == end || *p++ != '{'){
+        return false;
+    }
+    skip_whitespace(p, end);
+    if(p < end && *p == '}'){
+        return false;
+    }
+    while(true){
+        std::string_view key;
+        if(p == end || *p != '"' || !parse_string(p, end, &arena, key)){
+            return false;
+        }
+        skip_whitespace(p, end);
+        if(p == end || *p++ != ':'){
+            return false;
+        }
+        skip_whitespace(p, end);
+        if(p == end){
+            return false;
+        }
+
+        if(key == "type"){
+            if(have_type || *p != '"' || !parse_string(p, end, &arena, out.type)){
+                return false;
+            }
+            have_type = true;
+        } else if(key == "payload"){
+            const char* start = p;
+            if(have_payload || (*p != '{' && *p != '[') || !skip_container(p, end, 1)){
+                return false;
+            }
+            out.payload = std::string_view(start, static_cast<size_t>(p - start));
+            have_payload = true;
+        } else if(key == "request_id"){
+            // echoed back verbatim, so keep the raw token; other value kinds
+            // are left to the slow path, which ignores them. So are strings
+            // with escapes, which nlohmann re-encodes in its own spelling:
+            // both paths echo the same bytes.
+            const char* start = p;
+            std::string_view unused;
+            bool integer = false;
+            if(*p == '"'){
+                if(!parse_string(p, end, nullptr, unused)
+                   || std::string_view(start, static_cast<size_t>(p - start)).find('\\') != std::string_view::npos){
+                    return false;
+                }
+            } else if(!parse_number(p, end, integer) || !integer){
+                return false;
+            }
+            out.request_id = std::string_view(start, static_cast<size_t>(p - start));
+        } else if(!skip_value(p, end, 1)){
+            return false;
+        }
+
+        skip_whitespace(p, end);
+        if(p == end){
+            return false;
+        }
+        if(*p == '}'){
+            ++p;
+            break;
+        }
+        if(*p++ != ','){
+            return false;
+        }
+        skip_whitespace(p, end);
+    }
+    skip_whitespace(p, end);
+    return p == end && have_type && have_payload;
+}
+
+bool JsonScanner::peek_envelope(std::string_view frame, std::string_view& type, std::string_view& request_id){
+    const char* p = frame.data();
+    const char* end = p + frame.size();
+    type = {};
+    request_id = {};
+
+    skip_whitespace(p, end);
+    if(p == end || *p++ != '{'){
+        return false;
+    }
+    skip_whitespace(p, end);
+    while(p < end && *p != '}'){
+        // escaped keys decode to nothing without an arena and match no name
+        std::string_view key;
+        if(*p != '"' || !parse_string(p, end, nullptr, key)){
+            return false;
+        }
+        skip_whitespace(p, end);
+        if(p == end || *p++ != ':'){
+            return false;
+        }
+        skip_whitespace(p, end);
+        const char* start = p;
+        if(!skip_value(p, end, 1)){
+            return false;
+        }
+        std::string_view token(start, static_cast<size_t>(p - start));
+        if(key == "type"){
+            if(token.size() < 2 || token.front() != '"' || token.find('\\') != std::string_view::npos){
+                return false;
+            }
+            type = token.substr(1, token.size() - 2);
+        } else if(key == "request_id"){
+            bool integer = false;
+            const char* number = start;
+            if(token.front() == '"' ? token.find('\\') == std::string_view::npos
+                                    : parse_number(number, p, integer) && integer){
+                request_id = token;
+            }
+        }
+        skip_whitespace(p, end);
+        if(p < end && *p == ','){
+            ++p;
+            skip_whitespace(p, end);
+        }
+    }
+    return !type.empty();
+}
+
+void JsonScanner::scan_items(std::string_view array, std::vector<std::string_view>& items){
+    const char* p = array.data();
+    const char* end = p + array.size();
+    ++p;
+    skip_whitespace(p, end);
+    if(p < end && *p == ']'){
+        return;
+    }
+    while(p < end){
+        const char* start = p;
+        skip_value(p, end, 2);
+        items.emplace_back(start, static_cast<size_t>(p - start));
+        skip_whitespace(p, end);
+        if(p == end || *p++ == ']'){
+            return;
+        }
+        skip_whitespace(p, end);
+    }
+}
+
+bool JsonScanner::scan_fields(std::string_view payload, CommandArena& arena, PayloadFields& fields){
+    // payload was validated by scan_envelope, only the value shapes matter here
+    const char* p = payload.data();
+    const char* end = p + payload.size();
+    std::array<std::string_view, PayloadFields::MAX_FIELDS> seen;
+    size_t seen_count = 0;
+    ++p;
+    skip_whitespace(p, end);
+    if(p < end && *p == '}'){
+        return true;
+    }
+    while(true){
+        std::string_view key;
+        std::string_view value;
+        if(!parse_string(p, end, &arena, key)){
+            return false;
+        }
+        // nlohmann keeps the last duplicate, leave that case to it
+        for(size_t i = 0; i < seen_count; ++i){
+            if(seen[i] == key){
+                return false;
+            }
+        }
+        if(seen_count == seen.size()){
+            return false;
+        }
+        seen[seen_count++] = key;
+        skip_whitespace(p, end);
+        ++p;    // ':'
+        skip_whitespace(p, end);
+
+        bool keep = true;
+        const char* start = p;
+        switch(*p){
+            case '"':
+                if(!parse_string(p, end, &arena, value)){
+                    return false;
+                }
+                break;
+            case 't':
+                p += 4;
+                value = "true";
+                break;
+            case 'f':
+                p += 5;
+                value = "false";
+                break;
+            case 'n':
+                p += 4;
+                keep = false;
+                break;
+            case '{':
+            case '[':
+                return false;
+            default: {
+                bool integer;
+                if(!parse_number(p, end, integer) || !integer){
+                    return false;
+                }
+                value = std::string_view(start, static_cast<size_t>(p - start));
+            }
+        }
+        if(keep && !fields.add(key, value)){
+            return false;
+        }
+
+        skip_whitespace(p, end);
+        if(*p++ == '}'){
+            return true;
+        }
+        skip_whitespace(p, end);
+    }
+}
@@ -0,0 +1,67 @@
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "JsonWriter.hpp"
+
+// First byte in [p, end) that has to be escaped: a quote, a backslash or a
+// control character. Everything else, UTF-8 included, is copied verbatim.
+static const char* find_escape(const char* p, const char* end){
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i minus_one = _mm_set1_epi8(-1);
+    while(end - p >= 16){
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // signed compares: 0 <= byte < 0x20, so UTF-8 bytes are left alone
+        __m128i control = _mm_and_si128(_mm_cmplt_epi8(chunk, space), _mm_cmpgt_epi8(chunk, minus_one));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                    _mm_cmpeq_epi8(chunk, backslash)),
+                                       control);
+        int mask = _mm_movemask_epi8(special);
+        if(mask != 0){
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+        p += 16;
+    }
+#endif
+    while(p < end){
+        auto c = static_cast<unsigned char>(*p);
+        if(c == '"' || c == '\\' || c < 0x20){
+            return p;
+        }
+        ++p;
+    }
+    return end;
+}
+
+void JsonWriter::write_string(std::string_view str){
+    static const char hex[] = "0123456789abcdef";
+    const char* p = str.data();
+    const char* end = p + str.size();
+
+    out_ += '"';
+    while(p < end){
+        const char* special = find_escape(p, end);
+        out_.append(p, special);
+        if(special == end){
+            break;
+        }
+        auto c = static_cast<unsigned char>(*special);
+        switch(c){
+            case '"': out_ += "\\\""; break;
+            case '\\': out_ += "\\\\"; break;
+            case '\b': out_ += "\\b"; break;
+            case '\f': out_ += "\\f"; break;
+            case '\n': out_ += "\\n"; break;
+            case '\r': out_ += "\\r"; break;
+            case '\t': out_ += "\\t"; break;
+            default: {
+                char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                out_.append(escape, sizeof(escape));
+            }
+        }
+        p = special + 1;
+    }
+    out_ += '"';
+}
@@ -1,7 +1,11 @@
+#include <unistd.h>
+#include "boost/beast/http.hpp"
 #include "Listener.hpp"
+#include "Room.hpp"
 
-Listener::Listener(net::io_context& ioc, tcp::endpoint endpoint, std::shared_ptr<ConnectionManager> cm)
-    : ioc_(ioc), acceptor_(ioc), conn_manager_(cm)
+Listener::Listener(net::io_context& ioc, tcp::endpoint endpoint, std::shared_ptr<ConnectionManager> cm,
+                   std::shared_ptr<IoThreadPool> io_pool)
+    : ioc_(ioc), acceptor_(ioc), conn_manager_(cm), io_pool_(std::move(io_pool))
 {
     error_code ec;
     
@@ -53,8 +57,94 @@ void Listener::on_accept(error_code ec, tcp::socket socket){
     if(ec){
         fail(ec, "accept");
     }
+    else if(io_pool_){
+        place_session(std::move(socket));
+    }
     else{
         conn_manager_->start_new_session(std::move(socket));
     }
     do_accept();
+}
+
+// Value of the barrack query parameter in an upgrade target such as
+// "/?barrack=<id>", empty when there is none.
+static std::string_view barrack_hint(std::string_view target){
+    auto query = target.find('?');
+    if(query == std::string_view::npos){
+        return {};
+    }
+    target.remove_prefix(query + 1);
+    constexpr std::string_view key = "barrack=";
+    while(!target.empty()){
+        auto param = target.substr(0, target.find('&'));
+        if(param.starts_with(key)){
+            return param.substr(key.size());
+        }
+        target.remove_prefix(std::min(param.size() + 1, target.size()));
+    }
+    return {};
+}
+
+// Reads the websocket upgrade request on the acceptor's thread, picks the io
+// thread the client's barrack hint maps to and moves the socket there before
+// the session exists. Clients that reconnect with ?barrack=<id> of their
+// busiest room end up next to the other members of that room. The choice is
+// made once: a session that later joins a barrack owned by another thread
+// stays where it is, since its stream, pending reads and timers are bound to
+// its strand. Its broadcasts then cross threads like they would without
+// placement, until the client reconnects with that barrack as its hint.
+class PlacementHandshake : public std::enable_shared_from_this<PlacementHandshake> {
+    public:
+        PlacementHandshake(tcp::socket&& socket, std::shared_ptr<IoThreadPool> io_pool, std::shared_ptr<ConnectionManager> conn_manager)
+            : stream_(std::move(socket)), io_pool_(std::move(io_pool)), conn_manager_(std::move(conn_manager)) {}
+
+        void run(){
+            stream_.expires_after(std::chrono::seconds(30));
+            http::async_read(stream_, buffer_, request_,
+                beast::bind_front_handler(&PlacementHandshake::on_read, shared_from_this()));
+        }
+
+    private:
+        void on_read(error_code ec, std::size_t){
+            if(ec){
+                fail(ec, "placement read");
+                return;
+            }
+            stream_.expires_never();
+            // the client may not send frames before the upgrade is answered,
+            // so nothing past the request can be buffered here
+            auto target = request_.target();
+            auto hint = barrack_hint(std::string_view(target.data(), target.size()));
+            size_t index = hint.empty() ? io_pool_->next_index() : io_pool_->owner_of(hint);
+
+            auto socket = stream_.release_socket();
+            auto protocol = socket.local_endpoint(ec).protocol();
+            auto handle = ec ? tcp::socket::native_handle_type{} : socket.release(ec);
+            if(ec){
+                fail(ec, "placement handoff");
+                return;
+            }
+            tcp::socket placed(net::make_strand(io_pool_->context(index)));
+            placed.assign(protocol, handle, ec);
+            if(ec){
+                // the released descriptor belongs to nobody now
+                ::close(handle);
+                fail(ec, "placement assign");
+                return;
+            }
+            if(!hint.empty()){
+                Room::fanout_stats().steered_sessions.fetch_add(1, std::memory_order_relaxed);
+            }
+            conn_manager_->start_new_session(std::move(placed), std::move(request_));
+        }
+
+        beast::tcp_stream stream_;
+        beast::flat_buffer buffer_;
+        http::request<http::string_body> request_;
+        std::shared_ptr<IoThreadPool> io_pool_;
+        std::shared_ptr<ConnectionManager> conn_manager_;
+};
+
+void Listener::place_session(tcp::socket socket){
+    std::make_shared<PlacementHandshake>(std::move(socket), io_pool_, conn_manager_)->run();
 }
\ No newline at end of file
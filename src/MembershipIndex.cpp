@@ -0,0 +1,115 @@
+#include <algorithm>
+#include "MembershipIndex.hpp"
+#include "ClientSession.hpp"
+
+bool MembershipIndex::add_room(const std::shared_ptr<ClientSession>& session, std::string_view barrack_id){
+    auto& shard = session_shard(session->get_id());
+    std::scoped_lock<std::mutex> lock(shard.mtx_);
+    if(session->is_closed()){
+        return false;
+    }
+    auto& rooms = shard.sessions_[session->get_id()].rooms;
+    if(std::find(rooms.begin(), rooms.end(), barrack_id) == rooms.end()){
+        rooms.emplace_back(barrack_id);
+    }
+    return true;
+}
+
+bool MembershipIndex::remove_room(SessionID session, std::string_view barrack_id){
+    auto& shard = session_shard(session);
+    std::scoped_lock<std::mutex> lock(shard.mtx_);
+    auto itr = shard.sessions_.find(session);
+    if(itr == shard.sessions_.end()){
+        return false;
+    }
+    auto& rooms = itr->second.rooms;
+    auto room = std::find(rooms.begin(), rooms.end(), barrack_id);
+    bool found = room != rooms.end();
+    if(found){
+        *room = std::move(rooms.back());
+        rooms.pop_back();
+    }
+    if(rooms.empty() && itr->second.user_id.empty()){
+        shard.sessions_.erase(itr);
+    }
+    return found;
+}
+
+void MembershipIndex::bind_user(std::string_view user_id, const std::shared_ptr<ClientSession>& session){
+    auto id = session->get_id();
+    std::string previous;
+    {
+        auto& shard = session_shard(id);
+        std::scoped_lock<std::mutex> lock(shard.mtx_);
+        if(session->is_closed()){
+            return;
+        }
+        auto& entry = shard.sessions_[id];
+        if(entry.user_id == user_id){
+            return;
+        }
+        previous = std::exchange(entry.user_id, std::string(user_id));
+    }
+    if(!previous.empty()){
+        unbind_user(previous, id);
+    }
+
+    auto& shard = user_shard(user_id);
+    std::scoped_lock<std::mutex> lock(shard.mtx_);
+    auto itr = shard.users_.find(user_id);
+    if(itr == shard.users_.end()){
+        itr = shard.users_.emplace(std::string(user_id), std::vector<UserSession>{}).first;
+    }
+    auto& sessions = itr->second;
+    // sessions that closed while binding left expired entries behind
+    std::erase_if(sessions, [](const UserSession& entry){ return entry.session.expired(); });
+    sessions.push_back({id, session});
+}
+
+void MembershipIndex::unbind_user(std::string_view user_id, SessionID session){
+    auto& shard = user_shard(user_id);
+    std::scoped_lock<std::mutex> lock(shard.mtx_);
+    auto itr = shard.users_.find(user_id);
+    if(itr == shard.users_.end()){
+        return;
+    }
+    std::erase_if(itr->second, [&](const UserSession& entry){ return entry.id == session || entry.session.expired(); });
+    if(itr->second.empty()){
+        shard.users_.erase(itr);
+    }
+}
+
+std::vector<std::shared_ptr<ClientSession>> MembershipIndex::sessions_of(std::string_view user_id) const {
+    std::vector<std::shared_ptr<ClientSession>> live;
+    const auto& shard = user_shard(user_id);
+    std::scoped_lock<std::mutex> lock(shard.mtx_);
+    auto itr = shard.users_.find(user_id);
+    if(itr == shard.users_.end()){
+        return live;
+    }
+    live.reserve(itr->second.size());
+    for(const auto& entry : itr->second){
+        if(auto session = entry.session.lock()){
+            live.push_back(std::move(session));
+        }
+    }
+    return live;
+}
+
+MembershipIndex::SessionEntry MembershipIndex::forget(SessionID session){
+    SessionEntry entry;
+    {
+        auto& shard = session_shard(session);
+        std::scoped_lock<std::mutex> lock(shard.mtx_);
+        auto itr = shard.sessions_.find(session);
+        if(itr == shard.sessions_.end()){
+            return entry;
+        }
+        entry = std::move(itr->second);
+        shard.sessions_.erase(itr);
+    }
+    if(!entry.user_id.empty()){
+        unbind_user(entry.user_id, session);
+    }
+    return entry;
+}
@@ -1,12 +1,85 @@
-
+#include <algorithm>
 #include <json.hpp>
 #include <thread>
 #include <vector>
 #include "ClientSession.hpp"
+#include "CommandMetrics.hpp"
+#include "JsonScanner.hpp"
 #include "MessageDispatcher.hpp"
+#include "Responses.hpp"
+#include "Room.hpp"
+
+// Copies the payload members into the task arena so the command can keep views
+// after the json DOM is gone. Non-string scalars keep their json spelling.
+// Returns false when the payload has more members than PayloadFields holds.
+static bool collect_fields(const nlohmann::json& payload, CommandArena& arena, PayloadFields& fields){
+    for (const auto& item : payload.items()) {
+        const auto& value = item.value();
+        std::string_view field;
+        if (value.is_string()) {
+            field = arena.copy(value.get_ref<const std::string&>());
+        } else if (value.is_boolean()) {
+            field = value.get<bool>() ? "true" : "false";
+        } else if (value.is_null()) {
+            continue;
+        } else {
+            field = arena.copy(value.dump());
+        }
+        if (!fields.add(arena.copy(item.key()), field)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string too_many_fields_message(){
+    return "A payload may hold at most " + std::to_string(PayloadFields::MAX_FIELDS) + " fields";
+}
+
+// Only strings and integers are echoed; anything else is treated as absent.
+static std::string_view request_id_of(const nlohmann::json& message, CommandArena& arena){
+    auto it = message.find("request_id");
+    if (it == message.end() || !(it->is_string() || it->is_number_integer())) {
+        return {};
+    }
+    return arena.copy(it->dump());
+}
+
+static void set_request_id(AnyCommand& command, std::string_view request_id){
+    std::visit([request_id](auto& c) {
+        if constexpr (!std::is_same_v<std::decay_t<decltype(c)>, std::monostate>) {
+            c.set_request_id(request_id);
+        }
+    }, command);
+}
+
+static ResponseMeta reply_meta_of(const AnyCommand& command, uint64_t sequence_id){
+    return std::visit([sequence_id](const auto& c) -> ResponseMeta {
+        if constexpr (std::is_same_v<std::decay_t<decltype(c)>, std::monostate>) {
+            return {sequence_id, {}};
+        } else {
+            return c.reply_meta(sequence_id);
+        }
+    }, command);
+}
+
+static std::pair<CommandPriority, std::chrono::milliseconds> scheduling_of(const AnyCommand& command){
+    return std::visit([](const auto& c) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(c)>, std::monostate>) {
+            return std::make_pair(CommandPriority::INTERACTIVE, CommandBase::DEFAULT_DEADLINE);
+        } else {
+            return std::make_pair(c.priority(), c.deadline());
+        }
+    }, command);
+}
+
+static constexpr std::string_view BATCH_TYPE = "BATCH";
 
 MessageDispatcher::MessageDispatcher(size_t num_threads, CommandContext context) : 
-    commandContext(context), command_queue(std::make_unique<ConcurrentQueue<CommandTask>>()) {
+    commandContext(context),
+    slot_pool_(std::make_unique<ObjectPool<TaskSlot>>(INITIAL_TASK_SLOTS)),
+    command_queue(std::make_unique<CommandQueue>(LANE_WEIGHTS, LANE_STARVATION_LIMIT)) {
+    commandContext.dispatcher = this;
     for(size_t i = 0; i < num_threads; i++){
         workers_.emplace_back(&MessageDispatcher::worker_loop, this);
     }
@@ -23,87 +96,224 @@ MessageDispatcher::~MessageDispatcher(){
 }
 
 void MessageDispatcher::dispatch(std::shared_ptr<ClientSession> session,
-                                 const std::string &raw_payload) {
+                                 std::string_view raw_payload) {
+   if (is_overloaded() && shed(session, raw_payload)) {
+       return;
+   }
+   TaskSlot* slot = slot_pool_->acquire();
+   // The slot arena owns the frame from here on
+   std::string_view frame = slot->arena.copy(raw_payload);
+
+   bool queued = dispatch_scanned(session, slot, frame);
+   if (queued) {
+       frames_scanned_.fetch_add(1, std::memory_order_relaxed);
+   } else {
+       frames_parsed_.fetch_add(1, std::memory_order_relaxed);
+       queued = dispatch_parsed(session, slot, frame);
+   }
+
+   if (!queued) {
+       slot->reset();
+       slot_pool_->release(slot);
+   }
+}
+
+// Decides on the frame before it costs a task slot, an arena copy or a parse:
+// only its type and request_id are peeked at. Control traffic (logout,
+// leave, heartbeats) is what lets a backed up server recover, so it is let
+// through; everything else, BATCH frames and frames the peek cannot read
+// included, is answered with RETRY_LATER.
+bool MessageDispatcher::shed(const std::shared_ptr<ClientSession>& session, std::string_view frame) {
+   std::string_view type;
+   std::string_view request_id;
+   CommandPriority priority = CommandPriority::INTERACTIVE;
+   if (JsonScanner::peek_envelope(frame, type, request_id) &&
+       CommandFactory::priority_of(type, priority) && priority == CommandPriority::CONTROL) {
+       return false;
+   }
+   frames_shed_.fetch_add(1, std::memory_order_relaxed);
+   session->send_message(failure_response("RETRY_LATER", {session->get_next_sequence_id(), request_id},
+                                          "RETRY_LATER", "Server is busy, retry later"));
+   return true;
+}
+
+bool MessageDispatcher::dispatch_scanned(const std::shared_ptr<ClientSession>& session,
+                                         TaskSlot* slot, std::string_view frame) {
+   JsonScanner::Envelope envelope;
+   if (!JsonScanner::scan_envelope(frame, slot->arena, envelope)) {
+       return false;
+   }
+   if (envelope.type == BATCH_TYPE) {
+       return dispatch_batch_scanned(session, slot, envelope);
+   }
+   if (envelope.payload.front() != '{') {
+       return false;
+   }
+   // Route on the type before touching the payload; unknown types take the
+   // slow path so they get the usual error response.
+   if (COMMAND_INDEX.find(envelope.type) < 0) {
+       return false;
+   }
+   PayloadFields fields;
+   if (!JsonScanner::scan_fields(envelope.payload, slot->arena, fields)) {
+       return false;
+   }
+   if (!commandFactory.create_command(envelope.type, fields, slot->command)) {
+       return false;
+   }
+   set_request_id(slot->command, envelope.request_id);
+   enqueue(session, slot);
+   return true;
+}
+
+bool MessageDispatcher::dispatch_parsed(const std::shared_ptr<ClientSession>& session,
+                                        TaskSlot* slot, std::string_view frame) {
+   bool queued = false;
    try {
         // Parse JSON and validate structure
-        auto json_msg = nlohmann::json::parse(raw_payload);
+        auto json_msg = nlohmann::json::parse(frame.begin(), frame.end());
+        std::string_view request_id = json_msg.is_object() ? request_id_of(json_msg, slot->arena) : std::string_view{};
         
         // Check if type field exists
         if (!json_msg.contains("type")) {
-            nlohmann::json error_response = {
-                {"type", "ERROR"},
-                {"payload", {
-                    {"error_code", "MISSING_TYPE"},
-                    {"message", "Message must contain a 'type' field"}
-                }}
-            };
-            session->send_message(error_response.dump());
-            
-            return;
-        }
-
-        std::string type = json_msg["type"].get<std::string>();
-        
-        // Check if payload field exists
-        if (!json_msg.contains("payload")) {
-            nlohmann::json error_response = {
-                {"type", "ERROR"},
-                {"payload", {
-                    {"error_code", "MISSING_PAYLOAD"},
-                    {"message", "Message must contain a 'payload' field"}
-                }}
-            };
-            session->send_message(error_response.dump());
-            return;
-        }
-
-        // Try to create command
-        auto command = commandFactory.create_command(type, json_msg["payload"]);
-
-        if (command) {
-            command_queue->push({std::move(command), session});
-        } else {
-            nlohmann::json error_response = {
-                {"type", "ERROR"},
-                {"payload", {
-                    {"error_code", "INVALID_COMMAND_TYPE"},
-                    {"message", "Unknown command type: " + type}
-                }}
-            };
-            session->send_message(error_response.dump());
+            session->send_message(error_response("MISSING_TYPE", "Message must contain a 'type' field", request_id));
+        }
+        else if (!json_msg.contains("payload")) {
+            // Check if payload field exists
+            session->send_message(error_response("MISSING_PAYLOAD", "Message must contain a 'payload' field", request_id));
+        }
+        else {
+            const std::string& type = json_msg["type"].get_ref<const std::string&>();
+            const auto& payload = json_msg["payload"];
+            if (type == BATCH_TYPE) {
+                queued = dispatch_batch_parsed(session, slot, payload, request_id);
+            }
+            else if (!payload.is_object()) {
+                session->send_message(error_response("TYPE_ERROR", "Invalid data type in JSON: 'payload' must be an object", request_id));
+            }
+            else {
+                PayloadFields fields;
+                if (!collect_fields(payload, slot->arena, fields)) {
+                    session->send_message(error_response("INVALID_DATA", too_many_fields_message(), request_id));
+                }
+                // Try to create command
+                else if (commandFactory.create_command(type, fields, slot->command)) {
+                    set_request_id(slot->command, request_id);
+                    enqueue(session, slot);
+                    queued = true;
+                } else {
+                    session->send_message(error_response("INVALID_COMMAND_TYPE", "Unknown command type: " + type, request_id));
+                }
+            }
         }
 
     } catch (const nlohmann::json::parse_error& e) {
         // JSON parsing error
-        nlohmann::json error_response = {
-            {"type", "ERROR"},
-            {"payload", {
-                {"error_code", "INVALID_JSON"},
-                {"message", "Failed to parse JSON: " + std::string(e.what())}
-            }}
-        };
-        session->send_message(error_response.dump());
+        session->send_message(error_response("INVALID_JSON", "Failed to parse JSON: " + std::string(e.what())));
     } catch (const nlohmann::json::type_error& e) {
         // Type conversion error
-        nlohmann::json error_response = {
-            {"type", "ERROR"},
-            {"payload", {
-                {"error_code", "TYPE_ERROR"},
-                {"message", "Invalid data type in JSON: " + std::string(e.what())}
-            }}
-        };
-        session->send_message(error_response.dump());
+        session->send_message(error_response("TYPE_ERROR", "Invalid data type in JSON: " + std::string(e.what())));
     } catch (const std::exception& e) {
         // Generic error handler
-        nlohmann::json error_response = {
-            {"type", "ERROR"},
-            {"payload", {
-                {"error_code", "INTERNAL_ERROR"},
-                {"message", "Internal server error: " + std::string(e.what())}
-            }}
-        };
-        session->send_message(error_response.dump());
+        session->send_message(error_response("INTERNAL_ERROR", "Internal server error: " + std::string(e.what())));
+    }
+    return queued;
+}
+
+// Takes the scanner path only when every element is a well formed command;
+// otherwise the whole frame goes through nlohmann, which builds the per
+// element error replies.
+bool MessageDispatcher::dispatch_batch_scanned(const std::shared_ptr<ClientSession>& session,
+                                               TaskSlot* slot, const JsonScanner::Envelope& envelope) {
+   thread_local std::vector<std::string_view> items;
+   items.clear();
+   if (envelope.payload.front() != '[') {
+       return false;
+   }
+   JsonScanner::scan_items(envelope.payload, items);
+   if (items.empty() || items.size() > MAX_BATCH_COMMANDS) {
+       return false;
+   }
+   slot->batch.resize(items.size());
+   for (size_t i = 0; i < items.size(); ++i) {
+       JsonScanner::Envelope item;
+       PayloadFields fields;
+       auto& command = slot->batch[i].command;
+       if (!JsonScanner::scan_envelope(items[i], slot->arena, item) ||
+           item.payload.front() != '{' ||
+           !JsonScanner::scan_fields(item.payload, slot->arena, fields) ||
+           !commandFactory.create_command(item.type, fields, command)) {
+           slot->batch.clear();
+           return false;
+       }
+       set_request_id(command, item.request_id);
+   }
+   slot->batch_request_id = envelope.request_id;
+   enqueue(session, slot);
+   return true;
+}
+
+bool MessageDispatcher::dispatch_batch_parsed(const std::shared_ptr<ClientSession>& session, TaskSlot* slot,
+                                              const nlohmann::json& commands, std::string_view request_id) {
+    if (!commands.is_array() || commands.empty()) {
+        session->send_message(error_response("TYPE_ERROR", "Invalid data type in JSON: 'payload' must be a non-empty array of commands", request_id));
+        return false;
+    }
+    if (commands.size() > MAX_BATCH_COMMANDS) {
+        session->send_message(error_response("BATCH_TOO_LARGE", "A batch may hold at most " + std::to_string(MAX_BATCH_COMMANDS) + " commands", request_id));
+        return false;
+    }
+    slot->batch.resize(commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const auto& item = commands[i];
+        auto& entry = slot->batch[i];
+        std::string_view item_request_id = item.is_object() ? request_id_of(item, slot->arena) : std::string_view{};
+        if (!item.is_object() || !item.contains("type") || !item["type"].is_string() ||
+            !item.contains("payload") || !item["payload"].is_object()) {
+            entry.error = slot->arena.copy(error_response("INVALID_BATCH_ITEM", "Batch entries must be objects with a string 'type' and an object 'payload'", item_request_id));
+            continue;
+        }
+        const std::string& type = item["type"].get_ref<const std::string&>();
+        PayloadFields fields;
+        if (!collect_fields(item["payload"], slot->arena, fields)) {
+            entry.error = slot->arena.copy(error_response("INVALID_DATA", too_many_fields_message(), item_request_id));
+            continue;
+        }
+        if (!commandFactory.create_command(type, fields, entry.command)) {
+            entry.error = slot->arena.copy(error_response("INVALID_COMMAND_TYPE", "Unknown command type: " + type, item_request_id));
+            continue;
+        }
+        set_request_id(entry.command, item_request_id);
     }
+    slot->batch_request_id = request_id;
+    enqueue(session, slot);
+    return true;
+}
+
+void MessageDispatcher::enqueue(const std::shared_ptr<ClientSession>& session, TaskSlot* slot) {
+    slot->session = session;
+    auto [priority, deadline] = scheduling_of(slot->command);
+    if (!slot->batch.empty()) {
+        // a batch runs as one task: in the least urgent lane of its
+        // commands, bounded by the tightest deadline
+        priority = CommandPriority::CONTROL;
+        deadline = CommandBase::NO_DEADLINE;
+        for (const auto& item : slot->batch) {
+            if (item.error.empty()) {
+                auto [item_priority, item_deadline] = scheduling_of(item.command);
+                priority = std::max(priority, item_priority);
+                deadline = std::min(deadline, item_deadline);
+            }
+        }
+        batch_frames_.fetch_add(1, std::memory_order_relaxed);
+        batch_commands_.fetch_add(slot->batch.size(), std::memory_order_relaxed);
+    }
+    slot->enqueued_at = std::chrono::steady_clock::now();
+    slot->deadline = deadline == CommandBase::NO_DEADLINE
+                         ? std::chrono::steady_clock::time_point::max()
+                         : slot->enqueued_at + deadline;
+    slot->lane = session->begin_request(static_cast<size_t>(priority));
+    command_queue->push(slot->lane, std::move(slot));
 }
 
 void MessageDispatcher::stop(){
@@ -111,22 +321,310 @@ void MessageDispatcher::stop(){
   command_queue->shutdown(); 
 }
 
+bool MessageDispatcher::is_overloaded() const {
+  return command_queue->size_approx() > 0 && overloaded_.load(std::memory_order_relaxed);
+}
+
+void MessageDispatcher::record_queue_wait(uint64_t wait_us) {
+  static constexpr auto enter_us = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(OVERLOAD_ENTER_WAIT).count());
+  static constexpr auto exit_us = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(OVERLOAD_EXIT_WAIT).count());
+  // EWMA (1/8); workers update it concurrently, so no sample is lost
+  auto ewma = queue_wait_ewma_us_.load(std::memory_order_relaxed);
+  uint64_t next;
+  do {
+    next = ewma - ewma / 8 + wait_us / 8;
+  } while (!queue_wait_ewma_us_.compare_exchange_weak(ewma, next, std::memory_order_relaxed));
+  if (next > enter_us) {
+    overloaded_.store(true, std::memory_order_relaxed);
+  } else if (next < exit_us) {
+    overloaded_.store(false, std::memory_order_relaxed);
+  }
+}
+
+MessageDispatcher::Stats MessageDispatcher::get_stats() const {
+  return {commands_executed_.load(std::memory_order_relaxed),
+          queue_pops_.load(std::memory_order_relaxed),
+          commands_expired_.load(std::memory_order_relaxed),
+          frames_shed_.load(std::memory_order_relaxed),
+          frames_scanned_.load(std::memory_order_relaxed),
+          frames_parsed_.load(std::memory_order_relaxed),
+          batch_frames_.load(std::memory_order_relaxed),
+          batch_commands_.load(std::memory_order_relaxed),
+          queue_wait_ewma_us_.load(std::memory_order_relaxed),
+          is_overloaded(),
+          slot_pool_->capacity(),
+          command_queue->get_stats()};
+}
+
+nlohmann::json MessageDispatcher::stats_json() const {
+  static const std::array<const char*, LANE_COUNT> lane_names = {"control", "interactive", "bulk"};
+  auto stats = get_stats();
+  nlohmann::json history = nullptr;
+  nlohmann::json writer = nullptr;
+  nlohmann::json wal = nullptr;
+  if (commandContext.barrack_manager) {
+    auto cache = commandContext.barrack_manager->history_stats();
+    auto reads = cache.hits + cache.misses;
+    history = {
+        {"bytes", cache.bytes},
+        {"budget_bytes", cache.budget_bytes},
+        {"cached_barracks", cache.cached_barracks},
+        {"hits", cache.hits},
+        {"misses", cache.misses},
+        {"hit_rate", reads ? static_cast<double>(cache.hits) / reads : 0.0},
+        {"evictions", cache.evictions}
+    };
+    auto writes = commandContext.barrack_manager->writer_stats();
+    writer = {
+        {"queued", writes.queued},
+        {"backlog", writes.backlog},
+        {"in_flight", writes.in_flight},
+        {"batches", writes.batches},
+        {"written", writes.written},
+        {"failed", writes.failed},
+        {"mean_batch", writes.batches ? static_cast<double>(writes.written + writes.failed) / writes.batches : 0.0},
+        {"commit", CommandMetrics::snapshot_to_json(writes.commit)},
+        {"round_trip", CommandMetrics::snapshot_to_json(writes.round_trip)}
+    };
+    if (auto log = commandContext.barrack_manager->wal_stats()) {
+      wal = {
+          {"segments", log->segments},
+          {"appends", log->appends},
+          {"syncs", log->syncs},
+          {"sync_failures", log->sync_failures},
+          {"appends_per_sync", log->syncs ? static_cast<double>(log->appends) / log->syncs : 0.0},
+          {"released", log->released},
+          {"sync", CommandMetrics::snapshot_to_json(log->sync_latency)}
+      };
+    }
+  }
+  nlohmann::json lanes = nlohmann::json::object();
+  for (size_t i = 0; i < LANE_COUNT; ++i) {
+    const auto& lane = stats.lanes[i];
+    lanes[lane_names[i]] = {
+        {"dequeued", lane.dequeued},
+        {"depth", lane.depth},
+        {"mean_wait_us", lane.dequeued ? lane.total_wait_us / lane.dequeued : 0},
+        {"max_wait_us", lane.max_wait_us}
+    };
+  }
+  return {
+      {"commands_executed", stats.commands_executed},
+      {"queue_pops", stats.queue_pops},
+      {"commands_expired", stats.commands_expired},
+      {"frames_shed", stats.frames_shed},
+      {"frames_scanned", stats.frames_scanned},
+      {"frames_parsed", stats.frames_parsed},
+      {"batch_frames", stats.batch_frames},
+      {"batch_commands", stats.batch_commands},
+      {"queue_wait_ewma_us", stats.queue_wait_ewma_us},
+      {"overloaded", stats.overloaded},
+      {"task_slots", stats.task_slots},
+      {"lanes", std::move(lanes)},
+      {"commands", CommandMetrics::instance().to_json()},
+      {"rooms", commandContext.room_registry ? commandContext.room_registry->size() : 0},
+      {"fanout", Room::fanout_stats().to_json()},
+      {"history", std::move(history)},
+      {"writer", std::move(writer)},
+      {"wal", std::move(wal)}
+  };
+}
+
 void MessageDispatcher::worker_loop() {
+  WorkerScratch scratch;
+  scratch.batch.reserve(MAX_BATCH_SIZE);
   while (!done_) {
-    auto opt_task = command_queue->wait_and_pop();
-    if (!opt_task.has_value()) {
+    scratch.batch.clear();
+    if (command_queue->wait_and_pop_batch(scratch.batch, MAX_BATCH_SIZE) == 0) {
       std::cerr << "No task available, breaking\n";
       break;
     }
-    auto task = std::move(opt_task.value());
-    if (!task.command) {
+    queue_pops_.fetch_add(1, std::memory_order_relaxed);
+    for (TaskSlot* slot : scratch.batch) {
+      if (slot->session) {
+        slot->session->left_lane(slot->lane);
+      }
+    }
+
+    // the longest wait in each batch drives load shedding
+    auto now = std::chrono::steady_clock::now();
+    auto oldest = scratch.batch.front()->enqueued_at;
+    for (TaskSlot* slot : scratch.batch) {
+      oldest = std::min(oldest, slot->enqueued_at);
+    }
+    record_queue_wait(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - oldest).count()));
+
+    execute_batch(scratch, now);
+
+    for (TaskSlot* slot : scratch.batch) {
+      if (slot->session) {
+        slot->session->end_request();
+      }
+      slot->reset();
+    }
+    slot_pool_->release(scratch.batch);
+  }
+}
+
+void MessageDispatcher::execute_batch(WorkerScratch& scratch, std::chrono::steady_clock::time_point now) {
+  auto& metrics = CommandMetrics::instance();
+
+  // Batchable commands are grouped by type and key, without reordering any
+  // one session's commands; a non-batchable command acts as a barrier so
+  // everything queued before it runs first.
+  auto flush_groups = [&]() {
+    for (size_t g = 0; g < scratch.groups_used; ++g) {
+      auto& entries = scratch.groups[g].entries;
+      size_t command_type = scratch.groups[g].type - 1;
+      CommandMetrics::Scope scope(command_type);
+      std::visit([&](auto& first) {
+        using Command = std::decay_t<decltype(first)>;
+        if constexpr (!std::is_same_v<Command, std::monostate>) {
+          if constexpr (requires { first.execute_batch(entries, commandContext); }) {
+            if (entries.size() > 1) {
+              // every sender waits for the whole batch
+              auto start = std::chrono::steady_clock::now();
+              first.execute_batch(entries, commandContext);
+              auto elapsed = std::chrono::steady_clock::now() - start;
+              for (size_t i = 0; i < entries.size(); ++i) {
+                metrics.record(command_type, LatencyStage::EXECUTION, elapsed);
+              }
+              return;
+            }
+          }
+          for (auto& entry : entries) {
+            auto start = std::chrono::steady_clock::now();
+            static_cast<Command*>(entry.command)->execute(entry.session, commandContext);
+            metrics.record(command_type, LatencyStage::EXECUTION, std::chrono::steady_clock::now() - start);
+          }
+        }
+      }, *scratch.groups[g].first_command);
+      entries.clear();
+    }
+    scratch.groups_used = 0;
+  };
+
+  // Runs a command right away, or parks it in its group if it is batchable.
+  auto schedule = [&](AnyCommand& command, const std::shared_ptr<ClientSession>& session) {
+    // AnyCommand index 0 is monostate
+    size_t command_type = command.index() - 1;
+    CommandBase* base = std::visit([](auto& c) -> CommandBase* {
+      if constexpr (std::is_same_v<std::decay_t<decltype(c)>, std::monostate>) {
+        return nullptr;
+      } else {
+        return &c;
+      }
+    }, command);
+    std::string_view key = std::visit([](const auto& c) -> std::string_view {
+      if constexpr (std::is_same_v<std::decay_t<decltype(c)>, std::monostate>) {
+        return {};
+      } else {
+        return c.batch_key();
+      }
+    }, command);
+
+    if (key.empty()) {
+      flush_groups();
+      CommandMetrics::Scope scope(command_type);
+      auto start = std::chrono::steady_clock::now();
+      std::visit([&](auto& c) {
+        if constexpr (!std::is_same_v<std::decay_t<decltype(c)>, std::monostate>) {
+          c.execute(session, commandContext);
+        }
+      }, command);
+      metrics.record(command_type, LatencyStage::EXECUTION, std::chrono::steady_clock::now() - start);
+      return;
+    }
+
+    // Joining an older group runs the command ahead of the groups opened
+    // after it, which is only allowed when none of them holds a command of
+    // the same session: a session's commands, and the items of a BATCH
+    // frame, keep their order. Other sessions still coalesce across keys.
+    size_t type = command.index();
+    CommandGroup* group = nullptr;
+    for (size_t g = scratch.groups_used; g-- > 0;) {
+      auto& candidate = scratch.groups[g];
+      if (candidate.type == type && candidate.key == key) {
+        group = &candidate;
+        break;
+      }
+      if (std::any_of(candidate.entries.begin(), candidate.entries.end(),
+                      [&](const BatchEntry& entry) { return entry.session == session; })) {
+        break;
+      }
+    }
+    if (!group) {
+      if (scratch.groups_used == scratch.groups.size()) {
+        scratch.groups.emplace_back();
+      }
+      group = &scratch.groups[scratch.groups_used++];
+      group->type = type;
+      group->key = key;
+      group->first_command = &command;
+    }
+    group->entries.push_back({base, session});
+  };
+
+  for (TaskSlot* slot : scratch.batch) {
+    if (!slot->session) {
+      std::cerr << "Null session received\n";
+      continue;
+    }
+    auto& session = slot->session;
+    auto start = std::chrono::steady_clock::now();
+
+    if (!slot->batch.empty()) {
+      for (auto& item : slot->batch) {
+        if (item.error.empty()) {
+          metrics.record(item.command.index() - 1, LatencyStage::QUEUE_WAIT, start - slot->enqueued_at);
+        }
+      }
+      if (now > slot->deadline) {
+        commands_expired_.fetch_add(slot->batch.size(), std::memory_order_relaxed);
+        session->send_message(failure_response("TIMEOUT", {session->get_next_sequence_id(), slot->batch_request_id},
+                                               "TIMEOUT", "Request expired in the server queue"));
+        continue;
+      }
+      // Commands queued ahead of the batch answer first; the batch itself
+      // runs in order, with same-key runs (e.g. MESSAGEBARRACK to one
+      // barrack) still going through execute_batch, and all of its replies
+      // go out as one frame.
+      commands_executed_.fetch_add(slot->batch.size(), std::memory_order_relaxed);
+      flush_groups();
+      scratch.replies.clear();
+      {
+        ReplyCapture capture(session.get(), scratch.replies);
+        for (auto& item : slot->batch) {
+          if (!item.error.empty()) {
+            flush_groups();
+            scratch.replies.emplace_back(item.error);
+            continue;
+          }
+          schedule(item.command, session);
+        }
+        flush_groups();
+      }
+      session->send_message(batch_response({session->get_next_sequence_id(), slot->batch_request_id}, scratch.replies));
+      continue;
+    }
+
+    if (std::holds_alternative<std::monostate>(slot->command)) {
       std::cerr << "Null command received\n";
       continue;
     }
-    if (!task.session) {
-      std::cerr << "Null session received\n";
+    metrics.record(slot->command.index() - 1, LatencyStage::QUEUE_WAIT, start - slot->enqueued_at);
+    if (now > slot->deadline) {
+      // the client has most likely given up already, do not run it
+      commands_expired_.fetch_add(1, std::memory_order_relaxed);
+      session->send_message(failure_response("TIMEOUT", reply_meta_of(slot->command, session->get_next_sequence_id()),
+                                             "TIMEOUT", "Request expired in the server queue"));
       continue;
     }
-    task.command->execute(task.session, commandContext);
+    commands_executed_.fetch_add(1, std::memory_order_relaxed);
+    schedule(slot->command, session);
   }
+  flush_groups();
 }
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <iostream>
+#include <variant>
+
+#include "MessageWriter.hpp"
+
+MessageWriter::MessageWriter(std::shared_ptr<MessageRepository> repo, WriterConfig config,
+                             std::shared_ptr<WriteAheadLog> wal, SettleCallback settled)
+    : repo_(std::move(repo)), wal_(std::move(wal)), config_(config), settled_(std::move(settled)) {
+    thread_ = std::thread(&MessageWriter::run, this);
+}
+
+MessageWriter::~MessageWriter(){
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    if(thread_.joinable()){
+        thread_.join();
+    }
+}
+
+void MessageWriter::push(ChatMessage&& message, WriteAheadLog::Lsn lsn){
+    auto now = std::chrono::steady_clock::now();
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    backlog_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mtx_);
+    incoming_.push_back(std::move(message));
+    incoming_tickets_.push_back({now, lsn});
+    // the writer only cares about a first message (to start its linger
+    // clock) and about enough of them to fill a batch
+    if(incoming_.size() == 1 || incoming_.size() % config_.max_batch_messages == 0){
+        cv_.notify_one();
+    }
+}
+
+void MessageWriter::push_batch(std::vector<ChatMessage>&& messages, const std::vector<WriteAheadLog::Lsn>& lsns){
+    if(messages.empty()){
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    queued_.fetch_add(messages.size(), std::memory_order_relaxed);
+    backlog_.fetch_add(messages.size(), std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mtx_);
+    for(size_t i = 0; i < messages.size(); ++i){
+        incoming_.push_back(std::move(messages[i]));
+        incoming_tickets_.push_back({now, i < lsns.size() ? lsns[i] : 0});
+    }
+    cv_.notify_one();
+}
+
+void MessageWriter::run(){
+    std::vector<ChatMessage> messages;
+    std::vector<Ticket> tickets;
+    std::vector<std::shared_ptr<Batch>> completed;
+    std::optional<Time> deadline;
+    bool window_full = false;
+    bool stopping = false;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            // New messages wait for the next deadline unless they may fill a
+            // batch; with the window full only completions can make progress.
+            auto ready = [&]{
+                return !completed_.empty() || (stopping_ && !draining_)
+                    || (!window_full && (incoming_.size() >= config_.max_batch_messages
+                                         || (!incoming_.empty() && !deadline)));
+            };
+            if(deadline && !window_full){
+                cv_.wait_until(lock, *deadline, ready);
+            } else {
+                cv_.wait(lock, ready);
+            }
+            messages.swap(incoming_);
+            tickets.swap(incoming_tickets_);
+            completed.swap(completed_);
+            stopping = stopping_;
+        }
+        if(stopping && !draining_){
+            draining_ = true;
+            // batches waiting for a retry are left to the WAL
+            std::vector<std::string> barracks;
+            for(const auto& [barrack_id, partition] : partitions_){
+                barracks.push_back(barrack_id);
+            }
+            for(const auto& barrack_id : barracks){
+                complete(barrack_id);
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for(auto& batch : completed){
+            batch->done = true;
+            in_flight_.fetch_sub(1, std::memory_order_relaxed);
+            round_trip_.record(now - batch->issued_at);
+            if(batch->error){
+                // still in the WAL and in the histories, written again later
+                failed_.fetch_add(batch->messages.size(), std::memory_order_relaxed);
+                auto delay = config_.retry_delay * (1u << std::min(batch->failures, 16u));
+                batch->retry_at = now + std::min<std::chrono::milliseconds>(delay, config_.max_retry_delay);
+                ++batch->failures;
+                std::cerr << "Chat messages insertion to database failed for batch of "
+                          << batch->messages.size() << " messages, retrying: " << batch->error->message << std::endl;
+            } else {
+                written_.fetch_add(batch->messages.size(), std::memory_order_relaxed);
+                backlog_.fetch_sub(batch->messages.size(), std::memory_order_relaxed);
+                for(const Ticket& ticket : batch->tickets){
+                    commit_latency_.record(now - ticket.queued_at);
+                }
+                std::cout << batch->messages.size() << " messages saved to database." << std::endl;
+                release(*batch);
+            }
+            complete(batch->messages.front().barrack_id);
+        }
+        completed.clear();
+
+        partition_incoming(messages, tickets);
+        deadline = flush(now, draining_);
+        window_full = in_flight_.load(std::memory_order_relaxed) >= config_.max_in_flight;
+        if(draining_ && partitions_.empty()){
+            break;
+        }
+    }
+    std::cout << "Message writer thread finished." << std::endl;
+}
+
+void MessageWriter::partition_incoming(std::vector<ChatMessage>& messages, std::vector<Ticket>& tickets){
+    for(size_t i = 0; i < messages.size(); ++i){
+        Partition& partition = partitions_[messages[i].barrack_id];
+        partition.pending_bytes += write_batch_bytes(messages[i]);
+        partition.pending.push_back(std::move(messages[i]));
+        partition.tickets.push_back(tickets[i]);
+    }
+    messages.clear();
+    tickets.clear();
+}
+
+void MessageWriter::release(const Batch& batch){
+    if(!wal_){
+        return;
+    }
+    std::vector<WriteAheadLog::Lsn> lsns;
+    lsns.reserve(batch.tickets.size());
+    for(const Ticket& ticket : batch.tickets){
+        if(ticket.lsn != 0){
+            lsns.push_back(ticket.lsn);
+        }
+    }
+    wal_->release(lsns);
+}
+
+void MessageWriter::complete(const std::string& barrack_id){
+    auto itr = partitions_.find(barrack_id);
+    if(itr == partitions_.end()){
+        return;
+    }
+    Partition& partition = itr->second;
+    while(!partition.in_flight.empty() && partition.in_flight.front()->done){
+        const auto& batch = partition.in_flight.front();
+        if(batch->error){
+            if(!draining_){
+                // pinned: settling it, or anything after it, would let the
+                // history drop messages Cassandra does not have
+                break;
+            }
+            partition.abandoned = true;
+            backlog_.fetch_sub(batch->messages.size(), std::memory_order_relaxed);
+        } else if(!partition.abandoned){
+            settled_(batch->messages);
+        }
+        partition.in_flight.pop_front();
+    }
+    if(partition.in_flight.empty() && partition.pending.empty()){
+        partitions_.erase(itr);
+    }
+}
+
+std::optional<MessageWriter::Time> MessageWriter::flush(Time now, bool draining){
+    // a barrack with a failed batch waits until it is stored before issuing more
+    auto held_back = [](const Partition& partition){
+        return std::any_of(partition.in_flight.begin(), partition.in_flight.end(), [](const std::shared_ptr<Batch>& batch){
+            return batch->failures > 0 && (!batch->done || batch->error);
+        });
+    };
+    auto due = [&](const Partition& partition){
+        return !partition.pending.empty()
+            && (draining
+                || (!held_back(partition)
+                    && (partition.pending.size() >= config_.max_batch_messages
+                        || partition.pending_bytes >= config_.max_batch_bytes
+                        || partition.tickets.front().queued_at + config_.linger <= now)));
+    };
+    auto window_open = [&]{ return in_flight_.load(std::memory_order_relaxed) < config_.max_in_flight; };
+
+    std::vector<Partition*> ready;
+    for(auto& [barrack_id, partition] : partitions_){
+        if(due(partition)){
+            ready.push_back(&partition);
+        }
+    }
+    // longest waiting first, so a full window does not starve anyone
+    std::sort(ready.begin(), ready.end(), [](const Partition* a, const Partition* b){
+        return a->tickets.front().queued_at < b->tickets.front().queued_at;
+    });
+    // failed batches go first, they hold back everything behind them
+    if(!draining){
+        for(auto& [barrack_id, partition] : partitions_){
+            for(const auto& batch : partition.in_flight){
+                if(!window_open()){
+                    break;
+                }
+                if(batch->done && batch->error && batch->retry_at <= now){
+                    write(batch, now);
+                }
+            }
+        }
+    }
+    bool issued = true;
+    while(issued && window_open()){
+        issued = false;
+        for(Partition* partition : ready){
+            if(!window_open()){
+                break;
+            }
+            if(due(*partition)){
+                issue(*partition, now);
+                issued = true;
+            }
+        }
+    }
+    if(!window_open()){
+        return std::nullopt;
+    }
+
+    std::optional<Time> next;
+    auto wake_at = [&](Time deadline){
+        if(!next || deadline < *next){
+            next = deadline;
+        }
+    };
+    for(const auto& [barrack_id, partition] : partitions_){
+        if(!partition.pending.empty() && (draining || !held_back(partition))){
+            wake_at(partition.tickets.front().queued_at + config_.linger);
+        }
+        for(const auto& batch : partition.in_flight){
+            if(!draining && batch->done && batch->error){
+                wake_at(batch->retry_at);
+            }
+        }
+    }
+    return next;
+}
+
+void MessageWriter::issue(Partition& partition, Time now){
+    auto batch = std::make_shared<Batch>();
+    // at least one message, however large
+    size_t count = 0;
+    size_t bytes = 0;
+    while(count < partition.pending.size() && count < config_.max_batch_messages){
+        size_t next = write_batch_bytes(partition.pending[count]);
+        if(count > 0 && bytes + next > config_.max_batch_bytes){
+            break;
+        }
+        bytes += next;
+        ++count;
+    }
+    batch->messages.assign(std::make_move_iterator(partition.pending.begin()),
+                           std::make_move_iterator(partition.pending.begin() + count));
+    batch->tickets.assign(partition.tickets.begin(), partition.tickets.begin() + count);
+    partition.pending.erase(partition.pending.begin(), partition.pending.begin() + count);
+    partition.tickets.erase(partition.tickets.begin(), partition.tickets.begin() + count);
+    partition.pending_bytes -= bytes;
+    partition.in_flight.push_back(batch);
+    queued_.fetch_sub(count, std::memory_order_relaxed);
+    write(batch, now);
+}
+
+void MessageWriter::write(const std::shared_ptr<Batch>& batch, Time now){
+    batch->done = false;
+    batch->error.reset();
+    batch->issued_at = now;
+    in_flight_.fetch_add(1, std::memory_order_relaxed);
+    batches_.fetch_add(1, std::memory_order_relaxed);
+
+    repo_->add_batch_async(batch->messages, [this, batch](Result<std::monostate> res){
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(std::holds_alternative<Error>(res)){
+            batch->error = std::get<Error>(std::move(res));
+        }
+        completed_.push_back(batch);
+        cv_.notify_one();
+    });
+}
+
+WriterStats MessageWriter::stats() const {
+    return {queued_.load(std::memory_order_relaxed),
+            backlog_.load(std::memory_order_relaxed),
+            in_flight_.load(std::memory_order_relaxed),
+            batches_.load(std::memory_order_relaxed),
+            written_.load(std::memory_order_relaxed),
+            failed_.load(std::memory_order_relaxed),
+            commit_latency_.snapshot(),
+            round_trip_.snapshot()};
+}
@@ -0,0 +1,195 @@
+#include <chrono>
+#include "JsonWriter.hpp"
+#include "Responses.hpp"
+
+// Renders through a buffer that keeps its capacity across calls on the same
+// thread and hands back an exactly sized copy.
+template<typename Render>
+static std::string render(Render&& render_document){
+    thread_local std::string buffer;
+    buffer.clear();
+    JsonWriter writer(buffer);
+    render_document(writer);
+    return std::string(buffer);
+}
+
+static auto to_unix_time(std::chrono::system_clock::time_point time){
+    return std::chrono::system_clock::to_time_t(time);
+}
+
+static void write_chat_message(JsonWriter& w, const ChatMessage& message){
+    w.object<"barrack_id", "created_at", "message", "seq", "user_id">(
+        message.barrack_id, to_unix_time(message.sent_at), message.content, message.seq, message.sender_user_id);
+}
+
+std::string failure_response(MessageType type, const ResponseMeta& meta, std::string_view message){
+    auto name = message_type_name(type);
+    return failure_response(name, meta, name, message);
+}
+
+std::string failure_response(std::string_view type, const ResponseMeta& meta, std::string_view error_code, std::string_view message){
+    return render([&](JsonWriter& w){
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{ w.object<"error_code", "message">(error_code, message); },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            type);
+    });
+}
+
+std::string error_response(std::string_view error_code, std::string_view message, std::string_view request_id){
+    return render([&](JsonWriter& w){
+        w.object<"payload", "request_id", "type">(
+            [&]{ w.object<"error_code", "message">(error_code, message); },
+            RawJson{request_id},
+            "ERROR");
+    });
+}
+
+std::string status_response(MessageType type, const ResponseMeta& meta, std::string_view message){
+    return render([&](JsonWriter& w){
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{ w.object<"message">(message); },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            message_type_name(type));
+    });
+}
+
+std::string message_response(MessageType type, const ResponseMeta& meta, std::string_view message){
+    return render([&](JsonWriter& w){
+        w.object<"message", "request_id", "sequence_id", "type">(message, RawJson{meta.request_id}, meta.sequence_id, message_type_name(type));
+    });
+}
+
+std::string auth_success_response(const ResponseMeta& meta, std::string_view token, std::string_view user_id, bool user_created){
+    return render([&](JsonWriter& w){
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{ w.object<"token", "user_created", "user_id">(token, user_created, user_id); },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            message_type_name(MessageType::AUTH_SUCCESS));
+    });
+}
+
+std::string username_response(const ResponseMeta& meta, std::string_view username){
+    return render([&](JsonWriter& w){
+        w.object<"request_id", "sequence_id", "type", "username">(RawJson{meta.request_id}, meta.sequence_id, message_type_name(MessageType::GET_USER_NAME), username);
+    });
+}
+
+std::string create_barrack_success_response(const ResponseMeta& meta, std::string_view barrack_id, std::string_view owner_id){
+    auto name = message_type_name(MessageType::CREATE_BARRACK_SUCCESS);
+    return render([&](JsonWriter& w){
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{
+                w.object<"barrack_id", "error_code", "message", "owner_id">(
+                    barrack_id, name, "Barrack Created Successfully", owner_id);
+            },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            name);
+    });
+}
+
+std::string barrack_response(const ResponseMeta& meta, const Barrack& barrack){
+    return render([&](JsonWriter& w){
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{
+                w.object<"admin_id", "barrack_id", "created_at", "is_private", "message", "name">(
+                    barrack.admin_id, barrack.barrack_id, to_unix_time(barrack.created_at),
+                    barrack.is_private, "Barrack fetched successfully", barrack.barrack_name);
+            },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            message_type_name(MessageType::GET_BARRACK_SUCCESS));
+    });
+}
+
+std::string barracks_response(const ResponseMeta& meta, const std::vector<Barrack>& barracks){
+    return render([&](JsonWriter& w){
+        auto write_barrack = [&](const Barrack& barrack){
+            w.object<"barrack_id", "barrack_name", "created_at", "is_private", "owner_id">(
+                barrack.barrack_id, barrack.barrack_name, to_unix_time(barrack.created_at),
+                barrack.is_private, barrack.admin_id);
+        };
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{
+                w.object<"message", "messages">(
+                    "Barracks fetched successfully",
+                    [&]{ w.array(barracks, write_barrack); });
+            },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            message_type_name(MessageType::GET_BARRACK_SUCCESS));
+    });
+}
+
+std::string barrack_members_response(const ResponseMeta& meta, const std::vector<BarrackMember>& members){
+    return render([&](JsonWriter& w){
+        auto write_member = [&](const BarrackMember& member){
+            w.object<"barrack_id", "joined_at", "user_id">(
+                member.barrack_id, to_unix_time(member.joined_at), member.user_id);
+        };
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{
+                w.object<"members", "message">(
+                    [&]{ w.array(members, write_member); },
+                    "Barrack members fetched successfully");
+            },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            message_type_name(MessageType::GET_BARRACK_MEMBER_SUCCESS));
+    });
+}
+
+std::string barrack_messages_response(const ResponseMeta& meta, const std::vector<ChatMessage>& messages){
+    return render([&](JsonWriter& w){
+        auto write_message = [&](const ChatMessage& message){ write_chat_message(w, message); };
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{
+                w.object<"message", "messages">(
+                    "Barrack messages fetched successfully",
+                    [&]{ w.array(messages, write_message); });
+            },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            message_type_name(MessageType::GET_BARRACK_MESSAGES_SUCCESS));
+    });
+}
+
+std::string batch_response(const ResponseMeta& meta, const std::vector<std::string>& replies){
+    return render([&](JsonWriter& w){
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{
+                w.object<"responses">(
+                    [&]{ w.array(replies, [&](const std::string& reply){ w.value(RawJson{reply}); }); });
+            },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            message_type_name(MessageType::BATCH));
+    });
+}
+
+std::string message_broadcast(const ChatMessage& message){
+    return render([&](JsonWriter& w){
+        w.object<"payload", "type">(
+            [&]{ write_chat_message(w, message); },
+            message_type_name(MessageType::RECEIVE_MESSAGE_BROADCAST));
+    });
+}
+
+std::string sync_response(const ResponseMeta& meta, std::string_view barrack_id, uint64_t last_seq,
+                          std::span<const ChatMessage> messages, bool more){
+    return render([&](JsonWriter& w){
+        auto write_message = [&](const ChatMessage& message){ write_chat_message(w, message); };
+        w.object<"payload", "request_id", "sequence_id", "type">(
+            [&]{
+                w.object<"barrack_id", "last_seq", "messages", "more">(
+                    barrack_id, last_seq, [&]{ w.array(messages, write_message); }, more);
+            },
+            RawJson{meta.request_id},
+            meta.sequence_id,
+            message_type_name(MessageType::SYNC));
+    });
+}
@@ -1,34 +1,506 @@
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <optional>
 #include "Room.hpp"
 #include "ClientSession.hpp"
+#include "CommandMetrics.hpp"
 
-void Room::join(std::shared_ptr<ClientSession> session){
+// Sessions are only ever created on strands of an io_context (see Listener).
+static net::io_context::executor_type io_executor(net::execution_context* context){
+    return static_cast<net::io_context*>(context)->get_executor();
+}
+
+// Keeps a room's broadcasts in order for every member. Grouped broadcasts may
+// overlap each other, since their tasks for one io_context all go through the
+// room's strand on it. Sharded broadcasts may overlap the ones cut from the
+// same member snapshot: shard k always runs on the room's strand for shard k,
+// so a member keeps its shard and strand across them. Anything else runs
+// alone: it starts once everything before it was delivered, and what comes
+// after waits for it.
+class Room::FanoutOrder {
+    public:
+        enum class Kind { ALONE, GROUPED, SHARDED };
+        using Start = std::function<void()>;
+        using Strand = net::strand<net::io_context::executor_type>;
+
+        // Calls start right away if it may overlap what is in flight,
+        // otherwise once that has been delivered. start calls done() once
+        // its frames are queued on every recipient. Sharded broadcasts pass
+        // their member snapshot as key.
+        template<typename Function>
+        void run(Kind kind, const void* key, Function&& start){
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                // a drain in progress may be about to start what it popped
+                if(draining_ || !waiting_.empty() || !may_start(kind, key)){
+                    waiting_.push_back({kind, key, Start(std::forward<Function>(start))});
+                    return;
+                }
+                kind_ = kind;
+                key_ = key;
+                ++in_flight_;
+            }
+            start();
+        }
+
+        void done(){
+            std::unique_lock<std::mutex> lock(mtx_);
+            --in_flight_;
+            // whoever is draining already picks up what became ready, which
+            // keeps back to back inline broadcasts from nesting
+            if(draining_){
+                return;
+            }
+            draining_ = true;
+            while(!waiting_.empty() && may_start(waiting_.front().kind, waiting_.front().key)){
+                kind_ = waiting_.front().kind;
+                key_ = waiting_.front().key;
+                ++in_flight_;
+                Start start = std::move(waiting_.front().start);
+                waiting_.pop_front();
+                lock.unlock();
+                start();
+                lock.lock();
+            }
+            draining_ = false;
+        }
+
+        // The room's strand on context, made on first use
+        Strand strand_for(net::execution_context* context){
+            std::lock_guard<std::mutex> lock(mtx_);
+            for(const auto& [known, strand] : strands_){
+                if(known == context){
+                    return strand;
+                }
+            }
+            return strands_.emplace_back(context, net::make_strand(io_executor(context))).second;
+        }
+
+        // The strand of member shard index, made on context the first time
+        // the shard is walked and kept for the room's lifetime
+        Strand shard_strand(size_t index, net::execution_context* context){
+            std::lock_guard<std::mutex> lock(mtx_);
+            while(shard_strands_.size() <= index){
+                shard_strands_.push_back(std::nullopt);
+            }
+            if(!shard_strands_[index]){
+                shard_strands_[index] = net::make_strand(io_executor(context));
+            }
+            return *shard_strands_[index];
+        }
+
+    private:
+        struct Waiting {
+            Kind kind;
+            const void* key;
+            Start start;
+        };
+
+        bool may_start(Kind kind, const void* key) const {
+            if(in_flight_ == 0){
+                return true;
+            }
+            return kind == kind_ && (kind == Kind::GROUPED || (kind == Kind::SHARDED && key == key_));
+        }
+
+        std::mutex mtx_;
+        Kind kind_ = Kind::ALONE;
+        const void* key_ = nullptr;     // snapshot of the sharded broadcasts in flight
+        size_t in_flight_ = 0;
+        bool draining_ = false;
+        std::deque<Waiting> waiting_;
+        std::vector<std::pair<net::execution_context*, Strand>> strands_;
+        std::vector<std::optional<Strand>> shard_strands_;
+};
+
+Room::Room(const std::string& barrack_id) : barrack_id_(barrack_id), order_(std::make_shared<FanoutOrder>()) {}
+
+RoomMembers::RoomMembers(std::vector<std::weak_ptr<ClientSession>> members)
+    : sessions(std::move(members)), left(std::make_unique<std::atomic<bool>[]>(sessions.size())) {}
+
+std::shared_ptr<ClientSession> RoomMembers::lock(size_t index) const {
+    if(left[index].load(std::memory_order_acquire)){
+        return nullptr;
+    }
+    return sessions[index].lock();
+}
+
+std::shared_ptr<const Room::Members> Room::members() const {
+    return members_.load(std::memory_order_acquire);
+}
+
+Room::SessionList Room::compacted() const {
+    auto current = members();
+    SessionList live;
+    live.reserve(current->size() + 1);
+    for(size_t i = 0; i < current->size(); ++i){
+        if(!current->left[i].load(std::memory_order_relaxed) && !current->sessions[i].expired()){
+            live.push_back(current->sessions[i]);
+        }
+    }
+    return live;
+}
+
+void Room::publish(SessionList members){
+    positions_.clear();
+    for(size_t i = 0; i < members.size(); ++i){
+        if(auto session = members[i].lock()){
+            positions_[session->get_id()] = i;
+        }
+    }
+    joined_.store(positions_.size(), std::memory_order_relaxed);
+    dead_.store(0, std::memory_order_relaxed);
+    members_.store(std::make_shared<const Members>(std::move(members)), std::memory_order_release);
+}
+
+bool Room::join(std::shared_ptr<ClientSession> session){
     std::scoped_lock<std::mutex> lock(mtx_);
-    auto itr = members_.find(session);
-    if(itr == members_.end()){
-        members_.insert(session);
-        std::cout << "Session ID: " << session->get_id() << " Joined barrack: " << barrack_id_ << " at: " << std::chrono::system_clock::now().time_since_epoch();
+    if(retired_){
+        return false;
     }
-    std::cout << "Session ID: " << session->get_id() << " Already member of barrack: " << barrack_id_;
+    if(positions_.contains(session->get_id())){
+        std::cout << "Session ID: " << session->get_id() << " Already member of barrack: " << barrack_id_;
+        return true;
+    }
+    auto live = compacted();
+    live.push_back(session);
+    publish(std::move(live));
+    std::cout << "Session ID: " << session->get_id() << " Joined barrack: " << barrack_id_ << " at: " << std::chrono::system_clock::now().time_since_epoch();
+    return true;
 }
 
 void Room::leave(std::shared_ptr<ClientSession> session){
     std::scoped_lock<std::mutex> lock(mtx_);
-    auto itr = members_.find(session);
-    if(itr != members_.end()){
-        std::cout << "Session ID: " << session->get_id() << " Left barrack: " << barrack_id_ << " at: " << std::chrono::system_clock::now().time_since_epoch();
-        members_.erase(session);
+    auto position = positions_.find(session->get_id());
+    if(position == positions_.end()){
+        std::cout << "Session ID: " << session->get_id() << " Not a member of: " << barrack_id_;
+        return;
     }
-    std::cout << "Session ID: " << session->get_id() << " Not a member of: " << barrack_id_;
-    if(members_.empty()){
-        members_.clear();
+    // broadcasts that already loaded the snapshot may still reach the
+    // session; the ones after this store do not
+    auto current = members();
+    current->left[position->second].store(true, std::memory_order_release);
+    positions_.erase(position);
+    joined_.store(positions_.size(), std::memory_order_relaxed);
+    if(dead_.fetch_add(1, std::memory_order_relaxed) + 1 >= current->size() / 4 + 1){
+        publish(compacted());
     }
+    std::cout << "Session ID: " << session->get_id() << " Left barrack: " << barrack_id_ << " at: " << std::chrono::system_clock::now().time_since_epoch();
 }
 
-void Room::broadcast(const std::string& message){
+bool Room::empty() const {
+    return joined_.load(std::memory_order_relaxed) == 0;
+}
+
+size_t Room::size() const {
+    return joined_.load(std::memory_order_relaxed);
+}
+
+std::vector<std::shared_ptr<ClientSession>> Room::live_members() const {
+    std::vector<std::shared_ptr<ClientSession>> live;
+    auto snapshot = members();
+    live.reserve(snapshot->size());
+    for(size_t i = 0; i < snapshot->size(); ++i){
+        if(auto session = snapshot->lock(i)){
+            live.push_back(std::move(session));
+        }
+    }
+    return live;
+}
+
+bool Room::try_retire(){
     std::scoped_lock<std::mutex> lock(mtx_);
-    for(auto& session : members_){
-        if(auto sess = session.lock()){
-            sess->send_message(message);
+    auto live = compacted();
+    if(live.empty()){
+        retired_ = true;
+    }
+    if(live.size() != members()->size()){
+        publish(std::move(live));
+    }
+    return retired_;
+}
+
+void Room::note_dead(size_t dead, size_t total){
+    // compact once broadcasts have tripped over a quarter of the room's worth
+    // of dead entries; skip if a writer is busy, it compacts anyway
+    if(dead_.fetch_add(dead, std::memory_order_relaxed) + dead < total / 4 + 1){
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mtx_, std::try_to_lock);
+    if(lock.owns_lock()){
+        publish(compacted());
+    }
+}
+
+void Room::broadcast(const std::string& message){
+    fanout(std::make_shared<const std::vector<std::string>>(1, message));
+}
+
+void Room::broadcast_batch(const std::vector<std::string>& messages){
+    if(messages.empty()){
+        return;
+    }
+    fanout(std::make_shared<const std::vector<std::string>>(messages));
+}
+
+static FanoutConfig fanout_settings;
+
+void Room::configure_fanout(const FanoutConfig& config){
+    fanout_settings = config;
+    fanout_settings.task_sessions = std::max<size_t>(fanout_settings.task_sessions, 1);
+    fanout_settings.shard_members = std::max<size_t>(fanout_settings.shard_members, 1);
+    fanout_settings.pace_sessions = std::max<size_t>(fanout_settings.pace_sessions, 1);
+}
+
+const FanoutConfig& Room::fanout_config(){
+    return fanout_settings;
+}
+
+static void deliver(ClientSession& session, const std::shared_ptr<const std::vector<std::string>>& frames,
+                    int command, c_time::time_point started){
+    for(const auto& frame : *frames){
+        // aliases frames, so every recipient shares the one copy
+        session.send_shared(std::shared_ptr<const std::string>(frames, &frame), command, started);
+    }
+}
+
+// Shared by the tasks of one broadcast; the last task to finish records how
+// far apart the first and the last recipient were served and lets the room's
+// next broadcasts go.
+class FanoutProgress {
+    public:
+        FanoutProgress(size_t tasks, std::shared_ptr<Room::FanoutOrder> order)
+            : pending_(tasks), order_(std::move(order)) {}
+
+        void delivering(c_time::time_point at){
+            auto ticks = at.time_since_epoch().count();
+            auto first = first_.load(std::memory_order_relaxed);
+            while(ticks < first && !first_.compare_exchange_weak(first, ticks, std::memory_order_relaxed)){
+            }
+        }
+
+        void task_done(){
+            if(pending_.fetch_sub(1, std::memory_order_acq_rel) != 1){
+                return;
+            }
+            auto first = first_.load(std::memory_order_relaxed);
+            if(first != NONE){
+                Room::fanout_stats().spread.record(c_time::now() - c_time::time_point(c_time::duration(first)));
+            }
+            if(order_){
+                order_->done();
+            }
+        }
+
+    private:
+        static constexpr c_time::rep NONE = std::numeric_limits<c_time::rep>::max();
+        std::atomic<size_t> pending_;
+        std::shared_ptr<Room::FanoutOrder> order_;
+        std::atomic<c_time::rep> first_{NONE};
+};
+
+// One member shard of a very large room, walked on the shard's strand a
+// paced slice at a time.
+struct ShardFanout {
+    std::shared_ptr<const RoomMembers> members;
+    size_t next;
+    size_t end;
+    Room::FanoutOrder::Strand strand;
+    net::execution_context* context;
+    std::shared_ptr<const std::vector<std::string>> frames;
+    int command;
+    c_time::time_point started;
+    std::shared_ptr<FanoutProgress> progress;
+};
+
+static void run_shard(ShardFanout shard){
+    auto& stats = Room::fanout_stats();
+    size_t slice_end = std::min(shard.next + fanout_settings.pace_sessions, shard.end);
+    size_t recipients = 0;
+    size_t handoffs = 0;
+    shard.progress->delivering(c_time::now());
+    for(; shard.next < slice_end; ++shard.next){
+        auto session = shard.members->lock(shard.next);
+        if(!session){
+            continue;
+        }
+        if(&session->get_execution_context() != shard.context){
+            handoffs += shard.frames->size();
+        }
+        deliver(*session, shard.frames, shard.command, shard.started);
+        ++recipients;
+    }
+    stats.deliveries.fetch_add(recipients * shard.frames->size(), std::memory_order_relaxed);
+    stats.handoffs.fetch_add(handoffs, std::memory_order_relaxed);
+
+    if(shard.next < shard.end){
+        // behind the slices other broadcasts queued on the strand meanwhile,
+        // which keeps every member's frames in broadcast order
+        stats.paced_yields.fetch_add(1, std::memory_order_relaxed);
+        auto strand = shard.strand;
+        net::post(strand, [shard = std::move(shard)]() mutable { run_shard(std::move(shard)); });
+        return;
+    }
+    stats.handoff.record(c_time::now() - shard.started);
+    shard.progress->task_done();
+}
+
+void Room::fanout(std::shared_ptr<const std::vector<std::string>> frames){
+    auto started = c_time::now();
+    int command = CommandMetrics::current_command();
+    auto& stats = fanout_stats();
+    stats.broadcasts.fetch_add(1, std::memory_order_relaxed);
+
+    auto snapshot = members();
+    if(snapshot->size() >= fanout_settings.shard_members){
+        fanout_sharded(std::move(snapshot), std::move(frames), command, started);
+        return;
+    }
+
+    struct Group {
+        net::execution_context* context;
+        std::vector<std::shared_ptr<ClientSession>> sessions;
+    };
+    std::vector<Group> groups;
+    size_t recipients = 0;
+    size_t dead = 0;
+    for(size_t i = 0; i < snapshot->size(); ++i){
+        auto session = snapshot->lock(i);
+        if(!session){
+            ++dead;
+            continue;
+        }
+        auto* context = &session->get_execution_context();
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const Group& g){ return g.context == context; });
+        if(group == groups.end()){
+            group = groups.insert(groups.end(), Group{context, {}});
+        }
+        group->sessions.push_back(std::move(session));
+        ++recipients;
+    }
+    if(dead > 0){
+        note_dead(dead, snapshot->size());
+    }
+    stats.deliveries.fetch_add(recipients * frames->size(), std::memory_order_relaxed);
+    stats.executor_groups.fetch_add(groups.size(), std::memory_order_relaxed);
+
+    if(recipients < fanout_settings.group_min_members){
+        order_->run(FanoutOrder::Kind::ALONE, nullptr, [groups = std::move(groups), frames, command, started, order = order_](){
+            auto& stats = fanout_stats();
+            size_t handoffs = 0;
+            auto first = c_time::now();
+            for(const auto& group : groups){
+                if(!io_executor(group.context).running_in_this_thread()){
+                    handoffs += group.sessions.size() * frames->size();
+                }
+                for(const auto& session : group.sessions){
+                    deliver(*session, frames, command, started);
+                }
+            }
+            auto done = c_time::now();
+            stats.handoffs.fetch_add(handoffs, std::memory_order_relaxed);
+            stats.handoff.record(done - started);
+            stats.spread.record(done - first);
+            order->done();
+        });
+        return;
+    }
+
+    stats.grouped_broadcasts.fetch_add(1, std::memory_order_relaxed);
+    order_->run(FanoutOrder::Kind::GROUPED, nullptr, [groups = std::move(groups), frames, command, started, order = order_]() mutable {
+        auto& stats = fanout_stats();
+        size_t per_task = fanout_settings.task_sessions;
+        size_t tasks = 0;
+        for(const auto& group : groups){
+            tasks += (group.sessions.size() + per_task - 1) / per_task;
+        }
+        auto progress = std::make_shared<FanoutProgress>(tasks, order);
+        for(auto& group : groups){
+            auto strand = order->strand_for(group.context);
+            bool local = io_executor(group.context).running_in_this_thread();
+            auto& sessions = group.sessions;
+            for(size_t begin = 0; begin < sessions.size(); begin += per_task){
+                size_t end = std::min(begin + per_task, sessions.size());
+                std::vector<std::shared_ptr<ClientSession>> task_sessions(std::make_move_iterator(sessions.begin() + begin),
+                                                                          std::make_move_iterator(sessions.begin() + end));
+                stats.group_tasks.fetch_add(1, std::memory_order_relaxed);
+                if(!local){
+                    stats.handoffs.fetch_add(1, std::memory_order_relaxed);
+                }
+                net::post(strand, [task_sessions = std::move(task_sessions), frames, command, started, progress](){
+                    progress->delivering(c_time::now());
+                    for(const auto& session : task_sessions){
+                        deliver(*session, frames, command, started);
+                    }
+                    fanout_stats().handoff.record(c_time::now() - started);
+                    progress->task_done();
+                });
+            }
+        }
+    });
+}
+
+// Cuts the snapshot into member shards without touching the members on this
+// thread. Shard k runs on the room's strand for shard k, made on the
+// io_context of its first live member. Dead entries are not counted here;
+// the room's next membership change drops them.
+void Room::fanout_sharded(std::shared_ptr<const Members> snapshot, std::shared_ptr<const std::vector<std::string>> frames,
+                          int command, c_time::time_point started){
+    auto& stats = fanout_stats();
+    stats.sharded_broadcasts.fetch_add(1, std::memory_order_relaxed);
+    const void* key = snapshot.get();
+    order_->run(FanoutOrder::Kind::SHARDED, key, [snapshot = std::move(snapshot), frames = std::move(frames),
+                                                  command, started, order = order_](){
+        auto& stats = fanout_stats();
+        size_t shard_members = fanout_settings.shard_members;
+        size_t shards = (snapshot->size() + shard_members - 1) / shard_members;
+        auto progress = std::make_shared<FanoutProgress>(shards, order);
+
+        for(size_t begin = 0; begin < snapshot->size(); begin += shard_members){
+            size_t end = std::min(begin + shard_members, snapshot->size());
+            net::execution_context* context = nullptr;
+            for(size_t i = begin; i < end && !context; ++i){
+                if(auto session = snapshot->lock(i)){
+                    context = &session->get_execution_context();
+                }
+            }
+            if(!context){
+                progress->task_done();
+                continue;
+            }
+            auto strand = order->shard_strand(begin / shard_members, context);
+            context = &net::query(strand, net::execution::context);
+            stats.shard_tasks.fetch_add(1, std::memory_order_relaxed);
+            if(!io_executor(context).running_in_this_thread()){
+                stats.handoffs.fetch_add(1, std::memory_order_relaxed);
+            }
+            net::post(strand, [shard = ShardFanout{snapshot, begin, end, strand, context, frames, command, started, progress}]() mutable {
+                run_shard(std::move(shard));
+            });
         }
-    } 
-}
\ No newline at end of file
+    });
+}
+
+FanoutStats& Room::fanout_stats(){
+    static FanoutStats stats;
+    return stats;
+}
+
+nlohmann::json FanoutStats::to_json() const {
+    return {
+        {"broadcasts", broadcasts.load(std::memory_order_relaxed)},
+        {"grouped_broadcasts", grouped_broadcasts.load(std::memory_order_relaxed)},
+        {"group_tasks", group_tasks.load(std::memory_order_relaxed)},
+        {"sharded_broadcasts", sharded_broadcasts.load(std::memory_order_relaxed)},
+        {"shard_tasks", shard_tasks.load(std::memory_order_relaxed)},
+        {"paced_yields", paced_yields.load(std::memory_order_relaxed)},
+        {"deliveries", deliveries.load(std::memory_order_relaxed)},
+        {"handoffs", handoffs.load(std::memory_order_relaxed)},
+        {"executor_groups", executor_groups.load(std::memory_order_relaxed)},
+        {"steered_sessions", steered_sessions.load(std::memory_order_relaxed)},
+        {"handoff", CommandMetrics::snapshot_to_json(handoff.snapshot())},
+        {"spread", CommandMetrics::snapshot_to_json(spread.snapshot())}
+    };
+}
@@ -0,0 +1,141 @@
+#include "RoomRegistry.hpp"
+#include "ClientSession.hpp"
+
+RoomRegistry::RoomRegistry() = default;
+
+size_t RoomRegistry::shard_index(std::string_view barrack_id){
+    return std::hash<std::string_view>{}(barrack_id) % SHARD_COUNT;
+}
+
+std::shared_ptr<Room> RoomRegistry::find(std::string_view barrack_id) const {
+    auto rooms = shards_[shard_index(barrack_id)].snapshot_.load(std::memory_order_acquire);
+    auto itr = rooms->find(barrack_id);
+    if(itr == rooms->end()){
+        return nullptr;
+    }
+    return itr->second;
+}
+
+template<typename Edit>
+void RoomRegistry::rewrite(Shard& shard, Edit&& edit){
+    auto current = shard.snapshot_.load(std::memory_order_acquire);
+    auto next = std::make_shared<RoomMap>();
+    next->reserve(current->size() + 1);
+    for(const auto& [barrack_id, room] : *current){
+        if(!room->try_retire()){
+            next->emplace(barrack_id, room);
+        }
+    }
+    shard.idle_rooms_.store(0, std::memory_order_relaxed);
+    edit(*next);
+    shard.snapshot_.store(std::move(next), std::memory_order_release);
+}
+
+std::shared_ptr<Room> RoomRegistry::get_or_create(std::string_view barrack_id){
+    if(auto room = find(barrack_id)){
+        return room;
+    }
+    return create(barrack_id);
+}
+
+std::shared_ptr<Room> RoomRegistry::create(std::string_view barrack_id){
+    auto& shard = shards_[shard_index(barrack_id)];
+    std::scoped_lock<std::mutex> lock(shard.mtx_);
+    {
+        auto current = shard.snapshot_.load(std::memory_order_acquire);
+        auto itr = current->find(barrack_id);
+        if(itr != current->end()){
+            return itr->second;
+        }
+    }
+    auto room = std::make_shared<Room>(std::string(barrack_id));
+    rewrite(shard, [&](RoomMap& rooms){ rooms.emplace(std::string(barrack_id), room); });
+    return room;
+}
+
+void RoomRegistry::join(std::string_view barrack_id, std::shared_ptr<ClientSession> session){
+    auto room = get_or_create(barrack_id);
+    // the room may have been retired since our snapshot was taken
+    while(!room->join(session)){
+        room = create(barrack_id);
+    }
+    // a JOIN still queued when the session was disconnected runs after
+    // disconnect() emptied its entry; take it back out of the room
+    if(!membership_.add_room(session, barrack_id)){
+        leave_room(barrack_id, session);
+    }
+}
+
+void RoomRegistry::leave(std::string_view barrack_id, std::shared_ptr<ClientSession> session){
+    membership_.remove_room(session->get_id(), barrack_id);
+    leave_room(barrack_id, session);
+}
+
+void RoomRegistry::leave_user(std::string_view barrack_id, std::string_view user_id, std::shared_ptr<ClientSession> session){
+    leave(barrack_id, session);
+    // the user's other devices, only where they had joined the room
+    for(const auto& other : membership_.sessions_of(user_id)){
+        if(other != session && membership_.remove_room(other->get_id(), barrack_id)){
+            leave_room(barrack_id, other);
+        }
+    }
+}
+
+void RoomRegistry::disconnect(const std::shared_ptr<ClientSession>& session){
+    auto entry = membership_.forget(session->get_id());
+    for(const auto& barrack_id : entry.rooms){
+        leave_room(barrack_id, session);
+    }
+}
+
+void RoomRegistry::leave_room(std::string_view barrack_id, const std::shared_ptr<ClientSession>& session){
+    auto room = find(barrack_id);
+    if(!room){
+        std::cout << "Session ID: " << session->get_id() << " Not a member of: " << barrack_id;
+        return;
+    }
+    room->leave(session);
+    if(!room->empty()){
+        return;
+    }
+    auto& shard = shards_[shard_index(barrack_id)];
+    if(shard.idle_rooms_.fetch_add(1, std::memory_order_relaxed) + 1 < SWEEP_THRESHOLD){
+        return;
+    }
+    std::scoped_lock<std::mutex> lock(shard.mtx_);
+    if(shard.idle_rooms_.load(std::memory_order_relaxed) >= SWEEP_THRESHOLD){
+        rewrite(shard, [](RoomMap&){});
+    }
+}
+
+bool RoomRegistry::remove(std::string_view barrack_id){
+    std::shared_ptr<Room> removed;
+    {
+        auto& shard = shards_[shard_index(barrack_id)];
+        std::scoped_lock<std::mutex> lock(shard.mtx_);
+        auto current = shard.snapshot_.load(std::memory_order_acquire);
+        auto itr = current->find(barrack_id);
+        if(itr == current->end()){
+            return false;
+        }
+        removed = itr->second;
+        rewrite(shard, [&](RoomMap& rooms){
+            auto room = rooms.find(barrack_id);
+            if(room != rooms.end()){
+                rooms.erase(room);
+            }
+        });
+    }
+    for(const auto& session : removed->live_members()){
+        membership_.remove_room(session->get_id(), barrack_id);
+    }
+    return true;
+}
+
+size_t RoomRegistry::size() const {
+    size_t total = 0;
+    for(const auto& shard : shards_){
+        total += shard.snapshot_.load(std::memory_order_acquire)->size();
+    }
+    return total;
+}
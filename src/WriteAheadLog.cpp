@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "WriteAheadLog.hpp"
+
+namespace {
+
+constexpr char SEGMENT_MAGIC[4] = {'C', 'W', 'A', 'L'};
+constexpr uint32_t SEGMENT_VERSION = 1;
+// magic, version, segment index, reserved
+constexpr size_t SEGMENT_HEADER_BYTES = 16;
+// payload length, payload CRC32, released flag
+constexpr size_t RECORD_HEADER_BYTES = 12;
+constexpr size_t RELEASED_OFFSET = 8;
+constexpr std::string_view SEGMENT_SUFFIX = ".wal";
+
+constexpr std::array<uint32_t, 256> make_crc_table(){
+    std::array<uint32_t, 256> table{};
+    for(uint32_t i = 0; i < 256; ++i){
+        uint32_t c = i;
+        for(int bit = 0; bit < 8; ++bit){
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+constexpr auto CRC_TABLE = make_crc_table();
+
+uint32_t crc32(const char* data, size_t size){
+    uint32_t crc = 0xFFFFFFFFu;
+    for(size_t i = 0; i < size; ++i){
+        crc = CRC_TABLE[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template<typename T>
+char* put(char* out, T value){
+    std::memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+}
+
+char* put_string(char* out, const std::string& str){
+    out = put(out, static_cast<uint32_t>(str.size()));
+    std::memcpy(out, str.data(), str.size());
+    return out + str.size();
+}
+
+// seq, sent_at ticks, then message_id, barrack_id, sender_user_id and
+// content, each prefixed with its length
+size_t payload_bytes(const ChatMessage& message){
+    return sizeof(uint64_t) + sizeof(int64_t) + 4 * sizeof(uint32_t)
+         + message.message_id.size() + message.barrack_id.size()
+         + message.sender_user_id.size() + message.content.size();
+}
+
+void encode(char* out, const ChatMessage& message){
+    out = put(out, static_cast<uint64_t>(message.seq));
+    out = put(out, static_cast<int64_t>(message.sent_at.time_since_epoch().count()));
+    out = put_string(out, message.message_id);
+    out = put_string(out, message.barrack_id);
+    out = put_string(out, message.sender_user_id);
+    put_string(out, message.content);
+}
+
+// Bounds checked reads over one record payload
+class PayloadReader {
+    public:
+        PayloadReader(const char* data, size_t size) : pos_(data), end_(data + size) {}
+
+        template<typename T>
+        bool get(T& value){
+            if(static_cast<size_t>(end_ - pos_) < sizeof(T)){
+                return false;
+            }
+            std::memcpy(&value, pos_, sizeof(T));
+            pos_ += sizeof(T);
+            return true;
+        }
+
+        bool get_string(std::string& str){
+            uint32_t size;
+            if(!get(size) || static_cast<size_t>(end_ - pos_) < size){
+                return false;
+            }
+            str.assign(pos_, size);
+            pos_ += size;
+            return true;
+        }
+
+    private:
+        const char* pos_;
+        const char* end_;
+};
+
+bool decode(const char* data, size_t size, ChatMessage& message){
+    PayloadReader reader(data, size);
+    uint64_t seq;
+    int64_t ticks;
+    if(!reader.get(seq) || !reader.get(ticks)
+       || !reader.get_string(message.message_id) || !reader.get_string(message.barrack_id)
+       || !reader.get_string(message.sender_user_id) || !reader.get_string(message.content)){
+        return false;
+    }
+    message.seq = seq;
+    message.sent_at = std::chrono::system_clock::time_point(std::chrono::system_clock::duration(ticks));
+    return true;
+}
+
+std::string segment_name(uint32_t index){
+    char name[16];
+    auto res = std::to_chars(name, name + sizeof(name), index);
+    std::string digits(name, res.ptr);
+    return std::string(10 - std::min<size_t>(digits.size(), 10), '0') + digits + std::string(SEGMENT_SUFFIX);
+}
+
+WriteAheadLog::Lsn make_lsn(uint32_t index, size_t offset){
+    return (static_cast<WriteAheadLog::Lsn>(index) << 32) | offset;
+}
+
+Error system_error(const std::string& what, const std::string& path){
+    return Error{ErrorCode::DATABASE_ERROR, what + " " + path + ": " + std::strerror(errno)};
+}
+
+}
+
+WriteAheadLog::Segment::~Segment(){
+    if(base){
+        munmap(base, size);
+    }
+    if(fd >= 0){
+        close(fd);
+    }
+}
+
+WriteAheadLog::WriteAheadLog(WalConfig config) : config_(std::move(config)) {}
+
+WriteAheadLog::~WriteAheadLog(){
+    if(dir_fd_ >= 0){
+        close(dir_fd_);
+    }
+}
+
+Result<size_t> WriteAheadLog::open(const RecordVisitor& visit){
+    std::error_code ec;
+    std::filesystem::create_directories(config_.directory, ec);
+    if(ec){
+        return Error{ErrorCode::DATABASE_ERROR, "Could not create " + config_.directory + ": " + ec.message()};
+    }
+    dir_fd_ = ::open(config_.directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dir_fd_ < 0){
+        return system_error("Could not open", config_.directory);
+    }
+
+    std::vector<uint32_t> indexes;
+    for(const auto& entry : std::filesystem::directory_iterator(config_.directory, ec)){
+        std::string name = entry.path().filename().string();
+        if(!name.ends_with(SEGMENT_SUFFIX)){
+            continue;
+        }
+        uint32_t index;
+        auto res = std::from_chars(name.data(), name.data() + name.size() - SEGMENT_SUFFIX.size(), index);
+        if(res.ec == std::errc{} && res.ptr == name.data() + name.size() - SEGMENT_SUFFIX.size()){
+            indexes.push_back(index);
+        }
+    }
+    if(ec){
+        return Error{ErrorCode::DATABASE_ERROR, "Could not list " + config_.directory + ": " + ec.message()};
+    }
+    std::sort(indexes.begin(), indexes.end());
+
+    size_t replayed = 0;
+    for(uint32_t index : indexes){
+        auto segment = std::make_shared<Segment>();
+        segment->index = index;
+        segment->path = config_.directory + "/" + segment_name(index);
+        segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CLOEXEC);
+        struct stat st;
+        if(segment->fd < 0 || fstat(segment->fd, &st) != 0){
+            return system_error("Could not open", segment->path);
+        }
+        segment->size = static_cast<size_t>(st.st_size);
+        if(segment->size < SEGMENT_HEADER_BYTES){
+            std::cerr << "[WARN] Skipping truncated WAL segment " << segment->path << std::endl;
+            continue;
+        }
+        void* base = mmap(nullptr, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+        if(base == MAP_FAILED){
+            return system_error("Could not map", segment->path);
+        }
+        segment->base = static_cast<char*>(base);
+        if(std::memcmp(segment->base, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0){
+            std::cerr << "[WARN] Skipping " << segment->path << ", it is not a WAL segment" << std::endl;
+            continue;
+        }
+
+        // Decoded before anything is handed out, so releases made by the
+        // visitor find the segment with its final count.
+        std::vector<std::pair<ChatMessage, Lsn>> records;
+        size_t offset = SEGMENT_HEADER_BYTES;
+        while(offset + RECORD_HEADER_BYTES <= segment->size){
+            uint32_t length, crc;
+            std::memcpy(&length, segment->base + offset, sizeof(length));
+            std::memcpy(&crc, segment->base + offset + sizeof(length), sizeof(crc));
+            const char* payload = segment->base + offset + RECORD_HEADER_BYTES;
+            if(length == 0 || length > segment->size - offset - RECORD_HEADER_BYTES){
+                break;
+            }
+            ChatMessage message;
+            if(crc32(payload, length) != crc || !decode(payload, length, message)){
+                // torn by a crash in the middle of an append; nothing follows it
+                std::cerr << "[WARN] WAL segment " << segment->path << " ends in a damaged record at "
+                          << offset << std::endl;
+                break;
+            }
+            uint32_t released;
+            std::memcpy(&released, segment->base + offset + RELEASED_OFFSET, sizeof(released));
+            if(released == 0){
+                records.emplace_back(std::move(message), make_lsn(index, offset));
+            }
+            offset += RECORD_HEADER_BYTES + length;
+        }
+        segment->end = offset;
+        segment->synced = offset;
+        segment->live = records.size();
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(records.empty()){
+                unlink(segment->path.c_str());
+                continue;
+            }
+            segments_[index] = segment;
+        }
+        for(auto& [message, lsn] : records){
+            visit(std::move(message), lsn);
+        }
+        replayed += records.size();
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    uint32_t next_index = indexes.empty() ? 0 : indexes.back() + 1;
+    auto created = create_segment(next_index);
+    if(std::holds_alternative<Error>(created)){
+        return std::get<Error>(created);
+    }
+    current_ = std::get<std::shared_ptr<Segment>>(created);
+    segments_[next_index] = current_;
+    durable_ = make_lsn(next_index, current_->end);
+    return replayed;
+}
+
+Result<std::shared_ptr<WriteAheadLog::Segment>> WriteAheadLog::create_segment(uint32_t index){
+    auto segment = std::make_shared<Segment>();
+    segment->index = index;
+    segment->path = config_.directory + "/" + segment_name(index);
+    segment->size = config_.segment_bytes;
+    segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(segment->fd < 0){
+        return system_error("Could not create", segment->path);
+    }
+    // allocated up front: a full disk fails here instead of faulting a write into the mapping
+    if(int rc = posix_fallocate(segment->fd, 0, static_cast<off_t>(segment->size)); rc != 0){
+        errno = rc;
+        auto error = system_error("Could not allocate", segment->path);
+        unlink(segment->path.c_str());
+        return error;
+    }
+    void* base = mmap(nullptr, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if(base == MAP_FAILED){
+        auto error = system_error("Could not map", segment->path);
+        unlink(segment->path.c_str());
+        return error;
+    }
+    segment->base = static_cast<char*>(base);
+
+    char* header = segment->base;
+    std::memcpy(header, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    header = put(header + sizeof(SEGMENT_MAGIC), SEGMENT_VERSION);
+    put(header, index);
+    segment->end = SEGMENT_HEADER_BYTES;
+    if(config_.sync != WalSync::NONE){
+        // the header and the directory entry, records are synced as they come
+        auto synced = sync_range(*segment, 0, SEGMENT_HEADER_BYTES);
+        if(std::holds_alternative<Success>(synced) && fsync(dir_fd_) != 0){
+            synced = system_error("Could not sync", config_.directory);
+        }
+        if(std::holds_alternative<Error>(synced)){
+            unlink(segment->path.c_str());
+            return std::get<Error>(synced);
+        }
+    }
+    segment->synced = SEGMENT_HEADER_BYTES;
+    return segment;
+}
+
+Result<std::monostate> WriteAheadLog::roll(){
+    auto created = create_segment(current_->index + 1);
+    if(std::holds_alternative<Error>(created)){
+        return std::get<Error>(created);
+    }
+    auto previous = current_;
+    current_ = std::get<std::shared_ptr<Segment>>(created);
+    segments_[current_->index] = current_;
+    if(previous->live == 0){
+        drop_segment(previous->index);
+    }
+    return Success{};
+}
+
+void WriteAheadLog::drop_segment(uint32_t index){
+    auto itr = segments_.find(index);
+    if(itr == segments_.end()){
+        return;
+    }
+    unlink(itr->second->path.c_str());
+    // a running group commit may still hold the mapping, it goes with the last reference
+    segments_.erase(itr);
+}
+
+StatusResult WriteAheadLog::sync_range(const Segment& segment, size_t from, size_t to){
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = from / page * page;
+    if(msync(segment.base + begin, to - begin, MS_SYNC) != 0){
+        auto error = system_error("Could not sync", segment.path);
+        std::cerr << "[ERROR] " << error.message << std::endl;
+        return error;
+    }
+    return Success{};
+}
+
+Result<WriteAheadLog::Lsn> WriteAheadLog::append(const ChatMessage& message){
+    size_t payload = payload_bytes(message);
+    size_t record = RECORD_HEADER_BYTES + payload;
+    if(record > config_.segment_bytes - SEGMENT_HEADER_BYTES || payload > UINT32_MAX){
+        return Error{ErrorCode::INVALID_DATA, "Message is too large for the write-ahead log"};
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(!current_){
+        return Error{ErrorCode::DATABASE_ERROR, "The write-ahead log is not open"};
+    }
+    if(current_->end + record > current_->size){
+        auto rolled = roll();
+        if(std::holds_alternative<Error>(rolled)){
+            return std::get<Error>(rolled);
+        }
+    }
+
+    Segment& segment = *current_;
+    char* out = segment.base + segment.end;
+    encode(out + RECORD_HEADER_BYTES, message);
+    put(put(put(out, static_cast<uint32_t>(payload)), crc32(out + RECORD_HEADER_BYTES, payload)), uint32_t{0});
+    Lsn lsn = make_lsn(segment.index, segment.end);
+    segment.end += record;
+
+    if(config_.sync == WalSync::ALWAYS){
+        auto started = std::chrono::steady_clock::now();
+        auto synced = sync_range(segment, segment.synced, segment.end);
+        syncs_.fetch_add(1, std::memory_order_relaxed);
+        sync_latency_.record(std::chrono::steady_clock::now() - started);
+        if(std::holds_alternative<Error>(synced)){
+            // taken back: the sender is told it failed, replay must not find it
+            segment.end -= record;
+            std::memset(out, 0, RECORD_HEADER_BYTES);
+            sync_failures_.fetch_add(1, std::memory_order_relaxed);
+            return std::get<Error>(synced);
+        }
+        segment.synced = segment.end;
+        durable_ = make_lsn(segment.index, segment.end);
+    }
+    ++segment.live;
+    appends_.fetch_add(1, std::memory_order_relaxed);
+    return lsn;
+}
+
+StatusResult WriteAheadLog::sync(Lsn lsn){
+    if(config_.sync != WalSync::GROUP){
+        return Success{};
+    }
+    std::unique_lock<std::mutex> lock(mtx_);
+    auto failed = [&]{
+        return std::any_of(failed_.begin(), failed_.end(),
+                           [lsn](const auto& range){ return lsn >= range.first && lsn < range.second; });
+    };
+    while(durable_ <= lsn && !failed()){
+        if(syncing_){
+            synced_cv_.wait(lock);
+            continue;
+        }
+        // this caller leads the commit; everything appended so far rides along
+        syncing_ = true;
+        Lsn from = durable_;
+        Lsn target = make_lsn(current_->index, current_->end);
+        std::vector<std::tuple<std::shared_ptr<Segment>, size_t, size_t>> dirty;
+        for(const auto& [index, segment] : segments_){
+            if(segment->synced < segment->end){
+                dirty.emplace_back(segment, segment->synced, segment->end);
+            }
+        }
+        lock.unlock();
+
+        auto started = std::chrono::steady_clock::now();
+        bool ok = true;
+        for(const auto& [segment, begin, end] : dirty){
+            ok = std::holds_alternative<Success>(sync_range(*segment, begin, end)) && ok;
+        }
+        syncs_.fetch_add(1, std::memory_order_relaxed);
+        sync_latency_.record(std::chrono::steady_clock::now() - started);
+
+        lock.lock();
+        if(ok){
+            for(const auto& [segment, begin, end] : dirty){
+                segment->synced = std::max(segment->synced, end);
+            }
+            durable_ = std::max(durable_, target);
+        } else {
+            // A failed msync may have dropped the dirty pages, so a retry
+            // that succeeds proves nothing for them: every record this
+            // commit covered fails, later ones are synced by the next leader.
+            if(!failed_.empty() && failed_.back().second >= from){
+                failed_.back().first = std::min(failed_.back().first, from);
+                failed_.back().second = std::max(failed_.back().second, target);
+            } else {
+                failed_.emplace_back(from, target);
+            }
+            sync_failures_.fetch_add(1, std::memory_order_relaxed);
+        }
+        syncing_ = false;
+        synced_cv_.notify_all();
+    }
+    if(failed()){
+        return Error{ErrorCode::DATABASE_ERROR, "The write-ahead log could not sync the message to disk"};
+    }
+    return Success{};
+}
+
+void WriteAheadLog::release(const std::vector<Lsn>& lsns){
+    std::lock_guard<std::mutex> lock(mtx_);
+    for(Lsn lsn : lsns){
+        auto itr = segments_.find(static_cast<uint32_t>(lsn >> 32));
+        if(itr == segments_.end() || itr->second->live == 0){
+            continue;
+        }
+        // Not synced: should the machine go down first, the record is only
+        // written to Cassandra once more, and the inserts are idempotent.
+        put(itr->second->base + static_cast<uint32_t>(lsn) + RELEASED_OFFSET, uint32_t{1});
+        if(--itr->second->live == 0 && itr->second != current_){
+            drop_segment(itr->first);
+        }
+    }
+    released_.fetch_add(lsns.size(), std::memory_order_relaxed);
+}
+
+WalStats WriteAheadLog::stats() const {
+    size_t segments;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        segments = segments_.size();
+    }
+    return {segments,
+            appends_.load(std::memory_order_relaxed),
+            syncs_.load(std::memory_order_relaxed),
+            sync_failures_.load(std::memory_order_relaxed),
+            released_.load(std::memory_order_relaxed),
+            sync_latency_.snapshot()};
+}
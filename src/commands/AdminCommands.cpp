@@ -0,0 +1,29 @@
+#include "AdminCommands.hpp"
+#include "Messages.hpp"
+#include "Responses.hpp"
+#include "ClientSession.hpp"
+#include "MessageDispatcher.hpp"
+
+StatsCommand::StatsCommand(const PayloadFields& payload){
+    boost::ignore_unused(payload);
+}
+
+void StatsCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext& context){
+    error_code ec;
+    auto address = net::ip::make_address(session->get_client_ip_addr(), ec);
+    if(ec || !address.is_loopback() || !context.dispatcher){
+        session->reply(failure_response("ERROR", reply_meta(session->get_next_sequence_id()), "FORBIDDEN",
+                                               "STATS is only available from localhost"));
+        return;
+    }
+
+    nlohmann::json response = {
+        {"type", message_type_to_string(MessageType::STATS)},
+        {"sequence_id", session->get_next_sequence_id()},
+        {"payload", context.dispatcher->stats_json()}
+    };
+    if(!request_id_.empty()){
+        response["request_id"] = nlohmann::json::parse(request_id_);
+    }
+    session->reply(response.dump());
+}
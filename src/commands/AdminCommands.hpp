@@ -0,0 +1,16 @@
+#ifndef ADMINCOMMANDS_H
+#define ADMINCOMMANDS_H
+
+#include "ICommand.hpp"
+
+// Replies with MessageDispatcher::stats_json(). Only served to loopback
+// connections.
+class StatsCommand : public CommandBase {
+    public:
+        explicit StatsCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
+        static constexpr CommandPriority priority() { return CommandPriority::CONTROL; }
+        std::chrono::milliseconds deadline() const { return NO_DEADLINE; }
+};
+
+#endif
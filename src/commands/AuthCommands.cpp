@@ -1,145 +1,85 @@
 #include "AuthCommands.hpp"
 #include "Messages.hpp"
+#include "Responses.hpp"
 #include "ClientSession.hpp"
 
-CreateUserCommand::CreateUserCommand(const nlohmann::json& payload){
-    username_ = payload.value("username", "");
-    password_ = payload.value("password", "");
+CreateUserCommand::CreateUserCommand(const PayloadFields& payload){
+    username_ = payload.get("username");
+    password_ = payload.get("password");
 }
 
 void CreateUserCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context) {
-    auto result = context.auth_manager->create_user(username_, password_);
+    auto result = context.auth_manager->create_user(std::string(username_), std::string(password_));
 
     if(std::holds_alternative<Error>(result)){
-        AuthFailure auth_failure;
-        auth_failure.error_code_str =  message_type_to_string(MessageType::AUTH_FAILURE);
-        auth_failure.message = std::get<Error>(result).message;
-        auth_failure.sequence_id_ = session->get_next_sequence_id();
-        auth_failure.type_ = MessageType::AUTH_FAILURE;
-        nlohmann::json response = {
-            {"type", message_type_to_string(auth_failure.type_)},
-            {"sequence_id", auth_failure.sequence_id_},
-            {"payload", {
-                {"error_code", auth_failure.error_code_str},
-                {"message", auth_failure.message}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::AUTH_FAILURE, reply_meta(session->get_next_sequence_id()),
+                                               std::get<Error>(result).message));
     }
     else {
-        AuthSuccess auth_success;
-        auth_success.sequence_id_ = session->get_next_sequence_id();
-        auth_success.token = std::get<std::pair<std::string, std::string>>(result).second;
-        auth_success.user_id = std::get<std::pair<std::string, std::string>>(result).first;
-        auth_success.user_created = true;
-        auth_success.type_  = MessageType::AUTH_SUCCESS;
-        
-        nlohmann::json response {
-            {"type", message_type_to_string(auth_success.type_)},
-            {"sequence_id", auth_success.sequence_id_},
-            {"payload", {
-                {"token", auth_success.token},
-                {"user_id", auth_success.user_id},
-                {"user_created", auth_success.user_created}
-            }}
-        };
-
-        session->send_message(response.dump());
-        session->set_authenticated_user(auth_success.user_id);
+        const auto& [user_id, token] = std::get<std::pair<std::string, std::string>>(result);
+        session->reply(auth_success_response(reply_meta(session->get_next_sequence_id()), token, user_id, true));
+        session->set_authenticated_user(user_id);
+        context.room_registry->membership().bind_user(user_id, session);
     }
 }
 
-LoginCommand::LoginCommand(const nlohmann::json& payload){
-    username_ = payload.value("username","");
-    password_ = payload.value("password","");
+LoginCommand::LoginCommand(const PayloadFields& payload){
+    username_ = payload.get("username");
+    password_ = payload.get("password");
 }
 
 void LoginCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext& context){
-    auto result = context.auth_manager->authenticate_user(username_, password_);
+    auto result = context.auth_manager->authenticate_user(std::string(username_), std::string(password_));
 
     if(std::holds_alternative<Error>(result)){
-        AuthFailure auth_failure;
-        auth_failure.error_code_str =  message_type_to_string(MessageType::AUTH_FAILURE);
-        auth_failure.message = std::get<Error>(result).message;
-        auth_failure.sequence_id_ = session->get_next_sequence_id();
-        auth_failure.type_ = MessageType::AUTH_FAILURE;
-        nlohmann::json response = {
-            {"type", message_type_to_string(auth_failure.type_)},
-            {"sequence_id", auth_failure.sequence_id_},
-            {"payload", {
-                {"error_code", auth_failure.error_code_str},
-                {"message", auth_failure.message}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::AUTH_FAILURE, reply_meta(session->get_next_sequence_id()),
+                                               std::get<Error>(result).message));
     }
     else {
-        AuthSuccess auth_success;
-        auth_success.sequence_id_ = session->get_next_sequence_id();
-        auth_success.token = std::get<std::pair<std::string, std::string>>(result).second;
-        auth_success.user_id = std::get<std::pair<std::string, std::string>>(result).first;
-        auth_success.user_created = false;
-        auth_success.type_  = MessageType::AUTH_SUCCESS;
-        
-        nlohmann::json response {
-            {"type", message_type_to_string(auth_success.type_)},
-            {"sequence_id", auth_success.sequence_id_},
-            {"payload", {
-                {"token", auth_success.token},
-                {"user_id", auth_success.user_id},
-                {"user_created", auth_success.user_created}
-            }}
-        };
-
-        session->send_message(response.dump());
-        session->set_authenticated_user(auth_success.user_id);
+        const auto& [user_id, token] = std::get<std::pair<std::string, std::string>>(result);
+        session->reply(auth_success_response(reply_meta(session->get_next_sequence_id()), token, user_id, false));
+        session->set_authenticated_user(user_id);
+        context.room_registry->membership().bind_user(user_id, session);
     }
 }
 
-GetUsernameCommand::GetUsernameCommand(const nlohmann::json& payload){
-    user_id_ = payload.value("user_id", "");
+GetUsernameCommand::GetUsernameCommand(const PayloadFields& payload){
+    user_id_ = payload.get("user_id");
 }
 
 void GetUsernameCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.auth_manager->get_username(user_id_);
+    auto result = context.auth_manager->get_username(std::string(user_id_));
 
     if(std::holds_alternative<Error>(result)){
-        nlohmann::json response {
-            {"sequence_id", session->get_next_sequence_id()},
-            {"type", message_type_to_string(MessageType::GET_USER_NAME)},
-            {"message" , std::get<Error>(result).message}
-        };
-        session->send_message(response.dump());
+        session->reply(message_response(MessageType::GET_USER_NAME, reply_meta(session->get_next_sequence_id()),
+                                               std::get<Error>(result).message));
     } else{
-        nlohmann::json response {
-            {"sequence_id", session->get_next_sequence_id()},
-            {"type", message_type_to_string(MessageType::GET_USER_NAME)},
-            {"username" , std::get<std::string>(result)}
-        };
-        session->send_message(response.dump());
+        session->reply(username_response(reply_meta(session->get_next_sequence_id()), std::get<std::string>(result)));
     }
 }
 
-LogoutCommand::LogoutCommand(const nlohmann::json& payload){
-    user_id_ = payload.value("user_id", "");
+LogoutCommand::LogoutCommand(const PayloadFields& payload){
+    user_id_ = payload.get("user_id");
 }
 
 void LogoutCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.auth_manager->logout(user_id_);
+    auto result = context.auth_manager->logout(std::string(user_id_));
     if(std::holds_alternative<Error>(result)){
-        nlohmann::json response {
-            {"sequence_id", session->get_next_sequence_id()},
-            {"type", message_type_to_string(MessageType::GET_USER_NAME)},
-            {"message" , std::get<Error>(result).message}
-        };
-        session->send_message(response.dump());
+        session->reply(message_response(MessageType::GET_USER_NAME, reply_meta(session->get_next_sequence_id()),
+                                               std::get<Error>(result).message));
     } else{
-        nlohmann::json response {
-            {"sequence_id", session->get_next_sequence_id()},
-            {"type", message_type_to_string(MessageType::GET_USER_NAME)},
-            {"message" , "Logged out successfully!!"}
-        };
-        session->send_message(response.dump());
+        session->reply(message_response(MessageType::GET_USER_NAME, reply_meta(session->get_next_sequence_id()),
+                                               "Logged out successfully!!"));
         session->leave_session(boost::beast::websocket::close_code::normal, std::string("Logging out").c_str());
     }
 }
+
+HeartbeatCommand::HeartbeatCommand(const PayloadFields& payload){
+    boost::ignore_unused(payload);
+}
+
+// The client's PONG keep-alive. Reading the frame already counted as
+// activity on the session, so there is nothing to answer.
+void HeartbeatCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
+    boost::ignore_unused(session, context);
+}
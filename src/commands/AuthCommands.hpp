@@ -4,39 +4,49 @@
 #include "ICommand.hpp"
 #include <json.hpp>
 
-class LoginCommand : public ICommand {
+class LoginCommand : public CommandBase {
     public:
-        explicit LoginCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context) override;
+        explicit LoginCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
     
     private:
-        std::string username_;
-        std::string password_;
+        std::string_view username_;
+        std::string_view password_;
 };
 
-class CreateUserCommand : public ICommand {
+class CreateUserCommand : public CommandBase {
     public:
-        explicit CreateUserCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context) override;
+        explicit CreateUserCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
     private:
-        std::string username_;
-        std::string password_;
+        std::string_view username_;
+        std::string_view password_;
 };
 
-class GetUsernameCommand : public ICommand {
+class GetUsernameCommand : public CommandBase {
     public:
-        explicit GetUsernameCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context) override;
+        explicit GetUsernameCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
     private:
-        std::string user_id_;
+        std::string_view user_id_;
 };
 
-class LogoutCommand : public ICommand {
+class LogoutCommand : public CommandBase {
     public:
-        explicit LogoutCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context) override;
+        explicit LogoutCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
+        static constexpr CommandPriority priority() { return CommandPriority::CONTROL; }
+        std::chrono::milliseconds deadline() const { return NO_DEADLINE; }
     private:
-        std::string user_id_;
+        std::string_view user_id_;
 };
 
-#endif
\ No newline at end of file
+class HeartbeatCommand : public CommandBase {
+    public:
+        explicit HeartbeatCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
+        static constexpr CommandPriority priority() { return CommandPriority::CONTROL; }
+        std::chrono::milliseconds deadline() const { return NO_DEADLINE; }
+};
+
+#endif
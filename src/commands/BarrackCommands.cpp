@@ -1,406 +1,294 @@
 #include "BarrackCommands.hpp"
 #include "Messages.hpp"
+#include "Responses.hpp"
 #include "ClientSession.hpp"
-#include "Room.hpp"
+#include <charconv>
+#include <span>
 
-std::unordered_map<std::string, std::shared_ptr<Room>> g_Members;
+static std::optional<std::string> to_optional_string(const std::optional<std::string_view>& value){
+    if(!value){
+        return std::nullopt;
+    }
+    return std::string(*value);
+}
 
-CreateBarrackCommand::CreateBarrackCommand(const nlohmann::json& payload){
-    barrack_name_ = payload.value("barrack_name", "");
-    owner_uid_ = payload.value("owner_id", "");
-    std::string private_ = payload.value("is_private", "");
-    is_private_ = private_ == "true" ? true : false;
-    password_ = payload.value("password", "");
+CreateBarrackCommand::CreateBarrackCommand(const PayloadFields& payload){
+    barrack_name_ = payload.get("barrack_name");
+    owner_uid_ = payload.get("owner_id");
+    is_private_ = payload.get("is_private") == "true";
+    password_ = payload.get("password");
 }
 
 void CreateBarrackCommand::execute(std::shared_ptr<ClientSession> session , const CommandContext& context){
-    auto result = context.barrack_manager->create_barrack(barrack_name_, owner_uid_, is_private_, password_);
+    auto result = context.barrack_manager->create_barrack(std::string(barrack_name_), std::string(owner_uid_), is_private_,
+                                                           to_optional_string(password_));
 
     if(std::holds_alternative<Error>(result)){
-        CreateBarrackFailure barrack_fail;
-        barrack_fail.error_code_str = message_type_to_string(MessageType::CREATE_BARRACK_FAILURE);
-        barrack_fail.message = std::get<Error>(result).message;
-        barrack_fail.type_ = MessageType::CREATE_BARRACK_FAILURE;
-        barrack_fail.sequence_id_ = session->get_next_sequence_id();
-
-        nlohmann::json response = {
-            {"type", message_type_to_string(barrack_fail.type_)},
-            {"sequence_id", barrack_fail.sequence_id_},
-            {"payload", {
-                {"error_code", barrack_fail.error_code_str},
-                {"message", barrack_fail.message}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::CREATE_BARRACK_FAILURE, reply_meta(session->get_next_sequence_id()),
+                                               std::get<Error>(result).message));
     }
     else {
-        CreateBarrackSuccess barrack_success;
-        barrack_success.error_code_str = message_type_to_string(MessageType::CREATE_BARRACK_SUCCESS);
-        barrack_success.message = std::string("Barrack Created Successfully");
-        barrack_success.type_ = MessageType::CREATE_BARRACK_SUCCESS;
-        barrack_success.sequence_id_ = session->get_next_sequence_id();
-        barrack_success.barrack_id = std::get<std::string>(result);
-        nlohmann::json response = {
-            {"type", message_type_to_string(barrack_success.type_)},
-            {"sequence_id", barrack_success.sequence_id_},
-            {"payload", {
-                {"error_code", barrack_success.error_code_str},
-                {"message", barrack_success.message},
-                {"barrack_id", barrack_success.barrack_id},
-                {"owner_id", owner_uid_}
-            }}
-        };
-        
-        if(g_Members.find(barrack_success.barrack_id) == g_Members.end()){
-            g_Members[barrack_success.barrack_id] = std::make_shared<Room>(barrack_success.barrack_id);
-        }
-        session->send_message(response.dump());
+        const auto& barrack_id = std::get<std::string>(result);
+        auto response = create_barrack_success_response(reply_meta(session->get_next_sequence_id()), barrack_id, owner_uid_);
+
+        context.room_registry->get_or_create(barrack_id);
+        session->reply(std::move(response));
     }
 }
 
-DestroyBarrackCommand::DestroyBarrackCommand(const nlohmann::json& payload){
-    barrack_id_ = payload.value("barrack_id", "");
-    owner_uid_ = payload.value("owner_id", "");
+DestroyBarrackCommand::DestroyBarrackCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
+    owner_uid_ = payload.get("owner_id");
 }
 
 void DestroyBarrackCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.barrack_manager->destroy_barrack(barrack_id_, owner_uid_);
+    auto result = context.barrack_manager->destroy_barrack(std::string(barrack_id_), std::string(owner_uid_));
 
     if(std::holds_alternative<Error>(result)){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::DESTROY_BARRACK_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::DESTROY_BARRACK_SUCCESS)},
-                {"message", std::get<Error>(result).message}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::DESTROY_BARRACK_SUCCESS, reply_meta(session->get_next_sequence_id()), std::get<Error>(result).message));
     }
     else {
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::DESTROY_BARRACK_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Barrack destroyed successfully"},
-            }}
-        };
-        session->send_message(response.dump());
-        auto room_itr = g_Members.find(barrack_id_);
-        if(room_itr != g_Members.end()){
-            g_Members.erase(room_itr);
-        }
-        else{
+        session->reply(status_response(MessageType::DESTROY_BARRACK_SUCCESS, reply_meta(session->get_next_sequence_id()), "Barrack destroyed successfully"));
+        if(!context.room_registry->remove(barrack_id_)){
             std::cout << "Room not found" << std::endl;
         }
     }
 }
 
-JoinBarrackCommand::JoinBarrackCommand(const nlohmann::json& payload){
-    barrack_id_ = payload.value("barrack_id", "");
-    owner_uid_ = payload.value("user_id", "");
-    password_ = payload.value("password", "");
+JoinBarrackCommand::JoinBarrackCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
+    owner_uid_ = payload.get("user_id");
+    password_ = payload.get("password");
 }
 
 void JoinBarrackCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.barrack_manager->join_barrack(barrack_id_, owner_uid_, password_);
+    auto result = context.barrack_manager->join_barrack(std::string(barrack_id_), std::string(owner_uid_), to_optional_string(password_));
 
     if(std::holds_alternative<Error>(result)){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::JOIN_BARRACK_FAILURE)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::JOIN_BARRACK_FAILURE)},
-                {"message", std::get<Error>(result).message}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::JOIN_BARRACK_FAILURE, reply_meta(session->get_next_sequence_id()), std::get<Error>(result).message));
     }
     else {
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::JOIN_BARRACK_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Barrack joined successfully"},
-            }}
-        };
-
-        auto join_itr = g_Members.find(barrack_id_);
-        if(join_itr != g_Members.end()){
-            auto room = join_itr->second;
-            room->join(session);
-        }
-        else{
-            g_Members[barrack_id_] = std::make_shared<Room>(barrack_id_);
-            g_Members[barrack_id_]->join(session);
-        }
-        session->send_message(response.dump());
+        auto response = status_response(MessageType::JOIN_BARRACK_SUCCESS, reply_meta(session->get_next_sequence_id()), "Barrack joined successfully");
+
+        context.room_registry->join(barrack_id_, session);
+        session->reply(std::move(response));
     }
 }
 
-LeaveBarrackCommand::LeaveBarrackCommand(const nlohmann::json& payload){
-    barrack_id_ = payload.value("barrack_id", "");
-    user_uid_ = payload.value("user_id", "");
+LeaveBarrackCommand::LeaveBarrackCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
+    user_uid_ = payload.get("user_id");
 }
 
 void LeaveBarrackCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.barrack_manager->leave_barrack(barrack_id_, user_uid_);
+    auto result = context.barrack_manager->leave_barrack(std::string(barrack_id_), std::string(user_uid_));
 
     if(std::holds_alternative<Error>(result)){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::LEAVE_BARRACK_FAILURE)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::LEAVE_BARRACK_FAILURE)},
-                {"message", std::get<Error>(result).message}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::LEAVE_BARRACK_FAILURE, reply_meta(session->get_next_sequence_id()), std::get<Error>(result).message));
     }
     else {
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::LEAVE_BARRACK_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Barrack left successfully"},
-            }}
-        };
-        auto leave_itr = g_Members.find(barrack_id_);
-        if(leave_itr != g_Members.end()){
-            auto room = leave_itr->second;
-            room->leave(session);
-        }
-        else{
-            std::cout << "Session ID: " << session->get_id() << " Not a member of: " << barrack_id_;
-        }
-        session->send_message(response.dump());
+        auto response = status_response(MessageType::LEAVE_BARRACK_SUCCESS, reply_meta(session->get_next_sequence_id()), "Barrack left successfully");
+        context.room_registry->leave_user(barrack_id_, user_uid_, session);
+        session->reply(std::move(response));
     }
 }
 
-MessageBarrackCommand::MessageBarrackCommand(const nlohmann::json& payload){
-    barrack_id_ = payload.value("barrack_id", "");
-    user_uid_ = payload.value("user_id", "");
-    message_ = payload.value("message", "");
+MessageBarrackCommand::MessageBarrackCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
+    user_uid_ = payload.get("user_id");
+    message_ = payload.get("message");
 }
 
 void MessageBarrackCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.barrack_manager->message_barrack(barrack_id_, user_uid_, message_);
+    auto result = context.barrack_manager->message_barrack(std::string(barrack_id_), std::string(user_uid_), std::string(message_));
 
     if(std::holds_alternative<Error>(result)){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::MESSAGE_BARRACK_FAILURE)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::MESSAGE_BARRACK_FAILURE)},
-                {"message", std::get<Error>(result).message}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::MESSAGE_BARRACK_FAILURE, reply_meta(session->get_next_sequence_id()), std::get<Error>(result).message));
     }
     else {
-        auto message_itr = g_Members.find(barrack_id_);
-        if(message_itr != g_Members.end()){
-            auto room = message_itr->second;
-            room->broadcast(message_);
+        if(auto room = context.room_registry->find(barrack_id_)){
+            room->broadcast(message_broadcast(std::get<ChatMessage>(result)));
         }
         else{
             std::cout << "Session ID: " << session->get_id() << " Not a member of: " << barrack_id_;
         }
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::MESSAGE_BARRACK_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Message sent successfully"},
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(status_response(MessageType::MESSAGE_BARRACK_SUCCESS, reply_meta(session->get_next_sequence_id()), "Message sent successfully"));
     }
 }
 
-GetBarrackMemberCommand::GetBarrackMemberCommand(const nlohmann::json& payload){
-    barrack_id_ = payload.value("barrack_id", "");
-    user_uid_ = payload.value("user_id", "");
+void MessageBarrackCommand::execute_batch(std::vector<BatchEntry>& batch, const CommandContext &context){
+    std::vector<std::pair<std::string, std::string>> messages;
+    messages.reserve(batch.size());
+    for(const auto& entry : batch){
+        auto* command = static_cast<MessageBarrackCommand*>(entry.command);
+        messages.emplace_back(std::string(command->user_uid_), std::string(command->message_));
+    }
+
+    auto results = context.barrack_manager->message_barrack_batch(std::string(barrack_id_), messages);
+
+    std::vector<std::string> accepted;
+    accepted.reserve(batch.size());
+    for(size_t i = 0; i < batch.size(); ++i){
+        if(!std::holds_alternative<Error>(results[i])){
+            accepted.push_back(message_broadcast(std::get<ChatMessage>(results[i])));
+        }
+    }
+
+    // one fanout pass over the room for the whole batch
+    if(auto room = context.room_registry->find(barrack_id_)){
+        room->broadcast_batch(accepted);
+    }
+    else if(!accepted.empty()){
+        std::cout << "Barrack " << barrack_id_ << " has no active room";
+    }
+
+    for(size_t i = 0; i < batch.size(); ++i){
+        auto& session = batch[i].session;
+        auto meta = batch[i].command->reply_meta(session->get_next_sequence_id());
+        if(std::holds_alternative<Error>(results[i])){
+            session->reply(failure_response(MessageType::MESSAGE_BARRACK_FAILURE, meta, std::get<Error>(results[i]).message));
+        }
+        else {
+            session->reply(status_response(MessageType::MESSAGE_BARRACK_SUCCESS, meta, "Message sent successfully"));
+        }
+    }
+}
+
+GetBarrackMemberCommand::GetBarrackMemberCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
+    user_uid_ = payload.get("user_id");
 }
 
 void GetBarrackMemberCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.barrack_manager->get_barrack_member(barrack_id_, user_uid_);
+    auto result = context.barrack_manager->get_barrack_member(std::string(barrack_id_), std::string(user_uid_));
 
     if(result == std::nullopt){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_MEMBER_FAILURE)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::GET_BARRACK_MEMBER_FAILURE)},
-                {"message", "Member not found"}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::GET_BARRACK_MEMBER_FAILURE, reply_meta(session->get_next_sequence_id()), "Member not found"));
     }
     else {
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_MEMBER_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Barrack member fetched successfully"},
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(status_response(MessageType::GET_BARRACK_MEMBER_SUCCESS, reply_meta(session->get_next_sequence_id()), "Barrack member fetched successfully"));
     }
 }
 
-GetBarrackMembersCommand::GetBarrackMembersCommand(const nlohmann::json& payload){
-    barrack_id_ = payload.value("barrack_id", "");
+GetBarrackMembersCommand::GetBarrackMembersCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
 }
 
 void GetBarrackMembersCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.barrack_manager->get_barrack_members(barrack_id_);
+    auto result = context.barrack_manager->get_barrack_members(std::string(barrack_id_));
 
     if(result == std::nullopt){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_MEMBER_FAILURE)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::GET_BARRACK_MEMBER_FAILURE)},
-                {"message", "Members not found"}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::GET_BARRACK_MEMBER_FAILURE, reply_meta(session->get_next_sequence_id()), "Members not found"));
     }
     else {
-        
-        std::vector<nlohmann::json> members_json;
-        for(const auto& member : *result){
-            members_json.push_back(
-              {
-                {"barrack_id", member.barrack_id},
-                {"user_id", member.user_id},
-                {"joined_at", std::chrono::system_clock::to_time_t(member.joined_at)} 
-              }  
-            );
-        }
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_MEMBER_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Barrack members fetched successfully"},
-                {"members", members_json}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(barrack_members_response(reply_meta(session->get_next_sequence_id()), *result));
     }
 }
 
 
-GetBarrackMessagesCommand::GetBarrackMessagesCommand(const nlohmann::json& payload){
-    barrack_id_ = payload.value("barrack_id", "");
+GetBarrackMessagesCommand::GetBarrackMessagesCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
 }
 
 void GetBarrackMessagesCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.barrack_manager->get_barrack_messages(barrack_id_);
+    auto result = context.barrack_manager->get_barrack_messages(std::string(barrack_id_));
 
     if(result == std::nullopt){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_MESSAGES_FAILURE)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::GET_BARRACK_MESSAGES_FAILURE)},
-                {"message", "Messages not found"}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::GET_BARRACK_MESSAGES_FAILURE, reply_meta(session->get_next_sequence_id()), "Messages not found"));
     }
     else {
-        std::vector<nlohmann::json> messages_json;
-        for(const auto& message : *result){
-            messages_json.push_back(
-              {
-                {"barrack_id", message.barrack_id},
-                {"user_id", message.sender_user_id},
-                {"message", message.content},
-                {"created_at", std::chrono::system_clock::to_time_t(message.sent_at)} 
-              }  
-            );
-        }
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_MESSAGES_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Barrack messages fetched successfully"},
-                {"messages", messages_json}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(barrack_messages_response(reply_meta(session->get_next_sequence_id()), *result));
     }
 }
 
-GetBarrackCommand::GetBarrackCommand(const nlohmann::json& payload){
-    barrack_id_ = payload.value("barrack_id", "");
+GetBarrackCommand::GetBarrackCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
 }
 
 void GetBarrackCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
-    auto result = context.barrack_manager->get_barrack(barrack_id_);
+    auto result = context.barrack_manager->get_barrack(std::string(barrack_id_));
 
     if(result == std::nullopt){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_FAILURE)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::GET_BARRACK_FAILURE)},
-                {"message", "Barrack not found"}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::GET_BARRACK_FAILURE, reply_meta(session->get_next_sequence_id()), "Barrack not found"));
     }
     else {
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Barrack fetched successfully"},
-                {"barrack_id", result->barrack_id},
-                {"name", result->barrack_name},
-                {"admin_id", result->admin_id},
-                {"created_at", std::chrono::system_clock::to_time_t(result->created_at)},
-                {"is_private", result->is_private},
-            }}
-        };        
-        session->send_message(response.dump());
+        session->reply(barrack_response(reply_meta(session->get_next_sequence_id()), *result));
     }
 }
 
+GetBarracks::GetBarracks(const PayloadFields& payload){
+    boost::ignore_unused(payload);
+}
+
 void GetBarracks::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
     auto result = context.barrack_manager->get_all_barracks();
     if(result == std::nullopt){
-        nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_FAILURE)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"error_code", message_type_to_string(MessageType::GET_BARRACK_FAILURE)},
-                {"message", "No Barracks"}
-            }}
-        };
-        session->send_message(response.dump());
+        session->reply(failure_response(MessageType::GET_BARRACK_FAILURE, reply_meta(session->get_next_sequence_id()), "No Barracks"));
     } else {
-        std::vector<nlohmann::json> barracks;
-        for(const auto& barrack : *result){
-            barracks.push_back(
-                {
-                    {"barrack_id", barrack.barrack_id},
-                    {"barrack_name", barrack.barrack_name},
-                    {"owner_id", barrack.admin_id},
-                    {"is_private", barrack.is_private},
-                    {"created_at", std::chrono::system_clock::to_time_t(barrack.created_at)}
-                }
-            );
+        session->reply(barracks_response(reply_meta(session->get_next_sequence_id()), *result));
+    }
+}
+SyncCommand::SyncCommand(const PayloadFields& payload){
+    barrack_id_ = payload.get("barrack_id");
+    after_seq_ = payload.get("after_seq");
+    cursors_ = payload.get("cursors");
+}
+
+// Streams the messages after each cursor in pages of SYNC_PAGE_SIZE. A
+// barrack that is further behind than SYNC_MAX_MESSAGES gets more:true on
+// its last page and the client syncs again from the returned last_seq.
+void SyncCommand::execute(std::shared_ptr<ClientSession> session, const CommandContext &context){
+    std::vector<std::pair<std::string, uint64_t>> cursors;
+    if(!cursors_.empty()){
+        auto parsed = nlohmann::json::parse(cursors_, nullptr, false);
+        if(!parsed.is_object()){
+            session->reply(failure_response(MessageType::SYNC, reply_meta(session->get_next_sequence_id()), "cursors must be an object of barrack_id -> last seen seq"));
+            return;
+        }
+        for(const auto& [barrack_id, seq] : parsed.items()){
+            if(!seq.is_number_unsigned()){
+                session->reply(failure_response(MessageType::SYNC, reply_meta(session->get_next_sequence_id()), "cursors must be an object of barrack_id -> last seen seq"));
+                return;
+            }
+            cursors.emplace_back(barrack_id, seq.get<uint64_t>());
         }
-         nlohmann::json response = {
-            {"type", message_type_to_string(MessageType::GET_BARRACK_SUCCESS)},
-            {"sequence_id", session->get_next_sequence_id()},
-            {"payload", {
-                {"message", "Barracks fetched successfully"},
-                {"messages", barracks}
-            }}
-        };
-        session->send_message(response.dump());
     }
-}
\ No newline at end of file
+    else if(!barrack_id_.empty()){
+        uint64_t after_seq = 0;
+        if(!after_seq_.empty()){
+            auto [ptr, ec] = std::from_chars(after_seq_.data(), after_seq_.data() + after_seq_.size(), after_seq);
+            if(ec != std::errc() || ptr != after_seq_.data() + after_seq_.size()){
+                session->reply(failure_response(MessageType::SYNC, reply_meta(session->get_next_sequence_id()), "after_seq must be a non-negative integer"));
+                return;
+            }
+        }
+        cursors.emplace_back(std::string(barrack_id_), after_seq);
+    }
+    else {
+        session->reply(failure_response(MessageType::SYNC, reply_meta(session->get_next_sequence_id()), "SYNC needs cursors or a barrack_id"));
+        return;
+    }
+
+    for(const auto& [barrack_id, after_seq] : cursors){
+        uint64_t cursor = after_seq;
+        size_t sent = 0;
+        while(true){
+            auto result = context.barrack_manager->get_messages_since(barrack_id, cursor, SYNC_PAGE_SIZE + 1);
+            if(std::holds_alternative<Error>(result)){
+                session->reply(failure_response(MessageType::SYNC, reply_meta(session->get_next_sequence_id()), std::get<Error>(result).message));
+                break;
+            }
+            const auto& messages = std::get<std::vector<ChatMessage>>(result);
+            std::span<const ChatMessage> page(messages.data(), std::min(messages.size(), SYNC_PAGE_SIZE));
+            if(!page.empty()){
+                cursor = page.back().seq;
+            }
+            sent += page.size();
+            bool more = messages.size() > SYNC_PAGE_SIZE;
+            session->reply(sync_response(reply_meta(session->get_next_sequence_id()), barrack_id, cursor, page, more));
+            if(!more || sent >= SYNC_MAX_MESSAGES){
+                break;
+            }
+        }
+    }
+}
@@ -4,101 +4,132 @@
 #include <json.hpp>
 #include "ICommand.hpp"
 
-class CreateBarrackCommand : public ICommand {
+class CreateBarrackCommand : public CommandBase {
     public:
-        explicit CreateBarrackCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit CreateBarrackCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
 
     private:
-        std::string barrack_name_;
-        std::string owner_uid_;
+        std::string_view barrack_name_;
+        std::string_view owner_uid_;
         bool is_private_;
-        std::optional<std::string> password_;
+        std::optional<std::string_view> password_;
 };
 
-class DestroyBarrackCommand : public ICommand {
+class DestroyBarrackCommand : public CommandBase {
     public:
-        explicit DestroyBarrackCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit DestroyBarrackCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
+        static constexpr CommandPriority priority() { return CommandPriority::CONTROL; }
+        std::chrono::milliseconds deadline() const { return NO_DEADLINE; }
 
     private:
-        std::string barrack_id_;
-        std::string owner_uid_;
+        std::string_view barrack_id_;
+        std::string_view owner_uid_;
 };
 
-class JoinBarrackCommand : public ICommand {
+class JoinBarrackCommand : public CommandBase {
     public:
-        explicit JoinBarrackCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit JoinBarrackCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
 
     private:
-        std::string barrack_id_;
-        std::string owner_uid_;
-        std::optional<std::string> password_;
+        std::string_view barrack_id_;
+        std::string_view owner_uid_;
+        std::optional<std::string_view> password_;
 };
 
-class LeaveBarrackCommand : public ICommand {
+class LeaveBarrackCommand : public CommandBase {
     public:
-        explicit LeaveBarrackCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit LeaveBarrackCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
+        static constexpr CommandPriority priority() { return CommandPriority::CONTROL; }
+        std::chrono::milliseconds deadline() const { return NO_DEADLINE; }
 
     private:
-        std::string barrack_id_;
-        std::string user_uid_;
+        std::string_view barrack_id_;
+        std::string_view user_uid_;
 };
 
-class MessageBarrackCommand : public ICommand {
+class MessageBarrackCommand : public CommandBase {
     public:
-        explicit MessageBarrackCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit MessageBarrackCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
+        std::string_view batch_key() const { return barrack_id_; }
+        void execute_batch(std::vector<BatchEntry>& batch, const CommandContext& context);
 
     private:
-        std::string barrack_id_;
-        std::string user_uid_;
-        std::string message_;
+        std::string_view barrack_id_;
+        std::string_view user_uid_;
+        std::string_view message_;
 };
 
-class GetBarrackMemberCommand : public ICommand {
+class GetBarrackMemberCommand : public CommandBase {
     public:
-        explicit GetBarrackMemberCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit GetBarrackMemberCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
 
     private:
-        std::string barrack_id_;
-        std::string user_uid_;
+        std::string_view barrack_id_;
+        std::string_view user_uid_;
 };
 
-class GetBarrackMembersCommand : public ICommand {
+class GetBarrackMembersCommand : public CommandBase {
     public:
-        explicit GetBarrackMembersCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit GetBarrackMembersCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
+        static constexpr CommandPriority priority() { return CommandPriority::BULK; }
+        std::chrono::milliseconds deadline() const { return BULK_DEADLINE; }
 
     private:
-        std::string barrack_id_;
+        std::string_view barrack_id_;
 };
 
 
-class GetBarrackMessagesCommand : public ICommand {
+class GetBarrackMessagesCommand : public CommandBase {
     public:
-        explicit GetBarrackMessagesCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit GetBarrackMessagesCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
+        static constexpr CommandPriority priority() { return CommandPriority::BULK; }
+        std::chrono::milliseconds deadline() const { return BULK_DEADLINE; }
 
     private:
-        std::string barrack_id_;
+        std::string_view barrack_id_;
 };
 
-class GetBarrackCommand : public ICommand {
+class GetBarrackCommand : public CommandBase {
     public:
-        explicit GetBarrackCommand(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex) override;
+        explicit GetBarrackCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& contex);
 
     private:
-        std::string barrack_id_;
+        std::string_view barrack_id_;
 };
 
-class GetBarracks : public ICommand {
+class GetBarracks : public CommandBase {
     public:
-        explicit GetBarracks(const nlohmann::json& payload);
-        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context) override;
+        explicit GetBarracks(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
+        static constexpr CommandPriority priority() { return CommandPriority::BULK; }
+        std::chrono::milliseconds deadline() const { return BULK_DEADLINE; }
+};
+
+// Incremental resync: {"cursors": {"<barrack_id>": <last seen seq>, ...}} or
+// {"barrack_id": ..., "after_seq": N}. Replies with SYNC pages holding only
+// the messages the client has not seen.
+class SyncCommand : public CommandBase {
+    public:
+        explicit SyncCommand(const PayloadFields& payload);
+        void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
+        static constexpr CommandPriority priority() { return CommandPriority::BULK; }
+        std::chrono::milliseconds deadline() const { return BULK_DEADLINE; }
+
+        static constexpr size_t SYNC_PAGE_SIZE = 100;
+        static constexpr size_t SYNC_MAX_MESSAGES = 1000;    // per barrack and command
+
+    private:
+        std::string_view barrack_id_;
+        std::string_view after_seq_;
+        std::string_view cursors_;      // JSON object text
 };
 #endif
@@ -1,17 +1,104 @@
+#ifndef COMMANDFACTORY_H
+#define COMMANDFACTORY_H
+
+#include <array>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <variant>
+
 #include "ICommand.hpp"
 #include "AuthCommands.hpp"
 #include "BarrackCommands.hpp"
+#include "AdminCommands.hpp"
+#include "PerfectHash.hpp"
+
+// Wire names of the routable commands. COMMAND_TYPES must list the command
+// classes in the same order.
+inline constexpr std::array<std::string_view, 16> COMMAND_NAMES = {
+    "LOGIN",
+    "CREATEUSER",
+    "GETUSER",
+    "JOINBARRACK",
+    "CREATEBARRACK",
+    "DESTROYBARRACK",
+    "LEAVEBARRACK",
+    "MESSAGEBARRACK",
+    "GETBARRACKMEMBER",
+    "GETBARRACKMEMBERS",
+    "GETBARRACKMESSAGES",
+    "GETBARRACK",
+    "GETBARRACKS",
+    "PONG",
+    "STATS",
+    "SYNC"
+};
+
+using COMMAND_TYPES = std::tuple<
+    LoginCommand,
+    CreateUserCommand,
+    GetUsernameCommand,
+    JoinBarrackCommand,
+    CreateBarrackCommand,
+    DestroyBarrackCommand,
+    LeaveBarrackCommand,
+    MessageBarrackCommand,
+    GetBarrackMemberCommand,
+    GetBarrackMembersCommand,
+    GetBarrackMessagesCommand,
+    GetBarrackCommand,
+    GetBarracks,
+    HeartbeatCommand,
+    StatsCommand,
+    SyncCommand
+>;
+
+static_assert(std::tuple_size_v<COMMAND_TYPES> == COMMAND_NAMES.size(),
+              "COMMAND_NAMES and COMMAND_TYPES must have the same length");
 
+inline constexpr PerfectHashMap<COMMAND_NAMES.size()> COMMAND_INDEX{COMMAND_NAMES};
+
+template<typename Tuple>
+struct command_variant;
+
+template<typename... Commands>
+struct command_variant<std::tuple<Commands...>> {
+    using type = std::variant<std::monostate, Commands...>;
+};
+
+// Any routable command, held by value. monostate marks an empty task slot.
+using AnyCommand = command_variant<COMMAND_TYPES>::type;
 
 class CommandFactory {
     public:
-        CommandFactory();
+        // Resolves type to its static command class and calls
+        // visitor.template operator()<Command>(). Returns false for unknown types.
+        template<typename Visitor>
+        static bool route(std::string_view type, Visitor&& visitor){
+            int index = COMMAND_INDEX.find(type);
+            if(index < 0){
+                return false;
+            }
+            return route_index(static_cast<size_t>(index), std::forward<Visitor>(visitor),
+                               std::make_index_sequence<COMMAND_NAMES.size()>{});
+        }
+
+        // The lane commands of type run in, read without building one.
+        // Returns false for unknown types.
+        static bool priority_of(std::string_view type, CommandPriority& out){
+            return route(type, [&]<typename Command>(){
+                out = Command::priority();
+            });
+        }
 
-        std::unique_ptr<ICommand> create_command(const std::string& type, const nlohmann::json& payload);
+        // Constructs the command for type in place. Returns false for unknown types.
+        bool create_command(std::string_view type, const PayloadFields& payload, AnyCommand& out);
 
     private:
-        void register_command(const std::string& type,
-                                std::function<std::unique_ptr<ICommand>(const nlohmann::json&)> factory);
+        template<typename Visitor, size_t... I>
+        static bool route_index(size_t index, Visitor&& visitor, std::index_sequence<I...>){
+            return ((index == I && (visitor.template operator()<std::tuple_element_t<I, COMMAND_TYPES>>(), true)) || ...);
+        }
+};
 
-        std::unordered_map<std::string, std::function<std::unique_ptr<ICommand>(const nlohmann::json&)>> command_map;
-};
\ No newline at end of file
+#endif
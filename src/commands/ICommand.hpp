@@ -2,20 +2,73 @@
 #define ICOMMAND_H
 
 // #include <memory>
+#include <chrono>
+#include <string_view>
+#include <vector>
 #include "AuthManager.hpp"
 #include "BarrackManager.hpp"
+#include "CommandArena.hpp"
+#include "Responses.hpp"
+#include "RoomRegistry.hpp"
 
 class ClientSession;
+class CommandBase;
+class MessageDispatcher;
 
 struct CommandContext {
     std::shared_ptr<AuthManager> auth_manager;
     std::shared_ptr<BarrackManager> barrack_manager;
+    std::shared_ptr<RoomRegistry> room_registry;
+    const MessageDispatcher* dispatcher = nullptr;  // set by the dispatcher itself
 };
 
-class ICommand {
+// Dispatcher lanes, highest priority first.
+enum class CommandPriority {
+    CONTROL = 0,        // admin and session control: logout, leave, heartbeats
+    INTERACTIVE,        // chat sends, joins, logins
+    BULK,               // history fetches and listings
+    COUNT
+};
+
+struct BatchEntry {
+    CommandBase* command;
+    std::shared_ptr<ClientSession> session;
+};
+
+// Commands are held by value in the dispatcher's task slots (see AnyCommand in
+// CommandFactory.hpp) and called through std::visit, so nothing here is
+// virtual. Every command provides
+//     Command(const PayloadFields& payload);
+//     void execute(std::shared_ptr<ClientSession> session, const CommandContext& context);
+// and may shadow priority(), deadline() or batch_key(). priority() is static
+// constexpr: the dispatcher looks it up by type to shed frames before parsing
+// them (see CommandFactory::priority_of). Commands with a non-empty batch key
+// can also provide
+//     void execute_batch(std::vector<BatchEntry>& batch, const CommandContext& context);
+// which receives every queued command of the same type and key; without it
+// they are executed one by one.
+// String members are views into the task arena and are only valid until the
+// command has finished executing.
+//
+// A client may tag a frame with a "request_id"; the dispatcher hands it to the
+// command and reply_meta() carries it into the response so pipelined clients
+// can match replies that complete out of order.
+class CommandBase {
     public:
-        virtual ~ICommand() = default;
-        virtual void execute(std::shared_ptr<ClientSession> session, const CommandContext& context) = 0; 
+        void set_request_id(std::string_view request_id) { request_id_ = request_id; }
+        ResponseMeta reply_meta(uint64_t sequence_id) const { return {sequence_id, request_id_}; }
+
+        static constexpr CommandPriority priority() { return CommandPriority::INTERACTIVE; }
+        // How long the command may wait in the dispatcher queue before it is
+        // answered with TIMEOUT instead of being executed. NO_DEADLINE never expires.
+        std::chrono::milliseconds deadline() const { return DEFAULT_DEADLINE; }
+        std::string_view batch_key() const { return {}; }
+
+        static constexpr std::chrono::milliseconds DEFAULT_DEADLINE{5000};
+        static constexpr std::chrono::milliseconds BULK_DEADLINE{2000};
+        static constexpr std::chrono::milliseconds NO_DEADLINE = std::chrono::milliseconds::max();
+    protected:
+        std::string_view request_id_;   // raw JSON token, view into the task arena
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,8 +1,12 @@
 #include <cstdlib>
+#include <future>
 #include <thread>
 #include <iostream>
+#include <string_view>
 
 #include <Listener.hpp>
+#include <IoThreadPool.hpp>
+#include <Room.hpp>
 #include <MessageDispatcher.hpp>
 #include <AuthManager.hpp>
 #include <BarrackManager.hpp>
@@ -14,21 +18,54 @@
 #include <OutboxRelay.hpp>
 #include <Error.hpp>
 #include <variant>
+#include <csignal>
+#include <boost/asio/signal_set.hpp>
 
-int main(){
+// SIGUSR1 dumps the dispatcher statistics and latency histograms to stdout.
+static void dump_stats_on_signal(net::signal_set& signals, std::shared_ptr<MessageDispatcher> dispatcher){
+    signals.async_wait([&signals, dispatcher](error_code ec, int){
+        if(ec){
+            return;
+        }
+        std::cout << "[STATS] " << dispatcher->stats_json().dump() << std::endl;
+        dump_stats_on_signal(signals, dispatcher);
+    });
+}
+
+int main(int argc, char** argv){
     auto const address = net::ip::make_address("0.0.0.0");
     auto const port = static_cast<unsigned short>(std::atoi("8080"));
 
     int thread_num = 4;
-    std::cout << "[INFO] Starting char server on " << address << ":" << port << " with " << thread_num << " threads." << std::endl;
+    // commands a single client may have in flight before its reads pause
+    size_t max_in_flight = 32;
+    // Room placement (--room-placement): give every io thread its own
+    // io_context and create sessions connecting with ?barrack=<id> on the
+    // thread owning that barrack
+    bool room_placement = false;
+    for(int i = 1; i < argc; ++i){
+        std::string_view option(argv[i]);
+        if(option == "--room-placement"){
+            room_placement = true;
+        }
+        else{
+            std::cerr << "[FATAL] Unknown option " << option << ". Usage: " << argv[0] << " [--room-placement]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    // broadcast thresholds for large rooms, see FanoutConfig for the defaults
+    FanoutConfig fanout_config;
+    Room::configure_fanout(fanout_config);
+    // per barrack message ring and the memory all rings may use together
+    HistoryConfig history_config;
+    // Cassandra write batching: batch size, linger and batches in flight
+    WriterConfig writer_config;
+    // local log of messages Cassandra has not stored yet, replayed at startup
+    WalConfig wal_config;
+    std::cout << "[INFO] Starting char server on " << address << ":" << port << " with " << thread_num << " threads"
+              << (room_placement ? ", room placement on." : ".") << std::endl;
     net::io_context ioc{thread_num};
 
-    auto cass_db = std::make_shared<CassandraMessageRepo>(std::make_shared<CassandraConnection>());
-    auto res = cass_db->init_database();
-    if(std::holds_alternative<Error>(res)){
-        std::cerr << "[FATAL] Could not initialize Cassandra Database." << std::get<Error>(res).what_happened() << " Shutting down." << std::endl;
-        return EXIT_FAILURE;
-    }
     auto database = std::make_shared<DatabaseConnection>("chat-server.db3");
     if(!database->is_valid()){
         std::cerr << "[FATAL] Could not initialize Database Manager. Shutting down." << std::endl;
@@ -44,23 +81,62 @@ int main(){
     auto barrack_repo = std::make_shared<BarrackRepository>(database->get_connection());
     auto event_repo = std::make_shared<EventRepository>(database->get_connection());
 
+    auto cass_db = std::make_shared<CassandraMessageRepo>(std::make_shared<CassandraConnection>());
+    auto auth_manager = std::make_shared<AuthManager>(user_repo);
+    auto barrack_manager = std::make_shared<BarrackManager>(barrack_repo, cass_db, history_config, writer_config,
+                                                            std::make_shared<WriteAheadLog>(wal_config));
+
+    // barracks and memberships load from SQLite while Cassandra connects;
+    // the listener only starts once both are done
+    auto warm_start = std::async(std::launch::async, [barrack_manager]{ return barrack_manager->warm_start(); });
+    auto res = cass_db->init_database();
+    auto loaded = warm_start.get();
+    if(std::holds_alternative<Error>(res)){
+        std::cerr << "[FATAL] Could not initialize Cassandra Database." << std::get<Error>(res).what_happened() << " Shutting down." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(std::holds_alternative<Error>(loaded)){
+        std::cerr << "[FATAL] Could not load barracks. " << std::get<Error>(loaded).what_happened() << " Shutting down." << std::endl;
+        return EXIT_FAILURE;
+    }
+    const auto& warm = std::get<WarmStartStats>(loaded);
+    std::cout << "[INFO] Loaded " << warm.barracks << " barracks and " << warm.memberships
+              << " memberships in " << warm.elapsed.count() << " ms" << std::endl;
+
+    // needs the loaded barracks to tell which logged messages are still wanted
+    auto replayed = barrack_manager->replay_wal();
+    if(std::holds_alternative<Error>(replayed)){
+        std::cerr << "[FATAL] Could not replay the write-ahead log. " << std::get<Error>(replayed).what_happened() << " Shutting down." << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "[INFO] Replayed " << std::get<size_t>(replayed) << " messages from the write-ahead log" << std::endl;
+
     auto outbox_relay = std::make_shared<OutboxRelay>(cass_db, event_repo);
     outbox_relay->start();
 
-    auto auth_manager = std::make_shared<AuthManager>(user_repo);
-    auto barrack_manager = std::make_shared<BarrackManager>(barrack_repo, cass_db);
     CommandContext command_context {
         .auth_manager = auth_manager,
-        .barrack_manager = barrack_manager
+        .barrack_manager = barrack_manager,
+        .room_registry = std::make_shared<RoomRegistry>()
     };
     auto message_dispatcher = std::make_shared<MessageDispatcher>(thread_num, command_context);
-    auto conn_manager = std::make_shared<ConnectionManager>(message_dispatcher);
+    auto conn_manager = std::make_shared<ConnectionManager>(message_dispatcher, command_context.room_registry, max_in_flight);
+
+    net::signal_set stats_signal(ioc, SIGUSR1);
+    dump_stats_on_signal(stats_signal, message_dispatcher);
+
+    std::shared_ptr<IoThreadPool> io_pool;
+    if(room_placement){
+        // the main thread keeps ioc for accepting and signals
+        io_pool = std::make_shared<IoThreadPool>(thread_num - 1);
+        io_pool->run();
+    }
 
     std::cout <<"[INFO] Initializing Listener" << std::endl;
-    std::make_shared<Listener>(ioc, tcp::endpoint{address, port}, conn_manager)->run();
+    std::make_shared<Listener>(ioc, tcp::endpoint{address, port}, conn_manager, io_pool)->run();
 
     std::vector<std::thread> v;
-    for(auto i = thread_num - 1; i > 0; --i){
+    for(auto i = io_pool ? 0 : thread_num - 1; i > 0; --i){
         v.emplace_back(
             [&ioc](){
                 std::cout << "[INFO] Worker thread started" << std::endl;